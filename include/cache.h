@@ -0,0 +1,278 @@
+/**
+ * \file cache.h
+ * \brief Incremental runs of the batch tools.
+ *
+ * A cache file records, for each input processed, its size, its modification
+ * time, the parameters of the tool, the output written and an optional
+ * result line. A later run processes only the inputs which are new, have
+ * changed, have been processed with other parameters or whose output is
+ * missing; the results of the other inputs are taken from the cache.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+
+#if __has_include (<sys/stat.h>)
+#include <sys/stat.h>
+#define HAS_STAT /**< POSIX stat availability */
+#endif
+
+#define CACHE_FILE ".incremental" /**< Cache file kept in an output directory */
+#define CACHE_HEADER "# spec_tools cache 1" /**< First line of a cache file */
+
+/**
+ * \class _cache
+ * \brief Cache of the inputs already processed. is_fresh() and update() may be called from several threads.
+ */
+class _cache {
+public:
+    /**
+     * \fn explicit _cache(const std::string &sFilename, const std::string &sParam)
+     * \brief sFilename is the cache file, sParam the parameters of the tool which change the outputs.
+     */
+    explicit _cache(const std::string &sFilename, const std::string &sParam);
+
+    _cache(const _cache&)=delete;
+    _cache& operator=(const _cache&)=delete;
+
+    /**
+     * \fn bool load()
+     * \brief Read the cache file. A missing file is an empty cache.
+     * \return false if the file exists and is not a cache
+     */
+    bool load();
+
+    /**
+     * \fn bool save()
+     * \brief Write the entries looked up or updated since load(): the inputs which disappeared are dropped. The file is replaced atomically.
+     */
+    bool save();
+
+    /**
+     * \fn bool is_fresh(const std::string &sIn, const std::string &sOut, std::string *psResult=nullptr)
+     * \brief true if sIn has not changed since it was processed with the same parameters into sOut, and sOut still exists. The cached result is copied into psResult.
+     */
+    bool is_fresh(const std::string &sIn, const std::string &sOut, std::string *psResult=nullptr);
+
+    /**
+     * \fn void update(const std::string &sIn, const std::string &sOut, const std::string &sResult="")
+     * \brief Record that sIn has been processed into sOut, sResult being its result line.
+     */
+    void update(const std::string &sIn, const std::string &sOut, const std::string &sResult="");
+
+    /**
+     * \fn size_t get_fresh() const
+     * \return Number of inputs found fresh since load()
+     */
+    size_t get_fresh() const;
+
+    const std::string& get_filename() const { return sFilename; }
+
+private:
+    struct _entry {
+        uint64_t u64Size;
+        int64_t i64Mtime; /**< Modification time in ns */
+        std::string sParam;
+        std::string sOut;
+        std::string sResult;
+        bool bSeen;
+    };
+
+    std::string sFilename;
+    std::string sParam;
+    std::unordered_map<std::string, _entry> umEntry;
+    size_t stFresh;
+    mutable std::mutex mMutex;
+
+    /**
+     * \fn static bool stamp(const std::string &sFile, uint64_t &u64Size, int64_t &i64Mtime)
+     * \brief Size and modification time of sFile.
+     */
+    static bool stamp(const std::string &sFile, uint64_t &u64Size, int64_t &i64Mtime);
+
+    static std::string escape(const std::string &sStr);
+    static std::string unescape(const std::string &sStr);
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _cache::_cache(const std::string &sFilename, const std::string &sParam):
+    sFilename(sFilename), sParam(sParam), stFresh(0) { }
+
+inline bool _cache::load() {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    umEntry.clear();
+    stFresh=0;
+
+    std::ifstream ifFile(sFilename);
+    if (!ifFile.is_open())
+        return true;
+
+    std::string sLine;
+    if (!std::getline(ifFile, sLine) || sLine!=CACHE_HEADER)
+        return false;
+
+    // path, size, mtime, parameters, output and result, tab separated
+    while (std::getline(ifFile, sLine)) {
+        std::vector<std::string> vsField;
+        size_t stBegin=0;
+        for(int i=0; i<5; i++) {
+            size_t stEnd=sLine.find('\t', stBegin);
+            if (stEnd==std::string::npos) break;
+            vsField.emplace_back(sLine.substr(stBegin, stEnd-stBegin));
+            stBegin=stEnd+1;
+        }
+        if (vsField.size()<5)
+            continue;
+
+        _entry eEntry;
+        try {
+            eEntry.u64Size=std::stoull(vsField[1]);
+            eEntry.i64Mtime=std::stoll(vsField[2]);
+        }
+        catch (...) {
+            continue;
+        }
+        eEntry.sParam=unescape(vsField[3]);
+        eEntry.sOut=unescape(vsField[4]);
+        eEntry.sResult=unescape(sLine.substr(stBegin));
+        eEntry.bSeen=false;
+
+        umEntry[unescape(vsField[0])]=std::move(eEntry);
+    }
+    return true;
+}
+
+inline bool _cache::save() {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+
+    const std::string sPart=sFilename+".part";
+    {
+        std::ofstream ofFile(sPart, std::ios::trunc);
+        if (!ofFile.is_open())
+            return false;
+
+        ofFile << CACHE_HEADER << "\n";
+        for(auto &pEntry: umEntry)
+            if (pEntry.second.bSeen)
+                ofFile << escape(pEntry.first) << "\t"
+                       << pEntry.second.u64Size << "\t"
+                       << pEntry.second.i64Mtime << "\t"
+                       << escape(pEntry.second.sParam) << "\t"
+                       << escape(pEntry.second.sOut) << "\t"
+                       << escape(pEntry.second.sResult) << "\n";
+
+        if (!ofFile.flush()) {
+            ofFile.close();
+            std::remove(sPart.c_str());
+            return false;
+        }
+    }
+    return std::rename(sPart.c_str(), sFilename.c_str())==0;
+}
+
+inline bool _cache::is_fresh(const std::string &sIn, const std::string &sOut, std::string *psResult) {
+    uint64_t u64Size;
+    int64_t i64Mtime;
+    if (!stamp(sIn, u64Size, i64Mtime))
+        return false;
+
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    auto itEntry=umEntry.find(sIn);
+    if (itEntry==umEntry.end())
+        return false;
+
+    _entry &eEntry=itEntry->second;
+    if (eEntry.u64Size!=u64Size || eEntry.i64Mtime!=i64Mtime || eEntry.sParam!=sParam || eEntry.sOut!=sOut)
+        return false;
+
+    uint64_t u64Out;
+    int64_t i64Out;
+    if (!sOut.empty() && !stamp(sOut, u64Out, i64Out))
+        return false;
+
+    if (psResult)
+        *psResult=eEntry.sResult;
+    eEntry.bSeen=true;
+    stFresh++;
+    return true;
+}
+
+inline void _cache::update(const std::string &sIn, const std::string &sOut, const std::string &sResult) {
+    _entry eEntry;
+    if (!stamp(sIn, eEntry.u64Size, eEntry.i64Mtime))
+        return;
+    eEntry.sParam=sParam;
+    eEntry.sOut=sOut;
+    eEntry.sResult=sResult;
+    eEntry.bSeen=true;
+
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    umEntry[sIn]=std::move(eEntry);
+}
+
+inline size_t _cache::get_fresh() const {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    return stFresh;
+}
+
+inline bool _cache::stamp(const std::string &sFile, uint64_t &u64Size, int64_t &i64Mtime) {
+#ifdef HAS_STAT
+    struct stat stFile;
+    if (::stat(sFile.c_str(), &stFile)!=0 || !S_ISREG(stFile.st_mode))
+        return false;
+    u64Size=stFile.st_size;
+    i64Mtime=static_cast<int64_t>(stFile.st_mtim.tv_sec)*1000000000+stFile.st_mtim.tv_nsec;
+    return true;
+#else
+    // without stat the size alone is compared
+    std::ifstream ifFile(sFile, std::ios::binary | std::ios::ate);
+    if (!ifFile.is_open())
+        return false;
+    u64Size=ifFile.tellg();
+    i64Mtime=0;
+    return true;
+#endif
+}
+
+inline std::string _cache::escape(const std::string &sStr) {
+    std::string sRes;
+    sRes.reserve(sStr.size());
+    for(char c: sStr) {
+        if (c=='\\') sRes+="\\\\";
+        else if (c=='\t') sRes+="\\t";
+        else if (c=='\n') sRes+="\\n";
+        else sRes+=c;
+    }
+    return sRes;
+}
+
+inline std::string _cache::unescape(const std::string &sStr) {
+    std::string sRes;
+    sRes.reserve(sStr.size());
+    for(size_t i=0; i<sStr.size(); i++) {
+        if (sStr[i]=='\\' && i+1<sStr.size()) {
+            char c=sStr[++i];
+            sRes+= c=='t' ? '\t' : c=='n' ? '\n' : c;
+        }
+        else
+            sRes+=sStr[i];
+    }
+    return sRes;
+}
+
+#endif // _CACHE_H
@@ -0,0 +1,427 @@
+/**
+ * \file claim.h
+ * \brief Share the files of a batch run between processes, on one or several hosts.
+ *
+ * The files are split in shards by a hash of their path relative to the
+ * input root, so that every process computes the same shards. A process
+ * claims a shard by creating its lock file with O_EXCL in a work directory
+ * shared by all the processes, processes its files, then marks it done. A
+ * lock is a lease: its owner touches it every lease/4 seconds, and a lock
+ * not touched for a whole lease belongs to a dead process and may be taken
+ * over: a process which was only stalled finds the name of another owner in
+ * the lock, and neither touches, removes nor marks done what it no longer
+ * holds. The results of the shards are merged by the first process which
+ * sees all of them done.
+ *
+ * Nothing but the filesystem is shared: the work directory may be on NFS,
+ * provided the clocks of the hosts agree within a fraction of the lease.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _CLAIM_H
+#define _CLAIM_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <cerrno>
+
+#if __has_include (<fcntl.h>) && __has_include (<unistd.h>) && __has_include (<sys/stat.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define HAS_CLAIM /**< O_EXCL lock files availability */
+#endif
+
+#define CLAIM_SHARDS 64 /**< Default number of shards */
+#define CLAIM_LEASE 60 /**< Default lease of a lock in s */
+#define CLAIM_POLL 1000 /**< Delay (ms) between two looks at the shards claimed by the others */
+
+/**
+ * \class _claim
+ * \brief Claim the shards of a run in a shared work directory. One shard is held at a time.
+ */
+class _claim {
+public:
+    /**
+     * \fn explicit _claim(const std::string &sWorkdir, size_t stShards=CLAIM_SHARDS, int iLease=CLAIM_LEASE)
+     * \brief sWorkdir is shared by all the processes of the run. The number of shards is the one of the first process of the run.
+     */
+    explicit _claim(const std::string &sWorkdir, size_t stShards=CLAIM_SHARDS, int iLease=CLAIM_LEASE);
+
+    _claim(const _claim&)=delete;
+    _claim& operator=(const _claim&)=delete;
+
+    virtual ~_claim();
+
+    /**
+     * \fn bool open()
+     * \brief Create the work directory, agree on the number of shards and start the heartbeat of the leases.
+     */
+    bool open();
+
+    /**
+     * \fn bool next(size_t &stShard)
+     * \brief Claim a shard not done yet. Wait while the remaining shards are held by live processes.
+     * \return false when all the shards are done
+     */
+    bool next(size_t &stShard);
+
+    /**
+     * \fn bool done(size_t stShard)
+     * \brief Mark the shard held done and release its lock. Its result must be in get_result(stShard) already.
+     * \return false if the lock has been taken over by another process, which then owns the shard
+     */
+    bool done(size_t stShard);
+
+    /**
+     * \fn void release(size_t stShard)
+     * \brief Give the shard held back to the other processes. A lock taken over by another process is left to it.
+     */
+    void release(size_t stShard);
+
+    /**
+     * \fn bool claim_merge()
+     * \brief Claim the merge of the results, once all the shards are done.
+     * \return false if the merge is done or held by another process
+     */
+    bool claim_merge();
+
+    /**
+     * \fn bool merge_done()
+     * \brief Mark the merge done.
+     */
+    bool merge_done();
+
+    bool is_done(size_t stShard) const;
+
+    /**
+     * \fn std::string get_result(size_t stShard) const
+     * \return File where the result of a shard is kept
+     */
+    std::string get_result(size_t stShard) const;
+
+    /**
+     * \fn std::string get_part(size_t stShard) const
+     * \return File where this process writes the result of a shard before renaming it: a process which lost its lease does not write in the file of the one which took over
+     */
+    std::string get_part(size_t stShard) const;
+
+    size_t get_shards() const { return stShards; }
+
+    /**
+     * \fn size_t get_claimed() const
+     * \return Number of shards done by this process
+     */
+    size_t get_claimed() const { return stClaimed; }
+
+    /**
+     * \fn static size_t shard(const std::string &sKey, size_t stShards)
+     * \return Shard of sKey: FNV-1a hash, the same for every process
+     */
+    static size_t shard(const std::string &sKey, size_t stShards);
+
+private:
+    std::string sWorkdir;
+    size_t stShards;
+    int iLease;
+    size_t stClaimed;
+    std::string sOwner; /**< host and pid, written in the locks */
+    std::string sTag; /**< host.pid, in the names of the files of this process */
+
+    std::mutex mMutex;
+    std::condition_variable cvStop;
+    std::string sHeld; /**< Lock held, touched by the heartbeat */
+    bool bStop;
+    std::thread thHeartbeat;
+
+    std::string get_path(size_t stShard, const std::string &sExt) const;
+
+    /**
+     * \fn bool lock(size_t stShard)
+     * \brief Create the lock of a shard (stShards for the merge), or take over a stale one.
+     */
+    bool lock(size_t stShard);
+
+    bool mark(size_t stShard);
+
+    bool is_stale(const std::string &sFile) const;
+
+    /**
+     * \fn bool is_owner(const std::string &sLock) const
+     * \return true if sLock is still the one created by this process
+     */
+    bool is_owner(const std::string &sLock) const;
+
+    void heartbeat();
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _claim::_claim(const std::string &sWorkdir, size_t stShards, int iLease):
+    sWorkdir(sWorkdir), stShards(std::max<size_t>(stShards, 1)), iLease(std::max(iLease, 4)), stClaimed(0), bStop(false) {
+
+    char pcHost[256]="localhost";
+#ifdef HAS_CLAIM
+    ::gethostname(pcHost, sizeof(pcHost)-1);
+    sOwner=std::string(pcHost)+" "+std::to_string(::getpid());
+    sTag=std::string(pcHost)+"."+std::to_string(::getpid());
+#else
+    sOwner=sTag=pcHost;
+#endif
+}
+
+inline _claim::~_claim() {
+    {
+        std::lock_guard<std::mutex> lgLock(mMutex);
+        bStop=true;
+    }
+    cvStop.notify_all();
+    if (thHeartbeat.joinable())
+        thHeartbeat.join();
+}
+
+inline bool _claim::open() {
+#ifdef HAS_CLAIM
+    ::mkdir(sWorkdir.c_str(), 0755);
+    struct stat stDir;
+    if (::stat(sWorkdir.c_str(), &stDir)!=0 || !S_ISDIR(stDir.st_mode))
+        return false;
+
+    // the first process sets the number of shards: written aside, then linked
+    const std::string sShards=sWorkdir+"/shards";
+    const std::string sPart=sShards+"."+std::to_string(::getpid())+".part";
+    {
+        std::ofstream ofPart(sPart);
+        ofPart << stShards << "\n";
+    }
+    ::link(sPart.c_str(), sShards.c_str());
+    ::unlink(sPart.c_str());
+
+    std::ifstream ifShards(sShards);
+    size_t stRead=0;
+    if (!(ifShards >> stRead) || stRead==0)
+        return false;
+    stShards=stRead;
+
+    if (!thHeartbeat.joinable())
+        thHeartbeat=std::thread(&_claim::heartbeat, this);
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline bool _claim::next(size_t &stShard) {
+    // the processes start from different shards
+    const size_t stStart=shard(sOwner, stShards);
+
+    while (true) {
+        bool bPending=false;
+
+        for(size_t i=0; i<stShards; i++) {
+            size_t stK=(stStart+i)%stShards;
+            if (is_done(stK))
+                continue;
+
+            if (lock(stK)) {
+                // done between the look and the lock
+                if (is_done(stK)) {
+                    release(stK);
+                    continue;
+                }
+                stShard=stK;
+                return true;
+            }
+            bPending=true;
+        }
+
+        if (!bPending)
+            return false;
+
+        std::unique_lock<std::mutex> ulLock(mMutex);
+        cvStop.wait_for(ulLock, std::chrono::milliseconds(CLAIM_POLL), [this]() { return bStop; });
+        if (bStop)
+            return false;
+    }
+}
+
+inline bool _claim::done(size_t stShard) {
+    // the shard of a process which lost its lease is done by the one which took over
+    if (!is_owner(get_path(stShard, "lock"))) {
+        release(stShard);
+        return false;
+    }
+    bool bRes=mark(stShard);
+    release(stShard);
+    if (bRes)
+        stClaimed++;
+    return bRes;
+}
+
+inline void _claim::release(size_t stShard) {
+    {
+        std::lock_guard<std::mutex> lgLock(mMutex);
+        sHeld.clear();
+    }
+    const std::string sLock=get_path(stShard, "lock");
+    if (is_owner(sLock))
+        std::remove(sLock.c_str());
+}
+
+inline bool _claim::claim_merge() {
+    if (is_done(stShards) || !lock(stShards))
+        return false;
+    if (is_done(stShards)) {
+        release(stShards);
+        return false;
+    }
+    return true;
+}
+
+inline bool _claim::merge_done() {
+    if (!is_owner(get_path(stShards, "lock"))) {
+        release(stShards);
+        return false;
+    }
+    bool bRes=mark(stShards);
+    release(stShards);
+    return bRes;
+}
+
+inline bool _claim::is_done(size_t stShard) const {
+#ifdef HAS_CLAIM
+    struct stat stFile;
+    return ::stat(get_path(stShard, "done").c_str(), &stFile)==0;
+#else
+    return false;
+#endif
+}
+
+inline std::string _claim::get_result(size_t stShard) const {
+    return get_path(stShard, "tsv");
+}
+
+inline std::string _claim::get_part(size_t stShard) const {
+    return get_path(stShard, "tsv."+sTag+".part");
+}
+
+inline size_t _claim::shard(const std::string &sKey, size_t stShards) {
+    uint64_t u64Hash=14695981039346656037ULL;
+    for(unsigned char c: sKey) {
+        u64Hash^=c;
+        u64Hash*=1099511628211ULL;
+    }
+    return u64Hash%std::max<size_t>(stShards, 1);
+}
+
+inline std::string _claim::get_path(size_t stShard, const std::string &sExt) const {
+    if (stShard>=stShards)
+        return sWorkdir+"/merge."+sExt;
+    return sWorkdir+"/shard_"+std::to_string(stShard)+"."+sExt;
+}
+
+inline bool _claim::lock(size_t stShard) {
+#ifdef HAS_CLAIM
+    const std::string sLock=get_path(stShard, "lock");
+
+    auto fCreate=[&]() {
+        int iFd=::open(sLock.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (iFd<0)
+            return false;
+        const std::string sLine=sOwner+"\n";
+        bool bRes=::write(iFd, sLine.data(), sLine.size())==static_cast<ssize_t>(sLine.size());
+        ::close(iFd);
+
+        std::lock_guard<std::mutex> lgLock(mMutex);
+        sHeld=sLock;
+        return bRes;
+    };
+
+    if (fCreate())
+        return true;
+    if (errno!=EEXIST || !is_stale(sLock))
+        return false;
+
+    // a single process takes over a stale lock: the others could remove the new one
+    const std::string sSteal=get_path(stShard, "steal");
+    int iFd=::open(sSteal.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (iFd<0) {
+        // the process which was taking over died
+        if (errno==EEXIST && is_stale(sSteal))
+            std::remove(sSteal.c_str());
+        return false;
+    }
+    ::close(iFd);
+
+    bool bRes=false;
+    if (is_stale(sLock)) {
+        std::remove(sLock.c_str());
+        bRes=fCreate();
+    }
+    std::remove(sSteal.c_str());
+    return bRes;
+#else
+    return false;
+#endif
+}
+
+inline bool _claim::mark(size_t stShard) {
+#ifdef HAS_CLAIM
+    int iFd=::open(get_path(stShard, "done").c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (iFd<0)
+        return false;
+    ::fsync(iFd);
+    return ::close(iFd)==0;
+#else
+    return true;
+#endif
+}
+
+inline bool _claim::is_stale(const std::string &sFile) const {
+#ifdef HAS_CLAIM
+    struct stat stFile;
+    if (::stat(sFile.c_str(), &stFile)!=0)
+        return false;
+    return std::time(nullptr)-stFile.st_mtime>iLease;
+#else
+    return false;
+#endif
+}
+
+inline bool _claim::is_owner(const std::string &sLock) const {
+    std::ifstream ifLock(sLock);
+    std::string sLine;
+    return std::getline(ifLock, sLine) && sLine==sOwner;
+}
+
+inline void _claim::heartbeat() {
+    std::unique_lock<std::mutex> ulLock(mMutex);
+    while (!bStop) {
+        cvStop.wait_for(ulLock, std::chrono::milliseconds(iLease*1000/4), [this]() { return bStop; });
+#ifdef HAS_CLAIM
+        // a lock taken over is not kept alive for its new owner
+        if (!bStop && !sHeld.empty()) {
+            if (is_owner(sHeld))
+                ::utimensat(AT_FDCWD, sHeld.c_str(), nullptr, 0);
+            else
+                sHeld.clear();
+        }
+#endif
+    }
+}
+
+#endif // _CLAIM_H
@@ -0,0 +1,348 @@
+/**
+ * \file collector.h
+ * \brief Gather the result lines computed by several threads into one table, in the order of the inputs.
+ *
+ * Each input is numbered when it is queued, and its result lines are added
+ * with this number by the thread which computed them. The lines are written
+ * as soon as all the inputs before them are in, so that only the results
+ * ahead of a slow input wait in memory, and they reach the file by blocks of
+ * COLLECT_BUFFER bytes. A table sorted by path or by S/N is written by
+ * close(). The table is written aside and renamed once complete.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _COLLECTOR_H
+#define _COLLECTOR_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#define COLLECT_BUFFER (1<<16) /**< Bytes gathered before a write */
+
+/**
+ * \class _collector
+ * \brief Ordered table of results. add() may be called from several threads.
+ */
+class _collector {
+public:
+    /**
+     * \enum eFormat
+     * \brief TEXT: tab separated lines, TSV: the same with a header, JSONL: one JSON object per line.
+     */
+    enum class eFormat { TEXT, TSV, JSONL };
+
+    /**
+     * \enum eOrder
+     * \brief INPUT: order of the inputs, PATH: by path, SNR: by decreasing S/N.
+     */
+    enum class eOrder { INPUT, PATH, SNR };
+
+    /**
+     * \fn explicit _collector(const std::string &sFilename, const std::vector<std::string> &vsColumn, eFormat fFormat=eFormat::TEXT, eOrder oOrder=eOrder::INPUT, size_t stKey=1)
+     * \brief vsColumn names the fields of a line, the path being the first one. stKey is the field of the S/N sorted by eOrder::SNR.
+     */
+    explicit _collector(const std::string &sFilename, const std::vector<std::string> &vsColumn,
+                        eFormat fFormat=eFormat::TEXT, eOrder oOrder=eOrder::INPUT, size_t stKey=1);
+
+    _collector(const _collector&)=delete;
+    _collector& operator=(const _collector&)=delete;
+
+    /**
+     * \fn virtual ~_collector()
+     * \brief A table which was not closed is discarded.
+     */
+    virtual ~_collector();
+
+    /**
+     * \fn bool open()
+     * \brief Start the table with its header.
+     */
+    bool open();
+
+    /**
+     * \fn void add(size_t stSeq, const std::string &sLines)
+     * \brief Add the result lines of the input stSeq, numbered from 0. Empty if the input has no result: the next inputs are not held back by it.
+     */
+    void add(size_t stSeq, const std::string &sLines);
+
+    /**
+     * \fn bool close()
+     * \brief Write the lines left, the inputs missing being skipped, and replace the table.
+     * \return false if the table cannot be written
+     */
+    bool close();
+
+    /**
+     * \fn size_t get_rows() const
+     * \return Number of lines added
+     */
+    size_t get_rows() const;
+
+    const std::string& get_filename() const { return sFilename; }
+
+    /**
+     * \fn void set_part(const std::string &sPart)
+     * \brief Name of the file written before the rename, sFilename.part by default. To be set before open().
+     */
+    void set_part(const std::string &sPart) { this->sPart=sPart; }
+
+    static bool parse_format(const std::string &sFormat, eFormat &fFormat);
+    static bool parse_order(const std::string &sOrder, eOrder &oOrder);
+
+private:
+    struct _row {
+        std::string sLine;
+        double dKey; /**< S/N, NaN if missing */
+    };
+
+    std::string sFilename;
+    std::string sPart; /**< Written aside, renamed by close() */
+    std::vector<std::string> vsColumn;
+    eFormat fFormat;
+    eOrder oOrder;
+    size_t stKey;
+
+    std::ofstream ofFile;
+    std::string sBuffer;
+    std::map<size_t, std::string> mPending; /**< Lines of the inputs after a missing one */
+    std::vector<_row> vrRow; /**< Lines of a sorted table, kept until close() */
+    size_t stNext;
+    size_t stRows;
+    bool bOpen;
+    bool bStatus;
+    mutable std::mutex mMutex;
+
+    void append(const std::string &sLines);
+    void format(const std::string &sLine);
+    void flush(bool bAll);
+
+    static std::vector<std::string> split(const std::string &sLine, char cSep);
+    static std::string json_string(const std::string &sStr);
+    static std::string json_number(const std::string &sStr);
+    static double number(const std::string &sStr);
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _collector::_collector(const std::string &sFilename, const std::vector<std::string> &vsColumn,
+                              eFormat fFormat, eOrder oOrder, size_t stKey):
+    sFilename(sFilename), sPart(sFilename+".part"), vsColumn(vsColumn), fFormat(fFormat), oOrder(oOrder), stKey(stKey),
+    stNext(0), stRows(0), bOpen(false), bStatus(true) { }
+
+inline _collector::~_collector() {
+    if (bOpen) {
+        ofFile.close();
+        std::remove(sPart.c_str());
+    }
+}
+
+inline bool _collector::open() {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    ofFile.open(sPart, std::ios::out | std::ios::trunc | std::ios::binary);
+    bOpen=ofFile.is_open();
+    bStatus=bOpen;
+    if (!bOpen)
+        return false;
+
+    if (fFormat==eFormat::TSV) {
+        for(size_t i=0; i<vsColumn.size(); i++)
+            sBuffer+=(i>0 ? "\t" : "")+vsColumn[i];
+        sBuffer+="\n";
+    }
+    return true;
+}
+
+inline void _collector::add(size_t stSeq, const std::string &sLines) {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    if (stSeq<stNext)
+        return;
+
+    if (stSeq>stNext) {
+        mPending.emplace(stSeq, sLines);
+        return;
+    }
+
+    // the input expected next: the ones waiting behind it follow
+    append(sLines);
+    stNext++;
+    for(auto itPending=mPending.begin(); itPending!=mPending.end() && itPending->first==stNext; itPending=mPending.erase(itPending)) {
+        append(itPending->second);
+        stNext++;
+    }
+    flush(false);
+}
+
+inline bool _collector::close() {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    if (!bOpen)
+        return false;
+
+    for(auto &pPending: mPending)
+        append(pPending.second);
+    mPending.clear();
+
+    if (oOrder!=eOrder::INPUT) {
+        // the lines of a file keep their order, e.g. the windows of a profile
+        auto fPath=[](const _row &rA, const _row &rB) {
+            return rA.sLine.compare(0, rA.sLine.find('\t'), rB.sLine, 0, rB.sLine.find('\t'))<0;
+        };
+
+        if (oOrder==eOrder::PATH)
+            std::stable_sort(vrRow.begin(), vrRow.end(), fPath);
+        else
+            // equal S/N by path, the missing ones last
+            std::stable_sort(vrRow.begin(), vrRow.end(), [&fPath](const _row &rA, const _row &rB) {
+                const bool bA=!std::isnan(rA.dKey), bB=!std::isnan(rB.dKey);
+                if (bA!=bB) return bA;
+                if (bA && rA.dKey!=rB.dKey) return rA.dKey>rB.dKey;
+                return fPath(rA, rB);
+            });
+
+        for(auto &rRow: vrRow) {
+            format(rRow.sLine);
+            flush(false);
+        }
+        vrRow.clear();
+    }
+
+    flush(true);
+    ofFile.close();
+    bOpen=false;
+
+    if (!bStatus || !ofFile) {
+        std::remove(sPart.c_str());
+        return false;
+    }
+    return std::rename(sPart.c_str(), sFilename.c_str())==0;
+}
+
+inline size_t _collector::get_rows() const {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    return stRows;
+}
+
+inline bool _collector::parse_format(const std::string &sFormat, eFormat &fFormat) {
+    if (sFormat=="text") fFormat=eFormat::TEXT;
+    else if (sFormat=="tsv") fFormat=eFormat::TSV;
+    else if (sFormat=="jsonl") fFormat=eFormat::JSONL;
+    else return false;
+    return true;
+}
+
+inline bool _collector::parse_order(const std::string &sOrder, eOrder &oOrder) {
+    if (sOrder=="input") oOrder=eOrder::INPUT;
+    else if (sOrder=="path") oOrder=eOrder::PATH;
+    else if (sOrder=="snr") oOrder=eOrder::SNR;
+    else return false;
+    return true;
+}
+
+inline void _collector::append(const std::string &sLines) {
+    size_t stBegin=0;
+    while (stBegin<sLines.size()) {
+        size_t stEnd=sLines.find('\n', stBegin);
+        if (stEnd==std::string::npos)
+            stEnd=sLines.size();
+
+        if (stEnd>stBegin) {
+            std::string sLine=sLines.substr(stBegin, stEnd-stBegin);
+            stRows++;
+
+            if (oOrder==eOrder::INPUT)
+                format(sLine);
+            else {
+                auto vsField=split(sLine, '\t');
+                vrRow.push_back({std::move(sLine), stKey<vsField.size() ? number(vsField[stKey]) : NAN});
+            }
+        }
+        stBegin=stEnd+1;
+    }
+}
+
+inline void _collector::format(const std::string &sLine) {
+    if (fFormat!=eFormat::JSONL) {
+        sBuffer+=sLine;
+        sBuffer+='\n';
+        return;
+    }
+
+    // the path is a string, the other fields numbers
+    auto vsField=split(sLine, '\t');
+    sBuffer+='{';
+    for(size_t i=0; i<vsField.size(); i++) {
+        if (i>0) sBuffer+=',';
+        sBuffer+=json_string(i<vsColumn.size() ? vsColumn[i] : "field"+std::to_string(i));
+        sBuffer+=':';
+        sBuffer+= i==0 ? json_string(vsField[i]) : json_number(vsField[i]);
+    }
+    sBuffer+="}\n";
+}
+
+inline void _collector::flush(bool bAll) {
+    if (sBuffer.empty() || (!bAll && sBuffer.size()<COLLECT_BUFFER))
+        return;
+    bStatus&=static_cast<bool>(ofFile.write(sBuffer.data(), sBuffer.size()));
+    sBuffer.clear();
+}
+
+inline std::vector<std::string> _collector::split(const std::string &sLine, char cSep) {
+    std::vector<std::string> vsField;
+    size_t stBegin=0, stEnd;
+    while ((stEnd=sLine.find(cSep, stBegin))!=std::string::npos) {
+        vsField.emplace_back(sLine, stBegin, stEnd-stBegin);
+        stBegin=stEnd+1;
+    }
+    vsField.emplace_back(sLine, stBegin);
+    return vsField;
+}
+
+inline std::string _collector::json_string(const std::string &sStr) {
+    std::string sRes="\"";
+    for(unsigned char c: sStr) {
+        if (c=='"' || c=='\\') {
+            sRes+='\\';
+            sRes+=c;
+        }
+        else if (c<0x20) {
+            char pcEsc[8];
+            std::snprintf(pcEsc, sizeof(pcEsc), "\\u%04x", c);
+            sRes+=pcEsc;
+        }
+        else
+            sRes+=c;
+    }
+    return sRes+"\"";
+}
+
+inline std::string _collector::json_number(const std::string &sStr) {
+    // JSON has no inf nor nan
+    double dValue=number(sStr);
+    if (!std::isfinite(dValue))
+        return "null";
+
+    char pcNum[32];
+    std::snprintf(pcNum, sizeof(pcNum), "%.9g", dValue);
+    return pcNum;
+}
+
+inline double _collector::number(const std::string &sStr) {
+    char *pcEnd=nullptr;
+    double dValue=std::strtod(sStr.c_str(), &pcEnd);
+    if (pcEnd==sStr.c_str() || *pcEnd!='\0')
+        return NAN;
+    return dValue;
+}
+
+#endif // _COLLECTOR_H
@@ -26,19 +26,41 @@
 #include <algorithm>
 #include <functional>
 #include <iterator>
+#include <memory>
+#include <thread>
+#include <future>
 
+#include <array>
 #include <string>
+#include <sstream>
 #include <iomanip>
-#include <regex>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
 
-#include <boost/spirit/include/qi_parse.hpp>
-#include <boost/spirit/include/qi_numeric.hpp>
+#if __has_include (<charconv>)
+#include <charconv>
+#endif
 
-#include <boost/tokenizer.hpp>
+#if defined (__cpp_lib_to_chars) && __cpp_lib_to_chars>=201611L
+#define HAS_FROM_CHARS /**< std::from_chars for floating point availability */
+#define HAS_TO_CHARS /**< std::to_chars for floating point availability */
+#endif
+
+#include <io.h>
+#include <spb.h>
+
+#define CSV_SNIFF_SIZE 4096 /**< Bytes inspected to detect the separator */
+
+#ifndef CSV_SEGMENT_MIN
+#define CSV_SEGMENT_MIN (1<<22) /**< Minimum bytes parsed by each thread of read() */
+#endif
 
 /**
  * \class _csv
- * \brief This is the templated _csv class, initialized with double by default. STL parallel execution policy does not provide enhancements for simple operations.
+ * \brief This is the templated _csv class, initialized with double by default. Data are stored by column: one contiguous buffer per column and a row count, so that column operations run over contiguous memory. STL parallel execution policy does not provide enhancements for simple operations.
  * 
  */
 template<typename _T=double> 
@@ -63,7 +85,7 @@ public:
      * \fn explicit _csv(const std::string &sFilename, const char &cSep)
      * \brief Constructor with two parameters such as the name of the working file and the separator character as usual with csv.
      * \param sFilename string Name of the input or output file with extension
-     * \param cSep char Separator char between column
+     * \param cSep char Separator char between column, '\\0' to detect it (see set_sniff())
      */
     explicit _csv(const std::string &sFilename, const char &cSep);
     
@@ -102,11 +124,57 @@ public:
     
     /**
      * \fn bool read();
-     * \brief Read the content of the file given to the constructor using boost. It detects the header and data consistency with digit sequence: {0123456789eE+-. tab std::endl} and basic regex and dimension matching between header and data line. It is able to recover basic errors such as 'tab'==' '. The method put NaN in the grid if an unrecoverable error appends. Data will be store in private variables.
+     * \brief Read the content of the file given to the constructor. The file is memory mapped and scanned once: lines are cut with memchr, tokens with a separator class table and values are converted with std::from_chars. It detects the header with the digit sequence {0123456789eE+-.} and checks the dimension matching between header and data line. 'tab' and ' ' are the same class when one of them is the separator, and blank lines are skipped. The method put NaN in the grid if a token cannot be converted. A .spb file is mapped and its columns are copied without parsing. Data will be store in private variables.
      * \return true if all seems OK
      */   
     bool read();
     
+    /**
+     * \fn bool read(const std::shared_ptr<_mmap> &pFile)
+     * \brief Same as read() on a file already mapped, e.g. by the read stage of a pipeline. A .spb file is opened again.
+     * \param pFile Mapping of get_filename()
+     * \return true if all seems OK
+     */
+    bool read(const std::shared_ptr<_mmap> &pFile);
+    
+    /**
+     * \fn bool for_each_chunk(size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk)
+     * \brief Stream the file given to the constructor by blocks of stChunk rows. Each block is parsed into a reused _csv, which holds the header, the separator and the filenames, and is handed to fChunk. The memory used is bounded by the chunk size, whatever the size of the file. Data of this instance are not filled.
+     * \param stChunk Number of rows per chunk
+     * \param fChunk Callback, return false to stop the streaming
+     * \return true if all the file has been parsed without error
+     */
+    bool for_each_chunk(size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk);
+    
+    /**
+     * \fn bool for_each_chunk(const std::shared_ptr<_mmap> &pFile, size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk)
+     * \brief Same as for_each_chunk() on a file already mapped, e.g. by the read stage of a pipeline. The pages of the mapping are given back as the stream goes past them. A .spb file is opened again.
+     * \param pFile Mapping of get_filename(), the file is read again if it is not open
+     */
+    bool for_each_chunk(const std::shared_ptr<_mmap> &pFile, size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk);
+    
+    /**
+     * \fn bool transform_chunks(size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk)
+     * \brief Stream the file like for_each_chunk() and write each chunk modified by fChunk to the output file. Rows are written in a temporary file renamed at the end, so the output can be the input. The output is not modified if an error happens. A .spb output needs the row count first: the whole file is then processed as one chunk.
+     * \param stChunk Number of rows per chunk
+     * \param fChunk Callback applied to each chunk before writing, return false to abort
+     * \return true if all seems OK
+     */
+    bool transform_chunks(size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk);
+    
+    /**
+     * \fn bool transform_chunks(const std::shared_ptr<_mmap> &pFile, size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk)
+     * \brief Same as transform_chunks() on a file already mapped, streamed like for_each_chunk(pFile, ...).
+     * \param pFile Mapping of get_filename(), the file is read again if it is not open
+     */
+    bool transform_chunks(const std::shared_ptr<_mmap> &pFile, size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk);
+    
+    /**
+     * \fn bool is_input_error() const
+     * \return true if the last transform_chunks() failed on the input, e.g. a file which is not a table, rather than on the output
+     */
+    bool is_input_error() const;
+    
     /**
      * \fn void show() const
      * \brief Show whole data, i.e. the header and data with no restriction on length or terminal size. It uses boost::format in order to correct spacing of number and strings.
@@ -124,11 +192,18 @@ public:
     
     /**
      * \fn bool write()
-     * \brief Write on disk what data are store
+     * \brief Write on disk what data are store. The .spb binary format is used if the output filename has this extension. The file is written as name.part, then renamed.
      * \return true if all seems OK
      */
     bool write();
     
+    /**
+     * \fn bool write(_sink &skOut, std::function<void()> fDone=nullptr)
+     * \brief Same as write(), the text is formatted in memory and queued in skOut, which writes it with the other files of its batch. A .spb file is written directly. fDone is called once the file is on disk, maybe by a later flush of skOut.
+     * \return true if the data have been formatted
+     */
+    bool write(_sink &skOut, std::function<void()> fDone=nullptr);
+    
     /**
      * \fn const std::vector<_T>& select_line(int iLine) const
      * \brief Select the line "line" in data.
@@ -139,11 +214,19 @@ public:
     
     /**
      * \fn const std::vector<_T>& select_column(int iCol) const
-     * \brief Select the column "col" in data.
+     * \brief Select the column "col" in data. It returns a copy, see get_column() for a reference.
      * \param iCol The column to select
      * \return std::vector<_T>
      */
     const std::vector<_T> select_column(int iCol) const;
+
+    /**
+     * \fn const std::vector<_T>& get_column(int iCol) const
+     * \brief Get a reference to the column buffer "iCol" without copy. The reference is invalidated by read(), set_data() and clear().
+     * \param iCol The column to select
+     * \return const std::vector<_T>&, empty if iCol is invalid
+     */
+    const std::vector<_T>& get_column(int iCol) const;
     
     /**
      * \fn const std::vector<std::vector<_T> >& select(int iLine_min, int iLine_max, int iCol_min, int iCol_max) const
@@ -217,8 +300,7 @@ public:
     
     /**
      * \fn bool set_separator(const std::string &sSep)
-     * \brief Set the csv separator. Usually: '\\t', ' ', ',', ';' ... 
-     * \todo
+     * \brief Set the csv separator. Usually: '\\t', ' ', ',', ';' ... "auto" enables set_sniff().
      * \param sSep The sep character: '\\t' for tabulation
      * \return true if all seems OK
      */
@@ -231,6 +313,46 @@ public:
      */
     void set_verbose(eVerbose evV);
     
+    /**
+     * \fn void set_precision(int iPrec)
+     * \brief Set the number of significant digits written by write(). A negative value selects the shortest representation which reads back to the same value (default).
+     * \param iPrec Number of significant digits or -1
+     */
+    void set_precision(int iPrec);
+    
+    /**
+     * \fn int get_precision() const
+     * \brief Get the number of significant digits written, -1 for the shortest round-trip.
+     */
+    int get_precision() const;
+    
+    /**
+     * \fn void set_sniff(bool bSniff)
+     * \brief Detect the separator and the decimal mark ('.' or ',') of each file read from its first CSV_SNIFF_SIZE bytes, instead of using the separator set. The header and the data are still parsed in a single pass.
+     * \param bSniff true to enable the detection
+     */
+    void set_sniff(bool bSniff);
+    
+    bool get_sniff() const;
+    
+    /**
+     * \fn void set_projection(const std::vector<int> &viCol)
+     * \brief Parse only the columns viCol when reading a text file, the other ones are parsed on first access. The lines of the rows are kept and written back verbatim, except the tokens of the columns modified by shift() or transform_lin(). An empty vector parses all the columns (default).
+     * \param viCol Columns to parse
+     */
+    void set_projection(const std::vector<int> &viCol);
+    
+    const std::vector<int>& get_projection() const;
+    
+    /**
+     * \fn void set_threads(int iThr)
+     * \brief Set the number of threads used by read() on a single text file. The mapped file is cut at line boundaries and each segment, of at least CSV_SEGMENT_MIN bytes, is parsed by its own thread. Default is 1.
+     * \param iThr Number of threads, values below 1 mean 1
+     */
+    void set_threads(int iThr);
+    
+    int get_threads() const;
+    
     /**
      * \fn const std::string get_filename() const
      * \brief Get the filename.
@@ -276,7 +398,7 @@ public:
     
     /**
      * \fn const std::vector<std::vector<_T> >& get_data() const
-     * \brief Get data and return it as a vector of vector.
+     * \brief Get data and return it as a vector of rows. Compatibility method: rows are gathered from the columns on demand and cached until the data change. Prefer get_column().
      * \return std::vector<std::vector<_T> >
      */
     const std::vector<std::vector<_T> >& get_data() const;
@@ -363,6 +485,16 @@ public:
      */
     bool apply_min_threshold(_T TVal,int iCol);
     
+    /**
+     * \fn bool apply_range_threshold(_T TMin, _T TMax, int iCol)
+     * \brief Delete \f$i\f$ line from the grid where \f$\mathbf{data}[i][iCol]\notin [min, max]\f$, in a single pass.
+     * \param TMin The min threshold
+     * \param TMax The max threshold
+     * \param iCol Select a column
+     * \return true if all seems OK
+     */
+    bool apply_range_threshold(_T TMin, _T TMax, int iCol);
+    
     /**
      * \fn void zeroize()
      * \brief Set to zero data. One should find this useful...
@@ -442,23 +574,155 @@ private:
     void error(const std::string &sMsg) const;
     
     /**
-     * \fn bool is_float(const std::string &val) const
-     * \brief Check if a string is a float and does not contain non digit characters. It uses boost::qi.
-     * \param TVal The string  
-     * \return true if float
+     * \fn bool write_to(_writer &wOut, bool bHeader) const
+     * \brief Serialize data in an opened writer, with the header if bHeader is true. Values are formatted in place in the writer buffer.
+     */
+    bool write_to(_writer &wOut, bool bHeader) const;
+    
+    /**
+     * \fn char* to_chars(char *pcFirst, char *pcLast, _T TVal) const
+     * \brief Format TVal in [pcFirst, pcLast) with the precision set by set_precision(). It uses std::to_chars if available and snprintf otherwise.
+     * \return One past the last character written
+     */
+    char* to_chars(char *pcFirst, char *pcLast, _T TVal) const;
+    
+    /**
+     * \fn bool read_spb(const _spb &spbFile, size_t stFirst, size_t stN)
+     * \brief Replace the data by stN rows of the opened .spb file from the row stFirst.
      */
-    bool is_float(const std::string &sVal) const;
+    bool read_spb(const _spb &spbFile, size_t stFirst, size_t stN);
+    
+    /**
+     * \fn bool sniff(const char *pcData, const char *pcEnd)
+     * \brief Set the separator and the decimal mark which give the most consistent numeric rows in the first CSV_SNIFF_SIZE bytes of [pcData, pcEnd). The first line is skipped as a possible header. Candidates are tab (and space), ',', ';', '|', ':' and '!'.
+     * \return true if a separator has been found
+     */
+    bool sniff(const char *pcData, const char *pcEnd);
+    
+    /**
+     * \fn const char* parse_header(const char *pcLine, const char *pcEnd, const std::array<unsigned char, 256> &aucClass)
+     * \brief Fill vsHeader if the first line of [pcLine, pcEnd) is a header.
+     * \return The beginning of the data
+     */
+    const char* parse_header(const char *pcLine, const char *pcEnd, 
+                             const std::array<unsigned char, 256> &aucClass);
+    
+    /**
+     * \fn const char* parse_lines(const char *pcLine, const char *pcEnd, const std::array<unsigned char, 256> &aucClass, size_t stMax, size_t stReserve, int &iCount, bool &bDim)
+     * \brief Append at most stMax rows of [pcLine, pcEnd) to the columns. Columns are created with the first row and reserve stReserve rows.
+     * \param iCount Line counter used by error messages
+     * \param bDim Set to false if a row does not match the number of columns
+     * \return The first character which has not been parsed
+     */
+    const char* parse_lines(const char *pcLine, const char *pcEnd, 
+                            const std::array<unsigned char, 256> &aucClass,
+                            size_t stMax, size_t stReserve, 
+                            int &iCount, bool &bDim);
+    
+    /**
+     * \fn void parse_segments(const char *pcLine, const char *pcEnd, const std::array<unsigned char, 256> &aucClass, size_t stSegments, int iCount, bool &bDim)
+     * \brief Cut [pcLine, pcEnd) in stSegments at line boundaries, parse them concurrently into per-segment columns and append these columns in order.
+     */
+    void parse_segments(const char *pcLine, const char *pcEnd, 
+                        const std::array<unsigned char, 256> &aucClass,
+                        size_t stSegments, int iCount, bool &bDim);
+    
+    /**
+     * \fn bool check_read(bool bDim)
+     * \brief Check the dimensions of data read and the header consistency.
+     */
+    bool check_read(bool bDim);
+    
+    /**
+     * \fn std::array<unsigned char, 256> sep_class(char cSep) const
+     * \brief Build the character class table used by the tokenizer: 1 for separators, 0 for token characters. '\\r' is always a separator, ' ' and '\\t' are both separators if one of them is cSep.
+     * \param cSep The separator
+     */
+    std::array<unsigned char, 256> sep_class(char cSep) const;
+    
+    /**
+     * \fn template<typename _F> void for_each_token(const char *pcFirst, const char *pcLast, const std::array<unsigned char, 256> &aucClass, _F fToken) const
+     * \brief Call fToken(pcBegin, pcEnd) for each token of the line [pcFirst, pcLast). Consecutive separators are merged.
+     */
+    template<typename _F> 
+    void for_each_token(const char *pcFirst, const char *pcLast, 
+                        const std::array<unsigned char, 256> &aucClass, _F fToken) const;
+    
+    /**
+     * \fn bool to_value(const char *pcFirst, const char *pcLast, _T &TVal) const
+     * \brief Convert the whole token [pcFirst, pcLast) into TVal. It uses std::from_chars if available and strtold otherwise. The decimal mark cDecimal is replaced by '.' first.
+     * \return true if the token is a number and does not contain other characters
+     */
+    bool to_value(const char *pcFirst, const char *pcLast, _T &TVal) const;
+    
+    /**
+     * \fn bool is_parsed(size_t j) const
+     * \return true if the column j holds its values
+     */
+    bool is_parsed(size_t j) const;
+    
+    /**
+     * \fn void parse_column(size_t j) const
+     * \brief Parse the column j from the lines kept by the projection mode.
+     */
+    void parse_column(size_t j) const;
+    
+    /**
+     * \fn void parse_all() const
+     * \brief Parse all the columns not parsed yet.
+     */
+    void parse_all() const;
+    
+    /**
+     * \fn void touch(size_t j)
+     * \brief Parse the column j and mark it as modified: its tokens are formatted again by write().
+     */
+    void touch(size_t j);
+    
+    /**
+     * \fn void drop_lines()
+     * \brief Parse all the columns and forget the lines kept by the projection mode. Used before the data are replaced.
+     */
+    void drop_lines();
+    
+    /**
+     * \fn void keep_rows()
+     * \brief Keep the rows whose vucMask byte is 1. Filters build the mask with a compare loop over contiguous columns, then all the columns are compacted in one pass.
+     */
+    void keep_rows();
+    
+    /**
+     * \fn void resize_rows(size_t stSize)
+     * \brief Resize all the columns to stSize rows.
+     */
+    void resize_rows(size_t stSize);
+    
+    mutable std::vector<std::vector<_T> > vvColumn; /**< Data: one contiguous buffer per column, parsed on demand in projection mode */
+    size_t stRows; /**< Number of rows in each column */
+    mutable std::vector<std::vector<_T> > vvData; /**< Row-major copy of the data built by get_data() */     
+    mutable bool bRows_valid; /**< True if vvData matches vvColumn */
+    std::vector<unsigned char> vucMask; /**< Row selection of the filters, 1 to keep */
     
-    std::vector<std::vector<_T> > vvData; /**< Data contains the 2D-vector and is private */     
+    std::vector<int> viProjection; /**< Columns parsed by read(), all if empty */
+    mutable std::vector<unsigned char> vucParsed; /**< 1 if the column holds its values, all parsed if empty */
+    std::vector<unsigned char> vucDirty; /**< 1 if the column has been modified since read() */
+    std::vector<std::pair<const char*, const char*> > vpcLine; /**< Source line of each row in projection mode */
+    std::shared_ptr<_mmap> pSource; /**< Mapping which holds the lines of read() */
+    std::string sHeader_line; /**< Source header line in projection mode */
     std::vector<std::string> vsHeader; /**<  vsHeader is a vector of column std::string name */
 
     std::vector<std::tuple<std::string, char> > vcSeplist; /**<  vcSeplist is a vector of allowed seperators */
     
     std::string sFilename,sFilename_out; /**< Store the filename  */
     char cSeparator; /**< Store the csv separator  */          
+    int iPrecision; /**< Significant digits written, -1 for the shortest round-trip */
+    int iThreads; /**< Threads used by read() */
+    bool bSniff; /**< Detect the separator of each file */
+    char cDecimal; /**< Decimal mark of the values read */
    
     eVerbose evVerbose; /**< Verbose define verbosity */
     bool bStatus; /**< Status is used to return error status  */
+    bool bInput_error; /**< The last transform_chunks() failed on the input */
     
     /**
      * \fn _T Gaussian(_T x, _T x0, _T sigma) const
@@ -1,14 +1,21 @@
 template<typename _T> 
 _csv<_T>::_csv():
-      vvData(std::vector<std::vector<_T> >(0))
+      vvColumn(std::vector<std::vector<_T> >(0))
+    , stRows(0)
+    , bRows_valid(false)
     , vcSeplist({{" ", ' '}, {";",';' },
                  {",", ','}, {":",':'},
                  {"|",'|'},  {"!",'!'},
                  {"\t",'\t'},{"\\t",'\t'}})
     , sFilename("out.csv")
     , cSeparator('\t')
+    , iPrecision(-1)
+    , iThreads(1)
+    , bSniff(false)
+    , cDecimal('.')
     , evVerbose(QUIET)
     , bStatus(true)
+    , bInput_error(false)
 {
     debug("initing csv with empty parameters: fill them");
 
@@ -16,30 +23,47 @@ _csv<_T>::_csv():
 
 template<typename _T> 
 _csv<_T>::_csv(const std::string &sFilename, const char &cSep):
-     vvData(std::vector<std::vector<_T> >(0))
+     vvColumn(std::vector<std::vector<_T> >(0))
+    , stRows(0)
+    , bRows_valid(false)
     , vcSeplist({{" ", ' '}, {";",';' },
                  {",", ','}, {":",':'},
                  {"|",'|'},  {"!",'!'},
                  {"\t",'\t'},{"\\t",'\t'}})
+    , iPrecision(-1)
+    , iThreads(1)
+    , bSniff(false)
+    , cDecimal('.')
     , evVerbose(QUIET)
     , bStatus(true)
+    , bInput_error(false)
 {
     debug("initing csv");
     
     set_filename(sFilename);
-    set_separator(cSep);
+    if (cSep=='\0') 
+        set_sniff(true);
+    else
+        set_separator(cSep);
 
 }
 
 template<typename _T> 
 _csv<_T>::_csv(const std::string &sFilename, const std::string &sSep):
-     vvData(std::vector<std::vector<_T> >(0))
+     vvColumn(std::vector<std::vector<_T> >(0))
+    , stRows(0)
+    , bRows_valid(false)
     , vcSeplist({{" ", ' '}, {";",';' },
                  {",", ','}, {":",':'},
                  {"|",'|'},  {"!",'!'},
                  {"\t",'\t'},{"\\t",'\t'}})
+    , iPrecision(-1)
+    , iThreads(1)
+    , bSniff(false)
+    , cDecimal('.')
     , evVerbose(QUIET)
     , bStatus(true)
+    , bInput_error(false)
 {
     debug("initing csv");
     
@@ -50,15 +74,22 @@ _csv<_T>::_csv(const std::string &sFilename, const std::string &sSep):
 
 template<typename _T> 
 _csv<_T>::_csv(const std::vector<std::vector<_T> > &vvData): 
-    vcSeplist({{" ", ' '}, {";",';' },
+      vvColumn(std::vector<std::vector<_T> >(0))
+    , stRows(0)
+    , bRows_valid(false)
+    , vcSeplist({{" ", ' '}, {";",';' },
                {",", ','}, {":",':'},
                {"|",'|'},  {"!",'!'},
                {"\t",'\t'},{"\\t",'\t'}})
     , sFilename("out.csv")
     , cSeparator('\t')
+    , iPrecision(-1)
+    , iThreads(1)
+    , bSniff(false)
+    , cDecimal('.')
     , evVerbose(QUIET)
     , bStatus(true)
-    , vvData(std::vector<std::vector<_T> >(0))
+    , bInput_error(false)
 {
     debug("initing csv with empty parameters: fill them");
     
@@ -68,15 +99,22 @@ _csv<_T>::_csv(const std::vector<std::vector<_T> > &vvData):
 template<typename _T> 
 _csv<_T>::_csv(const std::vector<std::string>& vsHeader, 
                const std::vector<std::vector<_T> > &vvData): 
-    vcSeplist({{" ", ' '}, {";",';' },
+      vvColumn(std::vector<std::vector<_T> >(0))
+    , stRows(0)
+    , bRows_valid(false)
+    , vcSeplist({{" ", ' '}, {";",';' },
                {",", ','}, {":",':'},
                {"|",'|'},  {"!",'!'},
                {"\t",'\t'},{"\\t",'\t'}})
     , sFilename("out.csv")
     , cSeparator('\t')
+    , iPrecision(-1)
+    , iThreads(1)
+    , bSniff(false)
+    , cDecimal('.')
     , evVerbose(QUIET)
     , bStatus(true)
-    , vvData(std::vector<std::vector<_T> >(0))
+    , bInput_error(false)
 {
     debug("initing csv with empty parameters: fill them");
     
@@ -88,15 +126,22 @@ template<typename _T>
 _csv<_T>::_csv(const std::vector<std::string>& vsHeader, 
                const std::vector<std::vector<_T> > &vvData, 
                const char &cSep):
-    vcSeplist({{" ", ' '}, {";",';' },
+      vvColumn(std::vector<std::vector<_T> >(0))
+    , stRows(0)
+    , bRows_valid(false)
+    , vcSeplist({{" ", ' '}, {";",';' },
                {",", ','}, {":",':'},
                {"|",'|'},  {"!",'!'},
                {"\t",'\t'},{"\\t",'\t'}})
     , sFilename("out.csv")
     , cSeparator('\t')
+    , iPrecision(-1)
+    , iThreads(1)
+    , bSniff(false)
+    , cDecimal('.')
     , evVerbose(QUIET)
     , bStatus(true)
-    , vvData(std::vector<std::vector<_T> >(0))
+    , bInput_error(false)
 {
     debug("initing csv with empty parameters: fill them");
     
@@ -115,89 +160,68 @@ template<typename _T>
 bool _csv<_T>::read() {
     
      bStatus=false;
-     std::fstream sFlux_in(get_filename(), std::ios::in);
-    
-     if (sFlux_in) {
+     
+     if (_spb::is_spb(get_filename())) {
+         _spb spbFile(get_filename());
          
-         char cSep=get_separator();
-         std::string sSep(std::string(1,cSep));
+         if (spbFile.is_open()) {
+             debug("file "+get_filename()+" mapped");
+             clear();
+             vsHeader=spbFile.get_header();
+             bStatus=read_spb(spbFile, 0, spbFile.get_rows());
+         }
+         else
+             error("read(): invalid spb file "+get_filename());
+         
+         return bStatus;
+     }
+     
+     return read(std::make_shared<_mmap>(get_filename()));
+}
 
-         debug("file "+get_filename()+" opened");
+template<typename _T> 
+bool _csv<_T>::read(const std::shared_ptr<_mmap> &pFile) {
+    
+     if (_spb::is_spb(get_filename()) || !pFile)
+         return read();
+    
+     bStatus=false;
+     
+     if (pFile->is_open()) {
          
-         clear();
+         debug("file "+get_filename()+" mapped");
          
-         debug("parsing header");
-         boost::char_separator<char> bcSep(sSep.c_str());
-         std::string sLine;
+         clear();
          
-         getline(sFlux_in,sLine);
-         boost::tokenizer<boost::char_separator<char> > btTok0(sLine,bcSep);
+         // the rows point into the mapping in projection mode
+         if (!viProjection.empty()) pSource=pFile;
          
-         std::string sDigit="0123456789eE+-. \n"+sSep;
+         const char *pcLine=pFile->data();
+         const char *pcEnd=pFile->end();
          
-         int iSkip_line=1; 
+         if (bSniff) sniff(pcLine, pcEnd);
          
-         for(auto sS: btTok0) {
-             if (sS.find_first_not_of(sDigit)!=std::string::npos) {
-                 vsHeader.emplace_back(sS);
-             }
-             else { 
-                 debug("unnamed data: continue parsing");
-                 iSkip_line=-1;
-                 break;                
-             }
-         }
+         const auto aucClass=sep_class(get_separator());
          
-         sLine.clear();
-         sFlux_in.clear();
-         sFlux_in.seekg (0, std::ios::beg);
+         debug("parsing header");
+         pcLine=parse_header(pcLine, pcEnd, aucClass);
          
          debug("parsing and checking data");
          
-         // define regex to correct errors. not mandatory
-         std::regex regex_test;
-         if (cSep==' ') regex_test=std::regex("\t");
-         if (cSep=='\t') regex_test=std::regex(" ");
-         
-         int iCount=0;
-         while(std::getline(sFlux_in,sLine)) {
-             
-             // try to correct errors with \t or ' '
-             sLine=std::regex_replace(sLine, regex_test, sSep);    
-             
-             boost::tokenizer<boost::char_separator<char> > btTok(sLine,bcSep);
-             std::vector<_T> vLine;
-             if (iCount>iSkip_line) {
-                 for(auto sS: btTok) {
-
-                     if (!is_float(sS) || sS.empty()) {
-                         error("read("+get_filename()+"): '"+sS+"' at line: "+std::to_string(iCount));
-                         vLine.emplace_back(std::nan(sS.c_str()));
-                     }
-                     else
-                         vLine.emplace_back(std::stof(sS));
-                 }
-                 
-                 vvData.emplace_back(vLine);
-             }
-             iCount++;
-         }
+         int iCount=vsHeader.empty() ? 0 : 1;
+         bool bDim=true;
          
-         bStatus=true;
+         const size_t stSegments=std::min<size_t>(iThreads, (pcEnd-pcLine)/CSV_SEGMENT_MIN);
          
-         if (!check_dim()) {
-             error("read("+get_filename()+"): dimension error");
-             bStatus=false;
-         }
-         if (!vsHeader.empty()) {
-             if (vsHeader.size()!=vvData[iSkip_line].size()) {
-                 error("read("+get_filename()+
-                       "): header and data line mismatch");
-                 bStatus=false;
-             }
+         if (stSegments>1) 
+             parse_segments(pcLine, pcEnd, aucClass, stSegments, iCount, bDim);
+         else {
+             // one row per line at most
+             const size_t stLines=std::count(pcLine, pcEnd, '\n')+1;
+             parse_lines(pcLine, pcEnd, aucClass, SIZE_MAX, stLines, iCount, bDim);
          }
          
-         sFlux_in.close();         
+         bStatus=check_read(bDim);
      }
      else 
          error("read(): cannot open file "+get_filename());
@@ -205,11 +229,557 @@ bool _csv<_T>::read() {
     return bStatus;
 }
 
+template<typename _T> 
+bool _csv<_T>::for_each_chunk(size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk) {
+    return for_each_chunk(nullptr, stChunk, fChunk);
+}
+
+template<typename _T> 
+bool _csv<_T>::for_each_chunk(const std::shared_ptr<_mmap> &pFile, size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk) {
+    bStatus=false;
+    
+    if (stChunk==0) {
+        error("for_each_chunk(): invalid chunk size");
+        return bStatus;
+    }
+    
+    debug("streaming "+get_filename()+" by "+std::to_string(stChunk)+" rows");
+    
+    clear();
+    
+    // the chunk is reused: its columns keep their capacity between calls
+    _csv<_T> csvChunk;
+    csvChunk.set_verbose(evVerbose);
+    csvChunk.set_filename(get_filename());
+    csvChunk.set_filename_out(get_filename_out());
+    csvChunk.set_separator(get_separator());
+    csvChunk.set_precision(get_precision());
+    csvChunk.viProjection=viProjection;
+    
+    if (_spb::is_spb(get_filename())) {
+        _spb spbFile(get_filename());
+        
+        if (!spbFile.is_open() || spbFile.get_rows()==0) {
+            error("for_each_chunk(): invalid spb file "+get_filename());
+            return bStatus;
+        }
+        
+        vsHeader=spbFile.get_header();
+        csvChunk.vsHeader=vsHeader;
+        
+        bool bContinue=true;
+        for(size_t stFirst=0; bContinue && stFirst<spbFile.get_rows(); stFirst+=stChunk) {
+            if (!csvChunk.read_spb(spbFile, stFirst, std::min(stChunk, spbFile.get_rows()-stFirst)))
+                return bStatus;
+            bContinue=fChunk(csvChunk);
+        }
+        
+        bStatus=bContinue;
+        return bStatus;
+    }
+    
+    // a mapped file is one block, its pages are given back behind the parser
+    const bool bView=pFile && pFile->is_open();
+    std::ifstream sfFlux;
+    
+    if (!bView) {
+        sfFlux.open(get_filename(), std::ios::in | std::ios::binary);
+        
+        if (!sfFlux) {
+            error("for_each_chunk(): cannot open file "+get_filename());
+            return bStatus;
+        }
+    }
+    
+    auto aucClass=sep_class(get_separator());
+    
+    std::vector<char> vcBuffer(bView ? 0 : 1<<20);
+    size_t stFill=bView ? pFile->size() : 0;
+    size_t stReleased=0;
+    bool bEof=bView;
+    bool bHeader_done=false;
+    bool bDim=true;
+    bool bContinue=true;
+    int iCount=0;
+    size_t stTotal=0;
+    
+    while (bContinue && !(bEof && stFill==0)) {
+        
+        if (!bEof) {
+            sfFlux.read(vcBuffer.data()+stFill, vcBuffer.size()-stFill);
+            stFill+=sfFlux.gcount();
+            bEof=!sfFlux;
+        }
+        
+        const char *pcFirst=bView ? pFile->data() : vcBuffer.data();
+        const char *pcLast=pcFirst+stFill;
+        
+        // only complete lines are parsed, except at the end of the file
+        if (!bEof) {
+            while (pcLast>pcFirst && *(pcLast-1)!='\n') --pcLast;
+            
+            if (pcLast==pcFirst) {
+                // a line longer than the buffer
+                vcBuffer.resize(2*vcBuffer.size());
+                continue;
+            }
+        }
+        
+        const char *pcLine=pcFirst;
+        
+        if (!bHeader_done) {
+            if (bSniff) {
+                sniff(pcLine, pcLast);
+                aucClass=sep_class(get_separator());
+                csvChunk.set_separator(get_separator());
+                csvChunk.cDecimal=cDecimal;
+            }
+            pcLine=parse_header(pcLine, pcLast, aucClass);
+            if (!vsHeader.empty()) {
+                csvChunk.vsHeader=vsHeader;
+                csvChunk.sHeader_line=sHeader_line;
+                iCount=1;
+            }
+            bHeader_done=true;
+        }
+        
+        while (bContinue && pcLine<pcLast) {
+            pcLine=csvChunk.parse_lines(pcLine, pcLast, aucClass, 
+                                        stChunk-csvChunk.stRows, stChunk, iCount, bDim);
+            
+            if (csvChunk.stRows==stChunk) {
+                stTotal+=csvChunk.stRows;
+                bContinue=fChunk(csvChunk);
+                csvChunk.resize_rows(0);
+                
+                if (bView) {
+                    pFile->release(stReleased, pcLine-pcFirst);
+                    stReleased=pcLine-pcFirst;
+                }
+            }
+        }
+        
+        // rows point into the buffer in projection mode: hand them before it moves
+        if (!viProjection.empty() && bContinue && csvChunk.stRows>0) {
+            stTotal+=csvChunk.stRows;
+            bContinue=fChunk(csvChunk);
+            csvChunk.resize_rows(0);
+        }
+        
+        // keep the partial line for the next block
+        size_t stLeft=pcFirst+stFill-pcLast;
+        if (stLeft>0)
+            std::memmove(vcBuffer.data(), pcLast, stLeft);
+        stFill=stLeft;
+    }
+    
+    if (bContinue && csvChunk.stRows>0) {
+        stTotal+=csvChunk.stRows;
+        bContinue=fChunk(csvChunk);
+    }
+    
+    bStatus=bDim;
+    if (!bDim)
+        error("for_each_chunk("+get_filename()+"): dimension error");
+    
+    if (!vsHeader.empty() && !csvChunk.vvColumn.empty() && 
+        vsHeader.size()!=csvChunk.vvColumn.size()) {
+        error("for_each_chunk("+get_filename()+"): header and data line mismatch");
+        bStatus=false;
+    }
+    
+    if (stTotal==0) {
+        error("for_each_chunk("+get_filename()+"): data are empty");
+        bStatus=false;
+    }
+    
+    debug(std::to_string(stTotal)+" rows streamed");
+    
+    return bStatus && bContinue;
+}
+
+template<typename _T> 
+bool _csv<_T>::transform_chunks(size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk) {
+    return transform_chunks(nullptr, stChunk, fChunk);
+}
+
+template<typename _T> 
+bool _csv<_T>::transform_chunks(const std::shared_ptr<_mmap> &pFile, size_t stChunk, const std::function<bool(_csv<_T>&)> &fChunk) {
+    bStatus=false;
+    bInput_error=false;
+    
+    // the output may be the input: write aside and rename at the end
+    const std::string sOutput=get_filename_out();
+    const std::string sTmp=sOutput+".part";
+    
+    if (_spb::is_spb(sOutput)) {
+        // the header of a .spb file needs the row count: one chunk
+        const std::string sKeep_out=sFilename_out;
+        sFilename_out=sTmp+".spb";
+        
+        const bool bRead=pFile && pFile->is_open() ? read(pFile) : read();
+        bInput_error=!bRead;
+        bStatus=bRead && fChunk(*this) && write();
+        sFilename_out=sKeep_out;
+        
+        if (bStatus && std::rename((sTmp+".spb").c_str(), sOutput.c_str())!=0) {
+            error("transform_chunks(): cannot rename "+sTmp+".spb to "+sOutput);
+            bStatus=false;
+        }
+        if (!bStatus)
+            std::remove((sTmp+".spb").c_str());
+        
+        return bStatus;
+    }
+    
+    _writer wOut;
+    if (!wOut.open(sTmp)) {
+        error("transform_chunks(): cannot open "+sTmp);
+        return bStatus;
+    }
+    
+    bool bFirst=true;
+    bool bWrite=true;
+    
+    bool bRead=for_each_chunk(pFile, stChunk, [&](_csv<_T> &csvChunk) {
+        if (!fChunk(csvChunk)) return false;
+        bWrite&=csvChunk.write_to(wOut, bFirst);
+        bFirst=false;
+        return bWrite;
+    });
+    
+    bWrite&=wOut.close();
+    
+    // the streaming stops on a write error too: only a failed read with a sound output blames the input
+    bInput_error=!bRead && bWrite;
+    
+    if (bRead && bWrite) {
+        if (std::rename(sTmp.c_str(), sOutput.c_str())==0)
+            bStatus=true;
+        else
+            error("transform_chunks(): cannot rename "+sTmp+" to "+sOutput);
+    }
+    
+    if (!bStatus)
+        std::remove(sTmp.c_str());
+    
+    return bStatus;
+}
+
+template<typename _T> 
+bool _csv<_T>::is_input_error() const {
+    return bInput_error;
+}
+
+template<typename _T> 
+bool _csv<_T>::sniff(const char *pcData, const char *pcEnd) {
+    // complete lines of the first block only
+    const char *pcLast=pcData+std::min<size_t>(CSV_SNIFF_SIZE, pcEnd-pcData);
+    if (pcLast<pcEnd) 
+        while (pcLast>pcData && *(pcLast-1)!='\n') --pcLast;
+    
+    std::vector<std::pair<const char*, const char*> > vLine;
+    for(const char *pcLine=pcData; pcLine<pcLast; ) {
+        const char *pcEol=static_cast<const char*>(std::memchr(pcLine, '\n', pcLast-pcLine));
+        if (pcEol==nullptr) pcEol=pcLast;
+        vLine.emplace_back(pcLine, pcEol);
+        pcLine=pcEol<pcLast ? pcEol+1 : pcLast;
+    }
+    
+    // the first line may be a header
+    if (vLine.size()>1) vLine.erase(vLine.begin());
+    
+    const std::string sCandidate="\t,;|:!";
+    const char cDecimal_prev=cDecimal;
+    
+    size_t stBest_rows=0, stBest_cols=0;
+    char cBest_sep=get_separator(), cBest_dec=cDecimal;
+    
+    for(char cSep: sCandidate) 
+        for(char cDec: {'.', ','}) {
+            if (cDec==cSep) continue;
+            cDecimal=cDec;
+            
+            const auto aucClass=sep_class(cSep);
+            
+            // rows fully numeric, by number of columns
+            std::vector<size_t> vstRows;
+            for(auto &pLine: vLine) {
+                size_t stCols=0;
+                bool bNum=true;
+                for_each_token(pLine.first, pLine.second, aucClass, [&](const char *pcFirst, const char *pcLast) {
+                    _T TVal;
+                    bNum&=to_value(pcFirst, pcLast, TVal);
+                    stCols++;
+                });
+                if (bNum && stCols>0) {
+                    if (vstRows.size()<=stCols) vstRows.resize(stCols+1, 0);
+                    vstRows[stCols]++;
+                }
+            }
+            
+            for(size_t stCols=1; stCols<vstRows.size(); stCols++)
+                if (vstRows[stCols]>stBest_rows || 
+                    (vstRows[stCols]==stBest_rows && stCols>stBest_cols)) {
+                    stBest_rows=vstRows[stCols];
+                    stBest_cols=stCols;
+                    cBest_sep=cSep;
+                    cBest_dec=cDec;
+                }
+        }
+    
+    if (stBest_rows==0) {
+        cDecimal=cDecimal_prev;
+        debug("sniff(): no separator found, keeping '"+std::string(1, get_separator())+"'");
+        return false;
+    }
+    
+    cSeparator=cBest_sep;
+    cDecimal=cBest_dec;
+    
+    debug("sniff(): separator '"+std::string(1, cSeparator)+
+          "', decimal mark '"+std::string(1, cDecimal)+
+          "', "+std::to_string(stBest_cols)+" column(s)");
+    
+    return true;
+}
+
+template<typename _T> 
+const char* _csv<_T>::parse_header(const char *pcLine, const char *pcEnd, 
+                                   const std::array<unsigned char, 256> &aucClass) {
+    vsHeader.clear();
+    
+    const char *pcEol=static_cast<const char*>(std::memchr(pcLine, '\n', pcEnd-pcLine));
+    if (pcEol==nullptr) pcEol=pcEnd;
+    
+    // the first line is a header if none of its tokens looks like a number
+    const std::string sDigit=std::string("0123456789eE+-.")+cDecimal;
+    bool bHeader=pcLine<pcEol;
+    
+    for_each_token(pcLine, pcEol, aucClass, [&](const char *pcFirst, const char *pcLast) {
+        std::string sS(pcFirst, pcLast);
+        bHeader&=sS.find_first_not_of(sDigit)!=std::string::npos;
+        vsHeader.emplace_back(sS);
+    });
+    bHeader&=!vsHeader.empty();
+    
+    if (!bHeader) {
+        debug("unnamed data: continue parsing");
+        vsHeader.clear();
+        return pcLine;
+    }
+    if (!viProjection.empty()) 
+        sHeader_line.assign(pcLine, pcEol);
+    
+    return pcEol<pcEnd ? pcEol+1 : pcEnd;
+}
+
+template<typename _T> 
+const char* _csv<_T>::parse_lines(const char *pcLine, const char *pcEnd, 
+                                  const std::array<unsigned char, 256> &aucClass,
+                                  size_t stMax, size_t stReserve, 
+                                  int &iCount, bool &bDim) {
+    // the first data line defines the number of columns
+    std::vector<_T> vFirst;
+    size_t stParsed=0;
+    const bool bProject=!viProjection.empty();
+    
+    auto bWanted=[&](size_t j) {
+        return std::find(viProjection.begin(), viProjection.end(), static_cast<int>(j))!=viProjection.end();
+    };
+    
+    while(pcLine<pcEnd && stParsed<stMax) {
+        const char *pcEol=static_cast<const char*>(std::memchr(pcLine, '\n', pcEnd-pcLine));
+        if (pcEol==nullptr) pcEol=pcEnd;
+        
+        size_t stCol=0;
+        const size_t stCols=vvColumn.size();
+        
+        for_each_token(pcLine, pcEol, aucClass, [&](const char *pcFirst, const char *pcLast) {
+            // columns out of the projection are only counted
+            if (bProject && (stCols==0 ? !bWanted(stCol) : (stCol<stCols && !is_parsed(stCol)))) {
+                if (stCols==0) 
+                    vFirst.emplace_back(0);
+                else if (stCol>=stCols) 
+                    bDim=false;
+                stCol++;
+                return;
+            }
+            
+            _T TVal;
+            if (!to_value(pcFirst, pcLast, TVal)) {
+                std::string sS(pcFirst, pcLast);
+                error("read("+get_filename()+"): '"+sS+"' at line: "+std::to_string(iCount));
+                TVal=std::nan(sS.c_str());
+            }
+            
+            if (stCols==0)
+                vFirst.emplace_back(TVal);
+            else if (stCol<stCols)
+                vvColumn[stCol].emplace_back(TVal);
+            else 
+                bDim=false;
+            stCol++;
+        });
+        
+        // blank lines are not data
+        if (stCol>0) {
+            if (stCols==0) {
+                vvColumn.resize(vFirst.size());
+                if (bProject) {
+                    vucParsed.assign(vFirst.size(), 0);
+                    for(size_t j=0; j<vFirst.size(); j++) 
+                        vucParsed[j]=bWanted(j);
+                    vpcLine.reserve(stReserve);
+                }
+                for(size_t j=0; j<vFirst.size(); j++) {
+                    if (!is_parsed(j)) continue;
+                    vvColumn[j].reserve(stReserve);
+                    vvColumn[j].emplace_back(vFirst[j]);
+                }
+            }
+            else if (stCol<stCols) {
+                bDim=false;
+                for(size_t j=stCol; j<stCols; j++) 
+                    if (is_parsed(j)) vvColumn[j].emplace_back(std::nan(""));
+            }
+            if (!vucParsed.empty()) 
+                vpcLine.emplace_back(pcLine, pcEol);
+            stRows++;
+            stParsed++;
+        }
+        
+        pcLine=pcEol<pcEnd ? pcEol+1 : pcEnd;
+        iCount++;
+    }
+    bRows_valid=false;
+    
+    return pcLine;
+}
+
+template<typename _T> 
+bool _csv<_T>::read_spb(const _spb &spbFile, size_t stFirst, size_t stN) {
+    bool bRes=true;
+    
+    vvColumn.resize(spbFile.get_cols());
+    resize_rows(stN);
+    
+    for(size_t j=0; j<vvColumn.size(); j++) 
+        bRes&=spbFile.copy_column(j, stFirst, stN, vvColumn[j].data());
+    
+    if (!bRes)
+        error("read("+get_filename()+"): invalid spb columns");
+    
+    return bRes;
+}
+
+template<typename _T> 
+void _csv<_T>::parse_segments(const char *pcLine, const char *pcEnd, 
+                              const std::array<unsigned char, 256> &aucClass,
+                              size_t stSegments, int iCount, bool &bDim) {
+    debug("parsing with "+std::to_string(stSegments)+" threads");
+    
+    // cut after the first newline following each equal share
+    std::vector<const char*> vpcCut(stSegments+1, pcEnd);
+    vpcCut[0]=pcLine;
+    
+    const size_t stShare=(pcEnd-pcLine)/stSegments;
+    for(size_t k=1; k<stSegments; k++) {
+        const char *pcCut=std::max(vpcCut[k-1], pcLine+k*stShare);
+        const char *pcEol=static_cast<const char*>(std::memchr(pcCut, '\n', pcEnd-pcCut));
+        vpcCut[k]=pcEol==nullptr ? pcEnd : pcEol+1;
+    }
+    
+    std::vector<_csv<_T> > vcsvSegment(stSegments);
+    std::unique_ptr<bool[]> pbDim(new bool[stSegments]);
+    std::vector<std::future<void> > vfTask;
+    
+    for(size_t k=0; k<stSegments; k++) {
+        pbDim[k]=true;
+        vcsvSegment[k].set_filename(get_filename());
+        vcsvSegment[k].set_verbose(evVerbose);
+        vcsvSegment[k].cDecimal=cDecimal;
+        vcsvSegment[k].viProjection=viProjection;
+    }
+    
+    // the line count of the previous segments gives the first line of each segment
+    std::vector<size_t> vstLines(stSegments);
+    std::vector<int> viCount(stSegments, iCount);
+    for(size_t k=0; k<stSegments; k++) {
+        vstLines[k]=std::count(vpcCut[k], vpcCut[k+1], '\n')+1;
+        if (k>0) viCount[k]=viCount[k-1]+vstLines[k-1]-1;
+    }
+    
+    auto fParse=[&](size_t k) {
+        vcsvSegment[k].parse_lines(vpcCut[k], vpcCut[k+1], aucClass, 
+                                   SIZE_MAX, vstLines[k], viCount[k], pbDim[k]);
+    };
+    
+    for(size_t k=1; k<stSegments; k++) 
+        vfTask.emplace_back(std::async(std::launch::async, fParse, k));
+    fParse(0);
+    
+    for(auto &fTask: vfTask) 
+        fTask.get();
+    
+    // stitch the segments in order
+    size_t stTotal=0;
+    for(size_t k=0; k<stSegments; k++) {
+        bDim&=pbDim[k];
+        stTotal+=vcsvSegment[k].stRows;
+    }
+    
+    stRows=0;
+    for(auto &csvSegment: vcsvSegment) {
+        if (csvSegment.vvColumn.empty()) continue;
+        
+        if (vvColumn.empty()) {
+            vvColumn=std::move(csvSegment.vvColumn);
+            vucParsed=csvSegment.vucParsed;
+            for(size_t j=0; j<vvColumn.size(); j++)
+                if (is_parsed(j)) vvColumn[j].reserve(stTotal);
+            vpcLine.reserve(stTotal);
+        }
+        else if (vvColumn.size()!=csvSegment.vvColumn.size()) {
+            bDim=false;
+            continue;
+        }
+        else
+            for(size_t j=0; j<vvColumn.size(); j++)
+                vvColumn[j].insert(vvColumn[j].end(), 
+                                   csvSegment.vvColumn[j].begin(), 
+                                   csvSegment.vvColumn[j].end());
+        
+        vpcLine.insert(vpcLine.end(), csvSegment.vpcLine.begin(), csvSegment.vpcLine.end());
+        stRows+=csvSegment.stRows;
+    }
+    bRows_valid=false;
+}
+
+template<typename _T> 
+bool _csv<_T>::check_read(bool bDim) {
+    bool bRes=true;
+    
+    if (!bDim || !check_dim()) {
+        error("read("+get_filename()+"): dimension error");
+        bRes=false;
+    }
+    if (!vsHeader.empty() && !vvColumn.empty()) {
+        if (vsHeader.size()!=vvColumn.size()) {
+            error("read("+get_filename()+
+                  "): header and data line mismatch");
+            bRes=false;
+        }
+    }
+    return bRes;
+}
+
 
 template<typename _T> 
 bool _csv<_T>::show() const{
-    bStatus=!this->vvData.empty();
+    bool bStatus=!this->empty();
     if (bStatus) {
+        parse_all();
         debug("showing data");
         std::cout << "\033[1;34m\u2022 \033[1;30m\033[0m data:\n";
         
@@ -233,7 +803,7 @@ bool _csv<_T>::show() const{
             std::string tmp;
             
             for(int j=0; j<iData_size_j; j++) 
-                table << std::setw(25) << get_data()[i][j] ;
+                table << std::setw(25) << vvColumn[j][i] ;
             
             table << "\n" ;
         }
@@ -248,8 +818,9 @@ bool _csv<_T>::show() const{
 template<typename _T> 
 bool _csv<_T>::show(int iiLine_stop) const {
 
-    bStatus=!this->vvData.empty();
+    bool bStatus=!this->empty();
     if (bStatus) {
+        parse_all();
         debug("showing data");
         std::cout << "\033[1;34m\u2022\033[0m data:\n";
 
@@ -267,11 +838,11 @@ bool _csv<_T>::show(int iiLine_stop) const {
         
         // *********** data
         size_t iData_size_j=get_data_size_j();
-        for(int i=0; i<iiLine_stop; i++) {
+        for(int i=0; i<iiLine_stop && i<get_data_size_i(); i++) {
             std::string tmp;
             
             for(int j=0; j<iData_size_j; j++) {
-                table << std::setw(25) << get_data()[i][j] ;
+                table << std::setw(25) << vvColumn[j][i] ;
             }
             table << "\n" ;
         }
@@ -288,72 +859,223 @@ template<typename _T>
 bool _csv<_T>::write() {
     bStatus=false;
     
-    if (!this->empty()) {
+    if (!this->empty() && _spb::is_spb(get_filename_out())) {
+        debug("writing spb data");
+        parse_all();
         
-        std::fstream f_out(get_filename_out(), std::ios::out);
+        // a crash never leaves a truncated output: write aside and rename
+        const std::string sOutput=get_filename_out()+".part";
         
-        if (f_out.is_open()) {
+        bStatus=_spb::write(sOutput, vsHeader, vvColumn, stRows) && 
+                std::rename(sOutput.c_str(), get_filename_out().c_str())==0;
+        if (!bStatus) {
+            error("write(): cannot write "+get_filename_out());
+            std::remove(sOutput.c_str());
+        }
+    }
+    else if (!this->empty()) {
+        
+        // the kept lines may live in the mapping of the input, and a crash 
+        // never leaves a truncated output: write aside and rename
+        const std::string sOutput=get_filename_out()+".part";
+        
+        _writer wOut;
+        
+        if (wOut.open(sOutput)) {
             debug("writing data");
             
-            char sep=get_separator();
+            bStatus=write_to(wOut, true);
+            bStatus&=wOut.close();
             
-            if (!vsHeader.empty()) {
-                
-                std::unique_ptr<std::vector<std::string> > Header(new std::vector<std::string>(vsHeader));
-                
-                for(auto h: *Header)
-                    f_out << h << sep;
-                f_out << "\n";
-            }
+            if (bStatus && std::rename(sOutput.c_str(), get_filename_out().c_str())!=0)
+                bStatus=false;
             
-            std::unique_ptr<std::vector<std::vector<_T> > >  Data(new std::vector<std::vector<_T> >(this->vvData));
-            for(auto g: *Data) {
-                for(auto v: g)
-                    f_out << v << sep;
-                f_out <<"\n";
+            if (!bStatus) {
+                error("write(): cannot write "+get_filename_out());
+                std::remove(sOutput.c_str());
             }
-            
-            f_out.close();
-            bStatus=true;
         }
         else
-            error("write(): cannot open "+get_filename());
+            error("write(): cannot open "+sOutput);
     }
     else bStatus=true;
     
     return bStatus;
 }
 
+template<typename _T> 
+bool _csv<_T>::write(_sink &skOut, std::function<void()> fDone) {
+    if (this->empty() || _spb::is_spb(get_filename_out())) {
+        if (!write()) return false;
+        if (fDone) fDone();
+        return true;
+    }
+    
+    bStatus=false;
+    
+    std::string sData;
+    _writer wOut;
+    
+    if (wOut.attach(sData)) {
+        debug("formatting data");
+        
+        bStatus=write_to(wOut, true);
+        bStatus&=wOut.close();
+        
+        // the sink writes name.part and renames it: the mapping of the input is safe
+        if (bStatus) 
+            skOut.put(get_filename_out(), std::move(sData), std::move(fDone));
+        else
+            error("write(): cannot format "+get_filename_out());
+    }
+    
+    return bStatus;
+}
+
+template<typename _T> 
+bool _csv<_T>::write_to(_writer &wOut, bool bHeader) const {
+    const char sep=get_separator();
+    
+    if (!vpcLine.empty() || !sHeader_line.empty()) {
+        // projection mode: source lines are copied, only modified tokens are formatted
+        if (bHeader && !sHeader_line.empty()) {
+            wOut.append(sHeader_line);
+            wOut.put('\n');
+        }
+        else if (bHeader && !vsHeader.empty()) {
+            for(auto &h: vsHeader) {
+                wOut.append(h);
+                wOut.put(sep);
+            }
+            wOut.put('\n');
+        }
+        
+        const bool bDirty=std::find(vucDirty.begin(), vucDirty.end(), 1)!=vucDirty.end();
+        
+        if (stRows==0 || vpcLine.empty()) 
+            return wOut.good();
+        
+        if (!bDirty) {
+            // consecutive lines are copied at once
+            const char *pcRun=vpcLine[0].first;
+            const char *pcRun_end=vpcLine[0].second;
+            for(size_t i=1; i<stRows; i++) {
+                if (vpcLine[i].first==pcRun_end+1) 
+                    pcRun_end=vpcLine[i].second;
+                else {
+                    wOut.append(pcRun, pcRun_end-pcRun);
+                    wOut.put('\n');
+                    pcRun=vpcLine[i].first;
+                    pcRun_end=vpcLine[i].second;
+                }
+            }
+            wOut.append(pcRun, pcRun_end-pcRun);
+            wOut.put('\n');
+        }
+        else {
+            const auto aucClass=sep_class(sep);
+            const size_t stMax=64+std::max(iPrecision, 0);
+            
+            for(size_t i=0; i<stRows; i++) {
+                const char *pcCopy=vpcLine[i].first;
+                size_t stCol=0;
+                
+                for_each_token(vpcLine[i].first, vpcLine[i].second, aucClass, [&](const char *pcFirst, const char *pcLast) {
+                    if (stCol<vucDirty.size() && vucDirty[stCol]) {
+                        wOut.append(pcCopy, pcFirst-pcCopy);
+                        char *pcOut=wOut.reserve(stMax);
+                        wOut.commit(to_chars(pcOut, pcOut+stMax, vvColumn[stCol][i])-pcOut);
+                        pcCopy=pcLast;
+                    }
+                    stCol++;
+                });
+                wOut.append(pcCopy, vpcLine[i].second-pcCopy);
+                wOut.put('\n');
+            }
+        }
+        return wOut.good();
+    }
+    
+    if (bHeader && !vsHeader.empty()) {
+        for(auto &h: vsHeader) {
+            wOut.append(h);
+            wOut.put(sep);
+        }
+        wOut.put('\n');
+    }
+    
+    // room for one formatted value and its separator
+    const size_t stMax=64+std::max(iPrecision, 0);
+    const size_t iData_size_j=get_data_size_j();
+    
+    for(size_t i=0; i<stRows; i++) {
+        for(size_t j=0; j<iData_size_j; j++) {
+            char *pcFirst=wOut.reserve(stMax);
+            char *pcLast=to_chars(pcFirst, pcFirst+stMax-1, vvColumn[j][i]);
+            *pcLast++=sep;
+            wOut.commit(pcLast-pcFirst);
+        }
+        wOut.put('\n');
+    }
+    
+    return wOut.good();
+}
+
+template<typename _T> 
+char* _csv<_T>::to_chars(char *pcFirst, char *pcLast, _T TVal) const {
+#ifdef HAS_TO_CHARS
+    std::to_chars_result tcRes=iPrecision<0 ? 
+        std::to_chars(pcFirst, pcLast, TVal) :
+        std::to_chars(pcFirst, pcLast, TVal, std::chars_format::general, iPrecision);
+    if (tcRes.ec==std::errc())
+        return tcRes.ptr;
+#endif
+    const int iDigits=iPrecision<0 ? std::numeric_limits<_T>::max_digits10 : iPrecision;
+    int iN=std::snprintf(pcFirst, pcLast-pcFirst, "%.*Lg", iDigits, static_cast<long double>(TVal));
+    if (iN<0) iN=0;
+    return pcFirst+std::min<size_t>(iN, pcLast-pcFirst-1);
+}
+
 template<typename _T> 
 const std::vector<_T> _csv<_T>::select_line(int line) const {
-    if (line<0 || line>get_data_size_i()) {
+    if (line<0 || line>=get_data_size_i()) {
         error("select_line(): invalid number of lines");
         return std::vector<_T>(0);
     }
     
     std::vector<_T> vvRes;
     
+    parse_all();
     size_t iData_size_j=get_data_size_j();
+    vvRes.reserve(iData_size_j);
     for(int j=0;j<iData_size_j;j++)
-        vvRes.emplace_back(vvData[line][j]);
+        vvRes.emplace_back(vvColumn[j][line]);
     
     return vvRes;    
 }
 
 template<typename _T> 
 const std::vector<_T> _csv<_T>::select_column(int col) const {
-    if (col<0 || col>get_data_size_j()) {
+    if (col<0 || col>=get_data_size_j()) {
         error("select_column(): invalid the number of columns");
         return std::vector<_T>(0);
     }
     
-    std::vector<_T> vvRes;
-    size_t iData_size_i=get_data_size_i();
+    parse_column(col);
+    return vvColumn[col];    
+}
+
+template<typename _T> 
+const std::vector<_T>& _csv<_T>::get_column(int iCol) const {
+    static const std::vector<_T> vEmpty;
     
-    for(int i=0;i<iData_size_i;i++)
-        vvRes.emplace_back(vvData[i][col]);
+    if (iCol<0 || iCol>=get_data_size_j()) {
+        error("get_column(): invalid the number of columns");
+        return vEmpty;
+    }
     
-    return vvRes;    
+    parse_column(iCol);
+    return vvColumn[iCol];    
 }
 
 template<typename _T> 
@@ -366,14 +1088,18 @@ const std::vector<std::vector<_T> > _csv<_T>::select(int iLine_min,
         iLine_max>get_data_size_i() ||  
         iCol_max>get_data_size_j()) {
         error("select(): invalid selection");
-        std::vector<std::vector<_T> >(0);
+        return std::vector<std::vector<_T> >(0);
     }
     
     std::vector<std::vector<_T> >vvRes;
     
-    for(int i=iLine_min;i<iLine_max;i++)
-        for(int j=iCol_min;i<iCol_max;j++)
-            vvRes.emplace_back(vvData[i][j]);
+    parse_all();
+    for(int i=iLine_min;i<iLine_max;i++) {
+        std::vector<_T> vLine;
+        for(int j=iCol_min;j<iCol_max;j++)
+            vLine.emplace_back(vvColumn[j][i]);
+        vvRes.emplace_back(vLine);
+    }
         
     return vvRes; 
 }
@@ -388,13 +1114,23 @@ bool _csv<_T>::set_data(const std::vector<std::vector<_T> > &vvData) {
         return bStatus;
     }
     
-    this->vvData=vvData;
+    drop_lines();
     
-//     if (this->check_dim()) {
-//         bStatus=false;
-//         error("set_data(): data dimensions mismatch");
-//         return bStatus;
-//     }
+    // transpose rows into column buffers
+    size_t iSize_i=vvData.size();
+    size_t iSize_j=vvData[0].size();
+    
+    this->vvColumn.assign(iSize_j, std::vector<_T>(iSize_i));
+    for(size_t i=0; i<iSize_i; i++) {
+        if (vvData[i].size()!=iSize_j) {
+            bStatus=false;
+            error("set_data(): data dimensions mismatch");
+        }
+        for(size_t j=0; j<iSize_j && j<vvData[i].size(); j++)
+            this->vvColumn[j][i]=vvData[i][j];
+    }
+    this->stRows=iSize_i;
+    this->bRows_valid=false;
     
     return bStatus;
 }
@@ -412,7 +1148,7 @@ bool _csv<_T>::set_column(const std::vector<_T>& vCol, int iCol) {
     size_t iSize_i=get_data_size_i();
     size_t iSize_j=get_data_size_j();
     
-    if (iCol>iSize_j) {
+    if (iCol<0 || iCol>=iSize_j) {
         error("set_column(): the number of columns out of range");
         return bStatus;
     }
@@ -422,8 +1158,9 @@ bool _csv<_T>::set_column(const std::vector<_T>& vCol, int iCol) {
         return bStatus;
     }
     else {
-        for(int i=0; i<iSize; i++)
-            this->vvData[i][iCol]=vCol[i];       
+        touch(iCol);
+        this->vvColumn[iCol]=vCol;
+        this->bRows_valid=false;
         
         bStatus=true;       
     }
@@ -444,7 +1181,17 @@ bool _csv<_T>::set_row(const std::vector<_T>& vRow, int iRow) {
     size_t iSize_i=get_data_size_i();
     size_t iSize_j=get_data_size_j();
     
-    if (iRow>iSize_i+1) {
+    // a new row has no source line
+    drop_lines();
+    
+    // an empty grid takes the dimension of its first row
+    if (iSize_j==0 && iRow==0) {
+        this->vvColumn.assign(iSize, std::vector<_T>(0));
+        iSize_j=iSize;
+        iRow=iSize_i+1;
+    }
+    
+    if (iRow<0 || iRow>iSize_i+1) {
         error("set_row(): invalid number of rows");
         return bStatus;
     }   
@@ -454,15 +1201,18 @@ bool _csv<_T>::set_row(const std::vector<_T>& vRow, int iRow) {
         return bStatus;
     }
     
-    if (iSize==iSize_j && iRow==iSize_i+1) {
-        this->vvData.emplace_back(vRow);
+    if (iRow==iSize_i+1 || iRow==iSize_i) {
+        for(size_t j=0; j<iSize_j; j++)
+            this->vvColumn[j].emplace_back(vRow[j]);
+        this->stRows++;
         bStatus=true;       
     }
-    
-    if (iSize==iSize_j && iRow<iSize_i) {
-        this->vvData[iRow]=vRow;       
+    else {
+        for(size_t j=0; j<iSize_j; j++)
+            this->vvColumn[j][iRow]=vRow[j];
         bStatus=true;       
     }
+    this->bRows_valid=false;
     
     return bStatus;
 }
@@ -474,6 +1224,7 @@ bool _csv<_T>::set_header(const std::vector<std::string> &iCol_name) {
     if (!iCol_name.empty()) {
         this->vsHeader.clear();
         this->vsHeader=iCol_name;
+        this->sHeader_line.clear();
         bStatus=true;
     }
     else
@@ -533,7 +1284,11 @@ bool _csv<_T>::set_separator(const char &sep) {
 template<typename _T> 
 bool _csv<_T>::set_separator(const std::string &sSep) {
     bStatus=true;
-    if (!sSep.empty() && sSep!="\0") {
+    if (sSep=="auto") {
+        debug("separator detected for each file");
+        set_sniff(true);
+    }
+    else if (!sSep.empty() && sSep!="\0") {
         debug("setting cSeparator: '"+sSep+"'");
         
         std::hash<std::string> shH; 
@@ -566,6 +1321,46 @@ void _csv<_T>::set_verbose(eVerbose evV) {
     evVerbose=evV;    
 }
 
+template<typename _T> 
+void _csv<_T>::set_precision(int iPrec) {
+    iPrecision=iPrec<0 ? -1 : iPrec;
+}
+
+template<typename _T> 
+int _csv<_T>::get_precision() const {
+    return iPrecision;
+}
+
+template<typename _T> 
+void _csv<_T>::set_sniff(bool bSniff) {
+    this->bSniff=bSniff;
+}
+
+template<typename _T> 
+bool _csv<_T>::get_sniff() const {
+    return bSniff;
+}
+
+template<typename _T> 
+void _csv<_T>::set_projection(const std::vector<int> &viCol) {
+    viProjection=viCol;
+}
+
+template<typename _T> 
+const std::vector<int>& _csv<_T>::get_projection() const {
+    return viProjection;
+}
+
+template<typename _T> 
+void _csv<_T>::set_threads(int iThr) {
+    iThreads=iThr<1 ? 1 : iThr;
+}
+
+template<typename _T> 
+int _csv<_T>::get_threads() const {
+    return iThreads;
+}
+
 template<typename _T>
 const std::string _csv<_T>::get_filename() const {
     return this->sFilename;
@@ -592,12 +1387,12 @@ const size_t _csv<_T>::get_header_size() const {
 
 template<typename _T>
 const size_t _csv<_T>::get_data_size_i() const {
-    return vvData.size();
+    return stRows;
 }
 
 template<typename _T>
 const size_t _csv<_T>::get_data_size_j() const {
-    return vvData[0].size();
+    return vvColumn.size();
 }
 
 template<typename _T>
@@ -605,6 +1400,17 @@ const std::vector<std::vector<_T> >& _csv<_T>::get_data() const {
     if (this->empty()) 
         error("get_data(): data are empty");    
     
+    // compatibility: rows are gathered from the columns on demand
+    if (!bRows_valid) {
+        parse_all();
+        size_t iData_size_j=get_data_size_j();
+        vvData.assign(stRows, std::vector<_T>(iData_size_j));
+        for(size_t j=0; j<iData_size_j; j++)
+            for(size_t i=0; i<stRows; i++)
+                vvData[i][j]=vvColumn[j][i];
+        bRows_valid=true;
+    }
+    
     return this->vvData;
 }
 
@@ -618,7 +1424,7 @@ const std::vector<std::string>& _csv<_T>::get_header() const {
 
 template<typename _T>
 bool _csv<_T>::empty() const {
-    return this->vvData.empty() || this->vvData[0].empty();
+    return this->stRows==0 || this->vvColumn.empty();
 }
 
 template<typename _T>
@@ -627,10 +1433,9 @@ bool _csv<_T>::check_dim() {
     
     if (!this->empty()) {
         bStatus=true;
-        size_t size=vvData.size()-2;
-        for (int i=0;i<size;i++) {
-            bStatus &= vvData[i].size()==vvData[i+1].size();
-        }
+        for(size_t j=0; j<vvColumn.size(); j++)
+            bStatus &= !is_parsed(j) || vvColumn[j].size()==stRows;
+        bStatus &= vpcLine.empty() || vpcLine.size()==stRows;
     }
     else 
         debug("check_dim(): data is empty");
@@ -656,7 +1461,8 @@ bool _csv<_T>::genrandspec(_T TMin, _T TMax, _T TStep) {
         size_t iPlimit=(TMax-TMin)/TStep;
         
         this->clear();
-        vvData.resize(iPlimit);
+        vvColumn.assign(2, std::vector<_T>(iPlimit));
+        stRows=iPlimit;
         
         std::vector<std::vector<_T> > vAtomicline;
         vAtomicline.reserve(iPlimit);
@@ -677,7 +1483,8 @@ bool _csv<_T>::genrandspec(_T TMin, _T TMax, _T TStep) {
             
             if (TFlux<0) TFlux=0;
     
-            this->vvData[i]={TLambda,TFlux};
+            this->vvColumn[0][i]=TLambda;
+            this->vvColumn[1][i]=TFlux;
         }
         bStatus=true;
     }
@@ -688,20 +1495,25 @@ template<typename _T>
 bool _csv<_T>::transform_lin(_T TA, _T TB, int iCol) {
     bStatus=true;
 
-    if (iCol<0 || iCol>get_data_size_j()) {
+    if (iCol<0 || iCol>=get_data_size_j()) {
         error("shift(): bad column selected");
         bStatus=false;
+        return bStatus;
     }
     
     debug("transform "
-          +std::to_string(vvData.size())
+          +std::to_string(stRows)
           +" values in the "
           +std::to_string(iCol)
           +"th column: X'=a*X+b="
           +std::to_string(TA)
           +"*X+"+std::to_string(TB));
     
-    std::for_each(vvData.begin(), vvData.end(), [&](std::vector<_T> &vV) { vV[iCol]=TA*vV[iCol]+TB; });
+    touch(iCol);
+    _T *pTCol=vvColumn[iCol].data();
+    for(size_t i=0; i<stRows; i++)
+        pTCol[i]=TA*pTCol[i]+TB;
+    bRows_valid=false;
     
     return bStatus;
 }
@@ -714,15 +1526,7 @@ bool _csv<_T>::shift(_T TVal) {
         debug("add "+std::to_string(TVal)+
               " to the first column");
 
-        std::vector<_T> vTmp(this->select_column(0));
-        
-        std::transform(vTmp.begin(), vTmp.end(),
-                       vTmp.begin(),
-                       std::bind(std::plus<_T>(), std::placeholders::_1, TVal));
-        
-        set_column(vTmp,0);
-        
-        bStatus=true;
+        bStatus=shift(TVal, 0);
     }
     else 
         debug("shift(): column is empty");    
@@ -733,29 +1537,21 @@ bool _csv<_T>::shift(_T TVal) {
 template<typename _T> 
 bool _csv<_T>::shift(_T TVal, int iCol) {
     bStatus=true;
-    if (iCol==0)
-        shift(TVal);
-    if (iCol==1) {
-        debug("add "+std::to_string(TVal)+" to the 2nd column");
-        this->data+=TVal;
-    }
-    if (iCol>1) {
-        if (iCol<get_data_size_j()) {
-            error("shift(): bad column selected");
-            bStatus=false;
-        }
-        else {
-            debug("add "+std::to_string(TVal)+" to the "+std::to_string(iCol)+" column");
-            
-            std::vector<_T> vTmp(this->select_column(iCol));
-            
-            std::transform(vTmp.begin(), vTmp.end(),
-                           vTmp.begin(),
-                           std::bind(std::plus<_T>(), std::placeholders::_1, TVal));
-            
-            set_column(vTmp,iCol);
-        }
+    
+    if (iCol<0 || iCol>=get_data_size_j()) {
+        error("shift(): bad column selected");
+        bStatus=false;
+        return bStatus;
     }
+    
+    debug("add "+std::to_string(TVal)+" to the "+std::to_string(iCol)+" column");
+    
+    touch(iCol);
+    _T *pTCol=vvColumn[iCol].data();
+    for(size_t i=0; i<stRows; i++)
+        pTCol[i]+=TVal;
+    bRows_valid=false;
+    
     return bStatus;
 }
 
@@ -763,17 +1559,17 @@ template<typename _T>
 bool _csv<_T>::apply_max_threshold(_T TVal) {
     bStatus=true;
     
-    size_t iPrev_size=get_data_size_i();
+    // a line is kept if all its values are <= TVal
+    parse_all();
+    vucMask.assign(stRows, 1);
+    unsigned char *pucMask=vucMask.data();
     
-    vvData.erase(std::remove_if( vvData.begin(),vvData.end(),
-    [&]( std::vector<_T> v){ 
-        for(auto vv: v) 
-            if (vv>TVal) return true; 
-                              
-        return false;
-    }),vvData.end());
-    
-    debug(std::to_string(static_cast<size_t>(get_data_size_i()-iPrev_size))+" line(s) erased");
+    for(auto &vCol: vvColumn) {
+        const _T *pCol=vCol.data();
+        for(size_t i=0; i<stRows; i++) 
+            pucMask[i]&=!(pCol[i]>TVal);
+    }
+    keep_rows();
     
     return bStatus;
 }
@@ -782,17 +1578,17 @@ template<typename _T>
 bool _csv<_T>::apply_min_threshold(_T TVal) {
     bStatus=true;
     
-    size_t iPrev_size=get_data_size_i();
-    
-    vvData.erase(std::remove_if( vvData.begin(), vvData.end(),
-    [&]( std::vector<_T> v){ 
-        for(auto vv: v) 
-            if (vv<TVal) return true; 
-                              
-        return false;
-    }),vvData.end());
+    // a line is kept if all its values are >= TVal
+    parse_all();
+    vucMask.assign(stRows, 1);
+    unsigned char *pucMask=vucMask.data();
     
-    debug(std::to_string(static_cast<size_t>(get_data_size_i()-iPrev_size))+" line(s) erased");
+    for(auto &vCol: vvColumn) {
+        const _T *pCol=vCol.data();
+        for(size_t i=0; i<stRows; i++) 
+            pucMask[i]&=!(pCol[i]<TVal);
+    }
+    keep_rows();
     
     return bStatus;
 }
@@ -801,63 +1597,108 @@ template<typename _T>
 bool _csv<_T>::apply_max_threshold(_T TVal, int iCol) {
     bStatus=true;
     
-    if (iCol<0 || iCol>get_data_size_j()) {
-        error("apply_min_threshold(): invalid column");
+    if (iCol<0 || iCol>=get_data_size_j()) {
+        error("apply_max_threshold(): invalid column");
         bStatus=false;
         return bStatus;
     }
     
-    size_t iPrev_size=get_data_size_i();
-    size_t iH_size=get_data_size_j();
+    parse_column(iCol);
+    vucMask.resize(stRows);
+    unsigned char *pucMask=vucMask.data();
+    const _T *pPred=vvColumn[iCol].data();
     
-    vvData.erase(std::remove_if( vvData.begin(),vvData.end(),
-    [&]( std::vector<_T> v){ 
-        for(int i=0;i<iH_size;i++) {
-            if (v[i]>TVal && i==iCol)
-                return true; 
-        }
-        
-        return false;
-    }),vvData.end());
-    
-    
-    debug(std::to_string(static_cast<size_t>(get_data_size_i()-iPrev_size))+" line(s) erased");
+    for(size_t i=0; i<stRows; i++) 
+        pucMask[i]=!(pPred[i]>TVal);
+    keep_rows();
     
     return bStatus;
 }
 
 template<typename _T> 
 bool _csv<_T>::apply_min_threshold(_T TVal, int iCol) {
-    
     bStatus=true;
-    if (iCol<0 || iCol>get_data_size_j()) {
+    
+    if (iCol<0 || iCol>=get_data_size_j()) {
         error("apply_min_threshold(): invalid column");
         bStatus=false;
         return bStatus;
     }
     
-    size_t iPrev_size=get_data_size_i();
-    size_t iH_size=get_data_size_j();
+    parse_column(iCol);
+    vucMask.resize(stRows);
+    unsigned char *pucMask=vucMask.data();
+    const _T *pPred=vvColumn[iCol].data();
     
-    vvData.erase(std::remove_if( vvData.begin(),vvData.end(),
-    [&]( std::vector<_T> v){ 
-        for(int i=0;i<iH_size;i++) {
-            if (v[i]<TVal && i==iCol)
-                return true; 
-        }
-        
-        return false;
-    }),vvData.end());
+    for(size_t i=0; i<stRows; i++) 
+        pucMask[i]=!(pPred[i]<TVal);
+    keep_rows();
     
-    debug(std::to_string(static_cast<size_t>(get_data_size_i()-iPrev_size))+" line(s) erased");
+    return bStatus;
+}
+
+template<typename _T> 
+bool _csv<_T>::apply_range_threshold(_T TMin, _T TMax, int iCol) {
+    bStatus=true;
+    
+    if (iCol<0 || iCol>=get_data_size_j()) {
+        error("apply_range_threshold(): invalid column");
+        bStatus=false;
+        return bStatus;
+    }
+    
+    parse_column(iCol);
+    vucMask.resize(stRows);
+    unsigned char *pucMask=vucMask.data();
+    const _T *pPred=vvColumn[iCol].data();
+    
+    for(size_t i=0; i<stRows; i++) 
+        pucMask[i]=!(pPred[i]<TMin) & !(pPred[i]>TMax);
+    keep_rows();
     
     return bStatus;
 }
 
+template<typename _T> 
+void _csv<_T>::keep_rows() {
+    const size_t stPrev=stRows;
+    const unsigned char *pucMask=vucMask.data();
+    
+    // rows before the first rejected one do not move
+    const size_t stFirst=std::find(pucMask, pucMask+stRows, 0)-pucMask;
+    if (stFirst==stRows) {
+        debug("0 line(s) erased");
+        return;
+    }
+    
+    // branchless compaction: each row is copied and kept if its mask is set
+    auto fCompact=[&](auto *pCol) {
+        size_t stK=stFirst;
+        for(size_t i=stFirst; i<stRows; i++) {
+            pCol[stK]=pCol[i];
+            stK+=pucMask[i];
+        }
+        return stK;
+    };
+    
+    size_t stKeep=stFirst;
+    for(size_t j=0; j<vvColumn.size(); j++) 
+        if (is_parsed(j)) stKeep=fCompact(vvColumn[j].data());
+    if (!vpcLine.empty()) 
+        stKeep=fCompact(vpcLine.data());
+    
+    resize_rows(stKeep);
+    
+    debug(std::to_string(stPrev-stKeep)+" line(s) erased");
+}
+
 template<typename _T> 
 void _csv<_T>::zeroize() {
     debug("zeroizing data");
-    std::fill(vvData.begin(), vvData.end(), 0);
+    drop_lines();
+    for(auto &vCol: vvColumn)
+        std::fill(vCol.begin(), vCol.end(), 0);
+    bRows_valid=false;
 }
 
 
@@ -865,7 +1706,78 @@ template<typename _T>
 void _csv<_T>::clear() {
     debug("deleting header and data");
     vsHeader.clear();
+    vvColumn.clear();
     vvData.clear();
+    vucParsed.clear();
+    vucDirty.clear();
+    vpcLine.clear();
+    pSource.reset();
+    sHeader_line.clear();
+    stRows=0;
+    bRows_valid=false;
+}
+
+template<typename _T> 
+void _csv<_T>::resize_rows(size_t stSize) {
+    for(size_t j=0; j<vvColumn.size(); j++)
+        if (is_parsed(j)) vvColumn[j].resize(stSize);
+    if (vpcLine.size()>stSize) 
+        vpcLine.resize(stSize);
+    stRows=stSize;
+    bRows_valid=false;
+}
+
+template<typename _T> 
+bool _csv<_T>::is_parsed(size_t j) const {
+    return vucParsed.empty() || vucParsed[j];
+}
+
+template<typename _T> 
+void _csv<_T>::parse_column(size_t j) const {
+    if (j>=vvColumn.size() || is_parsed(j)) return;
+    
+    debug("parsing column "+std::to_string(j));
+    
+    const auto aucClass=sep_class(get_separator());
+    std::vector<_T> &vCol=vvColumn[j];
+    vCol.assign(stRows, std::nan(""));
+    
+    for(size_t i=0; i<stRows && i<vpcLine.size(); i++) {
+        size_t stCol=0;
+        for_each_token(vpcLine[i].first, vpcLine[i].second, aucClass, [&](const char *pcFirst, const char *pcLast) {
+            if (stCol++!=j) return;
+            if (!to_value(pcFirst, pcLast, vCol[i]))
+                error("read("+get_filename()+"): '"+std::string(pcFirst, pcLast)+"' at row: "+std::to_string(i));
+        });
+    }
+    vucParsed[j]=1;
+    bRows_valid=false;
+}
+
+template<typename _T> 
+void _csv<_T>::parse_all() const {
+    for(size_t j=0; j<vvColumn.size(); j++) 
+        parse_column(j);
+}
+
+template<typename _T> 
+void _csv<_T>::touch(size_t j) {
+    parse_column(j);
+    if (!vpcLine.empty()) {
+        vucDirty.resize(vvColumn.size(), 0);
+        vucDirty[j]=1;
+    }
+    bRows_valid=false;
+}
+
+template<typename _T> 
+void _csv<_T>::drop_lines() {
+    parse_all();
+    vucParsed.clear();
+    vucDirty.clear();
+    vpcLine.clear();
+    pSource.reset();
+    sHeader_line.clear();
 }
 
 template<typename _T> 
@@ -897,8 +1809,10 @@ template<typename _T>
 bool _csv<_T>::operator==(const _csv& other) const {
     bool vvRes=true;
     
-    vvRes &= this->get_data() == other.get_data();
-    vvRes &= this->get_header() == other.get_header();
+    parse_all();
+    other.parse_all();
+    vvRes &= this->vvColumn == other.vvColumn;
+    vvRes &= this->vsHeader == other.vsHeader;
     vvRes &= this->get_separator()   == other.get_separator();
     vvRes &= this->get_filename() == other.get_filename();
     vvRes &= this->get_filename_out() == other.get_filename_out();
@@ -925,9 +1839,71 @@ void _csv<_T>::error(const std::string &msg) const {
 }
 
 template<typename _T> 
-bool _csv<_T>::is_float(const std::string &val) const {
-   std::string::const_iterator first(val.begin()), last(val.end());
-   return boost::spirit::qi::parse(first, last, boost::spirit::double_) && first == last;
+std::array<unsigned char, 256> _csv<_T>::sep_class(char cSep) const {
+    std::array<unsigned char, 256> aucClass;
+    aucClass.fill(0);
+    
+    aucClass[static_cast<unsigned char>(cSep)]=1;
+    aucClass[static_cast<unsigned char>('\r')]=1;
+    
+    // recover basic errors such as 'tab'==' '
+    if (cSep=='\t' || cSep==' ') {
+        aucClass[static_cast<unsigned char>('\t')]=1;
+        aucClass[static_cast<unsigned char>(' ')]=1;
+    }
+    return aucClass;
+}
+
+template<typename _T> 
+template<typename _F> 
+void _csv<_T>::for_each_token(const char *pcFirst, const char *pcLast, 
+                              const std::array<unsigned char, 256> &aucClass, _F fToken) const {
+    const char *pcC=pcFirst;
+    while (pcC<pcLast) {
+        while (pcC<pcLast && aucClass[static_cast<unsigned char>(*pcC)]) ++pcC;
+        if (pcC==pcLast) break;
+        
+        const char *pcToken=pcC;
+        while (pcC<pcLast && !aucClass[static_cast<unsigned char>(*pcC)]) ++pcC;
+        
+        fToken(pcToken, pcC);
+    }
+}
+
+template<typename _T> 
+bool _csv<_T>::to_value(const char *pcFirst, const char *pcLast, _T &TVal) const {
+    // from_chars does not accept an explicit '+'
+    if (pcFirst<pcLast && *pcFirst=='+') ++pcFirst;
+    if (pcFirst==pcLast) return false;
+    
+    if (cDecimal!='.') {
+        char acBuf[128];
+        size_t stLen=pcLast-pcFirst;
+        if (stLen>=sizeof(acBuf) || std::memchr(pcFirst, '.', stLen)!=nullptr) return false;
+        
+        std::replace_copy(pcFirst, pcLast, acBuf, cDecimal, '.');
+        acBuf[stLen]='\0';
+        
+        char *pcPtr=nullptr;
+        TVal=static_cast<_T>(std::strtold(acBuf, &pcPtr));
+        return pcPtr==acBuf+stLen;
+    }
+    
+#ifdef HAS_FROM_CHARS
+    auto [pcPtr, ecErr]=std::from_chars(pcFirst, pcLast, TVal);
+    return ecErr==std::errc() && pcPtr==pcLast;
+#else
+    char acBuf[128];
+    size_t stLen=pcLast-pcFirst;
+    if (stLen>=sizeof(acBuf)) return false;
+    
+    std::memcpy(acBuf, pcFirst, stLen);
+    acBuf[stLen]='\0';
+    
+    char *pcPtr=nullptr;
+    TVal=static_cast<_T>(std::strtold(acBuf, &pcPtr));
+    return pcPtr==acBuf+stLen;
+#endif
 }
 
 template<typename _T>
@@ -10,10 +10,11 @@
 #include <string>
 #include <cmath>
 #include <functional> 
+#include <memory>
 #include <thread>
-#include <future>
 #include <tuple>
 #include <chrono>
+#include <sstream>
 
 #include <boost/program_options.hpp>
 
@@ -46,10 +47,12 @@ namespace fs = boost::filesystem;
 #include <csv.h>
 #include <msg.h>
 #include <log.h>
+#include <snr.h>
 #include <der_snr.h>
 
 #define LOGFILE ".der_snr.log" /**< Define the default logfile  */
 #define HISTFILE ".history" /**< Define the default histfile (shared)  */
+#define SNR_CHUNK (1<<16) /**< Rows streamed at once by the approximate S/N */
 
 // Reference
 // ----------------------------------------------------
@@ -58,391 +61,165 @@ namespace fs = boost::filesystem;
 // 2008ASPC..394..505S
 // ----------------------------------------------------
 
-// Prototypes
-// ----------------------------------------------------
 /**
- * \fn void compute(const std::vector<std::string>& list, const std::string& sOutput)
- * \brief Compute S/N for all the string in the vector of strings. Default sep is tab. Used in the multithreaded mode. 
- * \param list list of files
- * \param sOutput output filename
+ * \struct _snr_param
+ * \brief What is measured in each spectrum: the S/N of the whole spectrum by default.
  */
-void compute(const std::vector<std::string>& list, const std::string& sOutput);
-
-/**
- * \fn void compute_sep(const std::vector<std::string>& list, const std::string& sOutput, const char& cSep)
- * \brief Compute S/N for all the string in the vector of strings. Used in the multithreaded mode.
- * \param list list of files
- * \param sOutput output filename
- * \param cSep char separator
- */
-void compute_sep(const std::vector<std::string>& list, const std::string& sOutput, const char& cSep);
-
-/**
- * \fn bool merge(const std::string &sPattern)
- * \brief Merge files from threads following a filename pattern, i.e. the given output name.
- * \param sPattern basename without ext
- */
-bool merge(const std::string &sPattern);
-
-/**
- * \fn bool write(std::vector<std::string> vsResults, const std::string& sOutput)
- * \brief Write on disk results with the default sep.
- * \param vsResults data to write
- * \param sOutput output filename
- */
-bool write(std::vector<std::string> vsResults, const std::string& sOutput);
+struct _snr_param {
+    size_t stWindow=0; /**< Points of the windows of the S/N profile, 0 for no profile */
+    size_t stStep=0; /**< Points between two windows of the profile */
+    std::vector<std::pair<float, float> > vpRegion; /**< Wavelength ranges whose S/N is measured */
+    double dApprox=0; /**< Relative accuracy of the approximate medians of a streamed spectrum, 0 for the exact S/N */
+};
 
+// Prototypes
+// ----------------------------------------------------
 /**
- * \fn bool write(std::vector<std::string> vsResults, const std::string& sOutput, const char& cSep)
- * \brief Write on disk results
- * \param vsResults data to write
- * \param sOutput output filename
- * \param cSep char separator
+ * \fn std::string compute_file(const std::string& sFile, char cSep, const std::shared_ptr<_mmap> &pFile=nullptr, const _snr_param &spParam=_snr_param())
+ * \brief Compute S/N of one file. The separator is detected if cSep is '\0'. pFile is the file already mapped by the read stage of the pipeline, if any.
+ * With a profile, one line per window with its central wavelength is returned. With regions, the line holds the S/N of each region.
+ * With approximate medians, the flux is streamed by SNR_CHUNK rows and never held whole in memory, and the line holds the bound of the relative error of the S/N after it.
+ * \return the result lines, empty if the file cannot be read
  */
-bool write(std::vector<std::string> vsResults, const std::string& sOutput, const char& cSep);
+std::string compute_file(const std::string& sFile, char cSep, const std::shared_ptr<_mmap> &pFile=nullptr, const _snr_param &spParam=_snr_param());
 
 /**
- * \fn float der_snr(const std::vector<float> &vFlux)
- * \brief Compute the S/N with der_snr method.
- * \param vFlux flux vector
- * \return -1 if error happens
+ * \fn bool parse_region(const std::string &sRegion, std::pair<float, float> &pRegion)
+ * \brief Read a wavelength range "min:max".
  */
-float der_snr(const std::vector<float> &vFlux);
-double der_snr(const std::vector<double> &vFlux);
+bool parse_region(const std::string &sRegion, std::pair<float, float> &pRegion);
 
 /**
- * \fn float median(const std::vector<float> &vFlux)
- * \brief Simple computation of the median
- * \param vFlux flux vector
- * \return 0 if error happens
+ * \fn bool read_regions(const std::string &sFile, std::vector<std::pair<float, float> > &vpRegion)
+ * \brief Append the ranges of sFile, one "min:max" or "min max" per line. Blank lines and lines starting with '#' are ignored.
+ * \return false if sFile cannot be opened or a line cannot be parsed
  */
-float median(const std::vector<float> &vFlux);
-double median(const std::vector<double> &vFlux);
+bool read_regions(const std::string &sFile, std::vector<std::pair<float, float> > &vpRegion);
 
 /**
- * \fn double long CPU_utilization()
- * \brief Get the CPU usage (%)
+ * \fn std::vector<std::string> columns(const _snr_param &spParam)
+ * \return Names of the fields of the result lines of compute_file()
  */
-double long CPU_utilization();
-
-std::tuple<double long, double long> get_stat();
+std::vector<std::string> columns(const _snr_param &spParam);
 
 // ----------------------------------------------------
 // ----------------------------------------------------
 
-void compute(const std::vector<std::string>& vsList, const std::string& sOutput) {
-
-    _msg msgM;
-    msgM.set_name("compute()");
-    msgM.set_threadname("compute");
-    msgM.set_log(LOGFILE);
-    
-#ifdef HAS_SYSCALL
-    msgM.msg(_msg::eMsg::THREADS, "compute S/N for", vsList.size(), "files");
-#else
-    msgM.msg(_msg::eMsg::MID, "compute S/N for", vsList.size(), "files\n";
-#endif
-    
-    std::vector<std::string> vsResults;
-    //vsResults.emplace_back("File\tSNR\n");
-    
-    for(auto sFile: vsList) {
-        
-        _csv<float> csv(sFile, '\t');
-        
-        if(csv.read()) {
-            
-            csv.set_verbose(_csv<float>::eVerbose::QUIET);
-            
-            vsResults.emplace_back(sFile+"\t"+std::to_string(der_snr(csv.select_column(1))) + "\n");
-        }
+std::string compute_file(const std::string& sFile, char cSep, const std::shared_ptr<_mmap> &pFile, const _snr_param &spParam) {
+    _csv<float> csv(sFile, cSep);
+    
+    if (spParam.dApprox>0) {
+        csv.set_verbose(_csv<float>::eVerbose::QUIET);
+        csv.set_projection({1});
+        
+        // the mapping of the read stage is streamed, its pages given back behind the chunks
+        _snr_sketch<float> ssSnr(spParam.dApprox);
+        bool bRes=csv.for_each_chunk(pFile, SNR_CHUNK, [&ssSnr](_csv<float> &csvChunk) {
+            const std::vector<float> &vFlux=csvChunk.get_column(1);
+            ssSnr.add(vFlux.data(), vFlux.size());
+            return true;
+        });
+        return bRes ? sFile+"\t"+std::to_string(ssSnr.get_snr())+"\t"+std::to_string(ssSnr.get_error())+"\n" : "";
     }
-    write(vsResults, sOutput);
-}
-
-void compute_sep(const std::vector<std::string>& vsList, const std::string& sOutput, const char& cSep) {
-    std::vector<std::string> vsResults;
-    
-    _msg msgM;
-    msgM.set_name("compute()");
-    msgM.set_threadname("compute");
-    msgM.set_log(LOGFILE);
-    
-#ifdef HAS_SYSCALL
-    msgM.msg(_msg::eMsg::THREADS, "compute S/N for", vsList.size(), "files");
-#else
-    msgM.msg(_msg::eMsg::MID, "compute S/N for", vsList.size(), "files\n";
-#endif
-    
-//     vsResults.emplace_back("File\tSNR\n");    
     
-    for(auto sFile: vsList) {
+    if(csv.read(pFile)) {
+        csv.set_verbose(_csv<float>::eVerbose::QUIET);
+        if (spParam.stWindow==0 && spParam.vpRegion.empty())
+            return sFile+"\t"+std::to_string(der_snr(csv.get_column(1))) + "\n";
         
-        _csv<float> csv(sFile, cSep);
+        const std::vector<float> &vWave=csv.get_column(0);
+        const std::vector<float> &vFlux=csv.get_column(1);
+        const size_t stN=std::min(vWave.size(), vFlux.size());
+        std::string sRes;
         
-        if(csv.read()) {
+        if (!spParam.vpRegion.empty()) {
+            std::vector<float> vSnr;
+            der_snr_regions(vWave.data(), vFlux.data(), stN, spParam.vpRegion, vSnr);
             
-            csv.set_verbose(_csv<float>::eVerbose::QUIET);
-            
-            vsResults.emplace_back(sFile+"\t"+std::to_string(der_snr(csv.select_column(1))) + "\n");
+            sRes=sFile;
+            for(float fSnr: vSnr)
+                sRes+="\t"+std::to_string(fSnr);
+            return sRes+"\n";
         }
-    }
-    write(vsResults, sOutput);
-}
-
-bool write(std::vector<std::string> vsResults, const std::string& sOutput) {
-    bool sStatus=true;
-    
-    std::fstream fFlux(sOutput, std::ios::out);
-    
-    if (fFlux) {
-        for(auto sS: vsResults)
-            fFlux << sS;
         
-        fFlux.close();
-    }
-    else {
-        _msg msgM;
-        msgM.set_name("write()");
-        msgM.set_log(LOGFILE);
+        std::vector<std::pair<float, float> > vpProfile;
+        der_snr_profile(vWave.data(), vFlux.data(), stN, spParam.stWindow, spParam.stStep, vpProfile);
         
-        msgM.msg(_msg::eMsg::ERROR, "cannot open", sOutput);
-        sStatus=false;
+        for(auto &pWindow: vpProfile)
+            sRes+=sFile+"\t"+std::to_string(pWindow.first)+"\t"+std::to_string(pWindow.second)+"\n";
+        return sRes;
     }
-    return sStatus;
+    return "";
 }
 
-bool merge(const std::string &sPattern) {
-    _msg msgM;
-    msgM.set_name("merge()");
-    msgM.set_log(LOGFILE);
-        
-    std::fstream fFlux0(sPattern, std::ios::out);
-    
-    if (fFlux0) {
-        int iCount=1;
-        fs::path pTmp("part"+std::to_string(iCount)+"_"+sPattern);
-        while(fs::exists(pTmp)) {
-            msgM.msg(_msg::eMsg::MID, "merge file", pTmp.string());
-            
-            std::fstream fFlux1(pTmp.string(), std::ios::in);
-            std::string sLine;
-            
-            while(std::getline(fFlux1, sLine))
-                fFlux0 << sLine << std::endl;
-            fFlux1.close();
-            
-            fs::remove(pTmp);
-            iCount++;
-            pTmp=fs::path("part"+std::to_string(iCount)+"_"+sPattern);
-        }
-        fFlux0.close();
-    }
-    else {
-        msgM.msg(_msg::eMsg::ERROR, "cannot open", sPattern);
+bool parse_region(const std::string &sRegion, std::pair<float, float> &pRegion) {
+    size_t stSep=sRegion.find(':');
+    if (stSep==std::string::npos)
         return false;
-    }
-    return true;    
-}
-
-float median(const std::vector<float> &vFlux) {    
-    int iSize=vFlux.size();
-    
-    if (iSize==0) {
-        _msg msgM;
-        msgM.set_name("median()");
-        msgM.set_log(LOGFILE);
-        msgM.msg(_msg::eMsg::MID, "error: flux is empty");
-        return 0;
-    }
-    
-    std::vector<float> vVec(vFlux);
-    std::sort(vVec.begin(), vVec.end());
     
-    if (iSize%2==0)     
-        return (vVec[iSize/2-1]+vVec[iSize/2])/2;
-    else
-        return vVec[iSize/2];
-}
-
-double median(const std::vector<double> &vFlux) {
-    int iSize=vFlux.size();
-    
-    if (iSize==0) {
-        _msg msgM;
-        msgM.set_name("median()");
-        msgM.set_log(LOGFILE);
-        msgM.msg(_msg::eMsg::MID, "error: flux is empty");
-        return 0;
+    try {
+        size_t stPos;
+        pRegion.first=std::stof(sRegion.substr(0, stSep), &stPos);
+        if (sRegion.find_first_not_of(" \t", stPos)!=stSep) return false;
+        
+        std::string sMax=sRegion.substr(stSep+1);
+        pRegion.second=std::stof(sMax, &stPos);
+        if (sMax.find_first_not_of(" \t", stPos)!=std::string::npos) return false;
     }
-    
-    std::vector<double> vVec(vFlux);
-    std::sort(vVec.begin(), vVec.end());
-    
-    if (iSize%2==0)
-        return (vVec[iSize/2-1]+vVec[iSize/2])/2;
-    else
-        return vVec[iSize/2];
-    
-    return 0;
-}
-
-
-float der_snr(const std::vector<float> &vFlux) {
-    if (vFlux.empty()) {
-        _msg msgM;
-        msgM.set_name("der_snr()");
-        msgM.set_log(LOGFILE);
-        msgM.msg(_msg::eMsg::MID, "error: flux is empty");
-        return 0;
+    catch (...) {
+        return false;
     }
     
-    if (vFlux.size()>4) {
-        std::vector<float> vNo0(vFlux);
-        
-        vNo0.erase(std::remove_if(vNo0.begin(), vNo0.end(), 
-                                   [&](float fF) { return fF<0; }),vNo0.end());
-        
-        int iSize=vNo0.size();
-        
-        std::vector<float> vSum; vSum.resize(iSize);
-        std::vector<float> vSum0=std::vector<float>(vNo0.begin()+2, vNo0.end()-2);
-        std::vector<float> vSum1=std::vector<float>(vNo0.begin()  , vNo0.end()-4);
-        std::vector<float> vSum2=std::vector<float>(vNo0.begin()+4, vNo0.end()  );
-        
-        // Sum1 = Sum1 + Sum2 
-        std::transform(vSum1.begin(), vSum1.end(), 
-                       vSum2.begin(), vSum1.begin(), 
-                       std::plus<float>());
-        
-        // Sum0 = 2*Sum0 
-        std::transform(vSum0.begin(), vSum0.end(), 
-                       vSum0.begin(),
-                       std::bind(std::multiplies<float>(), std::placeholders::_1, 2.0));
-        
-        // Sum0 = Sum0 - Sum1
-        std::transform(vSum0.begin(), vSum0.end(), 
-                       vSum1.begin(), vSum0.begin(), 
-                       std::minus<float>());
-        
-        // Sum0 = abs(Sum0)
-        std::for_each(vSum0.begin(), vSum0.end(), 
-                      [](float &fF) { fF=abs(fF);});
-        
-        float fNoise=1.482602/sqrt(6)*median(vSum0);
-        float fSignal=median(vNo0);
-        
-        return fSignal/fNoise;
-    }
-    return -1;
+    if (pRegion.first>pRegion.second)
+        std::swap(pRegion.first, pRegion.second);
+    return true;
 }
 
-double der_snr(const std::vector<double> &vFlux) {
-    if (vFlux.empty()) {
-        _msg msgM;
-        msgM.set_name("der_snr()");
-        msgM.set_log(LOGFILE);
-        
-        msgM.msg(_msg::eMsg::MID, "error: flux is empty");
-        return 0;
-    }
+bool read_regions(const std::string &sFile, std::vector<std::pair<float, float> > &vpRegion) {
+    std::ifstream ifFile(sFile);
+    if (!ifFile.is_open())
+        return false;
     
-    if (vFlux.size()>4) {
-        std::vector<double> vNo0(vFlux);
-        
-        vNo0.erase(std::remove_if(vNo0.begin(), vNo0.end(), 
-                                  [](float fF) { return fF<0.0; }), vNo0.end());
-        
-        std::vector<double> vSum0=std::vector<double>(vNo0.begin()+2, vNo0.end()-2);
-        std::vector<double> vSum1=std::vector<double>(vNo0.begin()  , vNo0.end()-4);
-        std::vector<double> vSum2=std::vector<double>(vNo0.begin()+4, vNo0.end()  );
-        
-        // Sum1 = Sum1 + Sum2 
-        std::transform(vSum1.begin(), vSum1.end(), 
-                       vSum2.begin(), vSum1.begin(), 
-                       std::plus<double>());
+    std::string sLine;
+    while (std::getline(ifFile, sLine)) {
+        if (!sLine.empty() && sLine.back()=='\r') sLine.pop_back();
         
-        // Sum0 = 2*Sum0 
-        std::transform(vSum0.begin(), vSum0.end(), 
-                       vSum0.begin(),
-                       std::bind(std::multiplies<double>(), std::placeholders::_1, 2));
+        size_t stFirst=sLine.find_first_not_of(" \t");
+        if (stFirst==std::string::npos || sLine[stFirst]=='#')
+            continue;
         
-        // Sum0 = Sum0 - Sum1
-        std::transform(vSum0.begin(), vSum0.end(), 
-                       vSum1.begin(), vSum0.begin(), 
-                       std::minus<double>());
-        
-        // Sum0 = abs(Sum0)
-        std::for_each(vSum0.begin(), vSum0.end(), 
-                      [](double &fF) { fF=abs(fF);});
-        
-        double fNoise=1.482602/sqrt(6)*median(vSum0);
-        double fSignal=median(vNo0);
+        // "min max" is read as "min:max"
+        std::string sRegion=sLine.substr(stFirst);
+        if (sRegion.find(':')==std::string::npos) {
+            size_t stSep=sRegion.find_first_of(" \t");
+            if (stSep!=std::string::npos)
+                sRegion[stSep]=':';
+        }
         
-        return fSignal/fNoise;
+        std::pair<float, float> pRegion;
+        if (!parse_region(sRegion, pRegion))
+            return false;
+        vpRegion.emplace_back(pRegion);
     }
-    return -1;
-}
-
-double long CPU_utilization() {
-     _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("CPU_utilization");
-    msgM.set_log(LOGFILE);
-        
-    auto [fTime_A, fIdle_A]=get_stat();
-    
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-    auto [fTime_B, fIdle_B]=get_stat();
-    
-    return 100.*(1.-((fIdle_B-fIdle_A)/(fTime_B-fTime_A)));
+    return true;
 }
 
-std::tuple<double long, double long>  get_stat() {
-    _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("get_stat");
-    msgM.set_log(LOGFILE);
-    
-    std::fstream sfCpu("/proc/stat", std::ios::in);
-    
-    if (sfCpu) {
-
-        std::string sLine;
-        std::getline(sfCpu, sLine);
-        
-        // erase "cpu"
-        sLine.erase(sLine.begin(), sLine.begin()+sLine.find_first_of("0123456789")); 
-        
-        // locate " " and push position into vec
-        std::vector<int> vPos;
-        std::vector<double long> vCol;
-        
-        vPos.push_back(0); 
-        
-        int iCount=0;
-        for(auto cC: sLine) {
-            if (cC==' ')
-                vPos.push_back(iCount);
-            iCount++;  
-        }
-        
-        // slice
-        for(int i=0; i<4; i++) {
-            std::string sVal=sLine.substr(vPos[i], vPos[i+1]-vPos[i]);
-            sVal.erase(std::remove(sVal.begin(), sVal.end(), ' '), sVal.end()); 
-            vCol.push_back(std::stod(sVal));
-        }
-        
-        sfCpu.close();
-                
-        return {static_cast<double long>(vCol[0]+vCol[1]+vCol[2]+vCol[3]), static_cast<double long>(vCol[3])};
+std::vector<std::string> columns(const _snr_param &spParam) {
+    if (spParam.stWindow>0)
+        return {"file", "wavelength", "snr"};
+    if (spParam.dApprox>0)
+        return {"file", "snr", "snr_error"};
+    if (spParam.vpRegion.empty())
+        return {"file", "snr"};
+    
+    // snr_4490_4510
+    std::vector<std::string> vsColumn={"file"};
+    for(auto &pRegion: spParam.vpRegion) {
+        std::ostringstream ossName;
+        ossName << "snr_" << pRegion.first << "_" << pRegion.second;
+        vsColumn.emplace_back(ossName.str());
     }
-    else 
-        msgM.msg(_msg::eMsg::ERROR, "cannot open /proc/stat");
-    
-    return {-1,1};
+    return vsColumn;
 }
 
 #endif // der_snr.h
@@ -0,0 +1,890 @@
+/**
+ * \file io.h
+ * \brief Low level file access shared by the csv reader and writer.
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _IO_H
+#define _IO_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+#include <functional>
+#include <mutex>
+
+#if __has_include (<sys/mman.h>) && __has_include (<sys/stat.h>) && __has_include (<fcntl.h>) && __has_include (<unistd.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAS_MMAP /**< POSIX mmap availability */
+#endif
+
+#if __has_include (<fcntl.h>) && __has_include (<unistd.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#define HAS_POSIX_IO /**< POSIX open/write availability */
+#endif
+
+// USE_URING is set by CMake when liburing is found
+#if defined(USE_URING) && __has_include (<liburing.h>) && defined(HAS_POSIX_IO)
+#include <liburing.h>
+#include <sys/stat.h>
+#define HAS_URING /**< io_uring availability for _source and _sink */
+#endif
+
+#define AIO_BATCH 32 /**< Files in flight in a _source or a _sink */
+#define AIO_MMAP_MIN (1<<26) /**< Files larger than this are mapped rather than read */
+#define AIO_IO_MAX (1<<30) /**< Largest single read or write request */
+
+/**
+ * \class _mmap
+ * \brief Read-only view of a whole file. The file is mapped in memory when mmap is available, otherwise it is loaded in a buffer.
+ */
+class _mmap {
+public:
+    explicit _mmap();
+
+    /**
+     * \fn explicit _mmap(const std::string &sFilename)
+     * \brief Map the file sFilename. Use is_open() to check the result.
+     */
+    explicit _mmap(const std::string &sFilename);
+
+    _mmap(const _mmap&)=delete;
+    _mmap& operator=(const _mmap&)=delete;
+
+    _mmap(_mmap &&other) noexcept;
+    _mmap& operator=(_mmap &&other) noexcept;
+
+    virtual ~_mmap();
+
+    /**
+     * \fn bool open(const std::string &sFilename)
+     * \brief Map the file sFilename. An empty file is a valid empty view.
+     * \return true if the file is readable
+     */
+    bool open(const std::string &sFilename);
+
+    /**
+     * \fn bool assign(std::string &&sData)
+     * \brief View the bytes of sData, e.g. a file read by a _source.
+     */
+    bool assign(std::string &&sData);
+
+    /**
+     * \fn void close()
+     * \brief Release the mapping.
+     */
+    void close();
+
+    bool is_open() const;
+
+    /**
+     * \fn void prefetch() const
+     * \brief Ask the kernel to read the whole mapping ahead and fault its pages in, so that a later scan does not wait for the disk. The pages of a mapping larger than AIO_MMAP_MIN are only read ahead in the page cache: they do not count in the memory of the process until they are scanned.
+     */
+    void prefetch() const;
+
+    /**
+     * \fn void release(size_t stFirst, size_t stLast) const
+     * \brief Give back the pages of the mapping between the offsets stFirst and stLast, e.g. once a stream has gone past them. They are read again from the page cache if needed.
+     */
+    void release(size_t stFirst, size_t stLast) const;
+
+    const char* data() const;
+    const char* end() const;
+    size_t size() const;
+
+private:
+    const char *pcData; /**< First byte of the view */
+    size_t stSize; /**< Size of the view */
+    bool bOpen;
+    bool bMapped; /**< True if pcData comes from mmap, false if it points to sBuffer */
+    std::string sBuffer; /**< Fallback storage when the file cannot be mapped */
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _mmap::_mmap(): pcData(nullptr), stSize(0), bOpen(false), bMapped(false) { }
+
+inline _mmap::_mmap(const std::string &sFilename): _mmap() {
+    open(sFilename);
+}
+
+inline _mmap::_mmap(_mmap &&other) noexcept:
+    pcData(other.pcData),
+    stSize(other.stSize),
+    bOpen(other.bOpen),
+    bMapped(other.bMapped),
+    sBuffer(std::move(other.sBuffer)) {
+    if (!bMapped) pcData=sBuffer.data();
+    other.pcData=nullptr;
+    other.stSize=0;
+    other.bOpen=false;
+    other.bMapped=false;
+}
+
+inline _mmap& _mmap::operator=(_mmap &&other) noexcept {
+    if (this!=&other) {
+        close();
+        pcData=other.pcData;
+        stSize=other.stSize;
+        bOpen=other.bOpen;
+        bMapped=other.bMapped;
+        sBuffer=std::move(other.sBuffer);
+        if (!bMapped) pcData=sBuffer.data();
+        other.pcData=nullptr;
+        other.stSize=0;
+        other.bOpen=false;
+        other.bMapped=false;
+    }
+    return *this;
+}
+
+inline _mmap::~_mmap() { close(); }
+
+inline bool _mmap::open(const std::string &sFilename) {
+    close();
+
+#ifdef HAS_MMAP
+    int iFd=::open(sFilename.c_str(), O_RDONLY);
+    if (iFd<0) return false;
+
+    struct stat sStat;
+    if (::fstat(iFd, &sStat)==0 && S_ISREG(sStat.st_mode)) {
+        stSize=static_cast<size_t>(sStat.st_size);
+
+        if (stSize==0) {
+            ::close(iFd);
+            bOpen=true;
+            return bOpen;
+        }
+
+        void *pMap=::mmap(nullptr, stSize, PROT_READ, MAP_PRIVATE, iFd, 0);
+        if (pMap!=MAP_FAILED) {
+            // the whole file is scanned once from the beginning
+            ::madvise(pMap, stSize, MADV_SEQUENTIAL);
+            ::close(iFd);
+            pcData=static_cast<const char*>(pMap);
+            bMapped=true;
+            bOpen=true;
+            return bOpen;
+        }
+    }
+    ::close(iFd);
+    stSize=0;
+#endif
+
+    // no mmap: load the file in a buffer
+    std::ifstream sfFlux(sFilename, std::ios::in | std::ios::binary);
+    if (!sfFlux) return false;
+
+    sBuffer.assign(std::istreambuf_iterator<char>(sfFlux), std::istreambuf_iterator<char>());
+    pcData=sBuffer.data();
+    stSize=sBuffer.size();
+    bOpen=true;
+
+    return bOpen;
+}
+
+inline bool _mmap::assign(std::string &&sData) {
+    close();
+
+    sBuffer=std::move(sData);
+    pcData=sBuffer.data();
+    stSize=sBuffer.size();
+    bOpen=true;
+
+    return bOpen;
+}
+
+inline void _mmap::close() {
+#ifdef HAS_MMAP
+    if (bMapped && pcData!=nullptr)
+        ::munmap(const_cast<char*>(pcData), stSize);
+#endif
+    sBuffer.clear();
+    sBuffer.shrink_to_fit();
+    pcData=nullptr;
+    stSize=0;
+    bOpen=false;
+    bMapped=false;
+}
+
+inline bool _mmap::is_open() const { return bOpen; }
+
+inline void _mmap::prefetch() const {
+#ifdef HAS_MMAP
+    if (!bMapped || stSize==0) return;
+
+    ::madvise(const_cast<char*>(pcData), stSize, MADV_WILLNEED);
+
+    // a large file is streamed: faulting it in would hold it all in memory
+    if (stSize>=AIO_MMAP_MIN) return;
+
+    // one read per page: the faults block this thread, not the parser
+    const size_t stPage=std::max(1L, ::sysconf(_SC_PAGESIZE));
+    volatile char cSink=0;
+    for(size_t st=0; st<stSize; st+=stPage)
+        cSink^=pcData[st];
+    (void)cSink;
+#endif
+}
+
+inline void _mmap::release(size_t stFirst, size_t stLast) const {
+#ifdef HAS_MMAP
+    if (!bMapped) return;
+
+    // whole pages only: the ends are still in use
+    const size_t stPage=std::max(1L, ::sysconf(_SC_PAGESIZE));
+    stFirst=(stFirst+stPage-1)/stPage*stPage;
+    stLast=std::min(stLast, stSize)/stPage*stPage;
+
+    if (stFirst<stLast)
+        ::madvise(const_cast<char*>(pcData)+stFirst, stLast-stFirst, MADV_DONTNEED);
+#endif
+}
+
+inline const char* _mmap::data() const { return pcData; }
+
+inline const char* _mmap::end() const { return pcData+stSize; }
+
+inline size_t _mmap::size() const { return stSize; }
+
+/**
+ * \class _writer
+ * \brief Buffered output file. Bytes are gathered in a large reusable buffer and flushed with a few big write(2) calls, or through an ofstream when POSIX I/O is not available.
+ */
+class _writer {
+public:
+    /**
+     * \fn explicit _writer(size_t stCapacity=1<<20)
+     * \param stCapacity Size of the buffer in bytes
+     */
+    explicit _writer(size_t stCapacity=1<<20);
+
+    _writer(const _writer&)=delete;
+    _writer& operator=(const _writer&)=delete;
+
+    virtual ~_writer();
+
+    /**
+     * \fn bool open(const std::string &sFilename)
+     * \brief Create or truncate sFilename.
+     * \return true if the file is writable
+     */
+    bool open(const std::string &sFilename);
+
+    /**
+     * \fn bool attach(std::string &sTarget)
+     * \brief Append the bytes to sTarget instead of a file, e.g. to hand them to a _sink.
+     */
+    bool attach(std::string &sTarget);
+
+    /**
+     * \fn bool close()
+     * \brief Flush the buffer and close the file.
+     * \return true if all the bytes have been written
+     */
+    bool close();
+
+    bool is_open() const;
+
+    /**
+     * \fn bool good() const
+     * \return false if a write has failed
+     */
+    bool good() const;
+
+    /**
+     * \fn char* reserve(size_t stN)
+     * \brief Make room for stN bytes and return where to write them. Call commit() with the number of bytes really written.
+     */
+    char* reserve(size_t stN);
+
+    void commit(size_t stN);
+
+    void put(char c);
+    void append(const char *pcData, size_t stN);
+    void append(const std::string &sS);
+
+    /**
+     * \fn bool flush()
+     * \brief Write the buffer on disk.
+     */
+    bool flush();
+
+private:
+    std::vector<char> vcBuffer; /**< Pending bytes */
+    size_t stFill; /**< Number of pending bytes */
+    int iFd; /**< File descriptor, -1 if closed */
+    std::ofstream sfOut; /**< Fallback stream when POSIX I/O is not available */
+    std::string *psTarget; /**< Memory target set by attach(), nullptr for a file */
+    bool bOpen;
+    bool bGood;
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _writer::_writer(size_t stCapacity): 
+    vcBuffer(stCapacity>0 ? stCapacity : 1), stFill(0), iFd(-1), psTarget(nullptr), bOpen(false), bGood(true) { }
+
+inline _writer::~_writer() { close(); }
+
+inline bool _writer::open(const std::string &sFilename) {
+    close();
+    bGood=true;
+
+#ifdef HAS_POSIX_IO
+    iFd=::open(sFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bOpen=iFd>=0;
+#else
+    sfOut.open(sFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+    bOpen=sfOut.is_open();
+#endif
+
+    return bOpen;
+}
+
+inline bool _writer::attach(std::string &sTarget) {
+    close();
+    bGood=true;
+
+    psTarget=&sTarget;
+    bOpen=true;
+
+    return bOpen;
+}
+
+inline bool _writer::close() {
+    if (!bOpen) return bGood;
+
+    flush();
+
+    if (psTarget) {
+        psTarget=nullptr;
+        bOpen=false;
+        return bGood;
+    }
+
+#ifdef HAS_POSIX_IO
+    if (::close(iFd)!=0) bGood=false;
+    iFd=-1;
+#else
+    sfOut.close();
+    if (!sfOut) bGood=false;
+#endif
+    bOpen=false;
+
+    return bGood;
+}
+
+inline bool _writer::is_open() const { return bOpen; }
+
+inline bool _writer::good() const { return bGood; }
+
+inline char* _writer::reserve(size_t stN) {
+    if (stFill+stN>vcBuffer.size()) {
+        flush();
+        if (stN>vcBuffer.size()) vcBuffer.resize(stN);
+    }
+    return vcBuffer.data()+stFill;
+}
+
+inline void _writer::commit(size_t stN) { stFill+=stN; }
+
+inline void _writer::put(char c) {
+    if (stFill==vcBuffer.size()) flush();
+    vcBuffer[stFill++]=c;
+}
+
+inline void _writer::append(const char *pcData, size_t stN) {
+    std::memcpy(reserve(stN), pcData, stN);
+    commit(stN);
+}
+
+inline void _writer::append(const std::string &sS) { append(sS.data(), sS.size()); }
+
+inline bool _writer::flush() {
+    if (!bOpen) {
+        stFill=0;
+        bGood=false;
+        return bGood;
+    }
+
+    if (psTarget) {
+        psTarget->append(vcBuffer.data(), stFill);
+        stFill=0;
+        return bGood;
+    }
+
+#ifdef HAS_POSIX_IO
+    const char *pcData=vcBuffer.data();
+    size_t stLeft=stFill;
+
+    while (stLeft>0) {
+        ssize_t sstN=::write(iFd, pcData, stLeft);
+        if (sstN<0) {
+            if (errno==EINTR) continue;
+            bGood=false;
+            break;
+        }
+        pcData+=sstN;
+        stLeft-=static_cast<size_t>(sstN);
+    }
+#else
+    sfOut.write(vcBuffer.data(), stFill);
+    if (!sfOut) bGood=false;
+#endif
+    stFill=0;
+
+    return bGood;
+}
+
+/**
+ * \class _source
+ * \brief Batch reader: the files of a batch are opened, sized, read and closed together. With io_uring all the requests of a step are in flight at once and the files land in preallocated buffers; otherwise each file is mapped and prefetched in turn. A ring which fails is shut down and the blocking path takes over.
+ */
+class _source {
+public:
+    /**
+     * \fn explicit _source(size_t stBatch=AIO_BATCH)
+     * \param stBatch Maximum number of requests in flight
+     */
+    explicit _source(size_t stBatch=AIO_BATCH);
+
+    _source(const _source&)=delete;
+    _source& operator=(const _source&)=delete;
+
+    virtual ~_source();
+
+    /**
+     * \fn std::vector<std::shared_ptr<_mmap> > read(const std::vector<std::string> &vsFile)
+     * \brief Read the files of vsFile. The views are in the same order, a file which cannot be read gives a view which is not open.
+     */
+    std::vector<std::shared_ptr<_mmap> > read(const std::vector<std::string> &vsFile);
+
+    /**
+     * \fn bool is_async() const
+     * \return true if the requests go through io_uring
+     */
+    bool is_async() const;
+
+private:
+    size_t stBatch;
+    bool bAsync;
+#ifdef HAS_URING
+    struct io_uring urRing;
+
+    bool read_batch(const std::vector<std::string> &vsFile, size_t stFirst, size_t stN,
+                    std::vector<std::shared_ptr<_mmap> > &vpView);
+#endif
+};
+
+/**
+ * \class _sink
+ * \brief Batch writer: put() queues the content of a file and flush() writes the queued files together, each one in name.part renamed at the end. With io_uring the opens and writes of a batch are in flight at once; otherwise a _writer is used for each file. A ring which fails is shut down and the blocking path takes over.
+ */
+class _sink {
+public:
+    /**
+     * \fn explicit _sink(size_t stBatch=AIO_BATCH)
+     * \param stBatch Number of queued files which triggers a flush
+     */
+    explicit _sink(size_t stBatch=AIO_BATCH);
+
+    _sink(const _sink&)=delete;
+    _sink& operator=(const _sink&)=delete;
+
+    /**
+     * \fn virtual ~_sink()
+     * \brief Flush the queued files.
+     */
+    virtual ~_sink();
+
+    /**
+     * \fn bool put(const std::string &sFilename, std::string &&sData, std::function<void()> fDone=nullptr)
+     * \brief Queue sData as the content of sFilename. The queue is flushed when it is full. fDone is called by the flush once the file is written and renamed, never if it fails.
+     * \return false if a flush has failed
+     */
+    bool put(const std::string &sFilename, std::string &&sData, std::function<void()> fDone=nullptr);
+
+    /**
+     * \fn bool flush()
+     * \brief Write the queued files.
+     * \return true if all of them have been written
+     */
+    bool flush();
+
+    size_t pending() const;
+
+    /**
+     * \fn size_t get_failed() const
+     * \return Number of files which could not be written since the creation of the sink
+     */
+    size_t get_failed() const;
+
+    bool is_async() const;
+
+private:
+    size_t stBatch;
+    size_t stFailed;
+    bool bAsync;
+    std::vector<std::pair<std::string, std::string> > vpFile; /**< Queued {name, content} */
+    std::vector<std::function<void()> > vfDone; /**< Called when the queued file of same index is on disk */
+#ifdef HAS_URING
+    struct io_uring urRing;
+
+    bool flush_batch(size_t stFirst, size_t stN, std::vector<unsigned char> &vucOk, bool &bDrained);
+#endif
+};
+
+#ifdef HAS_URING
+/**
+ * \fn inline bool uring_reap(struct io_uring &urRing, size_t stN, std::vector<int> &viRes, bool &bDrained)
+ * \brief Submit the stN queued requests and wait for the completions of all the submitted ones, even after a failed submit: they write in the buffers of the caller. An interrupted call is retried. viRes[i] gets the result of the request whose user data is i.
+ * \return false if the ring itself has failed: the caller shuts it down before its buffers go. bDrained is set false if submitted requests may still complete: their buffers must outlive the ring, see uring_keep()
+ */
+inline bool uring_reap(struct io_uring &urRing, size_t stN, std::vector<int> &viRes, bool &bDrained) {
+    bool bRes=true;
+    size_t stSubmitted=0;
+    while (stSubmitted<stN) {
+        const int iRet=io_uring_submit(&urRing);
+        if (iRet==-EINTR) continue;
+        if (iRet<=0) {
+            bRes=false;
+            break;
+        }
+        stSubmitted+=iRet;
+    }
+
+    for(size_t i=0; i<stSubmitted; ) {
+        struct io_uring_cqe *pCqe;
+        const int iRet=io_uring_wait_cqe(&urRing, &pCqe);
+        if (iRet==-EINTR) continue;
+        if (iRet<0) {
+            bDrained=false;
+            return false;
+        }
+
+        viRes[reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(pCqe))]=pCqe->res;
+        io_uring_cqe_seen(&urRing, pCqe);
+        i++;
+    }
+    return bRes;
+}
+
+/**
+ * \fn inline void uring_keep(std::shared_ptr<void> pBuffer)
+ * \brief Keep until the end of the process a buffer which the requests of a failed ring, not reaped, may still use.
+ */
+inline void uring_keep(std::shared_ptr<void> pBuffer) {
+    static std::mutex mKeep;
+    static std::vector<std::shared_ptr<void> > vpKeep;
+    std::lock_guard<std::mutex> lgLock(mKeep);
+    vpKeep.emplace_back(std::move(pBuffer));
+}
+#endif
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _source::_source(size_t stBatch): stBatch(std::max<size_t>(stBatch, 1)), bAsync(false) {
+#ifdef HAS_URING
+    // no io_uring in the kernel or forbidden by seccomp: blocking path
+    bAsync=io_uring_queue_init(this->stBatch, &urRing, 0)==0;
+#endif
+}
+
+inline _source::~_source() {
+#ifdef HAS_URING
+    if (bAsync) io_uring_queue_exit(&urRing);
+#endif
+}
+
+inline bool _source::is_async() const { return bAsync; }
+
+inline std::vector<std::shared_ptr<_mmap> > _source::read(const std::vector<std::string> &vsFile) {
+    std::vector<std::shared_ptr<_mmap> > vpView(vsFile.size());
+
+#ifdef HAS_URING
+    // a failed ring is shut down by read_batch(): the blocking path reads this batch and the next ones
+    for(size_t stFirst=0; bAsync && stFirst<vsFile.size(); stFirst+=stBatch)
+        read_batch(vsFile, stFirst, std::min(stBatch, vsFile.size()-stFirst), vpView);
+#endif
+
+    // blocking path, and the files left by the batches: large, special or failed
+    for(size_t i=0; i<vsFile.size(); i++)
+        if (!vpView[i]) {
+            vpView[i]=std::make_shared<_mmap>(vsFile[i]);
+            if (vpView[i]->is_open())
+                vpView[i]->prefetch();
+        }
+
+    return vpView;
+}
+
+#ifdef HAS_URING
+inline bool _source::read_batch(const std::vector<std::string> &vsFile, size_t stFirst, size_t stN,
+                                std::vector<std::shared_ptr<_mmap> > &vpView) {
+    std::vector<int> viFd(stN, -1);
+    std::vector<int> viRes(stN, -1);
+    std::vector<struct statx> vstxSize(stN);
+    std::vector<std::string> vsData(stN);
+    std::vector<size_t> vstDone(stN, 0);
+    std::vector<unsigned char> vucRead(stN, 0);
+    bool bDrained=true;
+
+    // open
+    for(size_t i=0; i<stN; i++) {
+        struct io_uring_sqe *pSqe=io_uring_get_sqe(&urRing);
+        io_uring_prep_openat(pSqe, AT_FDCWD, vsFile[stFirst+i].c_str(), O_RDONLY | O_CLOEXEC, 0);
+        io_uring_sqe_set_data(pSqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+    }
+    bool bRing=uring_reap(urRing, stN, viRes, bDrained);
+
+    // every descriptor reaped is closed at the end, whatever happens to the ring
+    for(size_t i=0; i<stN; i++)
+        if (viRes[i]>=0)
+            viFd[i]=viRes[i];
+
+    // size
+    size_t stSubmit=0;
+    for(size_t i=0; bRing && i<stN; i++) {
+        if (viFd[i]<0) continue;
+
+        struct io_uring_sqe *pSqe=io_uring_get_sqe(&urRing);
+        io_uring_prep_statx(pSqe, viFd[i], "", AT_EMPTY_PATH, STATX_SIZE | STATX_TYPE, &vstxSize[i]);
+        io_uring_sqe_set_data(pSqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+        stSubmit++;
+    }
+    std::fill(viRes.begin(), viRes.end(), -1);
+    bRing=bRing && uring_reap(urRing, stSubmit, viRes, bDrained);
+
+    for(size_t i=0; bRing && i<stN; i++)
+        if (viFd[i]>=0 && viRes[i]==0 && S_ISREG(vstxSize[i].stx_mode) && vstxSize[i].stx_size<AIO_MMAP_MIN) {
+            vsData[i].resize(vstxSize[i].stx_size);
+            vucRead[i]=1;
+        }
+
+    // read, again for the short reads
+    while (bRing) {
+        stSubmit=0;
+        for(size_t i=0; i<stN; i++) {
+            if (!vucRead[i] || vstDone[i]==vsData[i].size()) continue;
+
+            struct io_uring_sqe *pSqe=io_uring_get_sqe(&urRing);
+            io_uring_prep_read(pSqe, viFd[i], &vsData[i][vstDone[i]],
+                               std::min<size_t>(vsData[i].size()-vstDone[i], AIO_IO_MAX), vstDone[i]);
+            io_uring_sqe_set_data(pSqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+            stSubmit++;
+        }
+        if (stSubmit==0) break;
+
+        std::fill(viRes.begin(), viRes.end(), 0);
+        bRing=uring_reap(urRing, stSubmit, viRes, bDrained);
+
+        for(size_t i=0; bRing && i<stN; i++) {
+            if (!vucRead[i] || vstDone[i]==vsData[i].size()) continue;
+
+            if (viRes[i]<0)
+                vucRead[i]=0;
+            // the file has shrunk since statx
+            else if (viRes[i]==0)
+                vsData[i].resize(vstDone[i]);
+            else
+                vstDone[i]+=viRes[i];
+        }
+    }
+
+    // close: a plain close(2), never left in doubt by a failed ring
+    for(size_t i=0; i<stN; i++)
+        if (viFd[i]>=0)
+            ::close(viFd[i]);
+
+    // shut down while the buffers are alive: the requests still in flight keep theirs, and the opens not reaped their descriptor
+    if (!bRing) {
+        io_uring_queue_exit(&urRing);
+        bAsync=false;
+        if (!bDrained) {
+            uring_keep(std::make_shared<std::vector<struct statx> >(std::move(vstxSize)));
+            uring_keep(std::make_shared<std::vector<std::string> >(std::move(vsData)));
+        }
+    }
+
+    // a failed ring leaves the whole batch to the blocking path
+    for(size_t i=0; bRing && i<stN; i++)
+        if (vucRead[i]) {
+            vpView[stFirst+i]=std::make_shared<_mmap>();
+            vpView[stFirst+i]->assign(std::move(vsData[i]));
+        }
+
+    return bRing;
+}
+#endif
+
+// ----------------------------------------------------
+
+inline _sink::_sink(size_t stBatch): stBatch(std::max<size_t>(stBatch, 1)), stFailed(0), bAsync(false) {
+#ifdef HAS_URING
+    bAsync=io_uring_queue_init(this->stBatch, &urRing, 0)==0;
+#endif
+}
+
+inline _sink::~_sink() {
+    flush();
+#ifdef HAS_URING
+    if (bAsync) io_uring_queue_exit(&urRing);
+#endif
+}
+
+inline bool _sink::put(const std::string &sFilename, std::string &&sData, std::function<void()> fDone) {
+    vpFile.emplace_back(sFilename, std::move(sData));
+    vfDone.push_back(std::move(fDone));
+
+    if (vpFile.size()>=stBatch)
+        return flush();
+    return true;
+}
+
+inline size_t _sink::pending() const { return vpFile.size(); }
+
+inline size_t _sink::get_failed() const { return stFailed; }
+
+inline bool _sink::is_async() const { return bAsync; }
+
+inline bool _sink::flush() {
+    if (vpFile.empty()) return true;
+
+    std::vector<unsigned char> vucOk(vpFile.size(), 0);
+    bool bDrained=true;
+
+#ifdef HAS_URING
+    // a failed ring is shut down by flush_batch(): the blocking path writes this batch and the next ones
+    for(size_t stFirst=0; bAsync && stFirst<vpFile.size(); stFirst+=stBatch)
+        flush_batch(stFirst, std::min(stBatch, vpFile.size()-stFirst), vucOk, bDrained);
+#endif
+
+    size_t stFailed_now=0;
+
+    for(size_t i=0; i<vpFile.size(); i++) {
+        const std::string sTmp=vpFile[i].first+".part";
+
+        // blocking path, and the files left by a failed batch
+        if (!vucOk[i]) {
+            _writer wOut;
+            vucOk[i]=wOut.open(sTmp);
+            if (vucOk[i]) {
+                wOut.append(vpFile[i].second);
+                vucOk[i]=wOut.close();
+            }
+        }
+
+        if (!vucOk[i] || std::rename(sTmp.c_str(), vpFile[i].first.c_str())!=0) {
+            std::remove(sTmp.c_str());
+            stFailed_now++;
+        }
+        else if (vfDone[i])
+            vfDone[i]();
+    }
+#ifdef HAS_URING
+    // the writes of a failed ring not reaped may still read the contents
+    if (!bDrained)
+        uring_keep(std::make_shared<std::vector<std::pair<std::string, std::string> > >(std::move(vpFile)));
+#endif
+    vpFile.clear();
+    vfDone.clear();
+    stFailed+=stFailed_now;
+
+    return stFailed_now==0;
+}
+
+#ifdef HAS_URING
+inline bool _sink::flush_batch(size_t stFirst, size_t stN, std::vector<unsigned char> &vucOk, bool &bDrained) {
+    std::vector<int> viFd(stN, -1);
+    std::vector<int> viRes(stN, -1);
+    std::vector<size_t> vstDone(stN, 0);
+    std::vector<std::string> vsTmp(stN);
+
+    // open
+    for(size_t i=0; i<stN; i++) {
+        vsTmp[i]=vpFile[stFirst+i].first+".part";
+
+        struct io_uring_sqe *pSqe=io_uring_get_sqe(&urRing);
+        io_uring_prep_openat(pSqe, AT_FDCWD, vsTmp[i].c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        io_uring_sqe_set_data(pSqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+    }
+    bool bRing=uring_reap(urRing, stN, viRes, bDrained);
+
+    // every descriptor reaped is closed at the end, whatever happens to the ring
+    for(size_t i=0; i<stN; i++)
+        if (viRes[i]>=0) {
+            viFd[i]=viRes[i];
+            vucOk[stFirst+i]=1;
+        }
+
+    // write, again for the short writes
+    while (bRing) {
+        size_t stSubmit=0;
+        for(size_t i=0; i<stN; i++) {
+            const std::string &sData=vpFile[stFirst+i].second;
+            if (!vucOk[stFirst+i] || vstDone[i]==sData.size()) continue;
+
+            struct io_uring_sqe *pSqe=io_uring_get_sqe(&urRing);
+            io_uring_prep_write(pSqe, viFd[i], sData.data()+vstDone[i],
+                                std::min<size_t>(sData.size()-vstDone[i], AIO_IO_MAX), vstDone[i]);
+            io_uring_sqe_set_data(pSqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+            stSubmit++;
+        }
+        if (stSubmit==0) break;
+
+        std::fill(viRes.begin(), viRes.end(), 0);
+        bRing=uring_reap(urRing, stSubmit, viRes, bDrained);
+
+        for(size_t i=0; bRing && i<stN; i++) {
+            const std::string &sData=vpFile[stFirst+i].second;
+            if (!vucOk[stFirst+i] || vstDone[i]==sData.size()) continue;
+
+            if (viRes[i]<=0)
+                vucOk[stFirst+i]=0;
+            else
+                vstDone[i]+=viRes[i];
+        }
+    }
+
+    // close: a plain close(2), a delayed write error fails the file
+    for(size_t i=0; i<stN; i++)
+        if (viFd[i]>=0 && ::close(viFd[i])!=0)
+            vucOk[stFirst+i]=0;
+
+    // shut down while the contents are alive, then the whole batch is left to the blocking path
+    if (!bRing) {
+        io_uring_queue_exit(&urRing);
+        bAsync=false;
+        for(size_t i=0; i<stN; i++) {
+            vucOk[stFirst+i]=0;
+            // a late write goes to the file unlinked, not to the one written again
+            if (!bDrained)
+                std::remove(vsTmp[i].c_str());
+        }
+    }
+
+    return bRing;
+}
+#endif
+
+#endif // _IO_H
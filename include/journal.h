@@ -0,0 +1,230 @@
+/**
+ * \file journal.h
+ * \brief Append-only journal of the files completed by a batch run.
+ *
+ * Each completed input is appended as one line. The lines are buffered and
+ * written with a single write() followed by fdatasync() every JOURNAL_BATCH
+ * entries or JOURNAL_PERIOD ms, so that a run killed at any time loses at
+ * most the last batch. A truncated last line is ignored when the journal is
+ * read back by a resumed run.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <iterator>
+#include <unordered_set>
+#include <mutex>
+#include <chrono>
+
+#if __has_include (<fcntl.h>) && __has_include (<unistd.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#define HAS_POSIX_IO /**< POSIX open/write availability */
+#endif
+
+#define JOURNAL_FILE ".journal" /**< Journal kept in an output directory */
+#define JOURNAL_BATCH 256 /**< Entries written and synced together */
+#define JOURNAL_PERIOD 1000 /**< Longest delay (ms) before the entries are synced */
+
+/**
+ * \class _journal
+ * \brief Journal of the completed inputs. add() and is_done() may be called from several threads.
+ */
+class _journal {
+public:
+    _journal();
+
+    _journal(const _journal&)=delete;
+    _journal& operator=(const _journal&)=delete;
+
+    virtual ~_journal();
+
+    /**
+     * \fn bool open(const std::string &sFilename, bool bResume)
+     * \brief Open the journal sFilename. If bResume, the entries already there are read back, otherwise the journal is emptied.
+     */
+    bool open(const std::string &sFilename, bool bResume);
+
+    /**
+     * \fn bool close()
+     * \brief Write and sync the pending entries, then close the journal.
+     */
+    bool close();
+
+    /**
+     * \fn bool add(const std::string &sIn)
+     * \brief Record sIn as completed. The entries are synced by batch.
+     */
+    bool add(const std::string &sIn);
+
+    /**
+     * \fn bool sync()
+     * \brief Write and sync the pending entries now.
+     */
+    bool sync();
+
+    /**
+     * \fn bool is_done(const std::string &sIn) const
+     * \return true if sIn was completed by a previous run
+     */
+    bool is_done(const std::string &sIn) const;
+
+    /**
+     * \fn size_t get_done() const
+     * \return Number of entries read back by open()
+     */
+    size_t get_done() const;
+
+    const std::string& get_filename() const { return sFilename; }
+
+private:
+    std::string sFilename;
+    std::unordered_set<std::string> usDone;
+    std::string sPending;
+    size_t stPending;
+    std::chrono::steady_clock::time_point tpSync;
+    bool bStatus;
+    mutable std::mutex mMutex;
+
+#ifdef HAS_POSIX_IO
+    int iFd;
+#else
+    std::ofstream ofFile;
+#endif
+
+    bool sync_locked();
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _journal::_journal():
+    stPending(0), tpSync(std::chrono::steady_clock::now()), bStatus(true)
+#ifdef HAS_POSIX_IO
+    , iFd(-1)
+#endif
+{ }
+
+inline _journal::~_journal() {
+    close();
+}
+
+inline bool _journal::open(const std::string &sFilename, bool bResume) {
+    close();
+
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    this->sFilename=sFilename;
+    usDone.clear();
+    bStatus=true;
+
+    if (bResume) {
+        std::ifstream ifFile(sFilename, std::ios::binary);
+        std::string sContent((std::istreambuf_iterator<char>(ifFile)), std::istreambuf_iterator<char>());
+
+        // the last line may have been cut by the crash
+        size_t stBegin=0, stEnd;
+        while ((stEnd=sContent.find('\n', stBegin))!=std::string::npos) {
+            if (stEnd>stBegin)
+                usDone.emplace(sContent, stBegin, stEnd-stBegin);
+            stBegin=stEnd+1;
+        }
+
+        // the cut line is dropped so that the next entry starts a line
+        if (stBegin<sContent.size()) {
+#ifdef HAS_POSIX_IO
+            if (::truncate(sFilename.c_str(), stBegin)!=0)
+                return false;
+#else
+            std::ofstream ofCut(sFilename, std::ios::trunc | std::ios::binary);
+            if (!ofCut.write(sContent.data(), stBegin))
+                return false;
+#endif
+        }
+    }
+
+#ifdef HAS_POSIX_IO
+    iFd=::open(sFilename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (bResume ? 0 : O_TRUNC), 0644);
+    return iFd>=0;
+#else
+    ofFile.open(sFilename, bResume ? std::ios::app : std::ios::trunc);
+    return ofFile.is_open();
+#endif
+}
+
+inline bool _journal::close() {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    bool bRes=sync_locked();
+
+#ifdef HAS_POSIX_IO
+    if (iFd>=0) {
+        bRes&=::close(iFd)==0;
+        iFd=-1;
+    }
+#else
+    if (ofFile.is_open())
+        ofFile.close();
+#endif
+    return bRes && bStatus;
+}
+
+inline bool _journal::add(const std::string &sIn) {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    sPending+=sIn;
+    sPending+='\n';
+    stPending++;
+
+    if (stPending>=JOURNAL_BATCH ||
+        std::chrono::steady_clock::now()-tpSync>=std::chrono::milliseconds(JOURNAL_PERIOD))
+        return sync_locked();
+    return true;
+}
+
+inline bool _journal::sync() {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    return sync_locked();
+}
+
+inline bool _journal::is_done(const std::string &sIn) const {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    return usDone.count(sIn)>0;
+}
+
+inline size_t _journal::get_done() const {
+    std::lock_guard<std::mutex> lgLock(mMutex);
+    return usDone.size();
+}
+
+inline bool _journal::sync_locked() {
+    tpSync=std::chrono::steady_clock::now();
+    if (sPending.empty())
+        return true;
+
+    bool bRes;
+#ifdef HAS_POSIX_IO
+    bRes=iFd>=0;
+    size_t stDone=0;
+    while (bRes && stDone<sPending.size()) {
+        ssize_t ssN=::write(iFd, sPending.data()+stDone, sPending.size()-stDone);
+        if (ssN<0) bRes=false;
+        else stDone+=ssN;
+    }
+    bRes=bRes && ::fdatasync(iFd)==0;
+#else
+    bRes=ofFile.is_open() && ofFile.write(sPending.data(), sPending.size()).flush();
+#endif
+
+    sPending.clear();
+    stPending=0;
+    bStatus&=bRes;
+    return bRes;
+}
+
+#endif // _JOURNAL_H
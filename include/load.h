@@ -0,0 +1,380 @@
+/**
+ * \file load.h
+ * \brief Concurrency controller of the batch tools.
+ *
+ * The number of usable CPUs is bounded by the affinity mask of the process
+ * and by the cgroup CPU quota (v2 cpu.max or v1 cpu.cfs_quota_us) of the
+ * cgroup of the process and of its ancestors, the smallest one wins. During a
+ * run, a sampler thread reads /proc/stat and the CPU time of the process to
+ * estimate the load of the other processes, and resizes the number of active
+ * workers so that the machine load stays below a given percentage.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _LOAD_H
+#define _LOAD_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cmath>
+
+#if __has_include (<sched.h>) && __has_include (<sys/resource.h>) && __has_include (<unistd.h>)
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#define HAS_SCHED /**< sched_getaffinity, getrusage and sysconf availability */
+#endif
+
+#define LOAD_PERIOD 500 /**< Sampling period of the load in ms */
+
+/**
+ * \class _load
+ * \brief Bound and adapt the number of worker threads to the CPUs available to the process.
+ */
+class _load {
+public:
+    /**
+     * \fn explicit _load(int iThreads=0, double dMax_load=100)
+     * \brief iThreads is the maximum number of workers, 0 for all the available CPUs. dMax_load is the machine load (%) not to exceed.
+     */
+    explicit _load(int iThreads=0, double dMax_load=100);
+
+    _load(const _load&)=delete;
+    _load& operator=(const _load&)=delete;
+
+    virtual ~_load();
+
+    /**
+     * \fn void start(std::function<void(int)> fSet)
+     * \brief Start the sampler: fSet is called with the new number of active workers each time it changes.
+     */
+    void start(std::function<void(int)> fSet);
+
+    /**
+     * \fn void stop()
+     * \brief Stop the sampler.
+     */
+    void stop();
+
+    /**
+     * \fn int get_max() const
+     * \return Maximum number of workers
+     */
+    int get_max() const;
+
+    int get_active() const;
+
+    /**
+     * \fn double get_load() const
+     * \return Last machine load sampled (%), -1 before the first sample
+     */
+    double get_load() const;
+
+    /**
+     * \fn static int available()
+     * \return Number of CPUs usable by the process: affinity mask and cgroup quota
+     */
+    static int available();
+
+    /**
+     * \fn static int affinity()
+     * \return Number of CPUs in the affinity mask of the process
+     */
+    static int affinity();
+
+    /**
+     * \fn static double quota(const std::string &sRoot="/sys/fs/cgroup", const std::string &sSelf="/proc/self/cgroup")
+     * \brief Look for the quota of the cgroup of the process, listed in sSelf, and of its ancestors under the mount point sRoot.
+     * \return CPUs allowed by the smallest cgroup quota, 0 if there is no quota
+     */
+    static double quota(const std::string &sRoot="/sys/fs/cgroup", const std::string &sSelf="/proc/self/cgroup");
+
+    /**
+     * \fn static std::tuple<std::string, std::string> parse_cgroup(std::istream &isCgroup)
+     * \brief Parse a /proc/self/cgroup file: "0::/path" for v2, "N:cpu,cpuacct:/path" for the v1 cpu controller.
+     * \return {v2 path, v1 cpu path}, empty if not found
+     */
+    static std::tuple<std::string, std::string> parse_cgroup(std::istream &isCgroup);
+
+    /**
+     * \fn static double parse_cpu_max(const std::string &sLine)
+     * \brief Parse a cgroup v2 cpu.max line: "max 100000" or "200000 100000".
+     * \return CPUs allowed, 0 if there is no quota
+     */
+    static double parse_cpu_max(const std::string &sLine);
+
+    /**
+     * \fn static std::tuple<double long, double long> get_stat()
+     * \brief Read the first line of /proc/stat.
+     * \return {total, idle} in clock ticks, {-1, 1} on error
+     */
+    static std::tuple<double long, double long> get_stat();
+
+private:
+    int iMax; /**< Maximum number of workers */
+    int iActive; /**< Current number of workers, protected by mLock */
+    double dMax_load;
+    double dLoad; /**< Last sampled machine load, protected by mLock */
+    bool bStop;
+
+    std::function<void(int)> fSet;
+    std::thread thSampler;
+    mutable std::mutex mLock;
+    std::condition_variable cvStop;
+
+    void run();
+
+    static double long own_ticks();
+
+    /**
+     * \fn static double min_quota(const std::string &sMount, const std::string &sPath, const std::function<double(const std::string&)> &fQuota)
+     * \brief Apply fQuota to the directory of the cgroup sPath under sMount and to its ancestors up to sMount.
+     * \return Smallest quota found, 0 if there is none
+     */
+    static double min_quota(const std::string &sMount, const std::string &sPath, 
+                            const std::function<double(const std::string&)> &fQuota);
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _load::_load(int iThreads, double dMax_load):
+    iMax(iThreads>0 ? iThreads : available()), iActive(iMax),
+    dMax_load(dMax_load), dLoad(-1), bStop(false) { }
+
+inline _load::~_load() {
+    stop();
+}
+
+inline void _load::start(std::function<void(int)> fSet) {
+    stop();
+
+#ifdef HAS_SCHED
+    // one worker cannot shrink
+    if (iMax<2) return;
+
+    this->fSet=fSet;
+    bStop=false;
+    thSampler=std::thread(&_load::run, this);
+#endif
+}
+
+inline void _load::stop() {
+    {
+        std::lock_guard<std::mutex> lgLock(mLock);
+        bStop=true;
+    }
+    cvStop.notify_all();
+
+    if (thSampler.joinable())
+        thSampler.join();
+}
+
+inline int _load::get_max() const { return iMax; }
+
+inline int _load::get_active() const {
+    std::lock_guard<std::mutex> lgLock(mLock);
+    return iActive;
+}
+
+inline double _load::get_load() const {
+    std::lock_guard<std::mutex> lgLock(mLock);
+    return dLoad;
+}
+
+inline int _load::available() {
+    int iCpu=affinity();
+    double dQuota=quota();
+
+    if (dQuota>0)
+        iCpu=std::min(iCpu, static_cast<int>(std::ceil(dQuota)));
+
+    return std::max(iCpu, 1);
+}
+
+inline int _load::affinity() {
+#ifdef HAS_SCHED
+    cpu_set_t csSet;
+    CPU_ZERO(&csSet);
+    if (sched_getaffinity(0, sizeof(csSet), &csSet)==0)
+        return std::max(CPU_COUNT(&csSet), 1);
+#endif
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+inline double _load::quota(const std::string &sRoot, const std::string &sSelf) {
+    std::ifstream ifSelf(sSelf);
+    auto [sV2, sV1]=parse_cgroup(ifSelf);
+
+    // cgroup v2: a systemd or batch scheduler job runs in a sub-cgroup
+    std::ifstream ifControllers(sRoot+"/cgroup.controllers");
+    if (ifControllers)
+        return min_quota(sRoot, sV2, [](const std::string &sDir) {
+            std::ifstream ifMax(sDir+"/cpu.max");
+            std::string sLine;
+            return std::getline(ifMax, sLine) ? parse_cpu_max(sLine) : 0.;
+        });
+
+    // cgroup v1: the cpu controller may be mounted with cpuacct
+    for(const std::string &sMount: {sRoot+"/cpu", sRoot+"/cpu,cpuacct"}) {
+        std::ifstream ifMount(sMount+"/cpu.cfs_period_us");
+        if (!ifMount) continue;
+
+        return min_quota(sMount, sV1, [](const std::string &sDir) {
+            std::ifstream ifQuota(sDir+"/cpu.cfs_quota_us");
+            std::ifstream ifPeriod(sDir+"/cpu.cfs_period_us");
+            double dQuota=-1, dPeriod=0;
+            if (ifQuota >> dQuota && ifPeriod >> dPeriod && dQuota>0 && dPeriod>0)
+                return dQuota/dPeriod;
+            return 0.;
+        });
+    }
+
+    return 0;
+}
+
+inline std::tuple<std::string, std::string> _load::parse_cgroup(std::istream &isCgroup) {
+    std::string sV2, sV1, sLine;
+
+    // hierarchy-ID:controller-list:path
+    while (std::getline(isCgroup, sLine)) {
+        const size_t stFirst=sLine.find(':');
+        const size_t stSecond=stFirst==std::string::npos ? stFirst : sLine.find(':', stFirst+1);
+        if (stSecond==std::string::npos) continue;
+
+        const std::string sId=sLine.substr(0, stFirst);
+        const std::string sList=sLine.substr(stFirst+1, stSecond-stFirst-1);
+        const std::string sPath=sLine.substr(stSecond+1);
+
+        if (sId=="0" && sList.empty()) {
+            sV2=sPath;
+            continue;
+        }
+
+        std::istringstream issList(sList);
+        std::string sController;
+        while (std::getline(issList, sController, ','))
+            if (sController=="cpu")
+                sV1=sPath;
+    }
+    return {sV2, sV1};
+}
+
+inline double _load::min_quota(const std::string &sMount, const std::string &sPath, 
+                               const std::function<double(const std::string&)> &fQuota) {
+    double dMin=0;
+
+    // the path of a cgroup namespace may not exist under the mount: its ancestors are still read
+    std::string sDir=sMount+(sPath.empty() || sPath[0]=='/' ? "" : "/")+sPath;
+    while (sDir.size()>sMount.size() && sDir.back()=='/')
+        sDir.pop_back();
+
+    while (true) {
+        const double dQuota=fQuota(sDir);
+        if (dQuota>0 && (dMin==0 || dQuota<dMin))
+            dMin=dQuota;
+
+        if (sDir.size()<=sMount.size()) break;
+        sDir.erase(std::max(sDir.rfind('/'), sMount.size()));
+    }
+    return dMin;
+}
+
+inline double _load::parse_cpu_max(const std::string &sLine) {
+    std::istringstream issLine(sLine);
+    std::string sQuota;
+    double dPeriod=0;
+
+    if (!(issLine >> sQuota >> dPeriod) || sQuota=="max" || dPeriod<=0)
+        return 0;
+
+    try {
+        return std::max(std::stod(sQuota)/dPeriod, 0.);
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+inline std::tuple<double long, double long> _load::get_stat() {
+    std::ifstream ifStat("/proc/stat");
+    std::string sCpu;
+
+    // cpu user nice system idle iowait irq softirq steal
+    std::vector<double long> vldCol(8, 0);
+    if (ifStat >> sCpu && sCpu=="cpu") {
+        for(auto &ld: vldCol)
+            if (!(ifStat >> ld)) break;
+
+        double long ldTotal=0;
+        for(auto ld: vldCol) ldTotal+=ld;
+
+        return {ldTotal, vldCol[3]+vldCol[4]};
+    }
+    return {-1, 1};
+}
+
+inline double long _load::own_ticks() {
+#ifdef HAS_SCHED
+    struct rusage ruSelf;
+    if (getrusage(RUSAGE_SELF, &ruSelf)==0)
+        return (ruSelf.ru_utime.tv_sec+ruSelf.ru_stime.tv_sec+
+                1e-6L*(ruSelf.ru_utime.tv_usec+ruSelf.ru_stime.tv_usec))*sysconf(_SC_CLK_TCK);
+#endif
+    return 0;
+}
+
+inline void _load::run() {
+#ifdef HAS_SCHED
+    const int iCpu=std::max(static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)), 1);
+
+    auto [ldTotal_A, ldIdle_A]=get_stat();
+    double long ldOwn_A=own_ticks();
+
+    std::unique_lock<std::mutex> ulLock(mLock);
+    while (!cvStop.wait_for(ulLock, std::chrono::milliseconds(LOAD_PERIOD), [this]() { return bStop; })) {
+        ulLock.unlock();
+
+        auto [ldTotal_B, ldIdle_B]=get_stat();
+        double long ldOwn_B=own_ticks();
+
+        const double long ldTotal=ldTotal_B-ldTotal_A;
+        const double long ldBusy=ldTotal-(ldIdle_B-ldIdle_A);
+        const double long ldOwn=ldOwn_B-ldOwn_A;
+
+        ldTotal_A=ldTotal_B; ldIdle_A=ldIdle_B; ldOwn_A=ldOwn_B;
+
+        ulLock.lock();
+        if (ldTotal<=0 || ldTotal_B<0) continue;
+
+        dLoad=100.*ldBusy/ldTotal;
+
+        // CPUs left by the other processes under the load limit
+        const double dOthers=std::max(0.L, ldBusy-ldOwn)/ldTotal*iCpu;
+        const double dFree=iCpu*dMax_load/100.-dOthers;
+        const int iTarget=std::min(std::max(static_cast<int>(std::lround(dFree)), 1), iMax);
+
+        if (iTarget!=iActive) {
+            iActive=iTarget;
+            ulLock.unlock();
+            fSet(iTarget);
+            ulLock.lock();
+        }
+    }
+#endif
+}
+
+#endif // _LOAD_H
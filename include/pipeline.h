@@ -0,0 +1,578 @@
+/**
+ * \file pipeline.h
+ * \brief Read, compute and write stages of the batch tools, linked by bounded queues.
+ *
+ * I/O threads read the input files by batches through a _source, compute
+ * workers run the operation of the tool on the views, and writer threads
+ * flush the results by batches through a _sink. Each stage has its own threads, so the disk works while the
+ * CPUs parse. The queues between the stages are bounded: a fast stage blocks
+ * instead of loading the whole tree in memory.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include <io.h>
+
+#define PIPE_DEPTH 16 /**< Default capacity of the queues between the stages */
+#define PIPE_SPIN 64 /**< Tries of a blocked push or pop before it waits for a pop or a push */
+
+/**
+ * \class _ring
+ * \brief Bounded lock-free multi-producer multi-consumer queue (array of cells with sequence numbers).
+ * A push or a pop which stays blocked sleeps on a condition variable: an idle stage does not use the CPUs. The lock is only taken when a thread sleeps.
+ */
+template<typename _T>
+class _ring {
+public:
+    /**
+     * \fn explicit _ring(size_t stCapacity=PIPE_DEPTH)
+     * \brief stCapacity is rounded up to a power of two.
+     */
+    explicit _ring(size_t stCapacity=PIPE_DEPTH);
+
+    _ring(const _ring&)=delete;
+    _ring& operator=(const _ring&)=delete;
+
+    /**
+     * \fn bool try_push(_T &T)
+     * \brief Move T in the queue.
+     * \return false if the queue is full, T is left untouched
+     */
+    bool try_push(_T &T);
+
+    /**
+     * \fn bool try_pop(_T &T)
+     * \return false if the queue is empty
+     */
+    bool try_pop(_T &T);
+
+    /**
+     * \fn void push(_T &T)
+     * \brief Move T in the queue, wait while it is full.
+     */
+    void push(_T &T);
+
+    /**
+     * \fn bool pop(_T &T)
+     * \brief Wait for an element.
+     * \return false once the queue is closed and empty
+     */
+    bool pop(_T &T);
+
+    /**
+     * \fn void close()
+     * \brief No more push: pop() returns false when the queue is drained. Call it after the producers are done.
+     */
+    void close();
+
+    size_t capacity() const;
+
+private:
+    /**
+     * \struct _cell
+     * \brief One slot: stSeq tells whether it is free for the push or the pop of a given turn.
+     */
+    struct _cell {
+        std::atomic<size_t> stSeq;
+        _T TData;
+    };
+
+    std::unique_ptr<_cell[]> pCell;
+    size_t stMask;
+    alignas(64) std::atomic<size_t> stHead; /**< Next pop */
+    alignas(64) std::atomic<size_t> stTail; /**< Next push */
+    std::atomic<bool> bClosed;
+
+    std::mutex mWait;
+    std::condition_variable cvWait; /**< Wakes the threads blocked by a full or an empty queue */
+    std::atomic<int> iWaiting; /**< Threads asleep on cvWait */
+
+    bool push_cell(_T &T);
+    bool pop_cell(_T &T);
+
+    /**
+     * \fn void wait(const std::function<bool()> &fReady)
+     * \brief Sleep until fReady(), called under the lock, returns true.
+     */
+    void wait(const std::function<bool()> &fReady);
+
+    /**
+     * \fn void wake()
+     * \brief Wake the sleeping threads after a push or a pop, if any.
+     */
+    void wake();
+};
+
+/**
+ * \class _pipeline
+ * \brief Files go through a read stage (mapping and prefetch), a compute stage and a write stage. _T is the result handed from the compute stage to the write stage.
+ */
+template<typename _T>
+class _pipeline {
+public:
+    /**
+     * \struct _item
+     * \brief One file in the pipeline.
+     */
+    struct _item {
+        std::string sIn; /**< Input file */
+        std::string sOut; /**< Output file */
+        size_t stSeq; /**< Number given by push(), e.g. to restore the order of the inputs */
+        std::shared_ptr<_mmap> pFile; /**< Input read by the read stage, released after the compute stage */
+        _T TResult; /**< Set by the compute stage */
+    };
+
+    /**
+     * \fn explicit _pipeline(std::function<bool(_item&)> fCompute, std::function<void(_item&, _sink&)> fWrite, int iCompute=0, int iRead=1, int iWrite=1, size_t stDepth=PIPE_DEPTH)
+     * \brief Start the stages. fCompute fills TResult and returns false to drop the file, fWrite flushes TResult, through the _sink of the writer thread if it writes a file. A thread count <=0 means one thread, except iCompute which defaults to std::thread::hardware_concurrency().
+     */
+    explicit _pipeline(std::function<bool(_item&)> fCompute, std::function<void(_item&, _sink&)> fWrite,
+                       int iCompute=0, int iRead=1, int iWrite=1, size_t stDepth=PIPE_DEPTH);
+
+    _pipeline(const _pipeline&)=delete;
+    _pipeline& operator=(const _pipeline&)=delete;
+
+    /**
+     * \fn virtual ~_pipeline()
+     * \brief Drain the stages and join the threads.
+     */
+    virtual ~_pipeline();
+
+    /**
+     * \fn void push(const std::string &sIn, const std::string &sOut, size_t stSeq=0)
+     * \brief Queue a file. Wait while the read stage is full.
+     */
+    void push(const std::string &sIn, const std::string &sOut, size_t stSeq=0);
+
+    /**
+     * \fn void finish()
+     * \brief Close the input, wait until every file is written and join the threads. The first exception thrown by a stage is rethrown here.
+     */
+    void finish();
+
+    /**
+     * \fn void set_active(int iActive)
+     * \brief Let only the first iActive compute workers take files, in [1, get_threads()].
+     */
+    void set_active(int iActive);
+
+    int get_active() const;
+
+    /**
+     * \fn int get_threads() const
+     * \return Number of compute workers
+     */
+    int get_threads() const;
+
+    /**
+     * \fn size_t get_written() const
+     * \return Number of files which went through the write stage
+     */
+    size_t get_written() const;
+
+    /**
+     * \fn size_t get_failed() const
+     * \return Number of outputs which could not be written
+     */
+    size_t get_failed() const;
+
+    /**
+     * \fn static int worker()
+     * \return Index of the calling thread in its stage, -1 outside the pipeline
+     */
+    static int worker();
+
+private:
+    std::function<bool(_item&)> fCompute;
+    std::function<void(_item&, _sink&)> fWrite;
+    size_t stBatch; /**< Files read or written together */
+
+    _ring<_item> rFile; /**< Files to read */
+    _ring<_item> rRead; /**< Files mapped, to compute */
+    _ring<_item> rDone; /**< Results to write */
+
+    std::vector<std::thread> vthRead;
+    std::vector<std::thread> vthCompute;
+    std::vector<std::thread> vthWrite;
+
+    mutable std::mutex mState; /**< Protects iActive, bClosing and epError */
+    std::condition_variable cvActive; /**< Wakes the parked compute workers */
+    int iActive;
+    bool bClosing; /**< True once the compute stage has to drain */
+    bool bFinished;
+    std::exception_ptr epError; /**< First exception thrown by a stage */
+    std::atomic<size_t> stWritten; /**< Results handed to fWrite */
+    std::atomic<size_t> stFailed; /**< Outputs the sinks could not write, counted when the writers end */
+
+    static int &index();
+
+    void run_read(int iWorker);
+    void run_compute(int iWorker);
+    void run_write(int iWorker);
+    void keep(std::exception_ptr ep);
+    void join();
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+template<typename _T>
+_ring<_T>::_ring(size_t stCapacity): stHead(0), stTail(0), bClosed(false), iWaiting(0) {
+    size_t stSize=2;
+    while (stSize<stCapacity) stSize<<=1;
+
+    pCell=std::make_unique<_cell[]>(stSize);
+    for(size_t i=0; i<stSize; i++)
+        pCell[i].stSeq.store(i, std::memory_order_relaxed);
+    stMask=stSize-1;
+}
+
+template<typename _T>
+bool _ring<_T>::try_push(_T &T) {
+    if (!push_cell(T))
+        return false;
+    wake();
+    return true;
+}
+
+template<typename _T>
+bool _ring<_T>::try_pop(_T &T) {
+    if (!pop_cell(T))
+        return false;
+    wake();
+    return true;
+}
+
+template<typename _T>
+bool _ring<_T>::push_cell(_T &T) {
+    size_t stPos=stTail.load(std::memory_order_relaxed);
+
+    while (true) {
+        _cell &cCell=pCell[stPos & stMask];
+        const size_t stSeq=cCell.stSeq.load(std::memory_order_acquire);
+        const std::ptrdiff_t iDiff=static_cast<std::ptrdiff_t>(stSeq)-static_cast<std::ptrdiff_t>(stPos);
+
+        if (iDiff==0) {
+            if (stTail.compare_exchange_weak(stPos, stPos+1, std::memory_order_relaxed)) {
+                cCell.TData=std::move(T);
+                cCell.stSeq.store(stPos+1, std::memory_order_release);
+                return true;
+            }
+        }
+        // the cell still holds the element of the previous turn
+        else if (iDiff<0)
+            return false;
+        else
+            stPos=stTail.load(std::memory_order_relaxed);
+    }
+}
+
+template<typename _T>
+bool _ring<_T>::pop_cell(_T &T) {
+    size_t stPos=stHead.load(std::memory_order_relaxed);
+
+    while (true) {
+        _cell &cCell=pCell[stPos & stMask];
+        const size_t stSeq=cCell.stSeq.load(std::memory_order_acquire);
+        const std::ptrdiff_t iDiff=static_cast<std::ptrdiff_t>(stSeq)-static_cast<std::ptrdiff_t>(stPos+1);
+
+        if (iDiff==0) {
+            if (stHead.compare_exchange_weak(stPos, stPos+1, std::memory_order_relaxed)) {
+                T=std::move(cCell.TData);
+                cCell.TData=_T();
+                cCell.stSeq.store(stPos+stMask+1, std::memory_order_release);
+                return true;
+            }
+        }
+        // nothing pushed in this cell yet
+        else if (iDiff<0)
+            return false;
+        else
+            stPos=stHead.load(std::memory_order_relaxed);
+    }
+}
+
+template<typename _T>
+void _ring<_T>::push(_T &T) {
+    // a stage waits for a slower one: spin a little, then sleep until a pop
+    for(int iTry=0; iTry<PIPE_SPIN; iTry++) {
+        if (try_push(T)) return;
+        std::this_thread::yield();
+    }
+    wait([this, &T]() { return push_cell(T); });
+    wake();
+}
+
+template<typename _T>
+bool _ring<_T>::pop(_T &T) {
+    for(int iTry=0; iTry<PIPE_SPIN; iTry++) {
+        if (try_pop(T)) return true;
+        // the producers are done: one last look for their final pushes
+        if (bClosed.load(std::memory_order_acquire))
+            return try_pop(T);
+        std::this_thread::yield();
+    }
+
+    bool bPopped=false;
+    wait([this, &T, &bPopped]() {
+        bPopped=pop_cell(T);
+        return bPopped || bClosed.load(std::memory_order_acquire);
+    });
+    if (!bPopped)
+        return try_pop(T);
+    wake();
+    return true;
+}
+
+template<typename _T>
+void _ring<_T>::close() {
+    bClosed.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> lgLock(mWait);
+    cvWait.notify_all();
+}
+
+template<typename _T>
+size_t _ring<_T>::capacity() const {
+    return stMask+1;
+}
+
+template<typename _T>
+void _ring<_T>::wait(const std::function<bool()> &fReady) {
+    std::unique_lock<std::mutex> ulLock(mWait);
+    iWaiting.fetch_add(1);
+    // the count is seen by wake() before fReady() looks at the cells
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cvWait.wait(ulLock, fReady);
+    iWaiting.fetch_sub(1);
+}
+
+template<typename _T>
+void _ring<_T>::wake() {
+    // the cell is updated before the count is read: a thread going to sleep sees the change or is woken
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (iWaiting.load(std::memory_order_relaxed)==0)
+        return;
+    std::lock_guard<std::mutex> lgLock(mWait);
+    cvWait.notify_all();
+}
+
+// ----------------------------------------------------
+
+template<typename _T>
+_pipeline<_T>::_pipeline(std::function<bool(_item&)> fCompute, std::function<void(_item&, _sink&)> fWrite,
+                         int iCompute, int iRead, int iWrite, size_t stDepth):
+    fCompute(fCompute), fWrite(fWrite), stBatch(std::min<size_t>(std::max<size_t>(stDepth, 1), AIO_BATCH)),
+    rFile(stDepth), rRead(stDepth), rDone(stDepth),
+    bClosing(false), bFinished(false), stWritten(0), stFailed(0) {
+
+    if (iCompute<=0)
+        iCompute=std::max(1u, std::thread::hardware_concurrency());
+    iActive=iCompute;
+
+    for(int i=0; i<std::max(iRead, 1); i++)
+        vthRead.emplace_back(&_pipeline::run_read, this, i);
+    for(int i=0; i<iCompute; i++)
+        vthCompute.emplace_back(&_pipeline::run_compute, this, i);
+    for(int i=0; i<std::max(iWrite, 1); i++)
+        vthWrite.emplace_back(&_pipeline::run_write, this, i);
+}
+
+template<typename _T>
+_pipeline<_T>::~_pipeline() {
+    join();
+}
+
+template<typename _T>
+void _pipeline<_T>::push(const std::string &sIn, const std::string &sOut, size_t stSeq) {
+    _item iItem;
+    iItem.sIn=sIn;
+    iItem.sOut=sOut;
+    iItem.stSeq=stSeq;
+    rFile.push(iItem);
+}
+
+template<typename _T>
+void _pipeline<_T>::finish() {
+    join();
+
+    std::lock_guard<std::mutex> lgLock(mState);
+    if (epError) {
+        std::exception_ptr epRethrow=epError;
+        epError=nullptr;
+        std::rethrow_exception(epRethrow);
+    }
+}
+
+template<typename _T>
+void _pipeline<_T>::set_active(int iN) {
+    {
+        std::lock_guard<std::mutex> lgLock(mState);
+        iActive=std::min(std::max(iN, 1), get_threads());
+    }
+    cvActive.notify_all();
+}
+
+template<typename _T>
+int _pipeline<_T>::get_active() const {
+    std::lock_guard<std::mutex> lgLock(mState);
+    return iActive;
+}
+
+template<typename _T>
+int _pipeline<_T>::get_threads() const {
+    return vthCompute.size();
+}
+
+template<typename _T>
+size_t _pipeline<_T>::get_written() const {
+    return stWritten.load()-stFailed.load();
+}
+
+template<typename _T>
+size_t _pipeline<_T>::get_failed() const {
+    return stFailed.load();
+}
+
+template<typename _T>
+int _pipeline<_T>::worker() {
+    return index();
+}
+
+template<typename _T>
+int &_pipeline<_T>::index() {
+    static thread_local int iIndex=-1;
+    return iIndex;
+}
+
+template<typename _T>
+void _pipeline<_T>::keep(std::exception_ptr ep) {
+    std::lock_guard<std::mutex> lgLock(mState);
+    if (!epError) epError=ep;
+}
+
+template<typename _T>
+void _pipeline<_T>::join() {
+    if (bFinished) return;
+    bFinished=true;
+
+    // each stage is drained before the next one is closed
+    rFile.close();
+    for(auto &th: vthRead) th.join();
+
+    rRead.close();
+    {
+        std::lock_guard<std::mutex> lgLock(mState);
+        bClosing=true;
+    }
+    cvActive.notify_all();
+    for(auto &th: vthCompute) th.join();
+
+    rDone.close();
+    for(auto &th: vthWrite) th.join();
+}
+
+template<typename _T>
+void _pipeline<_T>::run_read(int iWorker) {
+    index()=iWorker;
+
+    _source srcIn(stBatch);
+    std::vector<_item> vItem;
+    std::vector<std::string> vsFile;
+
+    _item iItem;
+    while (rFile.pop(iItem)) {
+        // a batch: the first file and the ones already waiting
+        vItem.clear();
+        vItem.emplace_back(std::move(iItem));
+        while (vItem.size()<stBatch && rFile.try_pop(iItem))
+            vItem.emplace_back(std::move(iItem));
+
+        vsFile.clear();
+        for(auto &i: vItem)
+            vsFile.emplace_back(i.sIn);
+
+        try {
+            auto vpView=srcIn.read(vsFile);
+            for(size_t i=0; i<vItem.size(); i++)
+                vItem[i].pFile=vpView[i];
+        }
+        catch (...) {
+            keep(std::current_exception());
+        }
+
+        for(auto &i: vItem)
+            rRead.push(i);
+    }
+}
+
+template<typename _T>
+void _pipeline<_T>::run_compute(int iWorker) {
+    index()=iWorker;
+
+    _item iItem;
+    while (true) {
+        {
+            // parked by set_active() until the load drops or the input is drained
+            std::unique_lock<std::mutex> ulLock(mState);
+            cvActive.wait(ulLock, [this, iWorker]() { return bClosing || iWorker<iActive; });
+        }
+        if (!rRead.pop(iItem)) return;
+
+        bool bKeep=false;
+        try {
+            bKeep=fCompute(iItem);
+        }
+        catch (...) {
+            keep(std::current_exception());
+        }
+        iItem.pFile.reset();
+
+        if (bKeep)
+            rDone.push(iItem);
+    }
+}
+
+template<typename _T>
+void _pipeline<_T>::run_write(int iWorker) {
+    index()=iWorker;
+
+    _sink skOut(stBatch);
+
+    _item iItem;
+    while (true) {
+        if (!rDone.try_pop(iItem)) {
+            // nothing waiting: write the batch rather than hold it
+            skOut.flush();
+            if (!rDone.pop(iItem)) break;
+        }
+
+        try {
+            fWrite(iItem, skOut);
+        }
+        catch (...) {
+            keep(std::current_exception());
+        }
+        iItem=_item();
+        stWritten++;
+    }
+    skOut.flush();
+    stFailed+=skOut.get_failed();
+}
+
+#endif // _PIPELINE_H
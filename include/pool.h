@@ -0,0 +1,258 @@
+/**
+ * \file pool.h
+ * \brief Work-stealing thread pool for the tasks which do not read a file, e.g. genrandspec and the filter of waverage.
+ *
+ * Each worker owns a deque of tasks: it pops from the front of its own deque
+ * and, when it is empty, steals from the back of the other ones. Each deque
+ * has its own lock and the counters are atomic: a push or a take only
+ * contends with the workers using the same deque. The pool mutex is taken
+ * only to sleep, to wake a sleeping worker and to wait for the end.
+ * The tools which read files use the stages of _pipeline instead.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+/**
+ * \class _pool
+ * \brief Fixed set of workers with one task deque each and work stealing.
+ */
+class _pool {
+public:
+    /**
+     * \fn explicit _pool(int iThreads=0)
+     * \brief Start iThreads workers, std::thread::hardware_concurrency() if iThreads<=0.
+     */
+    explicit _pool(int iThreads=0);
+
+    _pool(const _pool&)=delete;
+    _pool& operator=(const _pool&)=delete;
+
+    /**
+     * \fn virtual ~_pool()
+     * \brief Run the remaining tasks and join the workers.
+     */
+    virtual ~_pool();
+
+    /**
+     * \fn void submit(std::function<void()> fTask)
+     * \brief Queue fTask. A task submitted by a worker goes in its own deque, otherwise the deques are filled in turn.
+     */
+    void submit(std::function<void()> fTask);
+
+    /**
+     * \fn void wait()
+     * \brief Block until all the submitted tasks are done. The first exception thrown by a task is rethrown here.
+     */
+    void wait();
+
+    int get_threads() const;
+
+    /**
+     * \fn void set_active(int iActive)
+     * \brief Let only the first iActive workers take tasks, in [1, get_threads()]. The other ones sleep and their queued tasks are stolen.
+     */
+    void set_active(int iActive);
+
+    int get_active() const;
+
+    /**
+     * \fn static int worker()
+     * \return Index of the worker running the calling thread in [0, get_threads()), -1 outside the pool
+     */
+    static int worker();
+
+private:
+    /**
+     * \struct _queue
+     * \brief Task deque of one worker.
+     */
+    struct _queue {
+        std::mutex mLock;
+        std::deque<std::function<void()> > dqTask;
+    };
+
+    std::vector<std::unique_ptr<_queue> > vpQueue; /**< One deque per worker */
+    std::vector<std::thread> vthWorker;
+
+    mutable std::mutex mState; /**< Protects the sleep and wait conditions and epError */
+    std::condition_variable cvTask; /**< Signals a new task or the stop */
+    std::condition_variable cvDone; /**< Signals the end of the last pending task */
+
+    std::atomic<size_t> stQueued; /**< Tasks in the deques */
+    std::atomic<size_t> stPending; /**< Tasks submitted and not finished */
+    std::atomic<size_t> stNext; /**< Next deque filled by an external submit */
+    std::atomic<int> iActive; /**< Number of workers allowed to run tasks */
+    std::atomic<int> iSleeping; /**< Workers waiting on cvTask */
+    std::atomic<bool> bStop;
+    std::exception_ptr epError; /**< First exception thrown by a task */
+
+    static int &index();
+
+    void run(int iWorker);
+    bool take(int iWorker, std::function<void()> &fTask);
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _pool::_pool(int iThreads): stQueued(0), stPending(0), stNext(0), iSleeping(0), bStop(false) {
+    if (iThreads<=0)
+        iThreads=std::max(1u, std::thread::hardware_concurrency());
+    iActive=iThreads;
+
+    for(int i=0; i<iThreads; i++)
+        vpQueue.emplace_back(std::make_unique<_queue>());
+
+    for(int i=0; i<iThreads; i++)
+        vthWorker.emplace_back(&_pool::run, this, i);
+}
+
+inline _pool::~_pool() {
+    {
+        std::lock_guard<std::mutex> lgLock(mState);
+        bStop=true;
+    }
+    cvTask.notify_all();
+
+    for(auto &th: vthWorker)
+        th.join();
+}
+
+inline void _pool::submit(std::function<void()> fTask) {
+    // the deques belong to this pool only if the caller is one of its workers
+    const int iN=iActive.load();
+    const size_t stQueue=index()>=0 && index()<iN ? index() : stNext++%iN;
+
+    // counted before the push: wait() never sees a queued task as finished
+    stPending++;
+    {
+        std::lock_guard<std::mutex> lgLock(vpQueue[stQueue]->mLock);
+        vpQueue[stQueue]->dqTask.emplace_back(std::move(fTask));
+    }
+    stQueued++;
+
+    // a worker going to sleep counts itself before it looks at stQueued: one of the two sees the other
+    if (iSleeping.load()>0) {
+        { std::lock_guard<std::mutex> lgLock(mState); }
+        // a sleeping worker may be parked by set_active(): wake them all
+        cvTask.notify_all();
+    }
+}
+
+inline void _pool::wait() {
+    std::unique_lock<std::mutex> ulLock(mState);
+    cvDone.wait(ulLock, [this]() { return stPending.load()==0; });
+
+    if (epError) {
+        std::exception_ptr epRethrow=epError;
+        epError=nullptr;
+        std::rethrow_exception(epRethrow);
+    }
+}
+
+inline int _pool::get_threads() const {
+    return vthWorker.size();
+}
+
+inline void _pool::set_active(int iN) {
+    {
+        std::lock_guard<std::mutex> lgLock(mState);
+        iActive=std::min(std::max(iN, 1), get_threads());
+    }
+    cvTask.notify_all();
+}
+
+inline int _pool::get_active() const {
+    return iActive.load();
+}
+
+inline int _pool::worker() {
+    return index();
+}
+
+inline int &_pool::index() {
+    static thread_local int iIndex=-1;
+    return iIndex;
+}
+
+inline bool _pool::take(int iWorker, std::function<void()> &fTask) {
+    const size_t stSize=vpQueue.size();
+
+    // own deque first, then the other ones starting with the next worker
+    for(size_t k=0; k<stSize; k++) {
+        _queue &qQueue=*vpQueue[(iWorker+k)%stSize];
+        std::lock_guard<std::mutex> lgLock(qQueue.mLock);
+
+        if (qQueue.dqTask.empty()) continue;
+
+        if (k==0) {
+            fTask=std::move(qQueue.dqTask.front());
+            qQueue.dqTask.pop_front();
+        }
+        else {
+            fTask=std::move(qQueue.dqTask.back());
+            qQueue.dqTask.pop_back();
+        }
+        stQueued--;
+        return true;
+    }
+    return false;
+}
+
+inline void _pool::run(int iWorker) {
+    index()=iWorker;
+
+    std::function<void()> fTask;
+    while (true) {
+        // the parked workers help to drain the deques at the stop
+        const bool bAllowed=iWorker<iActive.load() || bStop.load();
+
+        if (!bAllowed || !take(iWorker, fTask)) {
+            // a task is pushed or popped by another thread: look again
+            if (bAllowed && stQueued.load()>0) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> ulLock(mState);
+            iSleeping++;
+            cvTask.wait(ulLock, [this, iWorker]() { return bStop.load() || (stQueued.load()>0 && iWorker<iActive.load()); });
+            iSleeping--;
+
+            if (bStop.load() && stQueued.load()==0) return;
+            continue;
+        }
+
+        try {
+            fTask();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lgLock(mState);
+            if (!epError) epError=std::current_exception();
+        }
+        fTask=nullptr;
+
+        if (--stPending==0) {
+            { std::lock_guard<std::mutex> lgLock(mState); }
+            cvDone.notify_all();
+        }
+    }
+}
+
+#endif // _POOL_H
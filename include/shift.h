@@ -5,10 +5,11 @@
 #include <vector>
 #include <algorithm>
 #include <thread>
-#include <future>
 #include <string>
 #include <tuple>
 #include <chrono>
+#include <fstream>
+#include <unordered_map>
 #include <boost/program_options.hpp>
 #include <boost/range/iterator_range.hpp>
 
@@ -41,6 +42,9 @@ namespace fs = boost::filesystem;
 #include <csv.h>
 #include <msg.h>
 #include <log.h>
+#include <pipeline.h>
+#include <load.h>
+#include <tree.h>
 
 #define CLIGHT 299792.458 // /**< Speed of light in km/s  */
 
@@ -50,176 +54,111 @@ namespace fs = boost::filesystem;
 // Prototype
 // ----------------------------------------------------
 /**
- * \fn void add(const std::vector<std::string> &vsList, float fWavelength)
- * \brief Add the defined wavelength to the first column of spectra. Default sep is '\\t'.
+ * \fn bool add_file(const std::string &sFile, const std::string &sOutput, char cSep, float fWavelength, bool &bParsed)
+ * \brief Add the defined wavelength to the first column of sFile and write the result in sOutput. The separator is detected if cSep is '\0'. Used when multi-threading is disabled.
+ * \param bParsed false if sFile cannot be parsed
  */
-void add(const std::vector<std::string> &vsList, float fWavelength);
+bool add_file(const std::string &sFile, const std::string &sOutput, char cSep, float fWavelength, bool &bParsed);
 
 /**
- * \fn void add_sep(const std::vector<std::string> &vsList, char cSep , float fWavelength)
- * \brief Add the defined wavelength to the first column of spectra.
+ * \fn bool transform_file(const std::string &sFile, const std::string &sOutput, char cSep, float fVr, bool &bParsed)
+ * \brief Correct the radial velocity effect on sFile and write the result in sOutput. The separator is detected if cSep is '\0'. Used when multi-threading is disabled.
+ * \param bParsed false if sFile cannot be parsed
  */
-void add_sep(const std::vector<std::string> &vsList, char cSep , float fWavelength);
+bool transform_file(const std::string &sFile, const std::string &sOutput, char cSep, float fVr, bool &bParsed);
 
 /**
- * \fn void transform_sep(const std::vector<std::string> &vsList, char cSep , float fVr)
- * \brief Correct the radial velocity effect on spectra. Perform a linear transformation.
- * \param fVr Radial Velocity
+ * \fn std::string manifest_key(const fs::path &pFile)
+ * \brief Key of a file in a manifest: its absolute path, without "." and "..".
  */
-void transform_sep(const std::vector<std::string> &vsList, char cSep , float fVr);
+std::string manifest_key(const fs::path &pFile);
 
 /**
- * \fn double long CPU_utilization()
- * \brief Get the CPU usage (%)
+ * \fn bool read_manifest(const std::string &sManifest, const std::string &sInput, std::unordered_map<std::string, float> &umVr, size_t &stMissing)
+ * \brief Read the rows "path<TAB>vr" of sManifest into umVr. A relative path is looked for in sInput, then in the working directory. Blank lines and lines starting with '#' are ignored.
+ * \param stMissing Number of rows whose file does not exist
+ * \return false if sManifest cannot be opened or a row cannot be parsed
  */
-double long CPU_utilization();
-
-std::tuple<double long, double long> get_stat();
+bool read_manifest(const std::string &sManifest, const std::string &sInput, std::unordered_map<std::string, float> &umVr, size_t &stMissing);
 
 // ----------------------------------------------------
 // ----------------------------------------------------
 
-void add(const std::vector<std::string> &vsList, float fWavelength) {    
-    _msg msgM;
-    msgM.set_threadname("add");
-    msgM.set_name("add");
-    msgM.set_log(LOGFILE);
-    
-     for(auto sFile: vsList) {
-        
-        _csv<float> csv(sFile, '\t');
-        
-        if(csv.read()) {
-            
-            csv.set_verbose(_csv<float>::eVerbose::QUIET);
-            
-            csv.shift(fWavelength);
-            
-            csv.write();
-            
-        }
-     }
-    
-#ifdef HAS_SYSCALL   
-    msgM.msg(_msg::eMsg::THREADS, vsList.size(), "files parsed.");
-#else
-    msgM.msg(_msg::eMsg::MID, vsList.size(), " files parsed.");
-#endif
-}
-
-void add_sep(const std::vector<std::string> &vsList, char cSep , float fWavelength) {    
-    _msg msgM;
-    msgM.set_threadname("add");
-    msgM.set_name("add");
-    msgM.set_log(LOGFILE);
+bool add_file(const std::string &sFile, const std::string &sOutput, char cSep, float fWavelength, bool &bParsed) {
+    _csv<float> csv(sFile, cSep);
+    csv.set_filename_out(sOutput);
+    csv.set_projection({0});
     
-     for(auto sFile: vsList) {
-        
-        _csv<float> csv(sFile, cSep);
-        
-        if(csv.read()) {
-            
-            csv.set_verbose(_csv<float>::eVerbose::QUIET);
-            
-            csv.shift(fWavelength);
-            
-            csv.write();
-            
-        }    
+    bParsed=csv.read();
+    if(bParsed) {
+        csv.set_verbose(_csv<float>::eVerbose::QUIET);
+        csv.shift(fWavelength);
+        return csv.write();
     }
-    
-#ifdef HAS_SYSCALL   
-    msgM.msg(_msg::eMsg::THREADS, vsList.size(), "files parsed.");
-#else
-    msgM.msg(_msg::eMsg::MID, vsList.size(), " files parsed.");
-#endif
+    return false;
 }
 
-void transform_sep(const std::vector<std::string> &vsList, char cSep , float fVr) {
-    _msg msgM;
-    msgM.set_threadname("transform");
-    msgM.set_name("transform");
-    msgM.set_log(LOGFILE);
+bool transform_file(const std::string &sFile, const std::string &sOutput, char cSep, float fVr, bool &bParsed) {
+    _csv<float> csv(sFile, cSep);
+    csv.set_filename_out(sOutput);
+    csv.set_projection({0});
     
-     for(auto sFile: vsList) {
-        
-        _csv<float> csv(sFile, cSep);
-        
-        if(csv.read()) {
-            csv.set_verbose(_csv<float>::eVerbose::QUIET);
-            float fBeta=1/(1+fVr/CLIGHT);
-            csv.transform_lin(fBeta, 0, 0);
-            csv.write();
-        }    
+    bParsed=csv.read();
+    if(bParsed) {
+        csv.set_verbose(_csv<float>::eVerbose::QUIET);
+        float fBeta=1/(1+fVr/CLIGHT);
+        csv.transform_lin(fBeta, 0, 0);
+        return csv.write();
     }
-    
-#ifdef HAS_SYSCALL   
-    msgM.msg(_msg::eMsg::THREADS, vsList.size(), "files parsed.");
-#else
-    msgM.msg(_msg::eMsg::MID, vsList.size(), " files parsed.");
-#endif
+    return false;
 }
 
-double long CPU_utilization() {
-     _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("CPU_utilization");
-    msgM.set_log(LOGFILE);
-        
-    auto [fTime_A, fIdle_A]=get_stat();
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    auto [fTime_B, fIdle_B]=get_stat();
-    return 100.*(1.-((fIdle_B-fIdle_A)/(fTime_B-fTime_A)));
+std::string manifest_key(const fs::path &pFile) {
+    return fs::absolute(pFile).lexically_normal().string();
 }
 
-std::tuple<double long, double long>  get_stat() {
-    _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("get_stat");
-    msgM.set_log(LOGFILE);
+bool read_manifest(const std::string &sManifest, const std::string &sInput, std::unordered_map<std::string, float> &umVr, size_t &stMissing) {
+    std::ifstream ifFile(sManifest);
+    if (!ifFile.is_open())
+        return false;
     
-    std::fstream sfCpu("/proc/stat", std::ios::in);
+    stMissing=0;
+    std::string sLine;
     
-    if (sfCpu) {
-
-        std::string sLine;
-        std::getline(sfCpu, sLine);
+    while (std::getline(ifFile, sLine)) {
+        if (!sLine.empty() && sLine.back()=='\r') sLine.pop_back();
         
-        // erase "cpu"
-        sLine.erase(sLine.begin(), sLine.begin()+sLine.find_first_of("0123456789")); 
+        size_t stFirst=sLine.find_first_not_of(" \t");
+        if (stFirst==std::string::npos || sLine[stFirst]=='#')
+            continue;
         
-        // locate " " and push position into vec
-        std::vector<int> vPos;
-        std::vector<double long> vCol;
+        // the velocity is the last field: the path may contain spaces
+        size_t stLast=sLine.find_last_not_of(" \t");
+        size_t stSep=sLine.find_last_of(" \t", stLast);
+        if (stSep==std::string::npos || stSep<stFirst)
+            return false;
         
-        vPos.push_back(0); 
-        
-        int iCount=0;
-        for(auto cC: sLine) {
-            if (cC==' ')
-                vPos.push_back(iCount);
-            iCount++;  
+        float fVr;
+        try {
+            size_t stPos;
+            fVr=std::stof(sLine.substr(stSep+1, stLast-stSep), &stPos);
+            if (stPos!=stLast-stSep) return false;
         }
-        
-        // slice
-        for(int i=0; i<4; i++) {
-            std::string sVal=sLine.substr(vPos[i], vPos[i+1]-vPos[i]);
-            sVal.erase(std::remove(sVal.begin(), sVal.end(), ' '), sVal.end()); 
-            vCol.push_back(std::stod(sVal));
+        catch (...) {
+            return false;
         }
         
-        sfCpu.close();
-                
-        return {static_cast<double long>(vCol[0]+vCol[1]+vCol[2]+vCol[3]), static_cast<double long>(vCol[3])};
+        size_t stEnd=sLine.find_last_not_of(" \t", stSep);
+        fs::path pFile(sLine.substr(stFirst, stEnd-stFirst+1));
+        
+        if (pFile.is_relative() && fs::exists(fs::path(sInput)/pFile))
+            pFile=fs::path(sInput)/pFile;
+        else if (!fs::exists(pFile))
+            stMissing++;
+        
+        umVr[manifest_key(pFile)]=fVr;
     }
-    else 
-        msgM.msg(_msg::eMsg::ERROR, "cannot open /proc/stat");
-    
-    return {-1,1};
+    return true;
 }
 
-
-
-
-
 #endif // shift.cpp
@@ -0,0 +1,236 @@
+/**
+ * \file sketch.h
+ * \brief Mergeable sketch of the quantiles of a stream, in bounded memory.
+ *
+ * The values are counted in bins whose bounds grow geometrically by
+ * gamma=(1+alpha)/(1-alpha), so that any quantile is returned within a
+ * relative error alpha of the exact one, whatever the distribution
+ * (DDSketch, Masson et al. 2019, VLDB 12, 2195). Two sketches with the same
+ * alpha are merged by adding their bins: a stream split in chunks gives the
+ * sketch of the whole stream. Beyond SKETCH_BINS bins the bins of the
+ * smallest magnitudes are merged, which only degrades the quantiles of these
+ * values.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _SKETCH_H
+#define _SKETCH_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#define SKETCH_ALPHA 0.005 /**< Default relative accuracy of the quantiles */
+#define SKETCH_BINS 2048 /**< Bins kept for each sign, i.e. a dynamic range of ~1e9 at the default accuracy */
+
+/**
+ * \class _sketch
+ * \brief Quantiles within a relative error alpha. Not thread safe: one sketch per thread, merged afterwards.
+ */
+class _sketch {
+public:
+    /**
+     * \fn explicit _sketch(double dAlpha=SKETCH_ALPHA, size_t stMax_bins=SKETCH_BINS)
+     * \brief dAlpha in ]0, 1[ is the relative accuracy of the quantiles.
+     */
+    explicit _sketch(double dAlpha=SKETCH_ALPHA, size_t stMax_bins=SKETCH_BINS);
+
+    /**
+     * \fn void add(double dValue)
+     * \brief Count dValue. NaN and infinite values are ignored.
+     */
+    void add(double dValue);
+
+    /**
+     * \fn bool merge(const _sketch &skOther)
+     * \brief Add the values of skOther.
+     * \return false if the accuracies differ
+     */
+    bool merge(const _sketch &skOther);
+
+    /**
+     * \fn double quantile(double dQ) const
+     * \return Value of rank dQ*(count()-1), dQ in [0, 1]; 0 if the sketch is empty
+     */
+    double quantile(double dQ) const;
+
+    /**
+     * \fn double median() const
+     * \return Median, the mean of the two middle values for an even count
+     */
+    double median() const;
+
+    uint64_t count() const { return u64Count; }
+
+    double get_alpha() const { return dAlpha; }
+
+    /**
+     * \fn size_t get_bins() const
+     * \return Bins in use, the memory being about 8 bytes per bin
+     */
+    size_t get_bins() const { return stPos.vu64Bin.size()+stNeg.vu64Bin.size(); }
+
+    void clear();
+
+private:
+    /**
+     * \struct _store
+     * \brief Dense bins of one sign: vu64Bin[i] counts the magnitudes in ]gamma^(iOffset+i-1), gamma^(iOffset+i)].
+     */
+    struct _store {
+        std::vector<uint64_t> vu64Bin;
+        int iOffset=0;
+
+        void add(int iIndex, uint64_t u64N, size_t stMax);
+    };
+
+    double dAlpha;
+    double dGamma;
+    double dLog_gamma;
+    size_t stMax_bins;
+
+    _store stPos;
+    _store stNeg; /**< Magnitudes of the negative values */
+    uint64_t u64Zero;
+    uint64_t u64Count;
+
+    int index(double dMagnitude) const;
+    double value(int iIndex) const;
+
+    /**
+     * \fn double at_rank(uint64_t u64Rank) const
+     * \return Value of rank u64Rank, in increasing order
+     */
+    double at_rank(uint64_t u64Rank) const;
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _sketch::_sketch(double dAlpha, size_t stMax_bins):
+    dAlpha(std::min(std::max(dAlpha, 1e-6), 0.5)), stMax_bins(std::max<size_t>(stMax_bins, 2)),
+    u64Zero(0), u64Count(0) {
+    dGamma=(1+this->dAlpha)/(1-this->dAlpha);
+    dLog_gamma=std::log(dGamma);
+}
+
+inline void _sketch::add(double dValue) {
+    if (!std::isfinite(dValue))
+        return;
+
+    if (dValue>0)
+        stPos.add(index(dValue), 1, stMax_bins);
+    else if (dValue<0)
+        stNeg.add(index(-dValue), 1, stMax_bins);
+    else
+        u64Zero++;
+    u64Count++;
+}
+
+inline bool _sketch::merge(const _sketch &skOther) {
+    if (skOther.dAlpha!=dAlpha)
+        return false;
+
+    for(size_t i=0; i<skOther.stPos.vu64Bin.size(); i++)
+        if (skOther.stPos.vu64Bin[i]>0)
+            stPos.add(skOther.stPos.iOffset+static_cast<int>(i), skOther.stPos.vu64Bin[i], stMax_bins);
+    for(size_t i=0; i<skOther.stNeg.vu64Bin.size(); i++)
+        if (skOther.stNeg.vu64Bin[i]>0)
+            stNeg.add(skOther.stNeg.iOffset+static_cast<int>(i), skOther.stNeg.vu64Bin[i], stMax_bins);
+
+    u64Zero+=skOther.u64Zero;
+    u64Count+=skOther.u64Count;
+    return true;
+}
+
+inline double _sketch::quantile(double dQ) const {
+    if (u64Count==0)
+        return 0;
+    dQ=std::min(std::max(dQ, 0.), 1.);
+    return at_rank(static_cast<uint64_t>(dQ*(u64Count-1)));
+}
+
+inline double _sketch::median() const {
+    if (u64Count==0)
+        return 0;
+    if (u64Count%2==1)
+        return at_rank(u64Count/2);
+    return (at_rank(u64Count/2-1)+at_rank(u64Count/2))/2;
+}
+
+inline void _sketch::clear() {
+    stPos=_store();
+    stNeg=_store();
+    u64Zero=0;
+    u64Count=0;
+}
+
+inline void _sketch::_store::add(int iIndex, uint64_t u64N, size_t stMax) {
+    if (vu64Bin.empty()) {
+        iOffset=iIndex;
+        vu64Bin.assign(1, 0);
+    }
+    else if (iIndex<iOffset) {
+        // below the range kept: folded into the first bin if the range is full
+        size_t stGrow=iOffset-iIndex;
+        if (vu64Bin.size()>=stMax)
+            iIndex=iOffset;
+        else {
+            stGrow=std::min(stGrow, stMax-vu64Bin.size());
+            vu64Bin.insert(vu64Bin.begin(), stGrow, 0);
+            iOffset-=stGrow;
+            iIndex=std::max(iIndex, iOffset);
+        }
+    }
+    else if (iIndex>=iOffset+static_cast<int>(vu64Bin.size())) {
+        if (static_cast<size_t>(iIndex-iOffset)<stMax)
+            vu64Bin.resize(iIndex-iOffset+1, 0);
+        else {
+            // the smallest magnitudes give way to the largest ones: the range becomes ]iIndex-stMax, iIndex]
+            const int iFirst=iIndex-static_cast<int>(stMax)+1;
+            std::vector<uint64_t> vu64Kept(stMax, 0);
+            for(size_t i=0; i<vu64Bin.size(); i++)
+                vu64Kept[std::max(iOffset+static_cast<int>(i)-iFirst, 0)]+=vu64Bin[i];
+            vu64Bin.swap(vu64Kept);
+            iOffset=iFirst;
+        }
+    }
+    vu64Bin[iIndex-iOffset]+=u64N;
+}
+
+inline int _sketch::index(double dMagnitude) const {
+    return static_cast<int>(std::ceil(std::log(dMagnitude)/dLog_gamma));
+}
+
+inline double _sketch::value(int iIndex) const {
+    // the middle of ]gamma^(i-1), gamma^i] in relative error
+    return 2*std::exp(iIndex*dLog_gamma)/(dGamma+1);
+}
+
+inline double _sketch::at_rank(uint64_t u64Rank) const {
+    uint64_t u64Seen=0;
+
+    // the negative values first, from the largest magnitude
+    for(size_t i=stNeg.vu64Bin.size(); i-->0; ) {
+        u64Seen+=stNeg.vu64Bin[i];
+        if (u64Seen>u64Rank)
+            return -value(stNeg.iOffset+static_cast<int>(i));
+    }
+
+    u64Seen+=u64Zero;
+    if (u64Seen>u64Rank)
+        return 0;
+
+    for(size_t i=0; i<stPos.vu64Bin.size(); i++) {
+        u64Seen+=stPos.vu64Bin[i];
+        if (u64Seen>u64Rank)
+            return value(stPos.iOffset+static_cast<int>(i));
+    }
+    return stPos.vu64Bin.empty() ? 0 : value(stPos.iOffset+static_cast<int>(stPos.vu64Bin.size())-1);
+}
+
+#endif // _SKETCH_H
@@ -0,0 +1,456 @@
+/**
+ * \file snr.h
+ * \brief DER_SNR estimate of the signal to noise ratio of a spectrum.
+ *
+ * F. Stoehr et al: DER_SNR: A Simple & General Spectroscopic Signal-to-Noise Measurement Algorithm
+ * 394, Astronomical Data Analysis Software and Systems (ADASS) XVII
+ * 2008ASPC..394..505S
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _SNR_H
+#define _SNR_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstddef>
+#include <set>
+#include <iterator>
+#include <utility>
+#include <array>
+#include <cstdint>
+
+#include <msg.h>
+#include <sketch.h>
+
+#define SNR_SLIDE 16 /**< The medians of a profile slide if the step is shorter than window/SNR_SLIDE, and are selected again otherwise */
+
+/**
+ * \fn float der_snr(const std::vector<float> &vFlux)
+ * \brief Compute the S/N with der_snr method.
+ * \param vFlux flux vector
+ * \return -1 if error happens
+ */
+float der_snr(const std::vector<float> &vFlux);
+double der_snr(const std::vector<double> &vFlux);
+
+/**
+ * \fn template<typename _T> _T der_snr(const _T *pFlux, size_t stN)
+ * \brief Same as der_snr(vFlux) on the stN values from pFlux, e.g. a wavelength range of a column: nothing is copied but into the scratch buffer of the thread.
+ */
+template<typename _T>
+_T der_snr(const _T *pFlux, size_t stN);
+
+/**
+ * \fn float median(const std::vector<float> &vFlux)
+ * \brief Simple computation of the median
+ * \param vFlux flux vector
+ * \return 0 if error happens
+ */
+float median(const std::vector<float> &vFlux);
+double median(const std::vector<double> &vFlux);
+
+/**
+ * \fn template<typename _T> _T select_median(_T *pBegin, _T *pEnd)
+ * \brief Median of [pBegin, pEnd) by selection in O(n): the values are reordered.
+ */
+template<typename _T>
+_T select_median(_T *pBegin, _T *pEnd);
+
+/**
+ * \class _sliding_median
+ * \brief Median of a window sliding over a sequence: two ordered halves, O(log n) per value inserted or erased.
+ */
+template<typename _T>
+class _sliding_median {
+public:
+    void insert(_T TValue);
+
+    /**
+     * \fn void erase(_T TValue)
+     * \brief Remove one occurrence of TValue, which must have been inserted.
+     */
+    void erase(_T TValue);
+
+    _T median() const;
+
+    size_t size() const { return msLow.size()+msHigh.size(); }
+
+    void clear() { msLow.clear(); msHigh.clear(); }
+
+private:
+    std::multiset<_T> msLow; /**< Lower half, with the middle value if the size is odd */
+    std::multiset<_T> msHigh;
+
+    void balance();
+};
+
+/**
+ * \class _snr_sketch
+ * \brief DER_SNR of a flux streamed in one pass, in bounded memory: the medians are approximated by quantile sketches.
+ */
+template<typename _T>
+class _snr_sketch {
+public:
+    /**
+     * \fn explicit _snr_sketch(double dAlpha=SKETCH_ALPHA)
+     * \brief dAlpha is the relative accuracy of the medians.
+     */
+    explicit _snr_sketch(double dAlpha=SKETCH_ALPHA);
+
+    /**
+     * \fn void add(const _T *pFlux, size_t stN)
+     * \brief Stream the next stN fluxes. The negative fluxes are dropped, as in der_snr().
+     */
+    void add(const _T *pFlux, size_t stN);
+
+    /**
+     * \fn bool merge(const _snr_sketch &ssNext)
+     * \brief Append the fluxes streamed into ssNext, which follow the ones of this sketch, e.g. the next chunk of the spectrum.
+     * \return false if the accuracies differ
+     */
+    bool merge(const _snr_sketch &ssNext);
+
+    /**
+     * \fn _T get_snr() const
+     * \return S/N, -1 with fewer than 5 fluxes
+     */
+    _T get_snr() const;
+
+    /**
+     * \fn double get_error() const
+     * \return Bound of the relative error of get_snr() on the exact DER_SNR
+     */
+    double get_error() const;
+
+    uint64_t count() const { return u64Kept; }
+
+private:
+    _sketch skSignal;
+    _sketch skNoise;
+    uint64_t u64Kept;
+    std::vector<_T> vHead; /**< First 4 fluxes kept, for the residuals across a merge */
+    std::array<_T, 4> aTail; /**< Last 4 fluxes kept: flux k in aTail[k%4] */
+
+    std::vector<_T> get_tail() const;
+};
+
+/**
+ * \fn template<typename _T> void der_snr_profile(const _T *pWave, const _T *pFlux, size_t stN, size_t stWindow, size_t stStep, std::vector<std::pair<_T, _T> > &vpProfile)
+ * \brief Local S/N in windows of stWindow points moved by stStep points. Each window gives the wavelength of its middle point and its S/N, computed as der_snr() would on the window. The medians are updated as the window slides.
+ */
+template<typename _T>
+void der_snr_profile(const _T *pWave, const _T *pFlux, size_t stN, size_t stWindow, size_t stStep,
+                     std::vector<std::pair<_T, _T> > &vpProfile);
+
+/**
+ * \fn template<typename _T> void der_snr_regions(const _T *pWave, const _T *pFlux, size_t stN, const std::vector<std::pair<_T, _T> > &vpRegion, std::vector<_T> &vSnr)
+ * \brief S/N of each wavelength range [min, max] of vpRegion. The ranges are found by binary search in pWave, sorted in ascending or descending order, and the fluxes are not copied. A range without points gives -1.
+ */
+template<typename _T>
+void der_snr_regions(const _T *pWave, const _T *pFlux, size_t stN, const std::vector<std::pair<_T, _T> > &vpRegion,
+                     std::vector<_T> &vSnr);
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+template<typename _T>
+inline _T select_median(_T *pBegin, _T *pEnd) {
+    const size_t stSize=pEnd-pBegin;
+    _T *pMid=pBegin+stSize/2;
+
+    std::nth_element(pBegin, pMid, pEnd);
+    if (stSize%2==1)
+        return *pMid;
+
+    // the lower middle value is the largest of the lower half
+    return (*std::max_element(pBegin, pMid)+*pMid)/2;
+}
+
+template<typename _T>
+inline void _sliding_median<_T>::insert(_T TValue) {
+    if (msLow.empty() || TValue<=*msLow.rbegin())
+        msLow.insert(TValue);
+    else
+        msHigh.insert(TValue);
+    balance();
+}
+
+template<typename _T>
+inline void _sliding_median<_T>::erase(_T TValue) {
+    if (!msLow.empty() && TValue<=*msLow.rbegin())
+        msLow.erase(msLow.find(TValue));
+    else
+        msHigh.erase(msHigh.find(TValue));
+    balance();
+}
+
+template<typename _T>
+inline _T _sliding_median<_T>::median() const {
+    if (msLow.empty())
+        return 0;
+    if (msLow.size()>msHigh.size())
+        return *msLow.rbegin();
+    return (*msLow.rbegin()+*msHigh.begin())/2;
+}
+
+template<typename _T>
+inline void _sliding_median<_T>::balance() {
+    if (msLow.size()>msHigh.size()+1) {
+        auto itLast=std::prev(msLow.end());
+        msHigh.insert(*itLast);
+        msLow.erase(itLast);
+    }
+    else if (msHigh.size()>msLow.size()) {
+        msLow.insert(*msHigh.begin());
+        msHigh.erase(msHigh.begin());
+    }
+}
+
+inline float median(const std::vector<float> &vFlux) {    
+    if (vFlux.empty()) {
+        _msg msgM;
+        msgM.set_name("median()");
+        msgM.msg(_msg::eMsg::MID, "error: flux is empty");
+        return 0;
+    }
+    
+    std::vector<float> vVec(vFlux);
+    return select_median(vVec.data(), vVec.data()+vVec.size());
+}
+
+inline double median(const std::vector<double> &vFlux) {
+    if (vFlux.empty()) {
+        _msg msgM;
+        msgM.set_name("median()");
+        msgM.msg(_msg::eMsg::MID, "error: flux is empty");
+        return 0;
+    }
+    
+    std::vector<double> vVec(vFlux);
+    return select_median(vVec.data(), vVec.data()+vVec.size());
+}
+
+template<typename _T>
+inline _T der_snr(const _T *pFlux, size_t stN) {
+    if (stN==0) {
+        _msg msgM;
+        msgM.set_name("der_snr()");
+        msgM.msg(_msg::eMsg::MID, "error: flux is empty");
+        return 0;
+    }
+    
+    // reused by the next spectra of the worker: no allocation once warm
+    thread_local std::vector<_T> vScratch;
+    if (vScratch.size()<2*stN)
+        vScratch.resize(2*stN);
+    
+    // the fluxes kept in the first half, the residuals |2 f[i] - f[i-2] - f[i+2]| in the second half
+    _T *pSignal=vScratch.data();
+    _T *pNoise=pSignal+stN;
+    size_t stKept=0;
+    
+    for(size_t i=0; i<stN; i++) {
+        const _T TF=pFlux[i];
+        // the negative fluxes are dropped before the differences, and the NaN, which have no order
+        if (!(TF>=0)) continue;
+        
+        pSignal[stKept]=TF;
+        if (stKept>=4)
+            pNoise[stKept-4]=std::abs(2*pSignal[stKept-2]-pSignal[stKept-4]-TF);
+        stKept++;
+    }
+    
+    if (stKept<=4)
+        return -1;
+    
+    // the residuals first: the selection reorders the fluxes they are computed from
+    _T TNoise=static_cast<_T>(1.482602/std::sqrt(6.))*select_median(pNoise, pNoise+stKept-4);
+    _T TSignal=select_median(pSignal, pSignal+stKept);
+    
+    return TSignal/TNoise;
+}
+
+template<typename _T>
+inline void der_snr_profile(const _T *pWave, const _T *pFlux, size_t stN, size_t stWindow, size_t stStep,
+                            std::vector<std::pair<_T, _T> > &vpProfile) {
+    vpProfile.clear();
+    
+    // the negative and NaN fluxes are dropped, as in der_snr(), before the windows are cut
+    thread_local std::vector<_T> vScratch;
+    if (vScratch.size()<3*stN)
+        vScratch.resize(3*stN);
+    
+    _T *pSignal=vScratch.data();
+    _T *pNoise=pSignal+stN;
+    _T *pKept_wave=pNoise+stN;
+    size_t stKept=0;
+    
+    for(size_t i=0; i<stN; i++) {
+        const _T TF=pFlux[i];
+        if (!(TF>=0)) continue;
+        
+        pSignal[stKept]=TF;
+        pKept_wave[stKept]=pWave[i];
+        if (stKept>=4)
+            pNoise[stKept-4]=std::abs(2*pSignal[stKept-2]-pSignal[stKept-4]-TF);
+        stKept++;
+    }
+    
+    if (stKept==0)
+        return;
+    
+    // a spectrum shorter than the window is a single window
+    const size_t stW=std::min(std::max<size_t>(stWindow, 1), stKept);
+    stStep=std::max<size_t>(stStep, 1);
+    
+    if (stW<=4) {
+        vpProfile.emplace_back(pKept_wave[stW/2], -1);
+        return;
+    }
+    
+    // windows which share few points are cheaper to select again than to slide
+    if (stStep*SNR_SLIDE>=stW) {
+        for(size_t stBegin=0; stBegin+stW<=stKept; stBegin+=stStep)
+            vpProfile.emplace_back(pKept_wave[stBegin+stW/2], der_snr(pSignal+stBegin, stW));
+        return;
+    }
+    
+    // the window [b, b+W) holds the residuals [b, b+W-4)
+    const _T TScale=static_cast<_T>(1.482602/std::sqrt(6.));
+    _sliding_median<_T> smSignal, smNoise;
+    
+    for(size_t k=0; k<stW; k++)
+        smSignal.insert(pSignal[k]);
+    for(size_t k=0; k<stW-4; k++)
+        smNoise.insert(pNoise[k]);
+    
+    size_t stBegin=0;
+    while (true) {
+        vpProfile.emplace_back(pKept_wave[stBegin+stW/2], smSignal.median()/(TScale*smNoise.median()));
+        
+        const size_t stNext=stBegin+stStep;
+        if (stNext+stW>stKept)
+            break;
+        
+        for(size_t k=stBegin; k<stNext; k++) {
+            smSignal.erase(pSignal[k]);
+            smNoise.erase(pNoise[k]);
+        }
+        for(size_t k=stBegin+stW; k<stNext+stW; k++) {
+            smSignal.insert(pSignal[k]);
+            smNoise.insert(pNoise[k-4]);
+        }
+        stBegin=stNext;
+    }
+}
+
+template<typename _T>
+inline void der_snr_regions(const _T *pWave, const _T *pFlux, size_t stN, const std::vector<std::pair<_T, _T> > &vpRegion,
+                            std::vector<_T> &vSnr) {
+    vSnr.clear();
+    const bool bAscending=stN<2 || pWave[0]<=pWave[stN-1];
+    const _T *pLast=pWave+stN;
+    
+    for(auto &pRegion: vpRegion) {
+        const _T *pBegin, *pEnd;
+        if (bAscending) {
+            pBegin=std::lower_bound(pWave, pLast, pRegion.first);
+            pEnd=std::upper_bound(pBegin, pLast, pRegion.second);
+        }
+        else {
+            pBegin=std::lower_bound(pWave, pLast, pRegion.second, std::greater<_T>());
+            pEnd=std::upper_bound(pBegin, pLast, pRegion.first, std::greater<_T>());
+        }
+        
+        vSnr.push_back(pEnd>pBegin ? der_snr(pFlux+(pBegin-pWave), pEnd-pBegin) : -1);
+    }
+}
+
+template<typename _T>
+inline _snr_sketch<_T>::_snr_sketch(double dAlpha):
+    skSignal(dAlpha), skNoise(dAlpha), u64Kept(0), aTail() { }
+
+template<typename _T>
+inline void _snr_sketch<_T>::add(const _T *pFlux, size_t stN) {
+    for(size_t i=0; i<stN; i++) {
+        const _T TF=pFlux[i];
+        if (!(TF>=0)) continue;
+        
+        if (vHead.size()<4)
+            vHead.push_back(TF);
+        if (u64Kept>=4)
+            skNoise.add(std::abs(2*aTail[(u64Kept-2)%4]-aTail[u64Kept%4]-TF));
+        
+        skSignal.add(TF);
+        aTail[u64Kept%4]=TF;
+        u64Kept++;
+    }
+}
+
+template<typename _T>
+inline bool _snr_sketch<_T>::merge(const _snr_sketch &ssNext) {
+    if (ssNext.skSignal.get_alpha()!=skSignal.get_alpha())
+        return false;
+    
+    // the residuals whose 5 fluxes straddle the two parts
+    std::vector<_T> vTail=get_tail();
+    std::vector<_T> vBorder(vTail);
+    vBorder.insert(vBorder.end(), ssNext.vHead.begin(), ssNext.vHead.end());
+    for(size_t i=0; i<vTail.size() && i+4<vBorder.size(); i++)
+        skNoise.add(std::abs(2*vBorder[i+2]-vBorder[i]-vBorder[i+4]));
+    
+    skSignal.merge(ssNext.skSignal);
+    skNoise.merge(ssNext.skNoise);
+    
+    for(size_t i=0; vHead.size()<4 && i<ssNext.vHead.size(); i++)
+        vHead.push_back(ssNext.vHead[i]);
+    
+    // the head of a part shorter than 4 is the whole part
+    if (ssNext.u64Kept>=4)
+        vTail=ssNext.get_tail();
+    else
+        vTail.insert(vTail.end(), ssNext.vHead.begin(), ssNext.vHead.end());
+    
+    u64Kept+=ssNext.u64Kept;
+    for(size_t i=0; i<vTail.size() && i<4; i++)
+        aTail[(u64Kept-1-i)%4]=vTail[vTail.size()-1-i];
+    return true;
+}
+
+template<typename _T>
+inline _T _snr_sketch<_T>::get_snr() const {
+    if (u64Kept<=4)
+        return -1;
+    return static_cast<_T>(skSignal.median()/(1.482602/std::sqrt(6.)*skNoise.median()));
+}
+
+template<typename _T>
+inline double _snr_sketch<_T>::get_error() const {
+    // signal and noise each within alpha
+    const double dAlpha=skSignal.get_alpha();
+    return 2*dAlpha/(1-dAlpha);
+}
+
+template<typename _T>
+inline std::vector<_T> _snr_sketch<_T>::get_tail() const {
+    std::vector<_T> vTail;
+    for(uint64_t k=u64Kept-std::min<uint64_t>(u64Kept, 4); k<u64Kept; k++)
+        vTail.push_back(aTail[k%4]);
+    return vTail;
+}
+
+inline float der_snr(const std::vector<float> &vFlux) {
+    return der_snr(vFlux.data(), vFlux.size());
+}
+
+inline double der_snr(const std::vector<double> &vFlux) {
+    return der_snr(vFlux.data(), vFlux.size());
+}
+
+#endif // _SNR_H
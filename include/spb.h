@@ -0,0 +1,338 @@
+/**
+ * \file spb.h
+ * \brief Native binary spectrum format (.spb).
+ *
+ * Layout, in host byte order:
+ * - a 64 bytes header (_spb_header),
+ * - the column names, each one terminated by '\\0',
+ * - one block per column, each block starting on a 64 bytes boundary.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _SPB_H
+#define _SPB_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+#include <io.h>
+
+#define SPB_VERSION 1 /**< Version of the .spb layout */
+#define SPB_ALIGN 64 /**< Alignment of the column blocks */
+
+/**
+ * \struct _spb_header
+ * \brief Fixed size header at the beginning of a .spb file.
+ */
+struct _spb_header {
+    char acMagic[4]; /**< "SPB\0" */
+    uint16_t u16Version; /**< SPB_VERSION */
+    uint8_t u8Dtype; /**< _spb::eDtype of the values */
+    uint8_t u8Flags; /**< _spb::eFlag bits */
+    uint32_t u32Cols; /**< Number of columns */
+    uint32_t u32Names; /**< Size of the names block in bytes */
+    uint64_t u64Rows; /**< Number of rows */
+    double dWmin; /**< Minimum of the first column */
+    double dWmax; /**< Maximum of the first column */
+    uint64_t u64Data; /**< Offset of the first column block */
+    uint64_t u64Stride; /**< Distance between two column blocks */
+    uint8_t au8Reserved[8];
+};
+
+static_assert(sizeof(_spb_header)==64, "_spb_header must be 64 bytes");
+
+/**
+ * \class _spb
+ * \brief Read-only memory mapped .spb file. Columns are used in place when the type matches, without any parsing.
+ */
+class _spb {
+public:
+    /**
+     * \enum eDtype
+     * \brief Type of the stored values
+     */
+    typedef enum { FLOAT=1, DOUBLE=2, LONG_DOUBLE=3 } eDtype;
+
+    /**
+     * \enum eFlag
+     * \brief Bits of _spb_header::u8Flags
+     */
+    typedef enum { SORTED=1 } eFlag;
+
+    explicit _spb();
+
+    /**
+     * \fn explicit _spb(const std::string &sFilename)
+     * \brief Map the file sFilename. Use is_open() to check the result.
+     */
+    explicit _spb(const std::string &sFilename);
+
+    /**
+     * \fn bool open(const std::string &sFilename)
+     * \brief Map and check the file sFilename.
+     * \return true if the file is a valid .spb file
+     */
+    bool open(const std::string &sFilename);
+
+    bool is_open() const;
+
+    size_t get_cols() const;
+    size_t get_rows() const;
+    eDtype get_dtype() const;
+    double get_wmin() const;
+    double get_wmax() const;
+
+    /**
+     * \fn bool is_sorted() const
+     * \return true if the first column is sorted in ascending order
+     */
+    bool is_sorted() const;
+
+    const std::vector<std::string>& get_header() const;
+
+    /**
+     * \fn template<typename _T> const _T* get_column(size_t stCol) const
+     * \brief Pointer to the mapped column stCol.
+     * \return nullptr if the stored type is not _T or stCol is invalid
+     */
+    template<typename _T>
+    const _T* get_column(size_t stCol) const;
+
+    /**
+     * \fn template<typename _T> bool copy_column(size_t stCol, size_t stFirst, size_t stN, _T *pOut) const
+     * \brief Copy stN values of the column stCol from the row stFirst, with a conversion if the stored type is not _T.
+     */
+    template<typename _T>
+    bool copy_column(size_t stCol, size_t stFirst, size_t stN, _T *pOut) const;
+
+    /**
+     * \fn template<typename _T> static bool write(const std::string &sFilename, const std::vector<std::string> &vsHeader, const std::vector<std::vector<_T> > &vvColumn, size_t stRows)
+     * \brief Write the columns (the first stRows values of each) in sFilename. The wavelength range and the sortedness are taken from the first column.
+     */
+    template<typename _T>
+    static bool write(const std::string &sFilename,
+                      const std::vector<std::string> &vsHeader,
+                      const std::vector<std::vector<_T> > &vvColumn,
+                      size_t stRows);
+
+    /**
+     * \fn static bool is_spb(const std::string &sFilename)
+     * \return true if sFilename has the .spb extension
+     */
+    static bool is_spb(const std::string &sFilename);
+
+    template<typename _T>
+    static eDtype dtype();
+
+    static size_t dtype_size(eDtype edType);
+
+private:
+    _mmap mFile;
+    const _spb_header *pHeader; /**< Header in the mapping, nullptr if closed */
+    std::vector<std::string> vsHeader; /**< Column names */
+
+    static size_t align(size_t stN);
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _spb::_spb(): pHeader(nullptr) { }
+
+inline _spb::_spb(const std::string &sFilename): _spb() {
+    open(sFilename);
+}
+
+inline bool _spb::open(const std::string &sFilename) {
+    pHeader=nullptr;
+    vsHeader.clear();
+
+    if (!mFile.open(sFilename) || mFile.size()<sizeof(_spb_header))
+        return false;
+
+    const _spb_header *pH=reinterpret_cast<const _spb_header*>(mFile.data());
+
+    if (std::memcmp(pH->acMagic, "SPB", 4)!=0 || pH->u16Version!=SPB_VERSION)
+        return false;
+
+    const size_t stElem=dtype_size(static_cast<eDtype>(pH->u8Dtype));
+    if (stElem==0 || pH->u32Cols==0)
+        return false;
+
+    // everything must be inside the file: divisions, a corrupt header must not overflow the products
+    if (sizeof(_spb_header)+pH->u32Names>pH->u64Data ||
+        pH->u64Data>mFile.size() || pH->u64Stride>mFile.size() ||
+        pH->u64Data%SPB_ALIGN!=0 || pH->u64Stride%SPB_ALIGN!=0)
+        return false;
+    if (pH->u64Stride==0) {
+        if (pH->u64Rows!=0)
+            return false;
+    }
+    else if (pH->u64Rows>pH->u64Stride/stElem ||
+             pH->u32Cols>(mFile.size()-pH->u64Data)/pH->u64Stride)
+        return false;
+
+    const char *pcName=mFile.data()+sizeof(_spb_header);
+    const char *pcEnd=pcName+pH->u32Names;
+
+    while (pcName<pcEnd) {
+        const char *pcZero=static_cast<const char*>(std::memchr(pcName, '\0', pcEnd-pcName));
+        if (pcZero==nullptr) return false;
+        vsHeader.emplace_back(pcName, pcZero);
+        pcName=pcZero+1;
+    }
+
+    if (!vsHeader.empty() && vsHeader.size()!=pH->u32Cols) {
+        vsHeader.clear();
+        return false;
+    }
+
+    pHeader=pH;
+
+    return true;
+}
+
+inline bool _spb::is_open() const { return pHeader!=nullptr; }
+
+inline size_t _spb::get_cols() const { return pHeader ? pHeader->u32Cols : 0; }
+
+inline size_t _spb::get_rows() const { return pHeader ? pHeader->u64Rows : 0; }
+
+inline _spb::eDtype _spb::get_dtype() const {
+    return static_cast<eDtype>(pHeader ? pHeader->u8Dtype : 0);
+}
+
+inline double _spb::get_wmin() const { return pHeader ? pHeader->dWmin : 0; }
+
+inline double _spb::get_wmax() const { return pHeader ? pHeader->dWmax : 0; }
+
+inline bool _spb::is_sorted() const { return pHeader && (pHeader->u8Flags & SORTED); }
+
+inline const std::vector<std::string>& _spb::get_header() const { return vsHeader; }
+
+template<typename _T>
+const _T* _spb::get_column(size_t stCol) const {
+    if (!pHeader || stCol>=pHeader->u32Cols || pHeader->u8Dtype!=dtype<_T>())
+        return nullptr;
+
+    return reinterpret_cast<const _T*>(mFile.data()+pHeader->u64Data+stCol*pHeader->u64Stride);
+}
+
+template<typename _T>
+bool _spb::copy_column(size_t stCol, size_t stFirst, size_t stN, _T *pOut) const {
+    if (!pHeader || stCol>=pHeader->u32Cols || stFirst+stN>pHeader->u64Rows)
+        return false;
+
+    const char *pcBlock=mFile.data()+pHeader->u64Data+stCol*pHeader->u64Stride;
+
+    switch (pHeader->u8Dtype) {
+        case FLOAT: {
+            const float *pIn=reinterpret_cast<const float*>(pcBlock)+stFirst;
+            std::copy(pIn, pIn+stN, pOut);
+            break;
+        }
+        case DOUBLE: {
+            const double *pIn=reinterpret_cast<const double*>(pcBlock)+stFirst;
+            std::copy(pIn, pIn+stN, pOut);
+            break;
+        }
+        case LONG_DOUBLE: {
+            const long double *pIn=reinterpret_cast<const long double*>(pcBlock)+stFirst;
+            std::copy(pIn, pIn+stN, pOut);
+            break;
+        }
+        default:
+            return false;
+    }
+    return true;
+}
+
+template<typename _T>
+bool _spb::write(const std::string &sFilename,
+                 const std::vector<std::string> &vsHeader,
+                 const std::vector<std::vector<_T> > &vvColumn,
+                 size_t stRows) {
+    if (vvColumn.empty() || (!vsHeader.empty() && vsHeader.size()!=vvColumn.size()))
+        return false;
+
+    for(auto &vCol: vvColumn)
+        if (vCol.size()<stRows) return false;
+
+    _spb_header spbH;
+    std::memset(&spbH, 0, sizeof(spbH));
+    std::memcpy(spbH.acMagic, "SPB", 4);
+    spbH.u16Version=SPB_VERSION;
+    spbH.u8Dtype=dtype<_T>();
+    spbH.u32Cols=vvColumn.size();
+    spbH.u64Rows=stRows;
+
+    for(auto &h: vsHeader)
+        spbH.u32Names+=h.size()+1;
+
+    const std::vector<_T> &vWave=vvColumn[0];
+    if (stRows>0) {
+        auto pMinMax=std::minmax_element(vWave.begin(), vWave.begin()+stRows);
+        spbH.dWmin=*pMinMax.first;
+        spbH.dWmax=*pMinMax.second;
+    }
+    if (std::is_sorted(vWave.begin(), vWave.begin()+stRows))
+        spbH.u8Flags|=SORTED;
+
+    spbH.u64Data=align(sizeof(_spb_header)+spbH.u32Names);
+    spbH.u64Stride=align(stRows*sizeof(_T));
+
+    _writer wOut;
+    if (!wOut.open(sFilename))
+        return false;
+
+    const std::string sPad(SPB_ALIGN, '\0');
+
+    wOut.append(reinterpret_cast<const char*>(&spbH), sizeof(spbH));
+    for(auto &h: vsHeader)
+        wOut.append(h.c_str(), h.size()+1);
+    wOut.append(sPad.data(), spbH.u64Data-sizeof(_spb_header)-spbH.u32Names);
+
+    for(auto &vCol: vvColumn) {
+        wOut.append(reinterpret_cast<const char*>(vCol.data()), stRows*sizeof(_T));
+        wOut.append(sPad.data(), spbH.u64Stride-stRows*sizeof(_T));
+    }
+
+    return wOut.close();
+}
+
+inline bool _spb::is_spb(const std::string &sFilename) {
+    const std::string sExt(".spb");
+    return sFilename.size()>sExt.size() &&
+           sFilename.compare(sFilename.size()-sExt.size(), sExt.size(), sExt)==0;
+}
+
+template<typename _T>
+_spb::eDtype _spb::dtype() {
+    static_assert(std::is_floating_point<_T>::value, "_spb: floating point type required");
+
+    if (std::is_same<_T, float>::value) return FLOAT;
+    if (std::is_same<_T, double>::value) return DOUBLE;
+    return LONG_DOUBLE;
+}
+
+inline size_t _spb::dtype_size(eDtype edType) {
+    switch (edType) {
+        case FLOAT: return sizeof(float);
+        case DOUBLE: return sizeof(double);
+        case LONG_DOUBLE: return sizeof(long double);
+        default: return 0;
+    }
+}
+
+inline size_t _spb::align(size_t stN) {
+    return (stN+SPB_ALIGN-1)/SPB_ALIGN*SPB_ALIGN;
+}
+
+#endif // _SPB_H
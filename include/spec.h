@@ -0,0 +1,287 @@
+/**
+ * \file spec.h
+ * \brief Commands of the spec tool: trim, threshold, shift and der_snr applied in turn to a spectrum held in memory.
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _SPEC_H
+#define _SPEC_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <boost/program_options.hpp>
+
+#include <csv.h>
+#include <snr.h>
+#include <collector.h>
+
+#define CLIGHT 299792.458 // /**< Speed of light in km/s  */
+
+/**
+ * \class _stage
+ * \brief One command of a chain. Its options are parsed by the constructor of the derived class.
+ */
+class _stage {
+public:
+    virtual ~_stage() { }
+
+    /**
+     * \fn virtual bool apply(_csv<float> &csv, std::string &sResult) const
+     * \brief Apply the command to the spectrum. A measure is appended to sResult, tab separated.
+     * \return false if the spectrum has to be dropped
+     */
+    virtual bool apply(_csv<float> &csv, std::string &sResult) const=0;
+
+    /**
+     * \fn virtual std::vector<int> get_columns() const
+     * \return Columns read by apply(): the other ones are copied verbatim
+     */
+    virtual std::vector<int> get_columns() const=0;
+
+    /**
+     * \fn virtual bool is_writer() const
+     * \return true if apply() modifies the spectrum, which then has to be written
+     */
+    virtual bool is_writer() const { return true; }
+
+    const std::string& get_name() const { return sName; }
+
+    /**
+     * \fn static std::unique_ptr<_stage> make(const std::string &sName, const std::vector<std::string> &vsArgs)
+     * \brief Build the command sName with its options vsArgs.
+     * \return nullptr if sName is unknown. boost::program_options errors are thrown.
+     */
+    static std::unique_ptr<_stage> make(const std::string &sName, const std::vector<std::string> &vsArgs);
+
+    /**
+     * \fn static bool is_command(const std::string &sName)
+     * \return true if sName is the name of a command
+     */
+    static bool is_command(const std::string &sName);
+
+    /**
+     * \fn static void help()
+     * \brief Print the options of each command.
+     */
+    static void help();
+
+protected:
+    explicit _stage(const std::string &sName): sName(sName) { }
+
+    /**
+     * \fn static boost::program_options::variables_map parse(const boost::program_options::options_description &poDesc, const std::vector<std::string> &vsArgs)
+     * \brief Parse the options of one command.
+     */
+    static boost::program_options::variables_map parse(const boost::program_options::options_description &poDesc,
+                                                       const std::vector<std::string> &vsArgs);
+
+    static boost::program_options::options_description options(const std::string &sName);
+
+private:
+    std::string sName;
+};
+
+/**
+ * \class _stage_trim
+ * \brief Keep the wavelengths in [min, max].
+ */
+class _stage_trim: public _stage {
+public:
+    explicit _stage_trim(const std::vector<std::string> &vsArgs);
+    bool apply(_csv<float> &csv, std::string &sResult) const override;
+    std::vector<int> get_columns() const override { return {0}; }
+
+private:
+    float fMin;
+    float fMax;
+};
+
+/**
+ * \class _stage_threshold
+ * \brief Remove the rows whose flux is lower or equal to the threshold.
+ */
+class _stage_threshold: public _stage {
+public:
+    explicit _stage_threshold(const std::vector<std::string> &vsArgs);
+    bool apply(_csv<float> &csv, std::string &sResult) const override;
+    std::vector<int> get_columns() const override { return {1}; }
+
+private:
+    float fThreshold;
+};
+
+/**
+ * \class _stage_shift
+ * \brief Shift the wavelengths, or correct them from a radial velocity.
+ */
+class _stage_shift: public _stage {
+public:
+    explicit _stage_shift(const std::vector<std::string> &vsArgs);
+    bool apply(_csv<float> &csv, std::string &sResult) const override;
+    std::vector<int> get_columns() const override { return {0}; }
+
+private:
+    bool bVelocity;
+    float fValue; /**< Wavelength shift or radial velocity in km/s */
+};
+
+/**
+ * \class _stage_der_snr
+ * \brief Measure the S/N of the flux. The spectrum is left untouched.
+ */
+class _stage_der_snr: public _stage {
+public:
+    explicit _stage_der_snr(const std::vector<std::string> &vsArgs);
+    bool apply(_csv<float> &csv, std::string &sResult) const override;
+    std::vector<int> get_columns() const override { return {1}; }
+    bool is_writer() const override { return false; }
+
+    const std::string& get_output() const { return sOutput; }
+    _collector::eFormat get_format() const { return fFormat; }
+    _collector::eOrder get_order() const { return oOrder; }
+
+private:
+    std::string sOutput; /**< File of the S/N table */
+    _collector::eFormat fFormat;
+    _collector::eOrder oOrder;
+};
+
+/**
+ * \fn bool split_chain(const std::vector<std::string> &vsToken, std::vector<std::unique_ptr<_stage> > &vpStage)
+ * \brief Build the commands of a chain: "name options : name options ...".
+ * \return false if a command is unknown. boost::program_options errors are thrown.
+ */
+inline bool split_chain(const std::vector<std::string> &vsToken, std::vector<std::unique_ptr<_stage> > &vpStage);
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline boost::program_options::options_description _stage::options(const std::string &sName) {
+    namespace po = boost::program_options;
+    po::options_description poDesc(sName);
+
+    if (sName=="trim")
+        poDesc.add_options()
+        ("min,l",  po::value<float>()->required(),"Minimum wavelength")
+        ("max,u",  po::value<float>()->required(),"Maximum wavelength");
+    else if (sName=="threshold")
+        poDesc.add_options()
+        ("threshold,t",  po::value<float>()->required(),"f<=threshold will be deleted");
+    else if (sName=="shift")
+        poDesc.add_options()
+        ("wavelength,w",  po::value<float>(),"Shift the wavelengths by this value")
+        ("velocity,v",  po::value<float>(),"Correct the radial velocity (km/s)");
+    else if (sName=="der_snr")
+        poDesc.add_options()
+        ("output,o",  po::value<std::string>()->default_value("output.csv"),"Filename of the S/N table")
+        ("format",  po::value<std::string>()->default_value("text"),"Format of the table: text, tsv (with a header) or jsonl")
+        ("sort",  po::value<std::string>()->default_value("path"),"Order of the table: path, snr or input (the order the files are found)");
+
+    return poDesc;
+}
+
+inline boost::program_options::variables_map _stage::parse(const boost::program_options::options_description &poDesc,
+                                                           const std::vector<std::string> &vsArgs) {
+    namespace po = boost::program_options;
+    po::variables_map vm;
+    po::store(po::command_line_parser(vsArgs).options(poDesc).run(), vm);
+    po::notify(vm);
+    return vm;
+}
+
+inline std::unique_ptr<_stage> _stage::make(const std::string &sName, const std::vector<std::string> &vsArgs) {
+    if (sName=="trim") return std::make_unique<_stage_trim>(vsArgs);
+    if (sName=="threshold") return std::make_unique<_stage_threshold>(vsArgs);
+    if (sName=="shift") return std::make_unique<_stage_shift>(vsArgs);
+    if (sName=="der_snr") return std::make_unique<_stage_der_snr>(vsArgs);
+    return nullptr;
+}
+
+inline bool _stage::is_command(const std::string &sName) {
+    return sName=="trim" || sName=="threshold" || sName=="shift" || sName=="der_snr";
+}
+
+inline void _stage::help() {
+    for(auto sName: {"trim", "threshold", "shift", "der_snr"})
+        std::cout << options(sName);
+}
+
+// ----------------------------------------------------
+
+inline _stage_trim::_stage_trim(const std::vector<std::string> &vsArgs): _stage("trim") {
+    auto vm=parse(options("trim"), vsArgs);
+    fMin=std::min(vm["min"].as<float>(), vm["max"].as<float>());
+    fMax=std::max(vm["min"].as<float>(), vm["max"].as<float>());
+}
+
+inline bool _stage_trim::apply(_csv<float> &csv, std::string&) const {
+    return csv.apply_range_threshold(fMin, fMax, 0);
+}
+
+inline _stage_threshold::_stage_threshold(const std::vector<std::string> &vsArgs): _stage("threshold") {
+    auto vm=parse(options("threshold"), vsArgs);
+    fThreshold=vm["threshold"].as<float>();
+}
+
+inline bool _stage_threshold::apply(_csv<float> &csv, std::string&) const {
+    return csv.apply_min_threshold(fThreshold, 1);
+}
+
+inline _stage_shift::_stage_shift(const std::vector<std::string> &vsArgs): _stage("shift") {
+    auto vm=parse(options("shift"), vsArgs);
+
+    if (vm.count("wavelength")==vm.count("velocity"))
+        throw boost::program_options::error("shift: set either --wavelength or --velocity");
+
+    bVelocity=vm.count("velocity");
+    fValue=bVelocity ? vm["velocity"].as<float>() : vm["wavelength"].as<float>();
+}
+
+inline bool _stage_shift::apply(_csv<float> &csv, std::string&) const {
+    if (bVelocity)
+        return csv.transform_lin(1/(1+fValue/CLIGHT), 0, 0);
+    return csv.shift(fValue);
+}
+
+inline _stage_der_snr::_stage_der_snr(const std::vector<std::string> &vsArgs): _stage("der_snr") {
+    auto vm=parse(options("der_snr"), vsArgs);
+    sOutput=vm["output"].as<std::string>();
+    
+    if (!_collector::parse_format(vm["format"].as<std::string>(), fFormat))
+        throw boost::program_options::error("der_snr: unknown --format "+vm["format"].as<std::string>());
+    if (!_collector::parse_order(vm["sort"].as<std::string>(), oOrder))
+        throw boost::program_options::error("der_snr: unknown --sort "+vm["sort"].as<std::string>());
+}
+
+inline bool _stage_der_snr::apply(_csv<float> &csv, std::string &sResult) const {
+    sResult+="\t"+std::to_string(der_snr(csv.get_column(1)));
+    return true;
+}
+
+// ----------------------------------------------------
+
+inline bool split_chain(const std::vector<std::string> &vsToken, std::vector<std::unique_ptr<_stage> > &vpStage) {
+    vpStage.clear();
+
+    auto itFirst=vsToken.begin();
+    while (itFirst!=vsToken.end()) {
+        auto itLast=std::find(itFirst, vsToken.end(), std::string(":"));
+
+        // empty commands between two ':' are ignored
+        if (itFirst!=itLast) {
+            auto pStage=_stage::make(*itFirst, std::vector<std::string>(itFirst+1, itLast));
+            if (!pStage) return false;
+            vpStage.emplace_back(std::move(pStage));
+        }
+
+        itFirst=itLast==vsToken.end() ? itLast : itLast+1;
+    }
+    return true;
+}
+
+#endif // _SPEC_H
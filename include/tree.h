@@ -0,0 +1,588 @@
+/**
+ * \file tree.h
+ * \brief Discover the spectra of an input tree, and mirror it into an output directory.
+ *
+ * The spectra are handed to a callback with their input and output paths,
+ * so that a tool writes its result straight to the mirrored path. The other
+ * files are reflinked when the filesystem allows it, otherwise hard linked,
+ * otherwise copied.
+ *
+ * Several threads list the directories, which hides the latency of a network
+ * filesystem. The spectra are streamed to the callback, called from the
+ * thread of walk(), as soon as they are found. Files and directories are
+ * selected by include and exclude globs.
+ *
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#ifndef _TREE_H
+#define _TREE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <tuple>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string_view>
+#include <exception>
+
+#include <pipeline.h>
+
+#if __has_include (<filesystem>)
+#include <filesystem>
+#define FS_STD /**< std::filesystem availability (C++17) */
+namespace fs = std::filesystem;
+#elif __has_include (<experimental/filesystem>) && !__has_include (<filesystem>)
+#include <experimental/filesystem>
+#define FS_STDEXP /**< std::experimental::filesystem availability */
+namespace fs = std::experimental::filesystem;
+#elif __has_include(<boost/filesystem.hpp>) && !__has_include (<filesystem>) && !__has_include (<experimental/filesystem>)
+#include <boost/filesystem.hpp>
+#define FS_BOOST /**< boost::filesystem availability */
+namespace fs = boost::filesystem;
+#else
+#error "No filesystem header found"
+#endif
+
+#if __has_include (<linux/fs.h>) && __has_include (<sys/ioctl.h>) && __has_include (<sys/stat.h>) && __has_include (<fcntl.h>) && __has_include (<unistd.h>)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef FICLONE
+#define HAS_FICLONE /**< reflink (copy on write clone) availability */
+#endif
+#endif
+
+#define TREE_THREADS 8 /**< Default number of threads which list the directories */
+
+/**
+ * \class _tree
+ * \brief Walk an input tree and build its mirror in an output directory.
+ */
+class _tree {
+public:
+    /**
+     * \fn explicit _tree(const std::string &sInput, const std::string &sOutput="")
+     * \brief sInput is the root of the input tree, sOutput the root of its mirror. Without sOutput, the spectra are only discovered.
+     */
+    explicit _tree(const std::string &sInput, const std::string &sOutput="");
+
+    /**
+     * \fn bool walk(const std::function<void(const std::string&, const std::string&)> &fSpectrum)
+     * \brief Create the directories of the mirror, link the files which are not spectra and call fSpectrum(sIn, sOut) for each spectrum selected. fSpectrum is called from the calling thread, in no particular order; sOut is empty without mirror.
+     * \return false if a directory cannot be listed, or a directory or a link cannot be created
+     */
+    bool walk(const std::function<void(const std::string&, const std::string&)> &fSpectrum);
+
+    /**
+     * \fn void set_threads(int iThreads)
+     * \brief Number of threads which list the directories, TREE_THREADS by default.
+     */
+    void set_threads(int iThreads);
+
+    /**
+     * \fn void set_include(const std::vector<std::string> &vsGlob)
+     * \brief Select only the files matching one of the globs (*, ?, [...]). A glob with a '/' is matched against the path relative to the input root, otherwise against the file name. A glob without wildcard matches the names containing it.
+     */
+    void set_include(const std::vector<std::string> &vsGlob);
+
+    /**
+     * \fn void set_exclude(const std::vector<std::string> &vsGlob)
+     * \brief Skip the files and the directories matching one of the globs, same syntax as set_include().
+     */
+    void set_exclude(const std::vector<std::string> &vsGlob);
+
+    /**
+     * \fn static bool match(const std::string &sGlob, const std::string &sStr)
+     * \return true if sStr matches the glob sGlob: * any string, ? any character, [a-z] or [!a-z] a set
+     */
+    static bool match(const std::string &sGlob, const std::string &sStr);
+
+    /**
+     * \fn size_t get_linked() const
+     * \return Number of files linked or copied by the last walk()
+     */
+    size_t get_linked() const;
+
+    /**
+     * \fn void set_update(bool bUpdate)
+     * \brief Allow walk() over an existing mirror: the links still up to date are kept, the others are replaced.
+     */
+    void set_update(bool bUpdate);
+
+    /**
+     * \fn static bool is_spectrum(const fs::path &pFile)
+     * \return true if pFile looks like a spectrum: an extension, not an archive nor a text note
+     */
+    static bool is_spectrum(const fs::path &pFile);
+
+    /**
+     * \fn static bool link(const fs::path &pFrom, const fs::path &pTo)
+     * \brief Create pTo with the content of pFrom: reflink, then hard link, then copy.
+     */
+    static bool link(const fs::path &pFrom, const fs::path &pTo);
+
+    /**
+     * \fn static bool relink(const fs::path &pFrom, const fs::path &pTo)
+     * \brief Same as link(), an existing pTo is replaced first, e.g. the output of a previous run.
+     */
+    static bool relink(const fs::path &pFrom, const fs::path &pTo);
+
+    /**
+     * \fn static size_t remove_parts(const fs::path &pDir)
+     * \brief Remove the name.part files left in pDir by an interrupted run.
+     * \return Number of files removed
+     */
+    static size_t remove_parts(const fs::path &pDir);
+
+private:
+    fs::path pInput;
+    fs::path pOutput;
+    std::atomic<size_t> stLinked;
+    bool bUpdate;
+    int iThreads;
+    std::vector<std::string> vsInclude;
+    std::vector<std::string> vsExclude;
+
+    /**
+     * \struct _dir
+     * \brief A directory to list: input path, mirrored path and path relative to the input root.
+     */
+    struct _dir {
+        fs::path pIn;
+        fs::path pOut;
+        std::string sRel;
+    };
+
+    /**
+     * \fn bool list(const _dir &dDir, const std::function<void(_dir&&)> &fDir, const std::function<void(std::string&&, std::string&&)> &fFile)
+     * \brief List one directory: fDir is called for each subdirectory, fFile for each spectrum selected.
+     */
+    bool list(const _dir &dDir,
+              const std::function<void(_dir&&)> &fDir,
+              const std::function<void(std::string&&, std::string&&)> &fFile);
+
+    /**
+     * \fn static bool match_any(const std::vector<std::string> &vsGlob, const std::string &sRel, const std::string &sName)
+     * \return true if one of the globs matches sRel or sName
+     */
+    static bool match_any(const std::vector<std::string> &vsGlob, const std::string &sRel, const std::string &sName);
+
+    static std::vector<std::string> compile(const std::vector<std::string> &vsGlob);
+
+    /**
+     * \fn static bool is_linked(const fs::path &pFrom, const fs::path &pTo)
+     * \return true if pTo exists, has the size of pFrom and is not older
+     */
+    static bool is_linked(const fs::path &pFrom, const fs::path &pTo);
+
+    static bool reflink(const fs::path &pFrom, const fs::path &pTo);
+};
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+inline _tree::_tree(const std::string &sInput, const std::string &sOutput):
+    pInput(sInput), pOutput(sOutput), stLinked(0), bUpdate(false), iThreads(TREE_THREADS) { }
+
+inline bool _tree::walk(const std::function<void(const std::string&, const std::string&)> &fSpectrum) {
+    stLinked=0;
+
+    if (!pOutput.empty())
+        try {
+            fs::create_directories(pOutput);
+        }
+        catch (...) {
+            return false;
+        }
+
+    std::atomic<bool> bStatus(true);
+    std::deque<_dir> dqDir;
+    dqDir.push_back({pInput, pOutput, ""});
+
+    if (iThreads<=1) {
+        while (!dqDir.empty()) {
+            _dir dDir=std::move(dqDir.front());
+            dqDir.pop_front();
+
+            if (!list(dDir,
+                      [&dqDir](_dir &&dSub) { dqDir.push_back(std::move(dSub)); },
+                      [&fSpectrum](std::string &&sIn, std::string &&sOut) { fSpectrum(sIn, sOut); }))
+                bStatus=false;
+        }
+        return bStatus;
+    }
+
+    // the listers share the directories to list, the spectra are handed to the calling thread
+    std::mutex mDir;
+    std::condition_variable cvDir;
+    int iBusy=0;
+    _ring<std::pair<std::string, std::string> > rSpectrum(PIPE_DEPTH*PIPE_DEPTH);
+    std::atomic<int> aiLive(iThreads);
+    std::exception_ptr epError;
+
+    auto fLister=[&]() {
+        try {
+            while (true) {
+                _dir dDir;
+                {
+                    std::unique_lock<std::mutex> ulLock(mDir);
+                    cvDir.wait(ulLock, [&]() { return !dqDir.empty() || iBusy==0; });
+                    if (dqDir.empty())
+                        break;
+                    dDir=std::move(dqDir.front());
+                    dqDir.pop_front();
+                    iBusy++;
+                }
+
+                if (!list(dDir,
+                          [&](_dir &&dSub) {
+                              std::lock_guard<std::mutex> lgLock(mDir);
+                              dqDir.push_back(std::move(dSub));
+                              cvDir.notify_one();
+                          },
+                          [&](std::string &&sIn, std::string &&sOut) {
+                              std::pair<std::string, std::string> pFile(std::move(sIn), std::move(sOut));
+                              rSpectrum.push(pFile);
+                          }))
+                    bStatus=false;
+
+                std::lock_guard<std::mutex> lgLock(mDir);
+                if (--iBusy==0 && dqDir.empty())
+                    cvDir.notify_all();
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lgLock(mDir);
+            if (!epError) epError=std::current_exception();
+            // the other listers stop at their next directory
+            dqDir.clear();
+            iBusy--;
+            cvDir.notify_all();
+        }
+        // the last lister out closes the queue of spectra
+        if (--aiLive==0)
+            rSpectrum.close();
+    };
+
+    std::vector<std::thread> vthLister;
+    for(int i=0; i<iThreads; i++)
+        vthLister.emplace_back(fLister);
+
+    std::pair<std::string, std::string> pFile;
+    try {
+        while (rSpectrum.pop(pFile))
+            fSpectrum(pFile.first, pFile.second);
+    }
+    catch (...) {
+        {
+            std::lock_guard<std::mutex> lgLock(mDir);
+            if (!epError) epError=std::current_exception();
+            dqDir.clear();
+        }
+        // the listers are unblocked and finish their directory
+        while (rSpectrum.pop(pFile)) { }
+    }
+
+    for(auto &th: vthLister)
+        th.join();
+
+    if (epError)
+        std::rethrow_exception(epError);
+
+    return bStatus;
+}
+
+inline bool _tree::list(const _dir &dDir,
+                        const std::function<void(_dir&&)> &fDir,
+                        const std::function<void(std::string&&, std::string&&)> &fFile) {
+    bool bStatus=true;
+    const bool bMirror=!pOutput.empty();
+
+    try {
+        for(auto &deEntry: fs::directory_iterator(dDir.pIn)) {
+            const fs::path &pIn=deEntry.path();
+            const std::string sName=pIn.filename().string();
+            std::string sRel=dDir.sRel.empty() ? sName : dDir.sRel+"/"+sName;
+
+#ifdef FS_STD
+            // the type comes from the listing: no stat on most filesystems
+            const bool bDirectory=deEntry.is_directory();
+            const bool bSymlink=deEntry.is_symlink();
+#else
+            const bool bDirectory=fs::is_directory(deEntry.status());
+            const bool bSymlink=fs::is_symlink(deEntry.symlink_status());
+#endif
+
+            if (match_any(vsExclude, sRel, sName))
+                continue;
+
+            if (bDirectory) {
+                _dir dSub{pIn, bMirror ? dDir.pOut/sName : fs::path(), std::move(sRel)};
+                if (bMirror)
+                    try {
+                        fs::create_directories(dSub.pOut);
+                    }
+                    catch (...) {
+                        bStatus=false;
+                        continue;
+                    }
+                // the links to directories are not followed: no cycle
+                if (!bSymlink)
+                    fDir(std::move(dSub));
+                continue;
+            }
+
+            if (!vsInclude.empty() && !match_any(vsInclude, sRel, sName))
+                continue;
+
+            const fs::path pOut=bMirror ? dDir.pOut/sName : fs::path();
+
+            if (is_spectrum(pIn))
+                fFile(pIn.string(), pOut.string());
+            else if (!bMirror)
+                continue;
+            else if (bUpdate && is_linked(pIn, pOut))
+                stLinked++;
+            else {
+                // an out of date link is replaced
+                if (bUpdate)
+                    try {
+                        fs::remove(pOut);
+                    }
+                    catch (...) { }
+
+                // another process may have linked it meanwhile
+                if (link(pIn, pOut) || (bUpdate && is_linked(pIn, pOut)))
+                    stLinked++;
+                else
+                    bStatus=false;
+            }
+        }
+    }
+    catch (const fs::filesystem_error&) {
+        bStatus=false;
+    }
+    return bStatus;
+}
+
+inline void _tree::set_threads(int iThreads) {
+    this->iThreads=std::max(iThreads, 1);
+}
+
+inline void _tree::set_include(const std::vector<std::string> &vsGlob) {
+    vsInclude=compile(vsGlob);
+}
+
+inline void _tree::set_exclude(const std::vector<std::string> &vsGlob) {
+    vsExclude=compile(vsGlob);
+}
+
+inline std::vector<std::string> _tree::compile(const std::vector<std::string> &vsGlob) {
+    std::vector<std::string> vsRes;
+    for(auto &sGlob: vsGlob) {
+        if (sGlob.empty()) continue;
+        // a plain string matches the names containing it
+        if (sGlob.find_first_of("*?[")==std::string::npos)
+            vsRes.emplace_back("*"+sGlob+"*");
+        else
+            vsRes.emplace_back(sGlob);
+    }
+    return vsRes;
+}
+
+inline bool _tree::match_any(const std::vector<std::string> &vsGlob, const std::string &sRel, const std::string &sName) {
+    for(auto &sGlob: vsGlob)
+        if (match(sGlob, sGlob.find('/')==std::string::npos ? sName : sRel))
+            return true;
+    return false;
+}
+
+inline bool _tree::match(const std::string &sGlob, const std::string &sStr) {
+    size_t stG=0, stS=0;
+    // last '*' and the position of sStr it was tried at: backtrack there on a mismatch
+    size_t stStar=std::string::npos, stMark=0;
+
+    while (stS<sStr.size()) {
+        if (stG<sGlob.size() && sGlob[stG]=='*') {
+            stStar=stG++;
+            stMark=stS;
+            continue;
+        }
+
+        bool bMatch=false;
+        size_t stNext=stG+1;
+
+        if (stG<sGlob.size()) {
+            if (sGlob[stG]=='?')
+                bMatch=true;
+            else if (sGlob[stG]=='[') {
+                size_t stI=stG+1;
+                bool bNegate=stI<sGlob.size() && (sGlob[stI]=='!' || sGlob[stI]=='^');
+                if (bNegate) stI++;
+
+                bool bIn=false;
+                bool bFirst=true;
+                while (stI<sGlob.size() && (sGlob[stI]!=']' || bFirst)) {
+                    if (stI+2<sGlob.size() && sGlob[stI+1]=='-' && sGlob[stI+2]!=']') {
+                        bIn|=sStr[stS]>=sGlob[stI] && sStr[stS]<=sGlob[stI+2];
+                        stI+=3;
+                    }
+                    else
+                        bIn|=sStr[stS]==sGlob[stI++];
+                    bFirst=false;
+                }
+
+                // an unclosed '[' is a plain character
+                if (stI<sGlob.size()) {
+                    bMatch=bIn!=bNegate;
+                    stNext=stI+1;
+                }
+                else
+                    bMatch=sStr[stS]=='[';
+            }
+            else
+                bMatch=sGlob[stG]==sStr[stS];
+        }
+
+        if (bMatch) {
+            stG=stNext;
+            stS++;
+        }
+        else if (stStar!=std::string::npos) {
+            stG=stStar+1;
+            stS=++stMark;
+        }
+        else
+            return false;
+    }
+
+    while (stG<sGlob.size() && sGlob[stG]=='*')
+        stG++;
+    return stG==sGlob.size();
+}
+
+inline size_t _tree::get_linked() const {
+    return stLinked;
+}
+
+inline void _tree::set_update(bool bUpdate) {
+    this->bUpdate=bUpdate;
+}
+
+inline bool _tree::is_linked(const fs::path &pFrom, const fs::path &pTo) {
+    try {
+        return fs::exists(pTo) &&
+               fs::file_size(pTo)==fs::file_size(pFrom) &&
+               fs::last_write_time(pTo)>=fs::last_write_time(pFrom);
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+inline bool _tree::is_spectrum(const fs::path &pFile) {
+    // csv<> unable to parse non csv file: archives and text notes, whatever their last extension
+    static constexpr std::string_view svDeny[]={"tar", "tgz", "zip", "txt", "directory"};
+
+    if (!pFile.has_extension())
+        return false;
+
+    const std::string sName=pFile.filename().string();
+    size_t stDot=sName.find('.');
+
+    while (stDot!=std::string::npos) {
+        size_t stEnd=sName.find('.', stDot+1);
+        std::string_view svExt(sName.data()+stDot+1, (stEnd==std::string::npos ? sName.size() : stEnd)-stDot-1);
+
+        for(auto &svBad: svDeny)
+            if (svExt==svBad)
+                return false;
+        stDot=stEnd;
+    }
+    return true;
+}
+
+inline bool _tree::link(const fs::path &pFrom, const fs::path &pTo) {
+    if (reflink(pFrom, pTo))
+        return true;
+
+    try {
+        fs::create_hard_link(pFrom, pTo);
+        return true;
+    }
+    catch (...) { }
+
+    try {
+        return fs::copy_file(pFrom, pTo);
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+inline bool _tree::relink(const fs::path &pFrom, const fs::path &pTo) {
+    try {
+        fs::remove(pTo);
+    }
+    catch (...) { }
+
+    return link(pFrom, pTo);
+}
+
+inline size_t _tree::remove_parts(const fs::path &pDir) {
+    size_t stRemoved=0;
+    try {
+        std::vector<fs::path> vpPart;
+        for(auto &deEntry: fs::recursive_directory_iterator(pDir))
+            if (deEntry.path().extension()==".part" && !fs::is_directory(deEntry.path()))
+                vpPart.emplace_back(deEntry.path());
+
+        for(auto &pPart: vpPart)
+            if (fs::remove(pPart))
+                stRemoved++;
+    }
+    catch (...) { }
+    return stRemoved;
+}
+
+inline bool _tree::reflink(const fs::path &pFrom, const fs::path &pTo) {
+#ifdef HAS_FICLONE
+    int iIn=::open(pFrom.c_str(), O_RDONLY | O_CLOEXEC);
+    if (iIn<0) return false;
+
+    struct stat stIn;
+    if (::fstat(iIn, &stIn)!=0) {
+        ::close(iIn);
+        return false;
+    }
+
+    int iOut=::open(pTo.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, stIn.st_mode & 07777);
+    if (iOut<0) {
+        ::close(iIn);
+        return false;
+    }
+
+    bool bRes=::ioctl(iOut, FICLONE, iIn)==0;
+
+    ::close(iOut);
+    ::close(iIn);
+
+    if (!bRes)
+        ::unlink(pTo.c_str());
+
+    return bRes;
+#else
+    return false;
+#endif
+}
+
+#endif // _TREE_H
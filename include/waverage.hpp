@@ -20,6 +20,7 @@
 #include <future>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 
 #include <boost/algorithm/string/split.hpp>       
 #include <boost/algorithm/string.hpp>      
@@ -62,6 +63,9 @@ namespace fs = boost::filesystem;
 #define LNOTIFY  /**< check libnotify library availability. */
 #endif
 
+#include <load.h>
+#include <pool.h>
+
 #define PRECISION 10
 
 
@@ -163,7 +167,7 @@ public:
     
     inline bool filter_SG(int n); /**< Savitzky-Golay on spectrum n.*/
     inline vv compute_SG2(vv &vvSpectr) const; /**< Savitzky-Golay 2nd order. */
-    bool filter_SG(); /**< Savitzky-Golay on all spectra n.*/
+    bool filter_SG(double dMax_load=50); /**< Savitzky-Golay on all spectra, the threads are removed while the machine load (%) is above dMax_load. */
     
     inline void remove_peaks(int n);
     
@@ -192,13 +196,6 @@ private:
     _T der_snr(const std::valarray<_T> &vFlux) const;
     _T median(const std::valarray<_T> &vFlux) const;
     
-    /**
-    * \fn double long CPU_utilization()
-    * \brief Get the CPU usage (%)
-    */
-    double long CPU_utilization();
-    std::tuple<double long, double long> get_stat();
-    
     std::mutex mLock;
 };
 
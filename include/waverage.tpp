@@ -664,26 +664,27 @@ void _op<_T>::filter_SG_th(int n) {
 
 
 template<typename _T> 
-bool _op<_T>::filter_SG() {
+bool _op<_T>::filter_SG(double dMax_load) {
     
-    int max_thread=std::thread::hardware_concurrency();
+    // the threads are removed while other processes use the CPUs
+    _load load(0, dMax_load);
+    int max_thread=load.get_max();
     bool bStatus=true;
     
-#if defined (__linux__)
-    std::cout << "- CPU load: "<< static_cast<int>(CPU_utilization()) << "%\n";
-    if (CPU_utilization()>50) {
-        max_thread=1;
-        std::cout << "\t\t-> reducing max thread.\n";
-    }
-#endif
+    std::cout << "- available CPUs: "<< max_thread << "\n";
     
     if (max_thread>1) {
-        std::launch flag=std::launch::async | std::launch::deferred;
-        std::vector<std::future<void> > thread;
+        std::atomic<bool> abStatus(true);
         
+        _pool pool(max_thread);
+        load.start([&pool](int iN) { pool.set_active(iN); });
         for(int i=0; i<this->VvvSpectr.size();i++)
-            thread.emplace_back(std::async(flag, &_op<_T>::filter_SG_th, this, i));   // solve the non-static error
-        std::for_each(thread.begin(), thread.end(), [](std::future<void> &th) { th.get(); });
+            pool.submit([this, i, &abStatus]() { 
+                if (!this->filter_SG(i)) abStatus=false; 
+            });
+        pool.wait();
+        load.stop();
+        bStatus=abStatus;
         
         std::cout << "- filter_SG(): all done.\n\n";
     }
@@ -866,56 +867,6 @@ _T _op<_T>::mean_step(const std::valarray<_T> &vArray) const {
     return std::accumulate(shift.begin(), shift.end(), 0.0)/shift.size();
 }
 
-template <typename _T>
-double long _op<_T>::CPU_utilization() {       
-    auto [fTime_A, fIdle_A]=get_stat();
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    auto [fTime_B, fIdle_B]=get_stat();
-    return 100.*(1.-((fIdle_B-fIdle_A)/(fTime_B-fTime_A)));
-}
-
-template <typename _T>
-std::tuple<double long, double long>  _op<_T>::get_stat() {
-    std::fstream sfCpu("/proc/stat", std::ios::in);
-    
-    if (sfCpu) {
-
-        std::string sLine;
-        std::getline(sfCpu, sLine);
-        
-        // erase "cpu"
-        sLine.erase(sLine.begin(), sLine.begin()+sLine.find_first_of("0123456789")); 
-        
-        // locate " " and push position into vec
-        std::vector<int> vPos;
-        std::vector<_T> vCol;
-        
-        vPos.push_back(0); 
-        
-        int iCount=0;
-        for(auto cC: sLine) {
-            if (cC==' ')
-                vPos.push_back(iCount);
-            iCount++;  
-        }
-        
-        // slice
-        for(int i=0; i<4; i++) {
-            std::string sVal=sLine.substr(vPos[i], vPos[i+1]-vPos[i]);
-            sVal.erase(std::remove(sVal.begin(), sVal.end(), ' '), sVal.end()); 
-            vCol.push_back(std::stod(sVal));
-        }
-        
-        sfCpu.close();
-                
-        return {static_cast<_T>(vCol[0]+vCol[1]+vCol[2]+vCol[3]), static_cast<_T>(vCol[3])};
-    }
-    else 
-        std::cerr << "/!\\ cannot open /proc/stat.\n\n";
-    
-    return {-1,1};
-}
-
 template <typename _T>
 _T _op<_T>::der_snr(const std::valarray<_T> &vFlux) const {
     if (vFlux.size()<1) {
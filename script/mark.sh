@@ -17,7 +17,7 @@ $CFOLDER/bin/./marker  --xmin $1 --xmax $2  \
 -i "$4" \
 -i "$5" \
 -i "$6"  \
--s ' ' -s '\t' -s '\t' \ -t " " \
+-t " " \
 -l "$7" -l "$8" --width 0.8 \
 --xlabel "$\\\\lambda$" --xunit "$\\\\AA$" \
 --ylabel "Normalized flux" \
@@ -34,7 +34,7 @@ echo "$CFOLDER/bin/./marker  --xmin $1 --xmax $2  \
 -i "$4" \
 -i "$5" \
 -i "$6"  \
--s ' ' -s '\t' -s '\t' \ -t " " \
+-t " " \
 -l "$7" -l "$8" --width 0.8 \
 --xlabel "$\\\\lambda$" --xunit "$\\\\AA$" \
 --ylabel "Normalized flux" \
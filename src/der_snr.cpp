@@ -19,7 +19,6 @@
 #include <cmath>
 #include <functional> 
 #include <thread>
-#include <future>
 #include <tuple>
 #include <chrono>
 
@@ -55,6 +54,12 @@ namespace fs = boost::filesystem;
 #include <msg.h>
 #include <log.h>
 #include <der_snr.h>
+#include <pipeline.h>
+#include <load.h>
+#include <cache.h>
+#include <tree.h>
+#include <claim.h>
+#include <collector.h>
 
 // Reference
 // ----------------------------------------------------
@@ -83,8 +88,26 @@ int main(int argc, char** argv) {
     ("filename,f",  po::value<std::string>(),"Filename of the spectrum")
     ("directory,d",  po::value<std::string>(),"Directory where compute the S/N")
     ("output,o",  po::value<std::string>()->default_value("output.csv"),"Filename of results")
-    ("separator,s",  po::value<char>()->default_value('\t'),"The column separator. Do not set this option for \\tab.")
-    ("exclude,e",  po::value<std::string>(),"Exclude a string in filenames");
+    ("separator,s",  po::value<char>(),"The column separator, detected in each file if not set. Do not set this option for \\tab.")
+    ("window",  po::value<int>()->default_value(0),"Compute the local S/N profile in windows of this number of points: one line per window with its central wavelength")
+    ("step",  po::value<int>()->default_value(0),"With --window, points between two windows, the window size if not set")
+    ("region,r",  po::value<std::vector<std::string> >()->composing(),"Compute the S/N in the wavelength range min:max instead of the whole spectrum. Repeat it for several ranges: one column per range")
+    ("region-file",  po::value<std::string>(),"File of wavelength ranges, one \"min max\" per line, added to --region")
+    ("approx",  po::value<double>()->implicit_value(SKETCH_ALPHA),"Stream each spectrum in bounded memory and approximate the medians within this relative accuracy (0.005 if not given): the S/N is within about twice that, given in the snr_error field of each row")
+    ("format",  po::value<std::string>()->default_value("text"),"Format of the table: text (tab separated), tsv (with a header) or jsonl (JSON lines)")
+    ("sort",  po::value<std::string>()->default_value("path"),"Order of the table: path, snr (decreasing) or input (the order the files are found, which changes between runs with several scan threads)")
+    ("include",  po::value<std::vector<std::string> >()->multitoken(),"Process only the files matching these globs, e.g. \"*.dat\". A glob with a '/' is matched against the path relative to the directory")
+    ("exclude,e",  po::value<std::vector<std::string> >()->multitoken(),"Skip the files and the folders matching these globs. A string without wildcard excludes the names containing it")
+    ("scan-threads",  po::value<int>()->default_value(TREE_THREADS),"Threads which list the directory")
+    ("incremental",  "Compute only the new or modified files: the S/N of the others are read from the cache kept next to the output")
+    ("work-dir",  po::value<std::string>(),"Share the directory with the other processes started with this work directory, on a filesystem seen by all of them. The first process which sees all the files done writes the output.")
+    ("shards",  po::value<int>()->default_value(CLAIM_SHARDS),"With --work-dir, number of parts of the directory claimed by the processes, set by the first process")
+    ("lease",  po::value<int>()->default_value(CLAIM_LEASE),"With --work-dir, seconds after which the part claimed by a process which stopped is taken over")
+    ("threads",  po::value<int>()->default_value(0),"Maximum number of threads, 0 for all the CPUs available to the process")
+    ("max-load",  po::value<double>()->default_value(100),"Machine load (%) not to exceed: threads are removed while other processes use the CPUs")
+    ("io-threads",  po::value<int>()->default_value(1),"Threads which map and prefetch the input files")
+    ("write-threads",  po::value<int>()->default_value(1),"Threads which gather the results")
+    ("queue-depth",  po::value<int>()->default_value(PIPE_DEPTH),"Files waiting between two stages of the pipeline");
     
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(description).run(), vm);
@@ -104,30 +127,30 @@ int main(int argc, char** argv) {
         msgM.msg(_msg::eMsg::END, " 0.039347s wall, 0.040000s user + 0.000000s system = 0.040000s CPU (101.7%)\n");
         std::cout << std::endl;
         
+        std::cout << "./der_snr -f CPD-591792.obs --window 2000 --step 500 -o profile.csv\n";
+        msgM.msg(_msg::eMsg::START);
+        msgM.msg(_msg::eMsg::MID, "check command line");
+        msgM.msg(_msg::eMsg::MID, "compute S/N for 1 file");
+        msgM.msg(_msg::eMsg::MID, "CPD-591792.obs: 197 windows");
+        msgM.msg(_msg::eMsg::MID, "output: profile.csv");
+        msgM.msg(_msg::eMsg::END, " 0.061872s wall, 0.060000s user + 0.000000s system = 0.060000s CPU (97.0%)\n");
+        std::cout << std::endl;
+        
+        std::cout << "./der_snr -f CPD-591792.obs -r 4490:4510 -r 5190:5210\n";
+        msgM.msg(_msg::eMsg::START);
+        msgM.msg(_msg::eMsg::MID, "check command line");
+        msgM.msg(_msg::eMsg::MID, "compute S/N for 1 file");
+        msgM.msg(_msg::eMsg::MID, "CPD-591792.obs: S/N in 4490:4510 = 87.21");
+        msgM.msg(_msg::eMsg::MID, "CPD-591792.obs: S/N in 5190:5210 = 112.48");
+        msgM.msg(_msg::eMsg::END, " 0.035110s wall, 0.030000s user + 0.000000s system = 0.030000s CPU (85.4%)\n");
+        std::cout << std::endl;
+        
         std::cout << "./der_snr -d data\n";
         msgM.msg(_msg::eMsg::START);
         msgM.msg(_msg::eMsg::MID, "check command line");
-        msgM.msg(_msg::eMsg::MID, "CPU utilization: 0 %");
-        msgM.msg(_msg::eMsg::MID, "starting 8 async threads");
-        msgM.set_threadname("compute");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 521 files");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 521 files");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 521 files");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 521 files");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 521 files");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 521 files");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 521 files");
-        msgM.msg(_msg::eMsg::THREADS, "S/N for 524 files");
-        msgM.set_name("merge()");
-        msgM.msg(_msg::eMsg::MID, "merge file part1_snr.csv");
-        msgM.msg(_msg::eMsg::MID, "merge file part2_snr.csv");
-        msgM.msg(_msg::eMsg::MID, "merge file part3_snr.csv");
-        msgM.msg(_msg::eMsg::MID, "merge file part4_snr.csv");
-        msgM.msg(_msg::eMsg::MID, "merge file part5_snr.csv");
-        msgM.msg(_msg::eMsg::MID, "merge file part6_snr.csv");
-        msgM.msg(_msg::eMsg::MID, "merge file part7_snr.csv");
-        msgM.msg(_msg::eMsg::MID, "merge file part8_snr.csv");
-        msgM.set_name("der_snr");
+        msgM.msg(_msg::eMsg::MID, "available CPUs: 8");
+        msgM.msg(_msg::eMsg::MID, "starting 8 threads");
+        msgM.msg(_msg::eMsg::MID, "S/N for 4171 files");
         msgM.msg(_msg::eMsg::MID, "output: output.csv");        
         msgM.msg(_msg::eMsg::END, " 56.395825s wall, 323.050000s user + 0.450000s system = 323.500000s CPU (573.6%)\n");
         
@@ -138,13 +161,11 @@ int main(int argc, char** argv) {
         return EXIT_SUCCESS;
     }
     
-    bool bDefExclude=false;
     bool bDefSep=false;
     
     std::string sOutput;
-    std::string sExclude;
     
-    char cSep;
+    char cSep='\0';
     
     fs::path pDirectory;
     fs::path pFilename;
@@ -197,7 +218,8 @@ int main(int argc, char** argv) {
     
     if (vm.count("output")) {
         pOutput=fs::path(vm["output"].as<std::string>());
-        if (fs::exists(pOutput)) {
+        // a shared run replaces the output once all the processes are done
+        if (fs::exists(pOutput) && !vm.count("work-dir")) {
             msgM.msg(_msg::eMsg::MID, pOutput.string(), " exists: deleting");
             fs::remove(pOutput);
         }
@@ -209,110 +231,297 @@ int main(int argc, char** argv) {
         bDefSep=true;
     }
     
-    if (vm.count("exclude")) {
-        sExclude=vm["exclude"].as<std::string>();
-        bDefExclude=true;
+    if (vm["window"].as<int>()<0 || vm["step"].as<int>()<0) {
+        msgM.msg(_msg::eMsg::ERROR, "--window and --step must be positive");
+        return EXIT_FAILURE;
+    }
+    
+    // profile mode: the step defaults to the window, i.e. disjoint windows
+    _snr_param spParam;
+    spParam.stWindow=vm["window"].as<int>();
+    spParam.stStep=vm["step"].as<int>()>0 ? vm["step"].as<int>() : spParam.stWindow;
+    
+    if (vm.count("region"))
+        for(auto &sRegion: vm["region"].as<std::vector<std::string> >()) {
+            std::pair<float, float> pRegion;
+            if (!parse_region(sRegion, pRegion)) {
+                msgM.msg(_msg::eMsg::ERROR, "wrong region", sRegion, ": min:max expected");
+                return EXIT_FAILURE;
+            }
+            spParam.vpRegion.emplace_back(pRegion);
+        }
+    
+    if (vm.count("region-file") && !read_regions(vm["region-file"].as<std::string>(), spParam.vpRegion)) {
+        msgM.msg(_msg::eMsg::ERROR, "cannot read the regions of", vm["region-file"].as<std::string>());
+        return EXIT_FAILURE;
+    }
+    
+    if (spParam.stWindow>0 && !spParam.vpRegion.empty()) {
+        msgM.msg(_msg::eMsg::ERROR, "--window and --region cannot be combined");
+        return EXIT_FAILURE;
+    }
+    
+    if (vm.count("approx")) {
+        spParam.dApprox=vm["approx"].as<double>();
+        if (spParam.dApprox<=0 || spParam.dApprox>=0.5) {
+            msgM.msg(_msg::eMsg::ERROR, "--approx must be in ]0, 0.5[");
+            return EXIT_FAILURE;
+        }
+        if (spParam.stWindow>0 || !spParam.vpRegion.empty()) {
+            msgM.msg(_msg::eMsg::ERROR, "--approx measures whole spectra: it cannot be combined with --window or --region");
+            return EXIT_FAILURE;
+        }
+        msgM.msg(_msg::eMsg::MID, "approximate medians: S/N within",
+                 std::to_string(100*_snr_sketch<float>(spParam.dApprox).get_error())+"%");
     }
     
+    // the table: one field per measure after the path
+    _collector::eFormat fFormat;
+    _collector::eOrder oOrder;
+    if (!_collector::parse_format(vm["format"].as<std::string>(), fFormat) || !_collector::parse_order(vm["sort"].as<std::string>(), oOrder)) {
+        msgM.msg(_msg::eMsg::ERROR, "unknown --format or --sort");
+        return EXIT_FAILURE;
+    }
+    const std::vector<std::string> vsColumn=columns(spParam);
+    const size_t stKey=spParam.stWindow>0 ? 2 : 1;
+    
+    // the measure is part of the parameters of the cached results
+    std::string sMeasure;
+    if (spParam.stWindow>0)
+        sMeasure=" window "+std::to_string(spParam.stWindow)+" step "+std::to_string(spParam.stStep);
+    for(auto &pRegion: spParam.vpRegion)
+        sMeasure+=" "+std::to_string(pRegion.first)+":"+std::to_string(pRegion.second);
+    // the approximate rows carry their error bound
+    if (spParam.dApprox>0)
+        sMeasure+=" approx "+std::to_string(spParam.dApprox)+" snr_error";
+    
     if (vm.count("filename")) {
         msgM.msg(_msg::eMsg::MID, "compute S/N for 1 file");
         
         std::string sFilename=vm["filename"].as<std::string>();
         
-        _csv<float> csv(sFilename, '\t');
-        
-        if(csv.read()) {
-            csv.set_verbose(_csv<float>::eVerbose::QUIET);
-            msgM.msg(_msg::eMsg::MID,sFilename,": S/N =", der_snr(csv.select_column(1)));
+        if (spParam.dApprox>0) {
+            std::string sRes=compute_file(sFilename, bDefSep ? cSep : '\0', nullptr, spParam);
+            if (!sRes.empty()) {
+                // file, S/N and error bound
+                const size_t stSnr=sRes.find('\t')+1, stError=sRes.find('\t', stSnr)+1;
+                msgM.msg(_msg::eMsg::MID, sFilename, ": S/N =", std::stof(sRes.substr(stSnr)),
+                         "within", std::to_string(100*std::stod(sRes.substr(stError)))+"%");
+            }
+        }
+        else if (spParam.stWindow>0) {
+            _collector colOutput(sOutput, vsColumn, fFormat, oOrder, stKey);
+            std::string sRes=compute_file(sFilename, bDefSep ? cSep : '\0', nullptr, spParam);
+            
+            if (!sRes.empty() && colOutput.open()) {
+                colOutput.add(0, sRes);
+                if (colOutput.close())
+                    msgM.msg(_msg::eMsg::MID, sFilename, ":", colOutput.get_rows(), "windows");
+                else
+                    msgM.msg(_msg::eMsg::ERROR, "cannot write", sOutput);
+            }
+        }
+        else if (!spParam.vpRegion.empty()) {
+            _csv<float> csv(sFilename, bDefSep ? cSep : '\0');
+            
+            if(csv.read()) {
+                csv.set_verbose(_csv<float>::eVerbose::QUIET);
+                const std::vector<float> &vWave=csv.get_column(0);
+                const std::vector<float> &vFlux=csv.get_column(1);
+                std::vector<float> vSnr;
+                der_snr_regions(vWave.data(), vFlux.data(), std::min(vWave.size(), vFlux.size()), spParam.vpRegion, vSnr);
+                
+                for(size_t i=0; i<vSnr.size(); i++)
+                    msgM.msg(_msg::eMsg::MID, sFilename, ": S/N in", 
+                             std::to_string(spParam.vpRegion[i].first)+":"+std::to_string(spParam.vpRegion[i].second), "=", vSnr[i]);
+            }
+        }
+        else {
+            _csv<float> csv(sFilename, bDefSep ? cSep : '\0');
+            
+            if(csv.read()) {
+                csv.set_verbose(_csv<float>::eVerbose::QUIET);
+                msgM.msg(_msg::eMsg::MID,sFilename,": S/N =", der_snr(csv.get_column(1)));
+            }
         }
     }
     
     if (vm.count("directory")) {
         
-        fs::recursive_directory_iterator step0(pDirectory);
-        std::vector<std::string> list;
+        // the spectra are discovered by several threads and streamed to the workers
+        _tree tree(pDirectory.string());
+        tree.set_threads(vm["scan-threads"].as<int>());
+        if (vm.count("include"))
+            tree.set_include(vm["include"].as<std::vector<std::string> >());
+        if (vm.count("exclude"))
+            tree.set_exclude(vm["exclude"].as<std::vector<std::string> >());
         
-        if (bDefExclude) {
-            for(auto &file: boost::make_iterator_range(step0,{}) ) 
-                // csv<> unable to parse non csv file
-                if (!fs::is_directory(file) && 
-                    file.path().has_extension() && 
-                    file.path().filename().string().find(std::string(".tar"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".tar.gz"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".tgz"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".zip"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".txt"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".directory"))==std::string::npos &&
-                    file.path().filename().string().find(sExclude)==std::string::npos )
-                    list.emplace_back(file.path().relative_path().string());       
+        // incremental run: the S/N of the files unchanged since the last run are taken from the cache
+        const bool bIncremental=vm.count("incremental");
+        const bool bShared=vm.count("work-dir");
+        
+        if (bIncremental && bShared) {
+            msgM.msg(_msg::eMsg::ERROR, "--incremental and --work-dir cannot be combined");
+            return EXIT_FAILURE;
         }
-        else {
-            for(auto &file: boost::make_iterator_range(step0,{}) ) 
-                // csv<> unable to parse non csv file
-                if (!fs::is_directory(file) && 
-                    file.path().has_extension() && 
-                    file.path().filename().string().find(std::string(".tar"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".tar.gz"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".tgz"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".zip"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".txt"))==std::string::npos &&
-                    file.path().filename().string().find(std::string(".directory"))==std::string::npos )
-                    list.emplace_back(file.path().relative_path().string());
+        _cache cache(sOutput+CACHE_FILE, std::string("der_snr ")+(bDefSep ? std::string(1, cSep) : "auto")+sMeasure);
+        
+        if (bIncremental && !cache.load()) {
+            msgM.msg(_msg::eMsg::ERROR, "cannot read", cache.get_filename());
+            return EXIT_FAILURE;
         }
-        int iMax_thread=std::thread::hardware_concurrency();
         
-// Limit CPU usage -------------------------------------
-#if defined (__linux__)
-    msgM.msg(_msg::eMsg::MID, "CPU utilization:", static_cast<int>(CPU_utilization()), "%");
-    if (CPU_utilization()>50) {
-        iMax_thread=1;
-        msgM.msg(_msg::eMsg::MID, "Reduce max thread");
-    }
-#endif
-// -----------------------------------------------------
+        // true if the S/N of sFile is in the cache
+        auto fCached=[&](const std::string &sFile, std::string &sRes) {
+            return bIncremental && cache.is_fresh(sFile, "", &sRes);
+        };
         
-        if (iMax_thread>1) {
-            const std::size_t stSize_divided=list.size()/iMax_thread;
-            
-            std::vector<std::vector<std::string> > vvsList_divided;
-            
-            for(std::size_t i=0; i< iMax_thread-1; i++) 
-                vvsList_divided.emplace_back(std::vector<std::string>(list.begin()+i*stSize_divided, list.begin() + stSize_divided*(i+1)));
-            
-            // 1 extra thread for extra files : rest of division
-            vvsList_divided.emplace_back(std::vector<std::string>(list.begin()+(iMax_thread-1)*stSize_divided, list.end()));
-            
-            msgM.msg(_msg::eMsg::MID, "starting", iMax_thread, " async threads");
-            
-            // let's don't decide the flag
-            std::launch lFlag=std::launch::async | std::launch::deferred;
+        const char cFile_sep=bDefSep ? cSep : '\0';
+        auto fCompute=[&](const std::string &sFile, const std::shared_ptr<_mmap> &pFile) {
+            std::string sRes=compute_file(sFile, cFile_sep, pFile, spParam);
+            if (bIncremental && !sRes.empty())
+                cache.update(sFile, "", sRes);
+            return sRes;
+        };
+        
+        // Concurrency: affinity and cgroup quota, then the load of the machine
+        _load load(vm["threads"].as<int>(), vm["max-load"].as<double>());
+        int iMax_thread=load.get_max();
+        msgM.msg(_msg::eMsg::MID, "available CPUs:", _load::available());
+        
+        // the results are numbered in the order the files are found, whatever the thread which computes them
+        typedef _pipeline<std::string> _pipe;
+        size_t stFiles=0;
+        bool bTree;
+        
+        if (bShared) {
+            _claim claim(vm["work-dir"].as<std::string>(), vm["shards"].as<int>(), vm["lease"].as<int>());
+            if (!claim.open()) {
+                msgM.msg(_msg::eMsg::ERROR, "cannot use the work directory", vm["work-dir"].as<std::string>());
+                return EXIT_FAILURE;
+            }
             
-            std::vector<std::future<void> > vfThread;
-            std::vector<std::vector<std::string> > vvsRes;
+            // every process lists the same files: the shard of a file depends on its path in the directory
+            std::vector<std::vector<std::string> > vvsShard(claim.get_shards());
+            bTree=tree.walk([&](const std::string &sFile, const std::string&) {
+                vvsShard[_claim::shard(fs::path(sFile).lexically_relative(pDirectory).string(), claim.get_shards())].emplace_back(sFile);
+            });
+            msgM.msg(_msg::eMsg::MID, "starting", iMax_thread, "threads on", claim.get_shards(), "shards");
             
-            if (bDefSep) {
-                int iCount=0;
-                for(auto t_list: vvsList_divided) {
-                    iCount++;
-                    std::string sNewoutput="part"+std::to_string(iCount)+"_"+sOutput; 
-                    vfThread.emplace_back(std::async(lFlag, compute_sep, t_list, sNewoutput, cSep));
+            size_t stShard;
+            while (claim.next(stShard)) {
+                _collector colShard(claim.get_result(stShard), vsColumn);
+                colShard.set_part(claim.get_part(stShard));
+                bool bRes=colShard.open();
+                {
+                    _pipe pipe([&fCompute](_pipe::_item &iItem) {
+                        iItem.TResult=fCompute(iItem.sIn, iItem.pFile);
+                        return true;
+                    },
+                    [&colShard](_pipe::_item &iItem, _sink&) { colShard.add(iItem.stSeq, iItem.TResult); },
+                    iMax_thread, vm["io-threads"].as<int>(), 1, vm["queue-depth"].as<int>());
+                    
+                    load.start([&pipe](int iN) { pipe.set_active(iN); });
+                    size_t stSeq=0;
+                    for(auto &sFile: vvsShard[stShard])
+                        pipe.push(sFile, "", stSeq++);
+                    pipe.finish();
+                    load.stop();
+                }
+                stFiles+=vvsShard[stShard].size();
+                
+                // the result is complete before the shard is marked done
+                if (bRes && colShard.close()) {
+                    if (!claim.done(stShard))
+                        msgM.msg(_msg::eMsg::MID, "shard", stShard, "taken over by another process");
+                }
+                else {
+                    msgM.msg(_msg::eMsg::ERROR, "cannot write", claim.get_result(stShard));
+                    claim.release(stShard);
+                    return EXIT_FAILURE;
                 }
             }
-            else {
-                int iCount=0;
-                for(auto t_list: vvsList_divided) {
-                    iCount++;
-                    std::string sNewoutput="part"+std::to_string(iCount)+"_"+sOutput; 
-                    vfThread.emplace_back(std::async(lFlag, compute, t_list, sNewoutput));
+            msgM.msg(_msg::eMsg::MID, "S/N for", stFiles, "files in", claim.get_claimed(), "shards");
+            
+            if (claim.claim_merge()) {
+                _collector colOutput(sOutput, vsColumn, fFormat, oOrder, stKey);
+                bool bRes=colOutput.open();
+                for(size_t i=0; bRes && i<claim.get_shards(); i++) {
+                    std::ifstream ifResult(claim.get_result(i), std::ios::binary);
+                    std::string sLines((std::istreambuf_iterator<char>(ifResult)), std::istreambuf_iterator<char>());
+                    bRes=ifResult.is_open();
+                    colOutput.add(i, sLines);
+                }
+                
+                if (bRes && colOutput.close()) {
+                    claim.merge_done();
+                    msgM.msg(_msg::eMsg::MID, "merge", claim.get_shards(), "shards");
+                }
+                else {
+                    msgM.msg(_msg::eMsg::ERROR, "cannot write", sOutput);
+                    claim.release(claim.get_shards());
                 }
             }
-            std::for_each(vfThread.begin(), vfThread.end(), [](std::future<void> &th) { th.get(); });
-            merge(sOutput);            
-        }  
+            else
+                msgM.msg(_msg::eMsg::MID, "the output is written by another process");
+        }
         else {
-            msgM.msg(_msg::eMsg::MID, "multi-threading disabled");
-            compute(list, sOutput);
+            _collector colOutput(sOutput, vsColumn, fFormat, oOrder, stKey);
+            if (!colOutput.open()) {
+                msgM.msg(_msg::eMsg::ERROR, "cannot open", sOutput);
+                return EXIT_FAILURE;
+            }
+            size_t stSeq=0;
+            
+            if (iMax_thread>1) {
+                msgM.msg(_msg::eMsg::MID, "starting", iMax_thread, "threads");
+                
+                // read, compute and gather stages
+                _pipe pipe([&fCompute](_pipe::_item &iItem) {
+                    iItem.TResult=fCompute(iItem.sIn, iItem.pFile);
+                    return true;
+                },
+                [&colOutput](_pipe::_item &iItem, _sink&) { colOutput.add(iItem.stSeq, iItem.TResult); },
+                iMax_thread, vm["io-threads"].as<int>(), vm["write-threads"].as<int>(), vm["queue-depth"].as<int>());
+                
+                load.start([&pipe](int iN) { pipe.set_active(iN); });
+                bTree=tree.walk([&](const std::string &sFile, const std::string&) {
+                    std::string sRes;
+                    if (fCached(sFile, sRes))
+                        colOutput.add(stSeq++, sRes);
+                    else {
+                        pipe.push(sFile, "", stSeq++);
+                        stFiles++;
+                    }
+                });
+                pipe.finish();
+                load.stop();
+            }
+            else {
+                msgM.msg(_msg::eMsg::MID, "multi-threading disabled");
+                
+                bTree=tree.walk([&](const std::string &sFile, const std::string&) {
+                    std::string sRes;
+                    if (!fCached(sFile, sRes)) {
+                        sRes=fCompute(sFile, nullptr);
+                        stFiles++;
+                    }
+                    colOutput.add(stSeq++, sRes);
+                });
+            }
+            msgM.msg(_msg::eMsg::MID, "S/N for", stFiles, "files");
+            
+            if (!colOutput.close())
+                msgM.msg(_msg::eMsg::ERROR, "cannot write", sOutput);
+        }
+        
+        if (bIncremental) {
+            msgM.msg(_msg::eMsg::MID, cache.get_fresh(), "files up to date");
+            if (!cache.save())
+                msgM.msg(_msg::eMsg::ERROR, "cannot write", cache.get_filename());
         }
+        if (!bTree)
+            msgM.msg(_msg::eMsg::ERROR, "cannot list", pDirectory.string());
     }
     
     msgM.msg(_msg::eMsg::MID, "output:", sOutput);   
@@ -323,4 +532,3 @@ int main(int argc, char** argv) {
      
     return EXIT_SUCCESS;
 }
-
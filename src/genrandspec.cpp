@@ -17,7 +17,6 @@
 #include <cmath>
 #include <random>
 #include <thread>
-#include <future>
 #include <ctime>
 
 #include <tuple>
@@ -54,6 +53,8 @@ namespace fs = boost::filesystem;
 #include <csv.h>
 #include <msg.h>
 #include <log.h>
+#include <pool.h>
+#include <load.h>
 
 #define LOGFILE ".genrandspec.log" /**< Define the default logfile  */
 #define HISTFILE ".history" /**< Define the default histfile (shared)  */
@@ -67,18 +68,11 @@ namespace fs = boost::filesystem;
 // Prototype
 // ----------------------------------------------------
 /**
- * \fn void run(const std::string& sOutput, char cSep, float fMinw, float fMaxw, float fStep)
- * \brief Write random spectra on disk
+ * \fn void run_file(const std::string& sFname, char cSep, float fMinw, float fMaxw, float fStep)
+ * \brief Write one random spectrum in sFname. One task of the thread pool.
  */
-void run(const std::string& sOutput, char cSep, float fMinw, float fMaxw, float fStep);
+void run_file(const std::string& sFname, char cSep, float fMinw, float fMaxw, float fStep);
 
-/**
- * \fn double long CPU_utilization()
- * \brief Get the CPU usage (%)
- */
-double long CPU_utilization();
-
-std::tuple<double long, double long> get_stat();
 // ----------------------------------------------------
 
 int main(int argc, char** argv) {
@@ -103,7 +97,9 @@ int main(int argc, char** argv) {
     ("maxw,u",  po::value<float>()->default_value(8000),"Upper wavelength bound")
     ("step,s",  po::value<float>()->default_value(0.05),"Difference between two neighbored wavelengths")
     ("output,o",  po::value<std::string>()->default_value("rand_spectra"),"Filename of folder results")
-    ("separator,s",  po::value<char>()->default_value('\t'),"The column separator. Do not set this option for \\tab.");
+    ("separator,s",  po::value<char>()->default_value('\t'),"The column separator. Do not set this option for \\tab.")
+    ("threads",  po::value<int>()->default_value(0),"Maximum number of threads, 0 for all the CPUs available to the process")
+    ("max-load",  po::value<double>()->default_value(100),"Machine load (%) not to exceed: threads are removed while other processes use the CPUs");
     
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(description).run(), vm);
@@ -122,17 +118,10 @@ int main(int argc, char** argv) {
         msgM.msg(_msg::eMsg::MID, "write history");
         msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
         msgM.msg(_msg::eMsg::MID, "check command line");
-        msgM.msg(_msg::eMsg::MID, "CPU utilization: 3 %"); 
-        msgM.msg(_msg::eMsg::MID, "create 8 async threads");
-        msgM.msg(_msg::eMsg::MID, "start 8 async threads");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/0 ");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/1 ");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/2 ");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/3 ");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/4 ");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/5 ");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/6 ");
-        msgM.msg(_msg::eMsg::THREADS, "create spectra in rand_spectra/7 ");
+        msgM.msg(_msg::eMsg::MID, "available CPUs: 8");
+        msgM.msg(_msg::eMsg::MID, "create 8 folders");
+        msgM.msg(_msg::eMsg::MID, "start 8 threads");
+        msgM.msg(_msg::eMsg::MID, "80 spectra created");
         msgM.msg(_msg::eMsg::END," 10.694788s wall, 77.990000s user + 3.050000s system = 81.040000s CPU (757.8%)");
         return EXIT_SUCCESS;
     }
@@ -194,35 +183,34 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
     
-    int iMax_thread=std::thread::hardware_concurrency();   
-
-// Limit CPU usage -------------------------------------
-#if defined (__linux__)
-    msgM.msg(_msg::eMsg::MID, "CPU utilization:", static_cast<int>(CPU_utilization()), "%");
-    if (CPU_utilization()>50) {
-        iMax_thread=1;
-        msgM.msg(_msg::eMsg::MID, "Reduce max thread");
-    }
-#endif
-// -----------------------------------------------------
+    // Concurrency: affinity and cgroup quota, then the load of the machine
+    _load load(vm["threads"].as<int>(), vm["max-load"].as<double>());
+    int iMax_thread=load.get_max();
+    msgM.msg(_msg::eMsg::MID, "available CPUs:", _load::available());
     
     msgM.msg(_msg::eMsg::MID, "create", iMax_thread, "folders");
     
     if (iMax_thread>1) {
-        msgM.msg(_msg::eMsg::MID, "start", iMax_thread, "async threads");
+        msgM.msg(_msg::eMsg::MID, "start", iMax_thread, "threads");
         if (fs::create_directory(pOutput)) {
             std::vector<std::string> vsList;
             for(int i=0; i<iMax_thread; i++)
                 vsList.emplace_back(sOutput+"/"+std::to_string(i));
             
-            std::launch flag=std::launch::async | std::launch::deferred;
-            
-            std::vector<std::future<void> > vfThread;
+            // one task per spectrum
+            _pool pool(iMax_thread);
+            load.start([&pool](int iN) { pool.set_active(iN); });
+            int iCount=0;
             for(auto sFile: vsList) 
                 if (fs::create_directory(fs::path(sFile)))
-                    vfThread.emplace_back(std::async(flag, run, sFile, cSep, fMin, fMax, fStep));
+                    for(int i=0; i<MaxFilepDir; i++, iCount++) {
+                        std::string sFname=sFile+"/"+std::to_string(i)+".dat";
+                        pool.submit([sFname, cSep, fMin, fMax, fStep]() { run_file(sFname, cSep, fMin, fMax, fStep); });
+                    }
+            pool.wait();
+            load.stop();
             
-            std::for_each(vfThread.begin(), vfThread.end(), [](std::future<void> &th) { th.get(); });
+            msgM.msg(_msg::eMsg::MID, iCount, "spectra created");
         }
         else {
             msgM.msg(_msg::eMsg::ERROR, "cannot mkdir",sOutput);
@@ -254,92 +242,13 @@ int main(int argc, char** argv) {
 // ----------------------------------------------------
 // ----------------------------------------------------
 
-void run(const std::string& sOutput, char cSep, float fMinw, float fMaxw, float fStep) {
-    
-    _msg msgM;
-    msgM.set_name("run()");
-    msgM.set_threadname("run");
-    msgM.set_log(LOGFILE);
-    
-#ifdef HAS_SYSCALL
-    msgM.msg(_msg::eMsg::THREADS, "create spectra in", sOutput);
-#else
-    msgM.msg(_msg::eMsg::MID, "create spectra in", sOutput);
-#endif
-    
+void run_file(const std::string& sFname, char cSep, float fMinw, float fMaxw, float fStep) {
     _csv<float> csv;
     csv.set_verbose(_csv<float>::eVerbose::QUIET);
     csv.set_separator(cSep);
+    csv.set_filename_out(sFname);
     
-    for(int i=0; i< MaxFilepDir; i++) {
-        std::string sFname=sOutput+"/"+std::to_string(i)+".dat";
-
-        csv.set_filename_out(sFname);
-        
-        csv.genrandspec(fMinw,fMaxw,fStep);
-        
-        csv.write();
-        
-    }
-}
-
-double long CPU_utilization() {
-     _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("CPU_utilization");
-    msgM.set_log(LOGFILE);
-        
-    auto [fTime_A, fIdle_A]=get_stat();
-    
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-    auto [fTime_B, fIdle_B]=get_stat();
-    
-    return 100.*(1.-((fIdle_B-fIdle_A)/(fTime_B-fTime_A)));
-}
-
-std::tuple<double long, double long>  get_stat() {
-    _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("get_stat");
-    msgM.set_log(LOGFILE);
-    
-    std::fstream sfCpu("/proc/stat", std::ios::in);
-    
-    if (sfCpu) {
-
-        std::string sLine;
-        std::getline(sfCpu, sLine);
-        
-        // erase "cpu"
-        sLine.erase(sLine.begin(), sLine.begin()+sLine.find_first_of("0123456789")); 
-        
-        // locate " " and push position into vec
-        std::vector<int> vPos;
-        std::vector<double long> vCol;
-        
-        vPos.push_back(0); 
-        
-        int iCount=0;
-        for(auto cC: sLine) {
-            if (cC==' ')
-                vPos.push_back(iCount);
-            iCount++;  
-        }
-        
-        // slice
-        for(int i=0; i<4; i++) {
-            std::string sVal=sLine.substr(vPos[i], vPos[i+1]-vPos[i]);
-            sVal.erase(std::remove(sVal.begin(), sVal.end(), ' '), sVal.end()); 
-            vCol.push_back(std::stod(sVal));
-        }
-        
-        sfCpu.close();
-                
-        return {static_cast<double long>(vCol[0]+vCol[1]+vCol[2]+vCol[3]), static_cast<double long>(vCol[3])};
-    }
-    else 
-        msgM.msg(_msg::eMsg::ERROR, "cannot open /proc/stat");
+    csv.genrandspec(fMinw,fMaxw,fStep);
     
-    return {-1,1};
+    csv.write();
 }
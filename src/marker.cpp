@@ -47,6 +47,7 @@ namespace fs = boost::filesystem;
 #include <msg.h>
 #include <log.h>
 #include <csv.h>
+#include <load.h>
 
 #define LOGFILE ".marker.log" /**< Define the default logfile  */
 #define HISTFILE ".history" /**< Define the default histfile (shared)  */
@@ -69,7 +70,7 @@ int main(int argc, char** argv) {
     description.add_options()
     ("help,h", "Display this help message")
     ("input,i", po::value<std::vector<std::string> >()->multitoken(),"Set input files.")
-    ("sep,s", po::value<std::vector<std::string> >()->multitoken(), "Set separators. If more than one sep is defined, the number of sep must be equal to the numbers of files.")
+    ("sep,s", po::value<std::vector<std::string> >()->multitoken(), "Set separators, 'auto' or not set to detect them. If more than one sep is defined, the number of sep must be equal to the numbers of files.")
     ("output,o", po::value<std::string>(),"Set the output.")
     ("title,t", po::value<std::string>(), "Set the title.")
     ("label,l", po::value<std::vector<std::string> >()->multitoken(),"Set labels. If more than one label is defined, the number of labels must be equal to the numbers of files.")
@@ -286,8 +287,8 @@ int main(int argc, char** argv) {
         
     if (!vm.count("sep")) 
         for(auto sFile: vsFlist) {
-            msgM.msg(_msg::eMsg::MID, "set input:", sFile, "with sep: '",'\t',"'");
-            vCsv.push_back(_csv<float>(sFile,'\t'));
+            msgM.msg(_msg::eMsg::MID, "set input:", sFile, "with sep: auto");
+            vCsv.push_back(_csv<float>(sFile, "auto"));
         }
     else {
         if (vm["sep"].as<std::vector<std::string> >().size()==1) 
@@ -316,9 +317,12 @@ int main(int argc, char** argv) {
     if (vm.count("verbose")) 
         for(auto &csv: vCsv) csv.set_verbose(_csv<float>::DEBUG);
     
-    // Read all files
+    // Read all files, each one with all the cores
     bool bRead=true;
-    for(auto &csv: vCsv) bRead&=csv.read();
+    for(auto &csv: vCsv) {
+        csv.set_threads(_load::available());
+        bRead&=csv.read();
+    }
         
     if (bRead) {
         msgM.msg(_msg::eMsg::MID, "data read and stored");
@@ -344,23 +348,23 @@ int main(int argc, char** argv) {
         msgM.msg(_msg::eMsg::MID, "set data to plot");
         if (!vm.count("label"))
             for(auto &csv: vCsv) 
-                Marker.add_data(csv.select_column(0), 
-                                csv.select_column(1));
+                Marker.add_data(csv.get_column(0), 
+                                csv.get_column(1));
         else if (vsLabels.size()==1) {
             for(auto &csv: vCsv) 
-                Marker.add_data(csv.select_column(0), 
-                                csv.select_column(1));
+                Marker.add_data(csv.get_column(0), 
+                                csv.get_column(1));
             Marker.set_label(vsLabels[0]);
         }
         else {
             int i=0;
             for(auto &csv: vCsv) {
                 if (i==0)
-                    Marker.set_data(csv.select_column(0), 
-                                    csv.select_column(1));
+                    Marker.set_data(csv.get_column(0), 
+                                    csv.get_column(1));
                 else 
-                    Marker.add_data(csv.select_column(0), 
-                                    csv.select_column(1), 
+                    Marker.add_data(csv.get_column(0), 
+                                    csv.get_column(1), 
                                     vsLabels[i-1]);
                 i++;
             }
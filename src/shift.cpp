@@ -10,8 +10,8 @@
 #include <vector>
 #include <algorithm>
 #include <thread>
-#include <future>
 #include <string>
+#include <atomic>
 #include <tuple>
 #include <chrono>
 #include <boost/program_options.hpp>
@@ -47,6 +47,7 @@ namespace fs = boost::filesystem;
 #include <msg.h>
 #include <log.h>
 #include <shift.h>
+#include <journal.h>
 
 #define CLIGHT 299792.458 // /**< Speed of light in km/s  */
 
@@ -73,20 +74,31 @@ int main(int argc, char** argv) {
     ("help,h", "Display this help message")
     ("wavelength,w",  po::value<float>(),"Wavelength")
     ("velocity,v",  po::value<float>(),"Radial velocity of the source (km/s)")
+    ("manifest,m",  po::value<std::string>(),"File of rows \"path<TAB>vr\": correct each spectrum of the input folder from its own radial velocity (km/s). The spectra not listed are skipped.")
     ("filename,f",  po::value<std::string>(),"Shift a single file")
     ("input_folder,i",  po::value<std::string>(),"Name of the folder where original data are")
     ("output,o",  po::value<std::string>()->default_value("data_out"),"Set the directory or the file where store new data.")
-    ("separator,s",  po::value<char>()->default_value('\t'),"The column separator. Do not set this option for \\tab.");
+    ("separator,s",  po::value<char>(),"The column separator, detected in each file if not set. Do not set this option for \\tab.")
+    ("resume",  "Continue an interrupted run: the output folder exists and the files listed in its journal are skipped")
+    ("include",  po::value<std::vector<std::string> >()->multitoken(),"Process only the files matching these globs, e.g. \"*.dat\". A glob with a '/' is matched against the path relative to the input folder")
+    ("exclude,e",  po::value<std::vector<std::string> >()->multitoken(),"Skip the files and the folders matching these globs. A string without wildcard excludes the names containing it")
+    ("scan-threads",  po::value<int>()->default_value(TREE_THREADS),"Threads which list the input folders")
+    ("threads",  po::value<int>()->default_value(0),"Maximum number of threads, 0 for all the CPUs available to the process")
+    ("max-load",  po::value<double>()->default_value(100),"Machine load (%) not to exceed: threads are removed while other processes use the CPUs")
+    ("io-threads",  po::value<int>()->default_value(1),"Threads which map and prefetch the input files")
+    ("write-threads",  po::value<int>()->default_value(1),"Threads which write the output files")
+    ("queue-depth",  po::value<int>()->default_value(PIPE_DEPTH),"Files waiting between two stages of the pipeline");
     
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(description).run(), vm);
     po::notify(vm);
     
-    if (vm.count("help") || !(vm.count("wavelength") ^ vm.count("velocity")) || !(vm.count("input_folder") ^ vm.count("filename"))  || vm.size()<2) {
+    if (vm.count("help") || vm.count("wavelength")+vm.count("velocity")+vm.count("manifest")!=1 || !(vm.count("input_folder") ^ vm.count("filename")) || (vm.count("manifest") && !vm.count("input_folder")) || vm.size()<2) {
         msgM.enable_log(false);
         std::cout << description;
         std::cout << "\nExample:\n";
         std::cout << "./shift -w -1.0 -f CD-592728.obs\n";
+        std::cout << "./shift -m rv.tsv -i data -o data_out\n";
         msgM.msg(_msg::eMsg::START);
         msgM.msg(_msg::eMsg::MID, "write history");
         msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
@@ -127,6 +139,7 @@ int main(int argc, char** argv) {
     msgM.msg(_msg::eMsg::MID, "check command line");
         
     bool bDefVr=false;
+    bool bManifest=vm.count("manifest");
     
     float fVr;
     float fWavelength;
@@ -135,16 +148,19 @@ int main(int argc, char** argv) {
         fVr=vm["velocity"].as<float>();
         bDefVr=true;
     }
-    else 
+    else if (!bManifest)
         fWavelength=vm["wavelength"].as<float>();
+    else
+        bDefVr=true;
     
     std::string sFilename;
     std::string sOutput=vm["output"].as<std::string>();
-    char cSep=vm["separator"].as<char>();
+    // '\0': the separator is detected in each file
+    char cSep=vm.count("separator") ? vm["separator"].as<char>() : '\0';
     
     fs::path pFilename;
     
-    // one copies the original folder and then works on the original
+    // the input folder is mirrored in the output folder
     fs::path path(vm["output"].as<std::string>());
     fs::path path_out;
     
@@ -165,90 +181,177 @@ int main(int argc, char** argv) {
             return EXIT_FAILURE;
         }
         
-        // copy the original data with the available lib
-        if (!fs::exists(path)) {
-#ifdef FS_STD 
-        msgM.msg(_msg::eMsg::MID, "copying folder using std::"); 
-        fs::copy(path_out,path, fs::copy_options::recursive);
-#endif
-#ifdef FS_STDEXP
-        msgM.msg(_msg::eMsg::MID, "copying folder using std::experimental"); 
-        fs::copy(path_out,path, fs::copy_options::recursive);
-#endif
-#ifdef FS_BOOST
-        msgM.msg(_msg::eMsg::MID, "copying folder using boost:: : not implemented !");
-        return EXIT_FAILURE;
-#endif
-        }
-        else { 
+        if (fs::exists(path) && !vm.count("resume")) { 
             msgM.msg(_msg::eMsg::ERROR, "error directory", path.string(), "exists");
             return EXIT_FAILURE;
         }
     } 
     
-     if (vm.count("input_folder") && fs::is_directory(path)) {
+    // radial velocity of each spectrum
+    std::unordered_map<std::string, float> umVr;
+    
+    if (bManifest) {
+        std::string sManifest=vm["manifest"].as<std::string>();
+        size_t stMissing;
+        
+        if (!read_manifest(sManifest, path_out.string(), umVr, stMissing)) {
+            msgM.msg(_msg::eMsg::ERROR, "cannot read manifest", sManifest);
+            return EXIT_FAILURE;
+        }
+        msgM.msg(_msg::eMsg::MID, "manifest:", umVr.size(), "radial velocities");
+        if (stMissing>0)
+            msgM.msg(_msg::eMsg::ERROR, stMissing, "files of the manifest do not exist");
+    }
+    
+    if (vm.count("input_folder")) {
+        // Concurrency: affinity and cgroup quota, then the load of the machine
+        _load load(vm["threads"].as<int>(), vm["max-load"].as<double>());
+        int max_thread=load.get_max();
+        msgM.msg(_msg::eMsg::MID, "available CPUs:", _load::available());
         
-        fs::recursive_directory_iterator step0(path);
-        std::vector<std::string> list;
+        // the input tree is mirrored: the spectra are written straight to the output, the other files are linked
+        _tree tree(path_out.string(), path.string());
+        tree.set_threads(vm["scan-threads"].as<int>());
+        if (vm.count("include"))
+            tree.set_include(vm["include"].as<std::vector<std::string> >());
+        if (vm.count("exclude"))
+            tree.set_exclude(vm["exclude"].as<std::vector<std::string> >());
+        size_t stFiles=0;
+        size_t stSkipped=0;
+        bool bTree;
         
-        for(auto &file: boost::make_iterator_range(step0,{}) ) {
-            // csv<> unable to parse non csv file
-            if (!fs::is_directory(file) && 
-                file.path().has_extension() && 
-                file.path().filename().string().find(std::string(".tar"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".tar.gz"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".tgz"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".zip"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".txt"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".directory"))==std::string::npos )
-                list.emplace_back(file.path().relative_path().string());
+        // the completed files are journaled: an interrupted run is continued with --resume
+        const bool bResume=vm.count("resume");
+        _journal journal;
+        size_t stResumed=0;
+        tree.set_update(bResume);
+        if (bResume)
+            msgM.msg(_msg::eMsg::MID, _tree::remove_parts(path), "partial files removed");
+        try {
+            fs::create_directories(path);
+        }
+        catch (...) { }
+        if (!journal.open((path/JOURNAL_FILE).string(), bResume)) {
+            msgM.msg(_msg::eMsg::ERROR, "cannot open", journal.get_filename());
+            return EXIT_FAILURE;
         }
-        int max_thread=std::thread::hardware_concurrency();
         
-// Limit CPU usage -------------------------------------
-#if defined (__linux__)
-    msgM.msg(_msg::eMsg::MID, "CPU load:", static_cast<int>(CPU_utilization()), "%");
-    if (CPU_utilization()>50) {
-        max_thread=1;
-        msgM.msg(_msg::eMsg::MID, "Reduce max thread");
-    }
-#endif
-// -----------------------------------------------------
+        // false if the spectrum is not in the manifest
+        auto fVelocity=[&](const std::string &sIn, float &fFileVr) {
+            if (!bManifest) {
+                fFileVr=fVr;
+                return true;
+            }
+            auto itVr=umVr.find(manifest_key(sIn));
+            if (itVr==umVr.end())
+                return false;
+            fFileVr=itVr->second;
+            return true;
+        };
+        
+        auto fFile=[&](const std::string &sIn, const std::string &sOut, bool &bParsed) {
+            float fFileVr;
+            bParsed=true;
+            if (!bDefVr)
+                return add_file(sIn, sOut, cSep, fWavelength, bParsed);
+            return fVelocity(sIn, fFileVr) && transform_file(sIn, sOut, cSep, fFileVr, bParsed);
+        };
+        
+        // a file _csv cannot parse is mirrored as is, like the other files of the tree
+        std::atomic<size_t> stUnparsed(0), stLost(0);
+        auto fUnparsed=[&](const std::string &sIn, const std::string &sOut) {
+            if (!_tree::relink(sIn, sOut)) {
+                stLost++;
+                return;
+            }
+            stUnparsed++;
+            journal.add(sIn);
+        };
 
         if (max_thread>1) {
-            const std::size_t size_divided=list.size()/max_thread;
-            
-            std::vector<std::vector<std::string> > list_divided;
-            
-            for(std::size_t i=0; i< max_thread-1; i++) 
-                list_divided.emplace_back(std::vector<std::string>(list.begin()+i*size_divided, list.begin() + size_divided*(i+1)));
+            msgM.msg(_msg::eMsg::MID, "starting", max_thread, "threads");
             
-            // 1 extra thread for extra files : rest of division
-            list_divided.emplace_back(std::vector<std::string>(list.begin()+(max_thread-1)*size_divided, list.end()));
+            // read, compute and write stages: the disk works while the CPUs parse
+            typedef _pipeline<std::unique_ptr<_csv<float> > > _pipe;
+            _pipe pipe([&](_pipe::_item &iItem) {
+                auto pCsv=std::make_unique<_csv<float> >(iItem.sIn, cSep);
+                pCsv->set_filename_out(iItem.sOut);
+                // only the wavelength is parsed and formatted again
+                pCsv->set_projection({0});
+                if (!pCsv->read(iItem.pFile)) {
+                    fUnparsed(iItem.sIn, iItem.sOut);
+                    return false;
+                }
+                
+                pCsv->set_verbose(_csv<float>::eVerbose::QUIET);
+                float fFileVr;
+                if (!bDefVr)
+                    pCsv->shift(fWavelength);
+                else if (fVelocity(iItem.sIn, fFileVr))
+                    pCsv->transform_lin(1/(1+fFileVr/CLIGHT), 0, 0);
+                
+                iItem.TResult=std::move(pCsv);
+                return true;
+            },
+            [&journal](_pipe::_item &iItem, _sink &skOut) {
+                // journaled once the sink has renamed the output, not when it is queued
+                iItem.TResult->write(skOut, [&journal, sIn=iItem.sIn]() { journal.add(sIn); });
+            },
+            max_thread, vm["io-threads"].as<int>(), vm["write-threads"].as<int>(), vm["queue-depth"].as<int>());
             
-            msgM.msg(_msg::eMsg::MID, "starting", max_thread, "async threads");
-            
-            // let's dont decide the flag
-            std::launch flag=std::launch::async | std::launch::deferred;
-            
-            std::vector<std::future<void> > thread;
-            
-            if (!bDefVr)
-                for(auto t_list: list_divided)
-                    thread.emplace_back(std::async(flag, add_sep, t_list, cSep, fWavelength));
-            else
-                for(auto t_list: list_divided)
-                    thread.emplace_back(std::async(flag, transform_sep, t_list, cSep, fVr));                
-            
-            std::for_each(thread.begin(), thread.end(), [](std::future<void> &th) { th.get(); });
+            load.start([&pipe](int iN) { pipe.set_active(iN); });
+            bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+                float fFileVr;
+                if (bDefVr && !fVelocity(sIn, fFileVr)) {
+                    stSkipped++;
+                    return;
+                }
+                if (bResume && journal.is_done(sIn) && fs::exists(sOut)) {
+                    stResumed++;
+                    return;
+                }
+                pipe.push(sIn, sOut);
+                stFiles++;
+            });
+            pipe.finish();
+            if (pipe.get_failed()>0)
+                msgM.msg(_msg::eMsg::ERROR, pipe.get_failed(), "files cannot be written");
+            load.stop();
         }  
         else {
             msgM.msg(_msg::eMsg::MID, "multi-threading disabled");
-            if (!bDefVr)
-                add_sep(list, cSep, fWavelength);
-            else
-                transform_sep(list, cSep, fVr);
+            bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+                float fFileVr;
+                if (bDefVr && !fVelocity(sIn, fFileVr)) {
+                    stSkipped++;
+                    return;
+                }
+                if (bResume && journal.is_done(sIn) && fs::exists(sOut)) {
+                    stResumed++;
+                    return;
+                }
+                bool bParsed;
+                if (fFile(sIn, sOut, bParsed))
+                    journal.add(sIn);
+                else if (!bParsed)
+                    fUnparsed(sIn, sOut);
+                stFiles++;
+            });
         }
+        
+        msgM.msg(_msg::eMsg::MID, stFiles, "files parsed,", tree.get_linked(), "files linked");
+        if (stUnparsed>0)
+            msgM.msg(_msg::eMsg::MID, stUnparsed.load(), "files cannot be parsed, linked as is");
+        if (stLost>0)
+            msgM.msg(_msg::eMsg::ERROR, stLost.load(), "files cannot be parsed nor linked");
+        if (stSkipped>0)
+            msgM.msg(_msg::eMsg::MID, stSkipped, "files not in the manifest skipped");
+        if (bResume)
+            msgM.msg(_msg::eMsg::MID, stResumed, "files completed by the previous run");
+        if (!journal.close())
+            msgM.msg(_msg::eMsg::ERROR, "cannot write", journal.get_filename());
+        if (!bTree)
+            msgM.msg(_msg::eMsg::ERROR, "cannot mirror", path_out.string(), "in", path.string());
     }
     else {
         if (!bDefVr)
@@ -258,6 +361,11 @@ int main(int argc, char** argv) {
         
         _csv<float> csv(sFilename, cSep);
         csv.set_filename_out(sOutput);
+        // a single file: use all the available CPUs to parse it
+        _load load(vm["threads"].as<int>());
+        csv.set_threads(load.get_max());
+        // only the wavelength is parsed and formatted again
+        csv.set_projection({0});
         
         if (csv.read()) {
             csv.set_verbose(_csv<float>::eVerbose::QUIET);
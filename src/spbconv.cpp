@@ -0,0 +1,208 @@
+/**
+ * \file spbconv.cpp
+ * \brief Convert ASCII spectra to the binary .spb format and back.
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <boost/program_options.hpp>
+#include <boost/range/iterator_range.hpp>
+
+#if __has_include (<boost/timer/timer.hpp>)
+#include <boost/timer/timer.hpp>
+#define HAS_BOOST_TIMER /**< boost::timer availability */
+#endif
+
+#if __has_include (<filesystem>)
+#include <filesystem>
+#define FS_STD /**< std::filesystem availability (C++17) */
+namespace fs = std::filesystem;
+#elif __has_include (<experimental/filesystem>) && !__has_include (<filesystem>)
+#include <experimental/filesystem>
+#define FS_STDEXP /**< std::experimental::filesystem availability */
+namespace fs = std::experimental::filesystem;
+#elif __has_include(<boost/filesystem.hpp>) && !__has_include (<filesystem>) && !__has_include (<experimental/filesystem>)
+#include <boost/filesystem.hpp>
+#define FS_BOOST /**< boost::filesystem availability */
+namespace fs = boost::filesystem;
+#else
+#error "No filesystem header found"
+#endif
+
+#include <csv.h>
+#include <msg.h>
+#include <log.h>
+#include <tree.h>
+
+#define LOGFILE ".spbconv.log" /**< Define the default logfile  */
+#define HISTFILE ".history" /**< Define the default histfile (shared)  */
+
+/**
+ * \fn bool convert(const std::string &sInput, const std::string &sOutput, char cSep, int iPrec)
+ * \brief Convert sInput into sOutput, the direction is given by the .spb extension.
+ */
+bool convert(const std::string &sInput, const std::string &sOutput, char cSep, int iPrec);
+
+/**
+ * \fn std::string default_output(const std::string &sInput)
+ * \brief Add the .spb extension to an ASCII file, remove it from a .spb file.
+ */
+std::string default_output(const std::string &sInput);
+
+int main(int argc, char** argv) {
+
+#ifdef HAS_BOOST_TIMER
+    boost::timer::cpu_timer btTimer;
+#endif
+
+    _msg msgM;
+    msgM.set_name("spbconv");
+    msgM.set_log(LOGFILE);
+
+// Parse cmd line
+// ----------------------------------------------------
+
+    namespace po = boost::program_options;
+    po::options_description description("Usage");
+
+    description.add_options()
+    ("help,h", "Display this help message")
+    ("filename,f",  po::value<std::string>(),"Convert a single file")
+    ("input_folder,i",  po::value<std::string>(),"Convert all the spectra of a folder, next to the originals")
+    ("output,o",  po::value<std::string>(),"Output file for -f. Default: add or remove the .spb extension.")
+    ("reverse,r", "With -i, convert the .spb files back to ASCII")
+    ("include",  po::value<std::vector<std::string> >()->multitoken(),"With -i, convert only the files matching these globs, e.g. \"*.dat\"")
+    ("exclude,e",  po::value<std::vector<std::string> >()->multitoken(),"With -i, skip the files and the folders matching these globs")
+    ("scan-threads",  po::value<int>()->default_value(TREE_THREADS),"Threads which list the input folder")
+    ("precision,p",  po::value<int>()->default_value(-1),"Significant digits of the ASCII output, -1 for the shortest round-trip")
+    ("separator,s",  po::value<char>()->default_value('\t'),"The column separator. Do not set this option for \\tab.");
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(description).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || !(vm.count("input_folder") ^ vm.count("filename"))) {
+        msgM.enable_log(false);
+        std::cout << description;
+        std::cout << "\nExample:\n";
+        std::cout << "./spbconv -f CD-592728.obs\n";
+        msgM.msg(_msg::eMsg::START);
+        msgM.msg(_msg::eMsg::MID, "write history");
+        msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
+        msgM.msg(_msg::eMsg::MID, "check command line");
+        msgM.msg(_msg::eMsg::MID, "output: CD-592728.obs.spb");
+        msgM.msg(_msg::eMsg::END," 0.003272s wall, 0.000000s user + 0.000000s system = 0.000000s CPU (n/a%)\n");
+
+        return EXIT_SUCCESS;
+    }
+
+    // ----------------------------------------------------
+
+    msgM.msg(_msg::eMsg::START);
+
+    _log log;
+    log.set_execname(argv);
+    log.set_historyname(HISTFILE);
+    log.set_logname(LOGFILE);
+
+    // Write history
+    // ----------------------------------------------------
+    msgM.msg(_msg::eMsg::MID, "write history");
+    if (!log.write_history(vm))
+        msgM.msg(_msg::eMsg::ERROR, "cannot open history");
+    // ----------------------------------------------------
+
+    // Remove duplicates
+    // ----------------------------------------------------
+    msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
+    if (!log.remove_duplicate())
+        msgM.msg(_msg::eMsg::ERROR, "cannot open history");
+    // ----------------------------------------------------
+
+    msgM.msg(_msg::eMsg::MID, "check command line");
+
+    char cSep=vm["separator"].as<char>();
+    int iPrec=vm["precision"].as<int>();
+
+    if (vm.count("filename")) {
+        std::string sFilename=vm["filename"].as<std::string>();
+
+        if (!fs::exists(fs::path(sFilename))) {
+            msgM.msg(_msg::eMsg::ERROR, "file", sFilename, "does not exist");
+            return EXIT_FAILURE;
+        }
+
+        std::string sOutput=vm.count("output") ? vm["output"].as<std::string>() : default_output(sFilename);
+
+        if (!convert(sFilename, sOutput, cSep, iPrec)) {
+            msgM.msg(_msg::eMsg::ERROR, "cannot convert", sFilename);
+            return EXIT_FAILURE;
+        }
+        msgM.msg(_msg::eMsg::MID, "output:", sOutput);
+    }
+    else {
+        std::string sFolder=vm["input_folder"].as<std::string>();
+        fs::path path(sFolder);
+
+        if (!fs::is_directory(path)) {
+            msgM.msg(_msg::eMsg::ERROR, "directory", sFolder, "does not exist");
+            return EXIT_FAILURE;
+        }
+
+        bool bReverse=vm.count("reverse");
+
+        _tree tree(sFolder);
+        tree.set_threads(vm["scan-threads"].as<int>());
+        if (vm.count("include"))
+            tree.set_include(vm["include"].as<std::vector<std::string> >());
+        if (vm.count("exclude"))
+            tree.set_exclude(vm["exclude"].as<std::vector<std::string> >());
+
+        // the list is complete before the conversions add files next to the originals
+        std::vector<std::string> list;
+        if (!tree.walk([&](const std::string &sIn, const std::string&) {
+                if (_spb::is_spb(sIn)==bReverse)
+                    list.emplace_back(sIn);
+            }))
+            msgM.msg(_msg::eMsg::ERROR, "cannot list", sFolder);
+
+        size_t stDone=0;
+        for(auto &file: list) {
+            if (convert(file, default_output(file), cSep, iPrec))
+                stDone++;
+            else
+                msgM.msg(_msg::eMsg::ERROR, "cannot convert", file);
+        }
+
+        msgM.msg(_msg::eMsg::MID, stDone, "files converted");
+    }
+
+#ifdef HAS_BOOST_TIMER
+    msgM.msg(_msg::eMsg::END, btTimer.format());
+#endif
+
+    return EXIT_SUCCESS;
+}
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+bool convert(const std::string &sInput, const std::string &sOutput, char cSep, int iPrec) {
+    // values are kept as they are stored: no rounding through float
+    _csv<double> csv(sInput, cSep);
+    csv.set_filename_out(sOutput);
+    csv.set_precision(iPrec);
+
+    return csv.read() && csv.write();
+}
+
+std::string default_output(const std::string &sInput) {
+    if (_spb::is_spb(sInput))
+        return sInput.substr(0, sInput.size()-4);
+    return sInput+".spb";
+}
@@ -0,0 +1,329 @@
+/**
+ * \file spec.cpp
+ * \brief Run a chain of commands (trim, threshold, shift, der_snr) on a folder in one pass: each spectrum is read once, goes through the commands in memory and is written once.
+ * \author Audric Lemonnier
+ * \version 0.1
+ * \date 17/10/2026
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <string>
+#include <atomic>
+#include <memory>
+
+#include <boost/program_options.hpp>
+
+#if __has_include (<boost/timer/timer.hpp>)
+#include <boost/timer/timer.hpp>
+#define HAS_BOOST_TIMER /**< boost::timer availability */
+#endif
+
+#if __has_include (<filesystem>)
+#include <filesystem>
+#define FS_STD /**< std::filesystem availability (C++17) */
+namespace fs = std::filesystem;
+#elif __has_include (<experimental/filesystem>) && !__has_include (<filesystem>)
+#include <experimental/filesystem>
+#define FS_STDEXP /**< std::experimental::filesystem availability */
+namespace fs = std::experimental::filesystem;
+#elif __has_include(<boost/filesystem.hpp>) && !__has_include (<filesystem>) && !__has_include (<experimental/filesystem>)
+#include <boost/filesystem.hpp>
+#define FS_BOOST /**< boost::filesystem availability */
+namespace fs = boost::filesystem;
+#else
+#error "No filesystem header found"
+#endif
+
+#include <csv.h>
+#include <msg.h>
+#include <log.h>
+#include <pipeline.h>
+#include <load.h>
+#include <tree.h>
+#include <spec.h>
+#include <collector.h>
+
+#define LOGFILE ".spec.log" /**< Define the default logfile  */
+#define HISTFILE ".history" /**< Define the default histfile (shared)  */
+
+/**
+ * \struct _spectrum
+ * \brief Result of the chain for one file.
+ */
+struct _spectrum {
+    std::unique_ptr<_csv<float> > pCsv; /**< Spectrum to write, nullptr if no command modifies it */
+    std::string sResult; /**< Line of the S/N table, empty without der_snr */
+};
+
+int main(int argc, char** argv) {
+
+#ifdef HAS_BOOST_TIMER
+    boost::timer::cpu_timer btTimer;
+#endif
+
+    _msg msgM;
+    msgM.set_name("spec");
+    msgM.set_log(LOGFILE);
+
+// Parse cmd line
+// ----------------------------------------------------
+
+    namespace po = boost::program_options;
+    po::options_description description("Usage: spec [options] command [options] : command [options] ...\nOptions");
+
+    description.add_options()
+    ("help,h", "Display this help message")
+    ("input_folder,i",  po::value<std::string>(),"Name of the folder where original data are")
+    ("output_folder,o",  po::value<std::string>()->default_value("data_out"),"Set the directory where store new data, unused if no command modifies the spectra")
+    ("separator,s",  po::value<char>(),"The column separator, detected in each file if not set")
+    ("chain,c",  po::value<std::string>(),"The chain of commands as one string, e.g. \"trim -l 4700 -u 4800 : der_snr\"")
+    ("include",  po::value<std::vector<std::string> >()->multitoken(),"Process only the files matching these globs, e.g. \"*.dat\". A glob with a '/' is matched against the path relative to the input folder")
+    ("exclude,e",  po::value<std::vector<std::string> >()->multitoken(),"Skip the files and the folders matching these globs. A string without wildcard excludes the names containing it")
+    ("scan-threads",  po::value<int>()->default_value(TREE_THREADS),"Threads which list the input folders")
+    ("threads",  po::value<int>()->default_value(0),"Maximum number of threads, 0 for all the CPUs available to the process")
+    ("max-load",  po::value<double>()->default_value(100),"Machine load (%) not to exceed: threads are removed while other processes use the CPUs")
+    ("io-threads",  po::value<int>()->default_value(1),"Threads which map and prefetch the input files")
+    ("write-threads",  po::value<int>()->default_value(1),"Threads which write the output files")
+    ("queue-depth",  po::value<int>()->default_value(PIPE_DEPTH),"Files waiting between two stages of the pipeline");
+
+    // the options of spec stop at the first command
+    int iCommand=1;
+    while (iCommand<argc && !_stage::is_command(argv[iCommand]) && std::string(argv[iCommand])!=":")
+        iCommand++;
+
+    po::variables_map vm;
+    std::vector<std::string> vsChain;
+    std::vector<std::unique_ptr<_stage> > vpStage;
+
+    try {
+        po::store(po::command_line_parser(std::vector<std::string>(argv+1, argv+iCommand)).options(description).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("chain"))
+            vsChain=po::split_unix(vm["chain"].as<std::string>());
+        vsChain.insert(vsChain.end(), argv+iCommand, argv+argc);
+
+        // the chain is written in the history as one option
+        std::string sChain;
+        for(auto &sS: vsChain)
+            sChain+=(sChain.empty() ? "" : " ")+sS;
+        if (!sChain.empty() && !vm.count("chain"))
+            vm.insert({"chain", po::variable_value(sChain, false)});
+
+        if (!vm.count("help") && !split_chain(vsChain, vpStage)) {
+            msgM.msg(_msg::eMsg::ERROR, "unknown command in", sChain);
+            return EXIT_FAILURE;
+        }
+    }
+    catch (const po::error &e) {
+        msgM.msg(_msg::eMsg::ERROR, e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help") || vpStage.empty() || !vm.count("input_folder")) {
+        msgM.enable_log(false);
+        std::cout << description << "\n";
+        _stage::help();
+        std::cout << "\nThe S/N table of der_snr has one column per der_snr command and is written in the output of the last one.\n";
+        std::cout << "\nExample:\n";
+        std::cout << "./spec -i data -o reduced trim -l 4700 -u 4800 : threshold -t 0 : shift -v 12.3 : der_snr -o snr.csv\n";
+        msgM.msg(_msg::eMsg::START);
+        msgM.msg(_msg::eMsg::MID, "write history");
+        msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
+        msgM.msg(_msg::eMsg::MID, "check command line");
+        msgM.msg(_msg::eMsg::MID, "chain: trim threshold shift der_snr");
+        msgM.msg(_msg::eMsg::MID, "available CPUs: 8");
+        msgM.msg(_msg::eMsg::MID, "starting 8 threads");
+        msgM.msg(_msg::eMsg::MID, "4171 files parsed, 3 files linked");
+        msgM.msg(_msg::eMsg::MID, "S/N table: snr.csv");
+        msgM.msg(_msg::eMsg::END, " 54.108351s wall, 300.520000s user + 0.830000s system = 301.350000s CPU (557.0%)\n");
+        return EXIT_SUCCESS;
+    }
+
+    fs::path path(vm["output_folder"].as<std::string>());
+    fs::path path_out(vm["input_folder"].as<std::string>());
+    const char cSep=vm.count("separator") ? vm["separator"].as<char>() : '\0';
+
+    // ----------------------------------------------------
+    msgM.msg(_msg::eMsg::START);
+
+    _log log;
+    log.set_execname(argv);
+    log.set_historyname(HISTFILE);
+    log.set_logname(LOGFILE);
+
+    // Write history
+    // ----------------------------------------------------
+    msgM.msg(_msg::eMsg::MID, "write history");
+    if (!log.write_history(vm))
+        msgM.msg(_msg::eMsg::ERROR, "cannot open history");
+    // ----------------------------------------------------
+
+    // Remove duplicates
+    // ----------------------------------------------------
+    msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
+    if (!log.remove_duplicate())
+        msgM.msg(_msg::eMsg::ERROR, "cannot open history");
+    // ----------------------------------------------------
+
+    msgM.msg(_msg::eMsg::MID, "check command line");
+
+    // what the chain needs: the columns to parse, an output folder, a S/N table
+    std::vector<int> viColumn;
+    std::string sChain, sTable;
+    bool bWrite=false;
+    const _stage_der_snr *pTable=nullptr;
+    std::vector<std::string> vsTable={"file"};
+
+    for(auto &pStage: vpStage) {
+        for(int iCol: pStage->get_columns())
+            if (std::find(viColumn.begin(), viColumn.end(), iCol)==viColumn.end())
+                viColumn.emplace_back(iCol);
+
+        bWrite|=pStage->is_writer();
+        if (auto pSnr=dynamic_cast<const _stage_der_snr*>(pStage.get())) {
+            pTable=pSnr;
+            sTable=pSnr->get_output();
+            vsTable.emplace_back("snr_"+std::to_string(vsTable.size()));
+        }
+        sChain+=(sChain.empty() ? "" : " ")+pStage->get_name();
+    }
+    if (vsTable.size()==2)
+        vsTable[1]="snr";
+    std::sort(viColumn.begin(), viColumn.end());
+    msgM.msg(_msg::eMsg::MID, "chain:", sChain);
+
+    if (!fs::exists(path_out)) {
+        msgM.msg(_msg::eMsg::ERROR, "error directory", path_out.string(), "does not exist");
+        return EXIT_FAILURE;
+    }
+
+    if (bWrite && fs::exists(path)) {
+        msgM.msg(_msg::eMsg::ERROR, "error directory", path.string(), "exists");
+        return EXIT_FAILURE;
+    }
+
+    // Concurrency: affinity and cgroup quota, then the load of the machine
+    _load load(vm["threads"].as<int>(), vm["max-load"].as<double>());
+    int max_thread=load.get_max();
+    msgM.msg(_msg::eMsg::MID, "available CPUs:", _load::available());
+    msgM.msg(_msg::eMsg::MID, "starting", max_thread, "threads");
+
+    // the lines of the table are kept in the order the files are found
+    std::unique_ptr<_collector> pcolTable;
+    if (pTable) {
+        pcolTable=std::make_unique<_collector>(sTable, vsTable, pTable->get_format(), pTable->get_order());
+        if (!pcolTable->open()) {
+            msgM.msg(_msg::eMsg::ERROR, "cannot open", sTable);
+            return EXIT_FAILURE;
+        }
+    }
+    size_t stFiles=0;
+    bool bTree=true;
+
+    // a file which cannot be parsed or which a command rejects is mirrored as is
+    std::atomic<size_t> stSkipped(0), stLost(0);
+    auto fSkip=[&](const std::string &sIn, const std::string &sOut) {
+        if (bWrite && !_tree::relink(sIn, sOut))
+            stLost++;
+        else
+            stSkipped++;
+    };
+
+    {
+        // one read and one write per file: the commands run in memory between them
+        typedef _pipeline<_spectrum> _pipe;
+        _pipe pipe([&](_pipe::_item &iItem) {
+            auto pCsv=std::make_unique<_csv<float> >(iItem.sIn, cSep);
+            pCsv->set_verbose(_csv<float>::eVerbose::QUIET);
+            if (bWrite)
+                pCsv->set_filename_out(iItem.sOut);
+            // only the columns used by the chain are parsed, the lines are copied verbatim
+            pCsv->set_projection(viColumn);
+            // a file dropped goes on without result, so that the table is not held back
+            if (!pCsv->read(iItem.pFile)) {
+                fSkip(iItem.sIn, iItem.sOut);
+                return true;
+            }
+
+            std::string sResult;
+            for(auto &pStage: vpStage)
+                if (!pStage->apply(*pCsv, sResult)) {
+                    fSkip(iItem.sIn, iItem.sOut);
+                    return true;
+                }
+
+            if (!sTable.empty())
+                iItem.TResult.sResult=iItem.sIn+sResult+"\n";
+            if (bWrite)
+                iItem.TResult.pCsv=std::move(pCsv);
+            return true;
+        },
+        [&pcolTable](_pipe::_item &iItem, _sink &skOut) {
+            if (iItem.TResult.pCsv)
+                iItem.TResult.pCsv->write(skOut);
+            if (pcolTable)
+                pcolTable->add(iItem.stSeq, iItem.TResult.sResult);
+        },
+        max_thread, vm["io-threads"].as<int>(), vm["write-threads"].as<int>(), vm["queue-depth"].as<int>());
+
+        load.start([&pipe](int iN) { pipe.set_active(iN); });
+
+        if (bWrite) {
+            // the input tree is mirrored: the spectra are written straight to the output, the other files are linked
+            _tree tree(path_out.string(), path.string());
+            tree.set_threads(vm["scan-threads"].as<int>());
+            if (vm.count("include"))
+                tree.set_include(vm["include"].as<std::vector<std::string> >());
+            if (vm.count("exclude"))
+                tree.set_exclude(vm["exclude"].as<std::vector<std::string> >());
+            bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+                pipe.push(sIn, sOut, stFiles++);
+            });
+            pipe.finish();
+            msgM.msg(_msg::eMsg::MID, stFiles, "files parsed,", tree.get_linked(), "files linked");
+        }
+        else {
+            // the spectra are measured as soon as they are found
+            _tree tree(path_out.string());
+            tree.set_threads(vm["scan-threads"].as<int>());
+            if (vm.count("include"))
+                tree.set_include(vm["include"].as<std::vector<std::string> >());
+            if (vm.count("exclude"))
+                tree.set_exclude(vm["exclude"].as<std::vector<std::string> >());
+            bTree=tree.walk([&](const std::string &sIn, const std::string&) {
+                pipe.push(sIn, "", stFiles++);
+            });
+            pipe.finish();
+            msgM.msg(_msg::eMsg::MID, stFiles, "files parsed");
+        }
+        load.stop();
+
+        if (stSkipped>0)
+            msgM.msg(_msg::eMsg::MID, stSkipped.load(), bWrite ? "files cannot be parsed or processed, linked as is" : "files cannot be parsed or processed");
+        if (stLost>0)
+            msgM.msg(_msg::eMsg::ERROR, stLost.load(), "files cannot be parsed or processed, nor linked");
+        if (pipe.get_failed()>0)
+            msgM.msg(_msg::eMsg::ERROR, pipe.get_failed(), "files cannot be written");
+    }
+
+    if (!bTree)
+        msgM.msg(_msg::eMsg::ERROR, "cannot mirror", path_out.string(), "in", path.string());
+
+    if (pcolTable) {
+        if (pcolTable->close())
+            msgM.msg(_msg::eMsg::MID, "S/N table:", sTable);
+        else
+            msgM.msg(_msg::eMsg::ERROR, "cannot write", sTable);
+    }
+
+#ifdef HAS_BOOST_TIMER
+    msgM.msg(_msg::eMsg::END, btTimer.format());
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -10,10 +10,11 @@
 #include <vector>
 #include <algorithm>
 #include <thread>
-#include <future>
 #include <string>
+#include <functional>
 #include <tuple>
 #include <chrono>
+#include <atomic>
 #include <boost/program_options.hpp>
 #include <boost/range/iterator_range.hpp>
 
@@ -46,27 +47,26 @@ namespace fs = boost::filesystem;
 #include <csv.h>
 #include <msg.h>
 #include <log.h>
+#include <pipeline.h>
+#include <load.h>
+#include <tree.h>
+#include <cache.h>
+#include <journal.h>
+#include <claim.h>
 
 #define LOGFILE ".threshold.log" /**< Define the default logfile  */
 #define HISTFILE ".history" /**< Define the default histfile (shared)  */
+#define CHUNK 65536 /**< Rows per streamed chunk */
 
 // Prototype
 // ----------------------------------------------------
 /**
- * \fn void trim(const std::vector<std::string> &list, double threshold)
- * \brief Remove zero and negative values of the csv files in the std string vector.
- * \param list String list of files 
- * \param threshold The threshold
+ * \fn bool trim_file(const std::string &sFile, const std::string &sOutput, double threshold, bool &bParsed)
+ * \brief Remove the rows of sFile whose flux is below threshold and write the result in sOutput. Used when multi-threading is disabled.
+ * \param bParsed false if sFile cannot be parsed
  */
-void trim(const std::vector<std::string> &list, double threshold);
+bool trim_file(const std::string &sFile, const std::string &sOutput, double threshold, bool &bParsed);
 
-/**
- * \fn double long CPU_utilization()
- * \brief Get the CPU usage (%)
- */
-double long CPU_utilization();
-
-std::tuple<double long, double long> get_stat();
 // ----------------------------------------------------
 
 int main(int argc, char **argv) {
@@ -89,7 +89,20 @@ int main(int argc, char **argv) {
     ("help,h", "Display this help message")
     ("input_folder,i",  po::value<std::string>(),"Set the input directory.")
     ("output_folder,o",  po::value<std::string>()->default_value("data_out"),"Set the directory where set the threshold.")
-    ("threshold,t",  po::value<double>(),"Apply a threshold in all 2D spectrum data.\nf<=threshold will be deleted.");
+    ("threshold,t",  po::value<double>(),"Apply a threshold in all 2D spectrum data.\nf<=threshold will be deleted.")
+    ("incremental",  "Process only the new or modified files: the output folder may exist and keeps the list of the files processed")
+    ("resume",  "Continue an interrupted run: the output folder exists and the files listed in its journal are skipped")
+    ("include",  po::value<std::vector<std::string> >()->multitoken(),"Process only the files matching these globs, e.g. \"*.dat\". A glob with a '/' is matched against the path relative to the input folder")
+    ("exclude,e",  po::value<std::vector<std::string> >()->multitoken(),"Skip the files and the folders matching these globs. A string without wildcard excludes the names containing it")
+    ("scan-threads",  po::value<int>()->default_value(TREE_THREADS),"Threads which list the input folders")
+    ("work-dir",  po::value<std::string>(),"Share the input folder with the other processes started with this work directory, on a filesystem seen by all of them")
+    ("shards",  po::value<int>()->default_value(CLAIM_SHARDS),"With --work-dir, number of parts of the input folder claimed by the processes, set by the first process")
+    ("lease",  po::value<int>()->default_value(CLAIM_LEASE),"With --work-dir, seconds after which the part claimed by a process which stopped is taken over")
+    ("threads",  po::value<int>()->default_value(0),"Maximum number of threads, 0 for all the CPUs available to the process")
+    ("max-load",  po::value<double>()->default_value(100),"Machine load (%) not to exceed: threads are removed while other processes use the CPUs")
+    ("io-threads",  po::value<int>()->default_value(1),"Threads which map and prefetch the input files")
+    ("write-threads",  po::value<int>()->default_value(1),"Threads which write the output files")
+    ("queue-depth",  po::value<int>()->default_value(PIPE_DEPTH),"Files waiting between two stages of the pipeline");
     
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(description).run(), vm);
@@ -105,16 +118,9 @@ int main(int argc, char **argv) {
         msgM.msg(_msg::eMsg::MID, "write history");
         msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
         msgM.msg(_msg::eMsg::MID, "check command line");
-        msgM.msg(_msg::eMsg::MID, "CPU utilization: 2 %");
-        msgM.msg(_msg::eMsg::MID, "starting 8 async threads");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "524 files parsed");
+        msgM.msg(_msg::eMsg::MID, "available CPUs: 8");
+        msgM.msg(_msg::eMsg::MID, "starting 8 threads");
+        msgM.msg(_msg::eMsg::MID, "4171 files parsed, 3 files linked");
         msgM.msg(_msg::eMsg::END, " 57.269018s wall, 331.160000s user + 1.350000s system = 332.510000s CPU (580.6%)\n");
 
         return EXIT_SUCCESS;
@@ -152,167 +158,227 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
     
-    if (!fs::exists(path)) {
-#ifdef FS_STD 
-        msgM.msg(_msg::eMsg::MID, "copying folder using std::"); 
-        fs::copy(path_out,path, fs::copy_options::recursive);
-#endif
-#ifdef FS_STDEXP
-        msgM.msg(_msg::eMsg::MID, "copying folder using std::experimental"); 
-        fs::copy(path_out,path, fs::copy_options::recursive);
-#endif
-#ifdef FS_BOOST
-        msgM.msg(_msg::eMsg::MID, "copying folder using boost:: : not implemented !");
+    const bool bIncremental=vm.count("incremental");
+    const bool bResume=vm.count("resume");
+    const bool bShared=vm.count("work-dir");
+    
+    if (bShared && (bIncremental || bResume)) {
+        msgM.msg(_msg::eMsg::ERROR, "--work-dir cannot be combined with --incremental or --resume");
         return EXIT_FAILURE;
-#endif
     }
-    else { 
+    
+    // the processes of a shared run write in the same output folder
+    if (fs::exists(path) && !bIncremental && !bResume && !bShared) { 
         msgM.msg(_msg::eMsg::ERROR, "error directory", path.string(), " exists");
         return EXIT_FAILURE;
     }
     
-    if (fs::is_directory(path)) {
-        fs::recursive_directory_iterator step0(path);
-        std::vector<std::string> list;
-        for(auto &file: boost::make_iterator_range(step0,{}) ) {
-            // csv<> unable to parse non csv file
-            if (!fs::is_directory(file) && 
-                file.path().has_extension() && 
-                file.path().filename().string().find(std::string(".tar"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".tar.gz"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".tgz"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".zip"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".txt"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".directory"))==std::string::npos )
-                list.emplace_back(file.path().relative_path().string());
-        }
-        int max_thread=std::thread::hardware_concurrency();
-
-// Limit CPU usage -------------------------------------
-#if defined (__linux__)
-    msgM.msg(_msg::eMsg::MID, "CPU utilization:", static_cast<int>(CPU_utilization()), "%");
-    if (CPU_utilization()>50) {
-        max_thread=1;
-        msgM.msg(_msg::eMsg::MID, "Reduce max thread");
-    }
-#endif
-// -----------------------------------------------------
-
-        if (max_thread>1) {
-            const std::size_t size_divided=list.size()/max_thread;
-            
-            std::vector<std::vector<std::string> > list_divided;
-            
-            for(std::size_t i=0; i< max_thread-1; i++) 
-                list_divided.emplace_back(std::vector<std::string>(list.begin()+i*size_divided, list.begin() + size_divided*(i+1)));
-            
-            // 1 extra thread for extra files : rest of division
-            list_divided.emplace_back(std::vector<std::string>(list.begin()+(max_thread-1)*size_divided, list.end()));
-            
-            msgM.msg(_msg::eMsg::MID, "starting", max_thread, "async threads");
-            
-            // let's dont decide the flag
-            std::launch flag=std::launch::async | std::launch::deferred;
-            
-            std::vector<std::future<void> > thread;
-            for(auto t_list: list_divided)
-                thread.emplace_back(std::async(flag,trim,t_list,vm["threshold"].as<double>()));
-            
-            std::for_each(thread.begin(), thread.end(), [](std::future<void> &th) { th.get(); });
-        }  
-        else {
-            msgM.msg(_msg::eMsg::MID, "multi-threading disabled");
-            trim(list, vm["threshold"].as<double>());
-        }
-    }
+    const double threshold=vm["threshold"].as<double>();
     
-#ifdef HAS_BOOST_TIMER
-     msgM.msg(_msg::eMsg::END, btTimer.format());
-#endif
-     
-    return EXIT_SUCCESS;
-}
-
-void trim(const std::vector<std::string> &list, double threshold) {
+    // Concurrency: affinity and cgroup quota, then the load of the machine
+    _load load(vm["threads"].as<int>(), vm["max-load"].as<double>());
+    int max_thread=load.get_max();
+    msgM.msg(_msg::eMsg::MID, "available CPUs:", _load::available());
     
-    _msg msgM;
-    msgM.set_name("compute()");
-    msgM.set_threadname("compute");
-    msgM.set_log(LOGFILE);
+    // the input tree is mirrored: the spectra are written straight to the output, the other files are linked
+    _tree tree(path_out.string(), path.string());
+    tree.set_threads(vm["scan-threads"].as<int>());
+    if (vm.count("include"))
+        tree.set_include(vm["include"].as<std::vector<std::string> >());
+    if (vm.count("exclude"))
+        tree.set_exclude(vm["exclude"].as<std::vector<std::string> >());
+    size_t stFiles=0;
+    bool bTree;
     
-    for(auto file: list ) {
-        _csv<> csv; 
-        csv.set_filename(file);
-        csv.set_separator('\t');
-        if (csv.read()) {
-            csv.set_verbose(_csv<>::eVerbose::QUIET);
-            csv.apply_min_threshold(threshold,1);
-            csv.write();
-        }
-    } 
+    // incremental run: the files unchanged since the last run with the same parameters are skipped
+    _cache cache((path/CACHE_FILE).string(), "threshold "+std::to_string(threshold));
+    tree.set_update(bIncremental || bResume || bShared);
+    if (bIncremental && !cache.load()) {
+        msgM.msg(_msg::eMsg::ERROR, "cannot read", cache.get_filename());
+        return EXIT_FAILURE;
+    }
     
-#ifdef HAS_SYSCALL
-    msgM.msg(_msg::eMsg::THREADS, list.size(), "files parsed");
-#else
-    msgM.msg(_msg::eMsg::MID, list.size(), " files parsed");
-#endif
+    // the completed files are journaled: an interrupted run is continued with --resume
+    _journal journal;
+    size_t stResumed=0;
+    if (bResume)
+        msgM.msg(_msg::eMsg::MID, _tree::remove_parts(path), "partial files removed");
+    try {
+        fs::create_directories(path);
+    }
+    catch (...) { }
+    // in a shared run, the shards done play the part of the journal
+    if (!bShared && !journal.open((path/JOURNAL_FILE).string(), bResume)) {
+        msgM.msg(_msg::eMsg::ERROR, "cannot open", journal.get_filename());
+        return EXIT_FAILURE;
+    }
     
-}
-
-double long CPU_utilization() {
-     _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("CPU_utilization");
-    msgM.set_log(LOGFILE);
-        
-    auto [fTime_A, fIdle_A]=get_stat();
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    auto [fTime_B, fIdle_B]=get_stat();
-    return 100.*(1.-((fIdle_B-fIdle_A)/(fTime_B-fTime_A)));
-}
-
-std::tuple<double long, double long>  get_stat() {
-    _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("get_stat");
-    msgM.set_log(LOGFILE);
+    // an output complete on disk: journaled, and up to date for the next incremental run
+    auto fDone=[&](const std::string &sIn, const std::string &sOut) {
+        if (!bShared)
+            journal.add(sIn);
+        if (bIncremental)
+            cache.update(sIn, sOut);
+    };
     
-    std::fstream sfCpu("/proc/stat", std::ios::in);
+    // a file _csv cannot parse is mirrored as is, like the other files of the tree
+    std::atomic<size_t> stUnparsed(0), stLost(0), stStream_failed(0);
+    auto fUnparsed=[&](const std::string &sIn, const std::string &sOut) {
+        if (!_tree::relink(sIn, sOut)) {
+            stLost++;
+            return;
+        }
+        stUnparsed++;
+        fDone(sIn, sOut);
+    };
     
-    if (sfCpu) {
-
-        std::string sLine;
-        std::getline(sfCpu, sLine);
-        
-        // erase "cpu"
-        sLine.erase(sLine.begin(), sLine.begin()+sLine.find_first_of("0123456789")); 
-        
-        // locate " " and push position into vec
-        std::vector<int> vPos;
-        std::vector<double long> vCol;
+    // read, compute and write stages: the disk works while the CPUs parse
+    typedef _pipeline<std::unique_ptr<_csv<> > > _pipe;
+    auto fCompute=[threshold, &fDone, &fUnparsed, &stStream_failed](_pipe::_item &iItem) {
+        auto pCsv=std::make_unique<_csv<> >();
+        pCsv->set_filename(iItem.sIn);
+        pCsv->set_filename_out(iItem.sOut);
+        pCsv->set_sniff(true);
+        pCsv->set_verbose(_csv<>::eVerbose::QUIET);
+        // only the flux is parsed, the lines are copied verbatim
+        pCsv->set_projection({1});
+        // a large file is filtered and written by chunks: the memory does not grow with its size
+        if (iItem.pFile && iItem.pFile->size()>=AIO_MMAP_MIN) {
+            const bool bStatus=pCsv->transform_chunks(iItem.pFile, CHUNK, [threshold](_csv<> &csvChunk) {
+                csvChunk.apply_min_threshold(threshold, 1);
+                return true;
+            });
+            if (bStatus)
+                fDone(iItem.sIn, iItem.sOut);
+            else if (pCsv->is_input_error())
+                fUnparsed(iItem.sIn, iItem.sOut);
+            else
+                stStream_failed++;
+            return false;
+        }
+        if (!pCsv->read(iItem.pFile)) {
+            fUnparsed(iItem.sIn, iItem.sOut);
+            return false;
+        }
+        pCsv->apply_min_threshold(threshold, 1);
+        iItem.TResult=std::move(pCsv);
+        return true;
+    };
+    
+    if (bShared) {
+        _claim claim(vm["work-dir"].as<std::string>(), vm["shards"].as<int>(), vm["lease"].as<int>());
+        if (!claim.open()) {
+            msgM.msg(_msg::eMsg::ERROR, "cannot use the work directory", vm["work-dir"].as<std::string>());
+            return EXIT_FAILURE;
+        }
         
-        vPos.push_back(0); 
+        // every process mirrors the tree and lists the same files: the shard of a file depends on its path in the input folder
+        std::vector<std::vector<std::pair<std::string, std::string> > > vvpShard(claim.get_shards());
+        bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+            vvpShard[_claim::shard(fs::path(sIn).lexically_relative(path_out).string(), claim.get_shards())].emplace_back(sIn, sOut);
+        });
+        msgM.msg(_msg::eMsg::MID, "starting", max_thread, "threads on", claim.get_shards(), "shards");
         
-        int iCount=0;
-        for(auto cC: sLine) {
-            if (cC==' ')
-                vPos.push_back(iCount);
-            iCount++;  
+        size_t stShard;
+        while (claim.next(stShard)) {
+            _pipe pipe(fCompute, [](_pipe::_item &iItem, _sink &skOut) { iItem.TResult->write(skOut); },
+                       max_thread, vm["io-threads"].as<int>(), vm["write-threads"].as<int>(), vm["queue-depth"].as<int>());
+            
+            load.start([&pipe](int iN) { pipe.set_active(iN); });
+            for(auto &pFile: vvpShard[stShard])
+                pipe.push(pFile.first, pFile.second);
+            pipe.finish();
+            load.stop();
+            
+            if (pipe.get_failed()>0)
+                msgM.msg(_msg::eMsg::ERROR, pipe.get_failed(), "files cannot be written");
+            stFiles+=vvpShard[stShard].size();
+            if (!claim.done(stShard))
+                msgM.msg(_msg::eMsg::MID, "shard", stShard, "taken over by another process");
         }
+        if (stStream_failed>0)
+            msgM.msg(_msg::eMsg::ERROR, stStream_failed.load(), "files cannot be written");
+        msgM.msg(_msg::eMsg::MID, claim.get_claimed(), "shards done by this process");
+    }
+    else if (max_thread>1) {
+        msgM.msg(_msg::eMsg::MID, "starting", max_thread, "threads");
         
-        // slice
-        for(int i=0; i<4; i++) {
-            std::string sVal=sLine.substr(vPos[i], vPos[i+1]-vPos[i]);
-            sVal.erase(std::remove(sVal.begin(), sVal.end(), ' '), sVal.end()); 
-            vCol.push_back(std::stod(sVal));
-        }
+        _pipe pipe(fCompute,
+        [&fDone](_pipe::_item &iItem, _sink &skOut) {
+            // journaled and cached once the sink has renamed the output, not when it is queued
+            iItem.TResult->write(skOut, [&fDone, sIn=iItem.sIn, sOut=iItem.sOut]() { fDone(sIn, sOut); });
+        },
+        max_thread, vm["io-threads"].as<int>(), vm["write-threads"].as<int>(), vm["queue-depth"].as<int>());
         
-        sfCpu.close();
-                
-        return {static_cast<double long>(vCol[0]+vCol[1]+vCol[2]+vCol[3]), static_cast<double long>(vCol[3])};
+        load.start([&pipe](int iN) { pipe.set_active(iN); });
+        bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+            if (bIncremental && cache.is_fresh(sIn, sOut)) return;
+            if (bResume && journal.is_done(sIn) && fs::exists(sOut)) {
+                stResumed++;
+                return;
+            }
+            pipe.push(sIn, sOut);
+            stFiles++;
+        });
+        pipe.finish();
+        if (pipe.get_failed()+stStream_failed>0)
+            msgM.msg(_msg::eMsg::ERROR, pipe.get_failed()+stStream_failed, "files cannot be written");
+        load.stop();
+    }  
+    else {
+        msgM.msg(_msg::eMsg::MID, "multi-threading disabled");
+        bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+            if (bIncremental && cache.is_fresh(sIn, sOut)) return;
+            if (bResume && journal.is_done(sIn) && fs::exists(sOut)) {
+                stResumed++;
+                return;
+            }
+            bool bParsed;
+            if (trim_file(sIn, sOut, threshold, bParsed))
+                fDone(sIn, sOut);
+            else if (!bParsed)
+                fUnparsed(sIn, sOut);
+            stFiles++;
+        });
     }
-    else 
-        msgM.msg(_msg::eMsg::ERROR, "cannot open /proc/stat");
     
-    return {-1,1};
+    msgM.msg(_msg::eMsg::MID, stFiles, "files parsed,", tree.get_linked(), "files linked");
+    if (stUnparsed>0)
+        msgM.msg(_msg::eMsg::MID, stUnparsed.load(), "files cannot be parsed, linked as is");
+    if (stLost>0)
+        msgM.msg(_msg::eMsg::ERROR, stLost.load(), "files cannot be parsed nor linked");
+    if (bResume)
+        msgM.msg(_msg::eMsg::MID, stResumed, "files completed by the previous run");
+    if (!journal.close())
+        msgM.msg(_msg::eMsg::ERROR, "cannot write", journal.get_filename());
+    if (bIncremental) {
+        msgM.msg(_msg::eMsg::MID, cache.get_fresh(), "files up to date");
+        if (!cache.save())
+            msgM.msg(_msg::eMsg::ERROR, "cannot write", cache.get_filename());
+    }
+    if (!bTree)
+        msgM.msg(_msg::eMsg::ERROR, "cannot mirror", path_out.string(), "in", path.string());
+    
+#ifdef HAS_BOOST_TIMER
+     msgM.msg(_msg::eMsg::END, btTimer.format());
+#endif
+     
+    return EXIT_SUCCESS;
+}
+
+bool trim_file(const std::string &sFile, const std::string &sOutput, double threshold, bool &bParsed) {
+    _csv<> csv; 
+    csv.set_filename(sFile);
+    csv.set_filename_out(sOutput);
+    csv.set_sniff(true);
+    csv.set_verbose(_csv<>::eVerbose::QUIET);
+    // only the flux is parsed, the lines are copied verbatim
+    csv.set_projection({1});
+    // bounded memory: the file is filtered and written by chunks
+    bool bStatus=csv.transform_chunks(CHUNK, [&](_csv<> &csvChunk) {
+        csvChunk.apply_min_threshold(threshold,1);
+        return true;
+    });
+    bParsed=!csv.is_input_error();
+    return bStatus;
 }
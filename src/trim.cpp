@@ -10,10 +10,11 @@
 #include <vector>
 #include <algorithm>
 #include <thread>
-#include <future>
 #include <string>
+#include <functional>
 #include <tuple>
 #include <chrono>
+#include <atomic>
 
 #include <boost/program_options.hpp>
 #include <boost/range/iterator_range.hpp>
@@ -47,25 +48,25 @@ namespace fs = boost::filesystem;
 #include <csv.h>
 #include <msg.h>
 #include <log.h>
+#include <pipeline.h>
+#include <load.h>
+#include <tree.h>
+#include <cache.h>
+#include <journal.h>
 
 #define LOGFILE ".trim.log" /**< Define the default logfile  */
 #define HISTFILE ".history" /**< Define the default histfile (shared)  */
+#define CHUNK 65536 /**< Rows per streamed chunk */
 
 // Prototype
 // ----------------------------------------------------
 /**
- * \fn void trim(const std::vector<std::string> &list, float min, float max)
- * \brief Trim files in list between min and max.
+ * \fn bool trim_file(const std::string &sFile, const std::string &sOutput, float min, float max, bool &bParsed)
+ * \brief Trim the file sFile between min and max and write the result in sOutput. Used when multi-threading is disabled.
+ * \param bParsed false if sFile cannot be parsed
  */
-void trim(const std::vector<std::string> &list, float min, float max);
+bool trim_file(const std::string &sFile, const std::string &sOutput, float min, float max, bool &bParsed);
 
-/**
- * \fn double long CPU_utilization()
- * \brief Get the CPU usage (%)
- */
-double long CPU_utilization();
-
-std::tuple<double long, double long> get_stat();
 // ----------------------------------------------------
 
 int main(int argc, char** argv) {
@@ -89,7 +90,17 @@ int main(int argc, char** argv) {
     ("min,l",  po::value<float>(),"Minimum wavelength")
     ("max,u",  po::value<float>(),"Maximumw avelength")
     ("input_folder,i",  po::value<std::string>(),"Name of the folder where original data are")
-    ("output_folder,o",  po::value<std::string>()->default_value("data_out"),"Set the directory where store new data.");
+    ("output_folder,o",  po::value<std::string>()->default_value("data_out"),"Set the directory where store new data.")
+    ("incremental",  "Process only the new or modified files: the output folder may exist and keeps the list of the files processed")
+    ("resume",  "Continue an interrupted run: the output folder exists and the files listed in its journal are skipped")
+    ("include",  po::value<std::vector<std::string> >()->multitoken(),"Process only the files matching these globs, e.g. \"*.dat\". A glob with a '/' is matched against the path relative to the input folder")
+    ("exclude,e",  po::value<std::vector<std::string> >()->multitoken(),"Skip the files and the folders matching these globs. A string without wildcard excludes the names containing it")
+    ("scan-threads",  po::value<int>()->default_value(TREE_THREADS),"Threads which list the input folders")
+    ("threads",  po::value<int>()->default_value(0),"Maximum number of threads, 0 for all the CPUs available to the process")
+    ("max-load",  po::value<double>()->default_value(100),"Machine load (%) not to exceed: threads are removed while other processes use the CPUs")
+    ("io-threads",  po::value<int>()->default_value(1),"Threads which map and prefetch the input files")
+    ("write-threads",  po::value<int>()->default_value(1),"Threads which write the output files")
+    ("queue-depth",  po::value<int>()->default_value(PIPE_DEPTH),"Files waiting between two stages of the pipeline");
     
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(description).run(), vm);
@@ -105,16 +116,9 @@ int main(int argc, char** argv) {
         msgM.msg(_msg::eMsg::MID, "write history");
         msgM.msg(_msg::eMsg::MID, "remove duplicates in history");
         msgM.msg(_msg::eMsg::MID, "check command line");
-        msgM.msg(_msg::eMsg::MID, "CPU utilization: 3 %");
-        msgM.msg(_msg::eMsg::MID, "starting 8 async threads");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "521 files parsed");
-        msgM.msg(_msg::eMsg::THREADS, "524 files parsed");
+        msgM.msg(_msg::eMsg::MID, "available CPUs: 8");
+        msgM.msg(_msg::eMsg::MID, "starting 8 threads");
+        msgM.msg(_msg::eMsg::MID, "4171 files parsed, 3 files linked");
         msgM.msg(_msg::eMsg::END, " 52.909230s wall, 296.410000s user + 0.710000s system = 297.120000s CPU (561.6%)\n");
         return EXIT_SUCCESS;
     }   
@@ -162,80 +166,159 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
     
-    if (!fs::exists(path)) {
-#ifdef FS_STD 
-        msgM.msg(_msg::eMsg::MID, "copying folder using std::"); 
-        fs::copy(path_out,path, fs::copy_options::recursive);
-#endif
-#ifdef FS_STDEXP
-        msgM.msg(_msg::eMsg::MID, "copying folder using std::experimental"); 
-        fs::copy(path_out,path, fs::copy_options::recursive);
-#endif
-#ifdef FS_BOOST
-        msgM.msg(_msg::eMsg::MID, "copying folder using boost:: : not implemented !");
+    const bool bIncremental=vm.count("incremental");
+    const bool bResume=vm.count("resume");
+    
+    if (fs::exists(path) && !bIncremental && !bResume) { 
+        msgM.msg(_msg::eMsg::ERROR, "error directory", path.string(), "exists");
         return EXIT_FAILURE;
-#endif
     }
-    else { 
-        msgM.msg(_msg::eMsg::ERROR, "error directory", path.string(), "exists");
+    
+    // Concurrency: affinity and cgroup quota, then the load of the machine
+    _load load(vm["threads"].as<int>(), vm["max-load"].as<double>());
+    int max_thread=load.get_max();
+    msgM.msg(_msg::eMsg::MID, "available CPUs:", _load::available());
+    
+    // the input tree is mirrored: the spectra are written straight to the output, the other files are linked
+    _tree tree(path_out.string(), path.string());
+    tree.set_threads(vm["scan-threads"].as<int>());
+    if (vm.count("include"))
+        tree.set_include(vm["include"].as<std::vector<std::string> >());
+    if (vm.count("exclude"))
+        tree.set_exclude(vm["exclude"].as<std::vector<std::string> >());
+    size_t stFiles=0;
+    bool bTree;
+    
+    // incremental run: the files unchanged since the last run with the same parameters are skipped
+    _cache cache((path/CACHE_FILE).string(), "trim "+std::to_string(fMin)+" "+std::to_string(fMax));
+    tree.set_update(bIncremental || bResume);
+    if (bIncremental && !cache.load()) {
+        msgM.msg(_msg::eMsg::ERROR, "cannot read", cache.get_filename());
         return EXIT_FAILURE;
     }
-        
-     if (fs::is_directory(path)) {
-        fs::recursive_directory_iterator step0(path);
-        std::vector<std::string> list;
-        for(auto &file: boost::make_iterator_range(step0,{}) ) {
-            // csv<> unable to parse non csv file
-            if (!fs::is_directory(file) && 
-                file.path().has_extension() && 
-                file.path().filename().string().find(std::string(".tar"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".tar.gz"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".tgz"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".zip"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".txt"))==std::string::npos &&
-                file.path().filename().string().find(std::string(".directory"))==std::string::npos )
-                list.emplace_back(file.path().relative_path().string());
+    
+    // the completed files are journaled: an interrupted run is continued with --resume
+    _journal journal;
+    size_t stResumed=0;
+    if (bResume)
+        msgM.msg(_msg::eMsg::MID, _tree::remove_parts(path), "partial files removed");
+    try {
+        fs::create_directories(path);
+    }
+    catch (...) { }
+    if (!journal.open((path/JOURNAL_FILE).string(), bResume)) {
+        msgM.msg(_msg::eMsg::ERROR, "cannot open", journal.get_filename());
+        return EXIT_FAILURE;
+    }
+    
+    // an output complete on disk: journaled, and up to date for the next incremental run
+    auto fDone=[&](const std::string &sIn, const std::string &sOut) {
+        journal.add(sIn);
+        if (bIncremental)
+            cache.update(sIn, sOut);
+    };
+    
+    // a file _csv cannot parse is mirrored as is, like the other files of the tree
+    std::atomic<size_t> stUnparsed(0), stLost(0), stStream_failed(0);
+    auto fUnparsed=[&](const std::string &sIn, const std::string &sOut) {
+        if (!_tree::relink(sIn, sOut)) {
+            stLost++;
+            return;
         }
-        int max_thread=std::thread::hardware_concurrency();
+        stUnparsed++;
+        fDone(sIn, sOut);
+    };
+    
+    if (max_thread>1) {
+        msgM.msg(_msg::eMsg::MID, "starting", max_thread, "threads");
+        
+        // read, compute and write stages: the disk works while the CPUs parse
+        typedef _pipeline<std::unique_ptr<_csv<float> > > _pipe;
+        _pipe pipe([fMin, fMax, &fDone, &fUnparsed, &stStream_failed](_pipe::_item &iItem) {
+            auto pCsv=std::make_unique<_csv<float> >();
+            pCsv->set_filename(iItem.sIn);
+            pCsv->set_filename_out(iItem.sOut);
+            pCsv->set_sniff(true);
+            pCsv->set_verbose(_csv<float>::eVerbose::QUIET);
+            // only the wavelength is parsed, the lines are copied verbatim
+            pCsv->set_projection({0});
+            // a large file is filtered and written by chunks: the memory does not grow with its size
+            if (iItem.pFile && iItem.pFile->size()>=AIO_MMAP_MIN) {
+                const bool bStatus=pCsv->transform_chunks(iItem.pFile, CHUNK, [fMin, fMax](_csv<float> &csvChunk) {
+                    csvChunk.apply_range_threshold(fMin, fMax, 0);
+                    return true;
+                });
+                if (bStatus)
+                    fDone(iItem.sIn, iItem.sOut);
+                else if (pCsv->is_input_error())
+                    fUnparsed(iItem.sIn, iItem.sOut);
+                else
+                    stStream_failed++;
+                return false;
+            }
+            if (!pCsv->read(iItem.pFile)) {
+                fUnparsed(iItem.sIn, iItem.sOut);
+                return false;
+            }
+            pCsv->apply_range_threshold(fMin, fMax, 0);
+            iItem.TResult=std::move(pCsv);
+            return true;
+        },
+        [&fDone](_pipe::_item &iItem, _sink &skOut) {
+            // journaled and cached once the sink has renamed the output, not when it is queued
+            iItem.TResult->write(skOut, [&fDone, sIn=iItem.sIn, sOut=iItem.sOut]() { fDone(sIn, sOut); });
+        },
+        max_thread, vm["io-threads"].as<int>(), vm["write-threads"].as<int>(), vm["queue-depth"].as<int>());
         
-// Limit CPU usage -------------------------------------
-#if defined (__linux__)
-    msgM.msg(_msg::eMsg::MID, "CPU utilization:", static_cast<int>(CPU_utilization()), "%");
-    if (CPU_utilization()>50) {
-        max_thread=1;
-        msgM.msg(_msg::eMsg::MID, "Reduce max thread");
+        load.start([&pipe](int iN) { pipe.set_active(iN); });
+        bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+            if (bIncremental && cache.is_fresh(sIn, sOut)) return;
+            if (bResume && journal.is_done(sIn) && fs::exists(sOut)) {
+                stResumed++;
+                return;
+            }
+            pipe.push(sIn, sOut);
+            stFiles++;
+        });
+        pipe.finish();
+        if (pipe.get_failed()+stStream_failed>0)
+            msgM.msg(_msg::eMsg::ERROR, pipe.get_failed()+stStream_failed, "files cannot be written");
+        load.stop();
+    }  
+    else {
+        msgM.msg(_msg::eMsg::MID, "multi-threading disabled");
+        bTree=tree.walk([&](const std::string &sIn, const std::string &sOut) {
+            if (bIncremental && cache.is_fresh(sIn, sOut)) return;
+            if (bResume && journal.is_done(sIn) && fs::exists(sOut)) {
+                stResumed++;
+                return;
+            }
+            bool bParsed;
+            if (trim_file(sIn, sOut, fMin, fMax, bParsed))
+                fDone(sIn, sOut);
+            else if (!bParsed)
+                fUnparsed(sIn, sOut);
+            stFiles++;
+        });
     }
-#endif
-// -----------------------------------------------------
-
-        if (max_thread>1) {
-            const std::size_t size_divided=list.size()/max_thread;
-            
-            std::vector<std::vector<std::string> > list_divided;
-            
-            for(std::size_t i=0; i< max_thread-1; i++) 
-                list_divided.emplace_back(std::vector<std::string>(list.begin()+i*size_divided, list.begin() + size_divided*(i+1)));
-            
-            // 1 extra thread for extra files : rest of division
-            list_divided.emplace_back(std::vector<std::string>(list.begin()+(max_thread-1)*size_divided, list.end()));
-            
-            msgM.msg(_msg::eMsg::MID, "starting", max_thread, "async threads");
-            
-            // let's dont decide the flag
-            std::launch flag=std::launch::async | std::launch::deferred;
-            
-            std::vector<std::future<void> > thread;
-            
-            for(auto t_list: list_divided)
-                thread.emplace_back(std::async(flag,trim,t_list,fMin,fMax));
-            
-            std::for_each(thread.begin(), thread.end(), [](std::future<void> &th) { th.get(); });
-        }  
-        else {
-            msgM.msg(_msg::eMsg::MID, "multi-threading disabled");
-            trim(list, fMin, fMax);
-        }
+    
+    msgM.msg(_msg::eMsg::MID, stFiles, "files parsed,", tree.get_linked(), "files linked");
+    if (stUnparsed>0)
+        msgM.msg(_msg::eMsg::MID, stUnparsed.load(), "files cannot be parsed, linked as is");
+    if (stLost>0)
+        msgM.msg(_msg::eMsg::ERROR, stLost.load(), "files cannot be parsed nor linked");
+    if (bResume)
+        msgM.msg(_msg::eMsg::MID, stResumed, "files completed by the previous run");
+    if (!journal.close())
+        msgM.msg(_msg::eMsg::ERROR, "cannot write", journal.get_filename());
+    if (bIncremental) {
+        msgM.msg(_msg::eMsg::MID, cache.get_fresh(), "files up to date");
+        if (!cache.save())
+            msgM.msg(_msg::eMsg::ERROR, "cannot write", cache.get_filename());
     }
+    if (!bTree)
+        msgM.msg(_msg::eMsg::ERROR, "cannot mirror", path_out.string(), "in", path.string());
+    
 #ifdef HAS_BOOST_TIMER
     msgM.msg(_msg::eMsg::END, btTimer.format());
 #endif
@@ -246,83 +329,19 @@ int main(int argc, char** argv) {
 // ----------------------------------------------------
 // ----------------------------------------------------
 
-void trim(const std::vector<std::string> &list, float min, float max) {
-    _msg msgM;
-    msgM.set_threadname("trim");
-    msgM.set_name("trim()");
-    msgM.set_log(LOGFILE);
-    
-    for(auto file: list ) {
-        _csv<float> csv; 
-        csv.set_filename(file);
-        csv.set_separator('\t');
-        if (csv.read()) {
-            csv.set_verbose(_csv<float>::eVerbose::QUIET);
-            csv.apply_min_threshold(min,0);
-            csv.apply_max_threshold(max,0);
-            csv.write();
-        }
-    }
-#ifdef HAS_SYSCALL
-   msgM.msg(_msg::eMsg::THREADS, list.size(), "files parsed");
-#else
-    msgM.msg(_msg::eMsg::MID, list.size(), " files parsed.");
-#endif
-}
-
-double long CPU_utilization() {
-     _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("CPU_utilization");
-    msgM.set_log(LOGFILE);
-        
-    auto [fTime_A, fIdle_A]=get_stat();
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    auto [fTime_B, fIdle_B]=get_stat();
-    return 100.*(1.-((fIdle_B-fIdle_A)/(fTime_B-fTime_A)));
-}
-
-std::tuple<double long, double long>  get_stat() {
-    _msg msgM;
-    msgM.set_name("genrandspec");
-    msgM.set_threadname("get_stat");
-    msgM.set_log(LOGFILE);
-    
-    std::fstream sfCpu("/proc/stat", std::ios::in);
-    
-    if (sfCpu) {
-
-        std::string sLine;
-        std::getline(sfCpu, sLine);
-        
-        // erase "cpu"
-        sLine.erase(sLine.begin(), sLine.begin()+sLine.find_first_of("0123456789")); 
-        
-        // locate " " and push position into vec
-        std::vector<int> vPos;
-        std::vector<double long> vCol;
-        
-        vPos.push_back(0); 
-        
-        int iCount=0;
-        for(auto cC: sLine) {
-            if (cC==' ')
-                vPos.push_back(iCount);
-            iCount++;  
-        }
-        
-        // slice
-        for(int i=0; i<4; i++) {
-            std::string sVal=sLine.substr(vPos[i], vPos[i+1]-vPos[i]);
-            sVal.erase(std::remove(sVal.begin(), sVal.end(), ' '), sVal.end()); 
-            vCol.push_back(std::stod(sVal));
-        }
-        
-        sfCpu.close();
-                
-        return {static_cast<double long>(vCol[0]+vCol[1]+vCol[2]+vCol[3]), static_cast<double long>(vCol[3])};
-    }
-    else 
-        msgM.msg(_msg::eMsg::ERROR, "cannot open /proc/stat");
-    return {-1,1};
+bool trim_file(const std::string &sFile, const std::string &sOutput, float min, float max, bool &bParsed) {
+    _csv<float> csv; 
+    csv.set_filename(sFile);
+    csv.set_filename_out(sOutput);
+    csv.set_sniff(true);
+    csv.set_verbose(_csv<float>::eVerbose::QUIET);
+    // only the wavelength is parsed, the lines are copied verbatim
+    csv.set_projection({0});
+    // bounded memory: the file is filtered and written by chunks
+    bool bStatus=csv.transform_chunks(CHUNK, [&](_csv<float> &csvChunk) {
+        csvChunk.apply_range_threshold(min,max,0);
+        return true;
+    });
+    bParsed=!csv.is_input_error();
+    return bStatus;
 }
@@ -0,0 +1,69 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <string>
+
+#include "cache.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define CACHE_IN "test_cache_in.dat"
+#define CACHE_OUT "test_cache_out.dat"
+#define CACHE_NAME "test_cache.incremental"
+// ----------------------------------
+
+BOOST_AUTO_TEST_CASE(Cache_fresh) {
+    std::ofstream(CACHE_IN) << "1 2\n3 4\n";
+    std::ofstream(CACHE_OUT) << "1 2\n";
+    std::remove(CACHE_NAME);
+
+    {
+        _cache cache(CACHE_NAME, "trim 1 2");
+        BOOST_CHECK(cache.load());
+        BOOST_CHECK(!cache.is_fresh(CACHE_IN, CACHE_OUT));
+        cache.update(CACHE_IN, CACHE_OUT, "a\tb\\c\n");
+        BOOST_CHECK(cache.save());
+    }
+    {
+        _cache cache(CACHE_NAME, "trim 1 2");
+        BOOST_CHECK(cache.load());
+        std::string sRes;
+        BOOST_CHECK(cache.is_fresh(CACHE_IN, CACHE_OUT, &sRes));
+        BOOST_CHECK(sRes=="a\tb\\c\n");
+        BOOST_CHECK(cache.get_fresh()==1);
+        // another output
+        BOOST_CHECK(!cache.is_fresh(CACHE_IN, "test_cache_other.dat"));
+    }
+    {
+        // other parameters
+        _cache cache(CACHE_NAME, "trim 1 3");
+        BOOST_CHECK(cache.load());
+        BOOST_CHECK(!cache.is_fresh(CACHE_IN, CACHE_OUT));
+        // the entries not looked up are dropped
+        BOOST_CHECK(cache.save());
+    }
+    {
+        _cache cache(CACHE_NAME, "trim 1 2");
+        BOOST_CHECK(cache.load());
+        BOOST_CHECK(!cache.is_fresh(CACHE_IN, CACHE_OUT));
+        cache.update(CACHE_IN, CACHE_OUT);
+        BOOST_CHECK(cache.is_fresh(CACHE_IN, CACHE_OUT));
+
+        // the input changes, then the output disappears
+        std::ofstream(CACHE_IN, std::ios::app) << "5 6\n";
+        BOOST_CHECK(!cache.is_fresh(CACHE_IN, CACHE_OUT));
+        cache.update(CACHE_IN, CACHE_OUT);
+        std::remove(CACHE_OUT);
+        BOOST_CHECK(!cache.is_fresh(CACHE_IN, CACHE_OUT));
+    }
+
+    std::ofstream(CACHE_NAME) << "not a cache\n";
+    BOOST_CHECK(!_cache(CACHE_NAME, "").load());
+
+    std::remove(CACHE_IN);
+    std::remove(CACHE_NAME);
+}
@@ -0,0 +1,124 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <set>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "claim.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define CLAIM_DIR "test_claim_work"
+#define NSHARD 16
+// ----------------------------------
+
+BOOST_AUTO_TEST_CASE(Claim_shard) {
+    BOOST_CHECK(_claim::shard("a/b.dat", NSHARD)==_claim::shard("a/b.dat", NSHARD));
+    BOOST_CHECK(_claim::shard("a/b.dat", NSHARD)<NSHARD);
+    BOOST_CHECK(_claim::shard("a/b.dat", 1)==0);
+}
+
+BOOST_AUTO_TEST_CASE(Claim_cooperate) {
+    std::system("rm -rf " CLAIM_DIR);
+
+    std::mutex mDone;
+    std::multiset<size_t> msDone;
+
+    // the second claimer takes the number of shards of the first one
+    _claim claimA(CLAIM_DIR, NSHARD);
+    BOOST_REQUIRE(claimA.open());
+    _claim claimB(CLAIM_DIR, 3);
+    BOOST_REQUIRE(claimB.open());
+    BOOST_CHECK(claimB.get_shards()==NSHARD);
+
+    auto fWork=[&](_claim &claim) {
+        size_t stShard;
+        while (claim.next(stShard)) {
+            {
+                std::lock_guard<std::mutex> lgLock(mDone);
+                msDone.insert(stShard);
+            }
+            std::ofstream(claim.get_result(stShard)) << stShard << "\n";
+            claim.done(stShard);
+        }
+    };
+    std::thread thA(fWork, std::ref(claimA));
+    std::thread thB(fWork, std::ref(claimB));
+    thA.join();
+    thB.join();
+
+    BOOST_CHECK(msDone.size()==NSHARD);
+    BOOST_CHECK(std::set<size_t>(msDone.begin(), msDone.end()).size()==NSHARD);
+    BOOST_CHECK(claimA.get_claimed()+claimB.get_claimed()==NSHARD);
+
+    // a single merge
+    BOOST_CHECK(claimA.claim_merge());
+    BOOST_CHECK(!claimB.claim_merge());
+    BOOST_CHECK(claimA.merge_done());
+    BOOST_CHECK(!claimB.claim_merge());
+
+    std::system("rm -rf " CLAIM_DIR);
+}
+
+BOOST_AUTO_TEST_CASE(Claim_stale) {
+    std::system("rm -rf " CLAIM_DIR);
+
+    size_t stShard;
+    {
+        _claim claimA(CLAIM_DIR, 1, 4);
+        BOOST_REQUIRE(claimA.open());
+        BOOST_REQUIRE(claimA.next(stShard));
+        BOOST_CHECK(stShard==0);
+    }
+    _claim claimB(CLAIM_DIR, 1, 4);
+    BOOST_REQUIRE(claimB.open());
+
+    // claimA died without releasing its lock, which is not touched any more
+    const std::string sLock=std::string(CLAIM_DIR)+"/shard_0.lock";
+    struct timespec tsOld[2];
+    tsOld[0].tv_sec=tsOld[1].tv_sec=std::time(nullptr)-60;
+    tsOld[0].tv_nsec=tsOld[1].tv_nsec=0;
+    BOOST_REQUIRE(::utimensat(AT_FDCWD, sLock.c_str(), tsOld, 0)==0);
+
+    BOOST_CHECK(claimB.next(stShard));
+    BOOST_CHECK(stShard==0);
+    BOOST_CHECK(claimB.done(stShard));
+    BOOST_CHECK(!claimB.next(stShard));
+
+    std::system("rm -rf " CLAIM_DIR);
+}
+
+BOOST_AUTO_TEST_CASE(Claim_owner) {
+    std::system("rm -rf " CLAIM_DIR);
+
+    size_t stShard;
+    _claim claimA(CLAIM_DIR, 1, 4);
+    BOOST_REQUIRE(claimA.open());
+    BOOST_REQUIRE(claimA.next(stShard));
+
+    // each process writes its result aside
+    BOOST_CHECK(claimA.get_part(stShard)!=claimA.get_result(stShard));
+    BOOST_CHECK(claimA.get_part(stShard).find(claimA.get_result(stShard))==0);
+
+    // another process took the lock over while this one was stalled
+    const std::string sLock=std::string(CLAIM_DIR)+"/shard_0.lock";
+    std::ofstream(sLock) << "otherhost 1\n";
+
+    BOOST_CHECK(!claimA.done(stShard));
+    BOOST_CHECK(!claimA.is_done(stShard));
+    claimA.release(stShard);
+    std::ifstream ifLock(sLock);
+    std::string sLine;
+    BOOST_CHECK(std::getline(ifLock, sLine) && sLine=="otherhost 1");
+
+    std::system("rm -rf " CLAIM_DIR);
+}
@@ -0,0 +1,133 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "collector.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define TABLE_NAME "test_collector.csv"
+#define NFILE 5000
+#define NTHREAD 4
+// ----------------------------------
+
+std::vector<std::string> read_lines(const std::string &sFile) {
+    std::ifstream ifFile(sFile);
+    std::vector<std::string> vsLine;
+    std::string sLine;
+    while (std::getline(ifFile, sLine))
+        vsLine.emplace_back(sLine);
+    return vsLine;
+}
+
+BOOST_AUTO_TEST_CASE(Collector_input_order) {
+    _collector colTable(TABLE_NAME, {"file", "snr"}, _collector::eFormat::TSV);
+    BOOST_REQUIRE(colTable.open());
+
+    // the inputs are added in any order by several threads, some without result
+    std::vector<size_t> vstSeq(NFILE);
+    for(size_t i=0; i<vstSeq.size(); i++) vstSeq[i]=i;
+    std::shuffle(vstSeq.begin(), vstSeq.end(), std::mt19937(1));
+
+    std::vector<std::thread> vthAdd;
+    for(int i=0; i<NTHREAD; i++)
+        vthAdd.emplace_back([&colTable, &vstSeq, i]() {
+            for(size_t j=i; j<vstSeq.size(); j+=NTHREAD) {
+                size_t stSeq=vstSeq[j];
+                colTable.add(stSeq, stSeq%10==0 ? "" : "f"+std::to_string(stSeq)+"\t"+std::to_string(stSeq)+"\n");
+            }
+        });
+    for(auto &th: vthAdd) th.join();
+
+    // nothing is visible before close()
+    BOOST_CHECK(read_lines(TABLE_NAME).empty());
+    BOOST_REQUIRE(colTable.close());
+    BOOST_CHECK(colTable.get_rows()==NFILE-NFILE/10);
+
+    auto vsLine=read_lines(TABLE_NAME);
+    BOOST_REQUIRE(vsLine.size()==NFILE-NFILE/10+1);
+    BOOST_CHECK(vsLine[0]=="file\tsnr");
+
+    size_t stLine=1;
+    for(size_t i=0; i<NFILE; i++)
+        if (i%10!=0)
+            BOOST_CHECK(vsLine[stLine++]=="f"+std::to_string(i)+"\t"+std::to_string(i));
+
+    std::remove(TABLE_NAME);
+}
+
+BOOST_AUTO_TEST_CASE(Collector_sort) {
+    {
+        _collector colTable(TABLE_NAME, {"file", "snr"}, _collector::eFormat::TEXT, _collector::eOrder::SNR);
+        BOOST_REQUIRE(colTable.open());
+        colTable.add(0, "b\t10\n");
+        colTable.add(2, "c\t-nan\n");
+        colTable.add(1, "a\t10\nd\t30.5\n");
+        colTable.add(4, "e\t1\n"); // 3 is missing
+        BOOST_REQUIRE(colTable.close());
+    }
+    BOOST_CHECK((read_lines(TABLE_NAME)==std::vector<std::string>{"d\t30.5", "a\t10", "b\t10", "e\t1", "c\t-nan"}));
+
+    // the lines of a file keep their order
+    {
+        _collector colTable(TABLE_NAME, {"file", "wavelength", "snr"}, _collector::eFormat::TEXT, _collector::eOrder::PATH, 2);
+        BOOST_REQUIRE(colTable.open());
+        colTable.add(0, "b\t1\t5\nb\t2\t3\n");
+        colTable.add(1, "a\t1\t4\na\t2\t6\n");
+        BOOST_REQUIRE(colTable.close());
+    }
+    BOOST_CHECK((read_lines(TABLE_NAME)==std::vector<std::string>{"a\t1\t4", "a\t2\t6", "b\t1\t5", "b\t2\t3"}));
+
+    std::remove(TABLE_NAME);
+}
+
+BOOST_AUTO_TEST_CASE(Collector_jsonl) {
+    {
+        _collector colTable(TABLE_NAME, {"file", "snr"}, _collector::eFormat::JSONL);
+        BOOST_REQUIRE(colTable.open());
+        colTable.add(0, "dir/a \"1\".dat\t95.680000\n");
+        colTable.add(1, "b.dat\tinf\n");
+        BOOST_REQUIRE(colTable.close());
+    }
+    BOOST_CHECK((read_lines(TABLE_NAME)==std::vector<std::string>{
+        "{\"file\":\"dir/a \\\"1\\\".dat\",\"snr\":95.68}",
+        "{\"file\":\"b.dat\",\"snr\":null}"}));
+
+    // a table not closed is not written
+    {
+        _collector colTable(TABLE_NAME, {"file", "snr"});
+        BOOST_REQUIRE(colTable.open());
+        colTable.add(0, "c.dat\t1\n");
+    }
+    BOOST_CHECK(read_lines(TABLE_NAME).size()==2);
+    BOOST_CHECK(!std::ifstream(std::string(TABLE_NAME)+".part").is_open());
+
+    std::remove(TABLE_NAME);
+}
+
+BOOST_AUTO_TEST_CASE(Collector_part) {
+    const std::string sPart=std::string(TABLE_NAME)+".host.1.part";
+    {
+        _collector colTable(TABLE_NAME, {"file", "snr"});
+        colTable.set_part(sPart);
+        BOOST_REQUIRE(colTable.open());
+        colTable.add(0, "a.dat\t1\n");
+        BOOST_CHECK(std::ifstream(sPart).is_open());
+        BOOST_CHECK(!std::ifstream(std::string(TABLE_NAME)+".part").is_open());
+        BOOST_REQUIRE(colTable.close());
+    }
+    BOOST_CHECK(read_lines(TABLE_NAME)==std::vector<std::string>{"a.dat\t1"});
+    BOOST_CHECK(!std::ifstream(sPart).is_open());
+
+    std::remove(TABLE_NAME);
+}
@@ -7,8 +7,9 @@
 #include <ctime>
 #include <tuple>
 #include <random>
+#include <iterator>
 
-
+#define CSV_SEGMENT_MIN 64 // small segments to test the parallel read
 #include "csv.h"
 
 #include <boost/test/unit_test.hpp>
@@ -117,6 +118,290 @@ BOOST_AUTO_TEST_CASE(csv_str_str_double_long) {
     remove(sFile.c_str());
 }
 
+BOOST_AUTO_TEST_CASE(Read_header_mixed_sep) {
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "wavelength\tflux\r\n";
+    sfFlux << "4000.5\t+1.25\n";
+    sfFlux << "\n";
+    sfFlux << "4000.6  \t 1e-1\n";
+    sfFlux << "4000.7 0.5";
+    sfFlux.close();
+    _csv<real> csv(sFile, '\t');
+    BOOST_CHECK(csv.read());
+    BOOST_CHECK(csv.get_header_size()==2);
+    BOOST_CHECK(csv.get_header()[0]=="wavelength");
+    BOOST_CHECK(csv.get_header()[1]=="flux");
+    BOOST_CHECK(csv.get_data_size_i()==3);
+    BOOST_CHECK(csv.get_data_size_j()==2);
+    BOOST_CHECK(csv.select_column(0)[0]==4000.5);
+    BOOST_CHECK(csv.select_column(1)[0]==1.25);
+    BOOST_CHECK(csv.select_column(1)[1]==0.1);
+    BOOST_CHECK(csv.select_column(0)[2]==4000.7);
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Read_invalid_token) {
+    typedef float real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "1,2\n3,x4\n5,6\n";
+    sfFlux.close();
+    _csv<real> csv(sFile, ',');
+    BOOST_CHECK(csv.read());
+    BOOST_CHECK(csv.get_data_size_i()==3);
+    BOOST_CHECK(std::isnan(csv.select_column(1)[1]));
+    BOOST_CHECK(csv.select_column(1)[2]==6);
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Read_sniff) {
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "wavelength;flux\n4000,5;1,25\n4001;-0,5\n";
+    sfFlux.close();
+    _csv<real> csv(sFile, "auto");
+    BOOST_CHECK(csv.read());
+    BOOST_CHECK(csv.get_separator()==';');
+    BOOST_CHECK(csv.get_header_size()==2);
+    BOOST_CHECK(csv.get_column(0)==std::vector<real>({4000.5, 4001}));
+    BOOST_CHECK(csv.get_column(1)==std::vector<real>({1.25, -0.5}));
+    sfFlux.open(sFile, std::ios::out);
+    sfFlux << "4000.5,1.25\n4001,-0.5\n";
+    sfFlux.close();
+    BOOST_CHECK(csv.read());
+    BOOST_CHECK(csv.get_separator()==',');
+    BOOST_CHECK(csv.get_data_size_j()==2);
+    BOOST_CHECK(csv.get_column(1)[0]==1.25);
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Stream_chunks) {
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "wavelength\tflux\n";
+    for(int i=0; i<10; i++)
+        sfFlux << 4000+i << "\t" << (i%2 ? 1 : -1) << "\n";
+    sfFlux.close();
+    _csv<real> csv(sFile, '\t');
+    std::vector<size_t> vstRows;
+    BOOST_CHECK(csv.for_each_chunk(4, [&](_csv<real> &csvChunk) {
+        vstRows.emplace_back(csvChunk.get_data_size_i());
+        return csvChunk.get_header_size()==2;
+    }));
+    BOOST_CHECK(vstRows==std::vector<size_t>({4, 4, 2}));
+    BOOST_CHECK(csv.transform_chunks(3, [](_csv<real> &csvChunk) {
+        return csvChunk.apply_min_threshold(0, 1);
+    }));
+    BOOST_CHECK(csv.read());
+    BOOST_CHECK(csv.get_header_size()==2);
+    BOOST_CHECK(csv.get_data_size_i()==5);
+    BOOST_CHECK(csv.get_column(0)[0]==4001);
+    BOOST_CHECK(!csv.is_input_error());
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Stream_chunks_mapped) {
+    // the file mapped by a pipeline is streamed like the file itself
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "wavelength\tflux\n";
+    for(int i=0; i<10; i++)
+        sfFlux << 4000+i << "\t" << (i%2 ? 1 : -1) << "\n";
+    sfFlux.close();
+    auto pFile=std::make_shared<_mmap>(sFile);
+    _csv<real> csv(sFile, '\t');
+    csv.set_projection({1});
+    std::vector<size_t> vstRows;
+    BOOST_CHECK(csv.for_each_chunk(pFile, 4, [&](_csv<real> &csvChunk) {
+        vstRows.emplace_back(csvChunk.get_data_size_i());
+        return true;
+    }));
+    BOOST_CHECK(vstRows==std::vector<size_t>({4, 4, 2}));
+    csv.set_filename_out(sFile+".out");
+    BOOST_CHECK(csv.transform_chunks(pFile, 3, [](_csv<real> &csvChunk) {
+        return csvChunk.apply_min_threshold(0, 1);
+    }));
+    _csv<real> csvOut(sFile+".out", '\t');
+    BOOST_CHECK(csvOut.read());
+    BOOST_CHECK(csvOut.get_data_size_i()==5);
+    BOOST_CHECK(csvOut.get_column(0)[0]==4001);
+    remove(sFile.c_str());
+    remove((sFile+".out").c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Stream_input_error) {
+    // a header without data: the input is blamed, the output is not created
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "wavelength\tflux\n";
+    sfFlux.close();
+    _csv<real> csv(sFile, '\t');
+    csv.set_filename_out(sFile+".out");
+    BOOST_CHECK(!csv.transform_chunks(3, [](_csv<real>&) { return true; }));
+    BOOST_CHECK(csv.is_input_error());
+    std::ifstream ifOut(sFile+".out");
+    BOOST_CHECK(!ifOut);
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Write_round_trip) {
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::vector<std::vector<real> > vvData({{4000.123456789012, 1./3}, {-1e-300, 2}});
+    _csv<real> csv(std::vector<std::string>({"wavelength", "flux"}), vvData, '\t');
+    csv.set_filename_out(sFile);
+    BOOST_CHECK(csv.write());
+    _csv<real> csvIn(sFile, '\t');
+    BOOST_CHECK(csvIn.read());
+    BOOST_CHECK(csvIn.get_header_size()==2);
+    BOOST_CHECK(csvIn.get_data()==vvData);
+    csv.set_precision(3);
+    BOOST_CHECK(csv.write());
+    BOOST_CHECK(csvIn.read());
+    BOOST_CHECK(csvIn.get_column(0)[0]==4000);
+    BOOST_CHECK(csvIn.get_column(1)[0]==0.333);
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Spb_round_trip) {
+    typedef float real;
+    std::string sFile(gen_rand_string()+".spb");
+    std::vector<std::vector<real> > vvData({{4000.5, 0.25}, {4001, 1}, {4001.5, 0.75}});
+    _csv<real> csv(std::vector<std::string>({"wavelength", "flux"}), vvData, '\t');
+    csv.set_filename_out(sFile);
+    BOOST_CHECK(csv.write());
+    _spb spbFile(sFile);
+    BOOST_CHECK(spbFile.is_open());
+    BOOST_CHECK(spbFile.get_rows()==3 && spbFile.get_cols()==2);
+    BOOST_CHECK(spbFile.is_sorted());
+    BOOST_CHECK(spbFile.get_wmin()==4000.5 && spbFile.get_wmax()==4001.5);
+    BOOST_CHECK(spbFile.get_column<real>(1)[2]==0.75);
+    BOOST_CHECK(reinterpret_cast<uintptr_t>(spbFile.get_column<real>(1))%SPB_ALIGN==0);
+    _csv<double> csvIn(sFile, '\t');
+    BOOST_CHECK(csvIn.read());
+    BOOST_CHECK(csvIn.get_header()[1]=="flux");
+    BOOST_CHECK(csvIn.get_column(0)==std::vector<double>({4000.5, 4001, 4001.5}));
+    std::vector<size_t> vstRows;
+    BOOST_CHECK(csvIn.for_each_chunk(2, [&](_csv<double> &csvChunk) {
+        vstRows.emplace_back(csvChunk.get_data_size_i());
+        return true;
+    }));
+    BOOST_CHECK(vstRows==std::vector<size_t>({2, 1}));
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Spb_corrupt) {
+    typedef float real;
+    std::string sFile(gen_rand_string()+".spb");
+    _csv<real> csv(std::vector<std::string>({"wavelength", "flux"}), std::vector<std::vector<real> >({{4000, 1}, {4001, 2}}), '\t');
+    csv.set_filename_out(sFile);
+    BOOST_REQUIRE(csv.write());
+    BOOST_REQUIRE(_spb(sFile).is_open());
+
+    // header fields whose products overflow
+    auto fCorrupt=[&sFile](uint64_t u64Rows, uint64_t u64Stride) {
+        _spb_header hHeader;
+        std::fstream fsFile(sFile, std::ios::in | std::ios::out | std::ios::binary);
+        fsFile.read(reinterpret_cast<char*>(&hHeader), sizeof(hHeader));
+        hHeader.u64Rows=u64Rows;
+        hHeader.u64Stride=u64Stride;
+        fsFile.seekp(0);
+        fsFile.write(reinterpret_cast<const char*>(&hHeader), sizeof(hHeader));
+        fsFile.close();
+        return _spb(sFile).is_open();
+    };
+    BOOST_CHECK(!fCorrupt(1ULL<<62, 0));
+    BOOST_CHECK(!fCorrupt(1ULL<<62, SPB_ALIGN));
+    BOOST_CHECK(!fCorrupt(2, 1ULL<<62));
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Read_threads) {
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "wavelength\tflux\n";
+    for(int i=0; i<1000; i++)
+        sfFlux << 4000+i*STEP << "\t" << i << "\n";
+    sfFlux.close();
+    _csv<real> csv(sFile, '\t');
+    BOOST_CHECK(csv.read());
+    _csv<real> csvThr(sFile, '\t');
+    csvThr.set_threads(7);
+    BOOST_CHECK(csvThr.read());
+    BOOST_CHECK(csvThr.get_data_size_i()==1000);
+    BOOST_CHECK(csvThr.get_header_size()==2);
+    BOOST_CHECK(csvThr.get_column(0)==csv.get_column(0));
+    BOOST_CHECK(csvThr.get_column(1)==csv.get_column(1));
+    remove(sFile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Columns_get_data) {
+    typedef double real;
+    auto vvR=gen_rand_vv<real>();
+    _csv<real> csv(vvR);
+    BOOST_CHECK(csv.get_data()==vvR);
+    BOOST_CHECK(csv.get_column(1).size()==vvR.size());
+    BOOST_CHECK(csv.get_column(2).empty());
+    BOOST_CHECK(csv.shift(1.0));
+    BOOST_CHECK(csv.get_data()[0][0]==vvR[0][0]+1.0);
+}
+
+BOOST_AUTO_TEST_CASE(Columns_threshold) {
+    typedef float real;
+    _csv<real> csv(std::vector<std::vector<real> >({{1, 0.5}, {2, -1}, {3, 2}, {4, 0.7}}));
+    BOOST_CHECK(csv.apply_min_threshold(0, 1));
+    BOOST_CHECK(csv.get_data_size_i()==3);
+    BOOST_CHECK(csv.apply_max_threshold(1, 1));
+    BOOST_CHECK(csv.get_data_size_i()==2);
+    BOOST_CHECK(csv.get_column(0)==std::vector<real>({1, 4}));
+    BOOST_CHECK(csv.get_column(1)==std::vector<real>({0.5, 0.7}));
+}
+
+BOOST_AUTO_TEST_CASE(Range_threshold) {
+    typedef double real;
+    _csv<real> csv(std::vector<std::vector<real> >({{1, 0.5}, {2, -1}, {3, 2}, {4, 0.7}, {5, 0}}));
+    BOOST_CHECK(csv.apply_range_threshold(2, 4, 0));
+    BOOST_CHECK(csv.get_column(0)==std::vector<real>({2, 3, 4}));
+    BOOST_CHECK(csv.get_column(1)==std::vector<real>({-1, 2, 0.7}));
+    BOOST_CHECK(!csv.apply_range_threshold(0, 1, 2));
+    BOOST_CHECK(csv.apply_min_threshold(0));
+    BOOST_CHECK(csv.get_column(0)==std::vector<real>({3, 4}));
+}
+
+BOOST_AUTO_TEST_CASE(Projection_passthrough) {
+    typedef double real;
+    std::string sFile(gen_rand_string());
+    std::fstream sfFlux(sFile, std::ios::out);
+    sfFlux << "wavelength\tflux\terr\n"
+           << "4000.50\t1.2500\t7e0\n"
+           << "4001.50\t1.0\t 8.00\n"
+           << "4002.50\t0.75\t9\n";
+    sfFlux.close();
+    auto fRead=[](const std::string &sName) {
+        std::ifstream sfIn(sName);
+        return std::string(std::istreambuf_iterator<char>(sfIn), {});
+    };
+    _csv<real> csv(sFile, '\t');
+    csv.set_projection({0});
+    BOOST_CHECK(csv.transform_chunks(2, [](_csv<real> &csvChunk) {
+        return csvChunk.apply_range_threshold(4001, 4003, 0);
+    }));
+    BOOST_CHECK(fRead(sFile)=="wavelength\tflux\terr\n4001.50\t1.0\t 8.00\n4002.50\t0.75\t9\n");
+    BOOST_CHECK(csv.read());
+    BOOST_CHECK(csv.shift(1));
+    BOOST_CHECK(csv.write());
+    BOOST_CHECK(fRead(sFile)=="wavelength\tflux\terr\n4002.5\t1.0\t 8.00\n4003.5\t0.75\t9\n");
+    BOOST_CHECK(csv.get_column(2)==std::vector<real>({8, 9}));
+    remove(sFile.c_str());
+}
+
 BOOST_AUTO_TEST_CASE(csv_vv_float) {
     typedef float real;
     std::string sFile(gen_rand_string());
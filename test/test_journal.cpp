@@ -0,0 +1,66 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "journal.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define JOURNAL_NAME "test_journal.journal"
+#define NENTRY 1000
+// ----------------------------------
+
+BOOST_AUTO_TEST_CASE(Journal_resume) {
+    {
+        _journal journal;
+        BOOST_CHECK(journal.open(JOURNAL_NAME, false));
+        BOOST_CHECK(journal.get_done()==0);
+
+        std::vector<std::thread> vthWriter;
+        for(int i=0; i<2; i++)
+            vthWriter.emplace_back([&journal, i]() {
+                for(int j=i; j<NENTRY; j+=2)
+                    journal.add("file_"+std::to_string(j));
+            });
+        for(auto &th: vthWriter) th.join();
+        BOOST_CHECK(journal.close());
+    }
+
+    // a crash cuts the last line
+    std::ofstream(JOURNAL_NAME, std::ios::app) << "file_cut";
+    {
+        _journal journal;
+        BOOST_CHECK(journal.open(JOURNAL_NAME, true));
+        BOOST_CHECK(journal.get_done()==NENTRY);
+        BOOST_CHECK(journal.is_done("file_0") && journal.is_done("file_999"));
+        BOOST_CHECK(!journal.is_done("file_cut"));
+
+        BOOST_CHECK(journal.add("file_new"));
+        BOOST_CHECK(journal.sync());
+    }
+    {
+        _journal journal;
+        BOOST_CHECK(journal.open(JOURNAL_NAME, true));
+        BOOST_CHECK(journal.get_done()==NENTRY+1);
+        BOOST_CHECK(journal.is_done("file_new"));
+        BOOST_CHECK(!journal.is_done("file_cut"));
+    }
+    {
+        // a new run empties the journal
+        _journal journal;
+        BOOST_CHECK(journal.open(JOURNAL_NAME, false));
+    }
+    {
+        _journal journal;
+        BOOST_CHECK(journal.open(JOURNAL_NAME, true));
+        BOOST_CHECK(journal.get_done()==0);
+    }
+    std::remove(JOURNAL_NAME);
+}
@@ -0,0 +1,104 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <filesystem>
+#include <tuple>
+#include <atomic>
+
+#include "load.h"
+#include "pool.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace fs = std::filesystem;
+
+// ----------------------------------
+// Test parameters
+#define CGROUP_ROOT "test_load_cgroup"
+// ----------------------------------
+
+void put(const std::string &sFile, const std::string &sLine) {
+    fs::create_directories(fs::path(sFile).parent_path());
+    std::ofstream ofFile(sFile);
+    ofFile << sLine << "\n";
+}
+
+BOOST_AUTO_TEST_CASE(Load_cpu_max) {
+    BOOST_CHECK(_load::parse_cpu_max("max 100000")==0);
+    BOOST_CHECK(_load::parse_cpu_max("200000 100000")==2);
+    BOOST_CHECK(_load::parse_cpu_max("50000 100000")==0.5);
+    BOOST_CHECK(_load::parse_cpu_max("")==0);
+    BOOST_CHECK(_load::parse_cpu_max("abc 100000")==0);
+}
+
+BOOST_AUTO_TEST_CASE(Load_cgroup) {
+    std::istringstream issV2("0::/user.slice/job.scope\n");
+    BOOST_CHECK(std::get<0>(_load::parse_cgroup(issV2))=="/user.slice/job.scope");
+
+    std::istringstream issV1("12:memory:/a\n4:cpu,cpuacct:/slurm/job_7\n0::/\n");
+    auto [sV2, sV1]=_load::parse_cgroup(issV1);
+    BOOST_CHECK(sV1=="/slurm/job_7");
+    BOOST_CHECK(sV2=="/");
+}
+
+BOOST_AUTO_TEST_CASE(Load_quota_v2) {
+    // the quota of the job is set on an ancestor of the cgroup of the process
+    fs::remove_all(CGROUP_ROOT);
+    put(CGROUP_ROOT "/cgroup.controllers", "cpu memory");
+    put(CGROUP_ROOT "/batch/cpu.max", "400000 100000");
+    put(CGROUP_ROOT "/batch/job/cpu.max", "max 100000");
+    put(CGROUP_ROOT "/self", "0::/batch/job/step");
+    BOOST_CHECK(_load::quota(CGROUP_ROOT, CGROUP_ROOT "/self")==4);
+
+    // the smallest quota wins
+    put(CGROUP_ROOT "/batch/job/cpu.max", "150000 100000");
+    BOOST_CHECK(_load::quota(CGROUP_ROOT, CGROUP_ROOT "/self")==1.5);
+
+    put(CGROUP_ROOT "/self", "0::/other");
+    BOOST_CHECK(_load::quota(CGROUP_ROOT, CGROUP_ROOT "/self")==0);
+    fs::remove_all(CGROUP_ROOT);
+}
+
+BOOST_AUTO_TEST_CASE(Load_quota_v1) {
+    fs::remove_all(CGROUP_ROOT);
+    put(CGROUP_ROOT "/cpu,cpuacct/cpu.cfs_quota_us", "-1");
+    put(CGROUP_ROOT "/cpu,cpuacct/cpu.cfs_period_us", "100000");
+    put(CGROUP_ROOT "/cpu,cpuacct/slurm/job_7/cpu.cfs_quota_us", "300000");
+    put(CGROUP_ROOT "/cpu,cpuacct/slurm/job_7/cpu.cfs_period_us", "100000");
+    put(CGROUP_ROOT "/self", "4:cpu,cpuacct:/slurm/job_7");
+    BOOST_CHECK(_load::quota(CGROUP_ROOT, CGROUP_ROOT "/self")==3);
+    fs::remove_all(CGROUP_ROOT);
+}
+
+BOOST_AUTO_TEST_CASE(Load_available) {
+    BOOST_CHECK(_load::available()>=1);
+    BOOST_CHECK(_load::available()<=_load::affinity());
+    BOOST_CHECK(_load(3).get_max()==3);
+    BOOST_CHECK(_load().get_max()==_load::available());
+}
+
+BOOST_AUTO_TEST_CASE(Load_stat) {
+    auto [ldTotal, ldIdle]=_load::get_stat();
+    BOOST_CHECK(ldTotal>0);
+    BOOST_CHECK(ldIdle>=0 && ldIdle<=ldTotal);
+}
+
+BOOST_AUTO_TEST_CASE(Load_pool_active) {
+    // a 0% limit leaves one worker after the first sample
+    _load load(4, 0);
+    _pool pool(load.get_max());
+    load.start([&](int iN) { pool.set_active(iN); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(3*LOAD_PERIOD));
+    std::atomic<int> aiCount(0);
+    for(int i=0; i<100; i++)
+        pool.submit([&]() { aiCount++; });
+    pool.wait();
+    load.stop();
+    BOOST_CHECK(aiCount==100);
+    BOOST_CHECK(load.get_active()==1);
+    BOOST_CHECK(pool.get_active()==1);
+    BOOST_CHECK(load.get_load()>=0);
+}
@@ -0,0 +1,262 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+
+#include "csv.h"
+#include "pipeline.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define NITEM 10000
+#define NFILE 20
+// ----------------------------------
+
+BOOST_AUTO_TEST_CASE(Ring_bounded) {
+    _ring<int> rRing(3);
+    BOOST_CHECK(rRing.capacity()==4);
+
+    for(int i=0; i<4; i++) {
+        int iVal=i;
+        BOOST_CHECK(rRing.try_push(iVal));
+    }
+    int iVal=4;
+    BOOST_CHECK(!rRing.try_push(iVal));
+
+    // first in, first out
+    for(int i=0; i<4; i++) {
+        BOOST_CHECK(rRing.try_pop(iVal));
+        BOOST_CHECK(iVal==i);
+    }
+    BOOST_CHECK(!rRing.try_pop(iVal));
+
+    rRing.close();
+    BOOST_CHECK(!rRing.pop(iVal));
+}
+
+BOOST_AUTO_TEST_CASE(Ring_mpmc) {
+    _ring<int> rRing(8);
+    std::atomic<long> alSum(0);
+    std::atomic<int> aiCount(0);
+
+    std::vector<std::thread> vthConsumer;
+    for(int i=0; i<3; i++)
+        vthConsumer.emplace_back([&]() {
+            int iVal;
+            while (rRing.pop(iVal)) {
+                alSum+=iVal;
+                aiCount++;
+            }
+        });
+
+    std::vector<std::thread> vthProducer;
+    for(int i=0; i<2; i++)
+        vthProducer.emplace_back([&, i]() {
+            for(int j=i; j<NITEM; j+=2) {
+                int iVal=j;
+                rRing.push(iVal);
+            }
+        });
+
+    for(auto &th: vthProducer) th.join();
+    rRing.close();
+    for(auto &th: vthConsumer) th.join();
+
+    BOOST_CHECK(aiCount==NITEM);
+    BOOST_CHECK(alSum==static_cast<long>(NITEM)*(NITEM-1)/2);
+}
+
+BOOST_AUTO_TEST_CASE(Ring_sleep) {
+    _ring<int> rRing(2);
+
+    // a pop asleep on an empty queue is woken by a push, then by close()
+    std::atomic<int> aiPopped(0);
+    std::thread thConsumer([&]() {
+        int iVal;
+        while (rRing.pop(iVal))
+            aiPopped+=iVal;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int iVal=5;
+    rRing.push(iVal);
+    while (aiPopped.load()==0)
+        std::this_thread::yield();
+    rRing.close();
+    thConsumer.join();
+    BOOST_CHECK(aiPopped==5);
+
+    // a push asleep on a full queue is woken by a pop
+    _ring<int> rFull(2);
+    for(int i=0; i<2; i++) {
+        iVal=i;
+        rFull.push(iVal);
+    }
+    std::thread thProducer([&]() {
+        int iLast=2;
+        rFull.push(iLast);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for(int i=0; i<3; i++) {
+        BOOST_CHECK(rFull.pop(iVal));
+        BOOST_CHECK(iVal==i);
+    }
+    thProducer.join();
+}
+
+BOOST_AUTO_TEST_CASE(Source_sink) {
+    std::vector<std::string> vsFile;
+    {
+        _sink skOut(4);
+        for(int i=0; i<NFILE; i++) {
+            vsFile.emplace_back("test_pipeline_io_"+std::to_string(i)+".dat");
+            BOOST_CHECK(skOut.put(vsFile.back(), std::string(i*1000, 'a'+i%26)));
+        }
+        BOOST_CHECK(skOut.pending()<4);
+        BOOST_CHECK(skOut.flush());
+        BOOST_CHECK(skOut.pending()==0);
+        BOOST_CHECK(skOut.get_failed()==0);
+
+        // the directory does not exist
+        skOut.put("test_pipeline_none/file.dat", "abc");
+        BOOST_CHECK(!skOut.flush());
+        BOOST_CHECK(skOut.get_failed()==1);
+    }
+
+    vsFile.emplace_back("test_pipeline_missing.dat");
+    _source srcIn(8);
+    auto vpView=srcIn.read(vsFile);
+    BOOST_CHECK(vpView.size()==vsFile.size());
+
+    for(int i=0; i<NFILE; i++) {
+        BOOST_CHECK(vpView[i]->is_open());
+        BOOST_CHECK(std::string(vpView[i]->data(), vpView[i]->size())==std::string(i*1000, 'a'+i%26));
+        std::remove(vsFile[i].c_str());
+    }
+    BOOST_CHECK(!vpView.back()->is_open());
+}
+
+BOOST_AUTO_TEST_CASE(Sink_done) {
+    _sink skOut(4);
+    std::vector<std::string> vsDone;
+
+    // called by the flush, once the file is renamed
+    skOut.put("test_pipeline_done.dat", "abc", [&vsDone]() { vsDone.push_back("test_pipeline_done.dat"); });
+    BOOST_CHECK(vsDone.empty());
+    skOut.put("test_pipeline_none/file.dat", "abc", [&vsDone]() { vsDone.push_back("test_pipeline_none/file.dat"); });
+    BOOST_CHECK(!skOut.flush());
+
+    // never for a file which cannot be written
+    BOOST_CHECK(vsDone.size()==1);
+    BOOST_CHECK(vsDone.front()=="test_pipeline_done.dat");
+    std::ifstream isIn(vsDone.front());
+    BOOST_CHECK(isIn.is_open());
+    std::remove(vsDone.front().c_str());
+}
+
+#ifdef HAS_URING
+BOOST_AUTO_TEST_CASE(Source_sink_uring) {
+    _sink skOut(4);
+    BOOST_REQUIRE(skOut.is_async());
+
+    // more files than a batch, one of them empty
+    std::vector<std::string> vsFile;
+    for(int i=0; i<NFILE; i++) {
+        vsFile.emplace_back("test_pipeline_uring_"+std::to_string(i)+".dat");
+        skOut.put(vsFile.back(), std::string(i*3000, 'a'+i%26));
+    }
+    BOOST_CHECK(skOut.flush());
+    BOOST_CHECK(skOut.get_failed()==0);
+    BOOST_CHECK(skOut.is_async());
+
+    // a missing file gives a view which is not open
+    vsFile.emplace_back("test_pipeline_uring_missing.dat");
+    _source srcIn(8);
+    BOOST_REQUIRE(srcIn.is_async());
+    auto vpView=srcIn.read(vsFile);
+    BOOST_REQUIRE(vpView.size()==vsFile.size());
+    BOOST_CHECK(srcIn.is_async());
+
+    for(int i=0; i<NFILE; i++) {
+        BOOST_CHECK(vpView[i]->is_open());
+        BOOST_CHECK(std::string(vpView[i]->data(), vpView[i]->size())==std::string(i*3000, 'a'+i%26));
+        std::remove(vsFile[i].c_str());
+    }
+    BOOST_CHECK(!vpView.back()->is_open());
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(Pipeline_files) {
+    std::vector<std::string> vsIn, vsOut;
+    for(int i=0; i<NFILE; i++) {
+        vsIn.emplace_back("test_pipeline_in_"+std::to_string(i)+".dat");
+        vsOut.emplace_back("test_pipeline_out_"+std::to_string(i)+".dat");
+
+        std::ofstream ofFile(vsIn.back());
+        for(int j=0; j<100; j++)
+            ofFile << j << " " << i << "\n";
+    }
+
+    typedef _pipeline<std::unique_ptr<_csv<float> > > _pipe;
+    {
+        _pipe pipe([](_pipe::_item &iItem) {
+            if (!iItem.pFile || !iItem.pFile->is_open()) return false;
+
+            auto pCsv=std::make_unique<_csv<float> >(iItem.sIn, ' ');
+            pCsv->set_filename_out(iItem.sOut);
+            pCsv->set_verbose(_csv<float>::eVerbose::QUIET);
+            if (!pCsv->read(iItem.pFile)) return false;
+            pCsv->apply_range_threshold(10, 19, 0);
+
+            iItem.TResult=std::move(pCsv);
+            return true;
+        },
+        [](_pipe::_item &iItem, _sink &skOut) { iItem.TResult->write(skOut); },
+        3, 2, 2, 4);
+
+        BOOST_CHECK(pipe.get_threads()==3);
+        pipe.set_active(2);
+        BOOST_CHECK(pipe.get_active()==2);
+
+        for(int i=0; i<NFILE; i++)
+            pipe.push(vsIn[i], vsOut[i]);
+        // a missing file is dropped by the compute stage
+        pipe.push("test_pipeline_missing.dat", "test_pipeline_missing_out.dat");
+        pipe.finish();
+
+        BOOST_CHECK(pipe.get_written()==NFILE);
+    }
+
+    for(int i=0; i<NFILE; i++) {
+        _csv<float> csv(vsOut[i], ' ');
+        csv.set_verbose(_csv<float>::eVerbose::QUIET);
+        BOOST_CHECK(csv.read());
+        BOOST_CHECK(csv.get_data_size_i()==10);
+        BOOST_CHECK(csv.get_column(0).front()==10 && csv.get_column(1).front()==i);
+
+        std::remove(vsIn[i].c_str());
+        std::remove(vsOut[i].c_str());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Pipeline_exception) {
+    _pipeline<int> pipe([](_pipeline<int>::_item &iItem) {
+        if (iItem.sIn=="bad") throw std::runtime_error("compute");
+        return true;
+    },
+    [](_pipeline<int>::_item&, _sink&) { }, 2);
+
+    pipe.push("bad", "");
+    pipe.push("good", "");
+    BOOST_CHECK_THROW(pipe.finish(), std::runtime_error);
+    BOOST_CHECK(pipe.get_written()==1);
+}
@@ -0,0 +1,105 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+
+#include "pool.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define NTASK 1000
+// ----------------------------------
+
+BOOST_AUTO_TEST_CASE(Pool_all_tasks) {
+    std::atomic<int> aiSum(0);
+    _pool pool(4);
+    BOOST_CHECK(pool.get_threads()==4);
+    for(int i=1; i<=NTASK; i++)
+        pool.submit([&aiSum, i]() { aiSum+=i; });
+    pool.wait();
+    BOOST_CHECK(aiSum==NTASK*(NTASK+1)/2);
+}
+
+BOOST_AUTO_TEST_CASE(Pool_worker_index) {
+    _pool pool(3);
+    std::vector<std::atomic<int> > vaiCount(3);
+    std::atomic<bool> abValid(true);
+    for(int i=0; i<NTASK; i++)
+        pool.submit([&]() {
+            int iWorker=_pool::worker();
+            if (iWorker<0 || iWorker>=3) abValid=false;
+            else vaiCount[iWorker]++;
+        });
+    pool.wait();
+    BOOST_CHECK(abValid);
+    BOOST_CHECK(vaiCount[0]+vaiCount[1]+vaiCount[2]==NTASK);
+    BOOST_CHECK(_pool::worker()==-1);
+}
+
+BOOST_AUTO_TEST_CASE(Pool_nested_submit) {
+    std::atomic<int> aiCount(0);
+    _pool pool(2);
+    for(int i=0; i<10; i++)
+        pool.submit([&]() {
+            for(int j=0; j<10; j++)
+                pool.submit([&]() { aiCount++; });
+        });
+    pool.wait();
+    BOOST_CHECK(aiCount==100);
+}
+
+BOOST_AUTO_TEST_CASE(Pool_exception) {
+    _pool pool(2);
+    pool.submit([]() { throw std::runtime_error("task"); });
+    pool.submit([]() { });
+    BOOST_CHECK_THROW(pool.wait(), std::runtime_error);
+    // the pool is still usable
+    std::atomic<int> aiCount(0);
+    pool.submit([&]() { aiCount++; });
+    pool.wait();
+    BOOST_CHECK(aiCount==1);
+}
+
+BOOST_AUTO_TEST_CASE(Pool_stealing) {
+    // the deques are filled in turn: without stealing the first worker
+    // would run the long task and half of the short ones (700 ms)
+    _pool pool(2);
+    auto tStart=std::chrono::steady_clock::now();
+    pool.submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(500)); });
+    for(int i=0; i<10; i++)
+        pool.submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(40)); });
+    pool.wait();
+    auto dElapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-tStart).count();
+    BOOST_CHECK(dElapsed<0.65);
+}
+
+BOOST_AUTO_TEST_CASE(Pool_active) {
+    _pool pool(4);
+    pool.set_active(1);
+    BOOST_CHECK(pool.get_active()==1);
+    std::atomic<bool> abOther(false);
+    for(int i=0; i<100; i++)
+        pool.submit([&]() { if (_pool::worker()!=0) abOther=true; });
+    pool.wait();
+    BOOST_CHECK(!abOther);
+    pool.set_active(10);
+    BOOST_CHECK(pool.get_active()==4);
+}
+
+BOOST_AUTO_TEST_CASE(Pool_drain_at_stop) {
+    // the tasks queued while most workers are parked all run before the join
+    std::atomic<int> aiCount(0);
+    {
+        _pool pool(4);
+        pool.set_active(1);
+        for(int i=0; i<NTASK; i++)
+            pool.submit([&aiCount]() { aiCount++; });
+    }
+    BOOST_CHECK(aiCount==NTASK);
+}
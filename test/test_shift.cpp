@@ -0,0 +1,71 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include "shift.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define INPUT_DIR "test_shift_input"
+#define MANIFEST "test_shift_manifest.tsv"
+#define CWD_FILE "test_shift_cwd.dat"
+// ----------------------------------
+
+void touch(const std::string &sFile) {
+    std::ofstream(sFile) << "4000\t1\n";
+}
+
+bool read_rows(const std::string &sRows, std::unordered_map<std::string, float> &umVr, size_t &stMissing) {
+    std::ofstream(MANIFEST, std::ios::binary) << sRows;
+    return read_manifest(MANIFEST, INPUT_DIR, umVr, stMissing);
+}
+
+BOOST_AUTO_TEST_CASE(Shift_manifest_key) {
+    // absolute, without "." and ".."
+    BOOST_CHECK(manifest_key("a/./b/../c.dat")==(fs::current_path()/"a"/"c.dat").string());
+    BOOST_CHECK(manifest_key(fs::current_path()/"a.dat")==manifest_key("a.dat"));
+}
+
+BOOST_AUTO_TEST_CASE(Shift_manifest) {
+    std::system("rm -rf " INPUT_DIR);
+    fs::create_directories(fs::path(INPUT_DIR)/"sub");
+    touch(INPUT_DIR "/a.dat");
+    touch(INPUT_DIR "/b c.dat");
+    touch(INPUT_DIR "/sub/d.dat");
+    touch(CWD_FILE);
+
+    std::unordered_map<std::string, float> umVr;
+    size_t stMissing=0;
+
+    // relative to the input, then to the working directory, absolute with a CRLF ending, a path with a space, a missing file
+    const std::string sAbsolute=(fs::current_path()/INPUT_DIR/"sub"/".."/"sub"/"d.dat").string();
+    BOOST_REQUIRE(read_rows("# path\tvr\n"
+                            "\n"
+                            "a.dat\t12.5\n"
+                            "  " CWD_FILE " 3\n"
+                            +sAbsolute+"\t-4.25\r\n"
+                            "b c.dat\t7\n"
+                            "missing.dat\t1\n", umVr, stMissing));
+    BOOST_CHECK(umVr.size()==5);
+    BOOST_CHECK(stMissing==1);
+    BOOST_CHECK(umVr[manifest_key(INPUT_DIR "/a.dat")]==12.5f);
+    BOOST_CHECK(umVr[manifest_key(CWD_FILE)]==3.f);
+    BOOST_CHECK(umVr[manifest_key(INPUT_DIR "/sub/d.dat")]==-4.25f);
+    BOOST_CHECK(umVr[manifest_key(INPUT_DIR "/b c.dat")]==7.f);
+    BOOST_CHECK(umVr.count(manifest_key("missing.dat"))==1);
+
+    // a malformed velocity, a row without velocity, a manifest which does not exist
+    BOOST_CHECK(!read_rows("a.dat\t12x\n", umVr, stMissing));
+    BOOST_CHECK(!read_rows("a.dat\tfast\n", umVr, stMissing));
+    BOOST_CHECK(!read_rows("a.dat\n", umVr, stMissing));
+    BOOST_CHECK(!read_manifest("test_shift_none.tsv", INPUT_DIR, umVr, stMissing));
+
+    std::remove(MANIFEST);
+    std::remove(CWD_FILE);
+    std::system("rm -rf " INPUT_DIR);
+}
@@ -0,0 +1,253 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#include "snr.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define NSPEC 50
+#define NPOINT 1000
+#define EPS 1e-5
+// ----------------------------------
+
+// former implementation: copies and full sorts
+double sorted_median(std::vector<double> vVec) {
+    std::sort(vVec.begin(), vVec.end());
+    size_t stSize=vVec.size();
+    if (stSize%2==0)
+        return (vVec[stSize/2-1]+vVec[stSize/2])/2;
+    return vVec[stSize/2];
+}
+
+double sorted_der_snr(std::vector<double> vFlux) {
+    vFlux.erase(std::remove_if(vFlux.begin(), vFlux.end(), [](double d) { return d<0; }), vFlux.end());
+    size_t stN=vFlux.size();
+    if (stN<=4)
+        return -1;
+
+    std::vector<double> vNoise;
+    for(size_t i=2; i<stN-2; i++)
+        vNoise.push_back(std::abs(2*vFlux[i]-vFlux[i-2]-vFlux[i+2]));
+
+    return sorted_median(vFlux)/(1.482602/std::sqrt(6.)*sorted_median(vNoise));
+}
+
+BOOST_AUTO_TEST_CASE(Snr_median) {
+    std::mt19937 mtGen(42);
+    std::uniform_real_distribution<double> urdFlux(-0.2, 2);
+
+    for(int i=1; i<NSPEC; i++) {
+        std::vector<double> vFlux(i);
+        for(auto &dF: vFlux) dF=urdFlux(mtGen);
+        BOOST_CHECK_CLOSE(median(vFlux), sorted_median(vFlux), EPS);
+    }
+    BOOST_CHECK(median(std::vector<double>())==0);
+}
+
+BOOST_AUTO_TEST_CASE(Snr_der_snr) {
+    std::mt19937 mtGen(7);
+    std::normal_distribution<double> ndFlux(1, 0.1);
+
+    for(int i=0; i<NSPEC; i++) {
+        // odd and even sizes, with some negative fluxes
+        std::vector<double> vFlux(NPOINT+i);
+        for(auto &dF: vFlux) dF=ndFlux(mtGen);
+        vFlux[i]=-1;
+
+        double dRef=sorted_der_snr(vFlux);
+        BOOST_CHECK_CLOSE(der_snr(vFlux), dRef, EPS);
+
+        // the float kernel on a sub-span, without copy
+        std::vector<float> vfFlux(vFlux.begin(), vFlux.end());
+        std::vector<double> vSub(vFlux.begin()+10, vFlux.begin()+110);
+        BOOST_CHECK_CLOSE(der_snr(vfFlux.data()+10, 100), sorted_der_snr(vSub), 1e-2);
+    }
+
+    BOOST_CHECK(der_snr(std::vector<double>{1, 2, 3, 4})==-1);
+    BOOST_CHECK(der_snr(std::vector<double>{1, 2, -3, 4, 5})==-1);
+}
+
+BOOST_AUTO_TEST_CASE(Snr_sliding_median) {
+    std::mt19937 mtGen(3);
+    std::uniform_int_distribution<int> uidValue(0, 20);
+
+    // many equal values: the halves share some of them
+    std::vector<double> vValue(NPOINT);
+    for(auto &dV: vValue) dV=uidValue(mtGen);
+
+    _sliding_median<double> smMedian;
+    const size_t stWindow=NSPEC;
+    for(size_t i=0; i<vValue.size(); i++) {
+        smMedian.insert(vValue[i]);
+        if (i>=stWindow)
+            smMedian.erase(vValue[i-stWindow]);
+
+        size_t stBegin=i>=stWindow ? i-stWindow+1 : 0;
+        std::vector<double> vWindow(vValue.begin()+stBegin, vValue.begin()+i+1);
+        BOOST_REQUIRE(smMedian.size()==vWindow.size());
+        BOOST_CHECK_CLOSE(smMedian.median(), sorted_median(vWindow), EPS);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Snr_profile) {
+    std::mt19937 mtGen(11);
+    std::normal_distribution<double> ndFlux(1, 0.1);
+
+    std::vector<double> vWave(NPOINT), vFlux(NPOINT);
+    for(size_t i=0; i<vFlux.size(); i++) {
+        vWave[i]=4000+0.1*i;
+        vFlux[i]=i%97==0 ? -1 : ndFlux(mtGen);
+    }
+
+    // the negative fluxes are dropped before the windows are cut
+    std::vector<double> vKept_wave, vKept_flux;
+    for(size_t i=0; i<vFlux.size(); i++)
+        if (vFlux[i]>=0) {
+            vKept_wave.push_back(vWave[i]);
+            vKept_flux.push_back(vFlux[i]);
+        }
+
+    // overlapping windows slide, the others are selected again
+    for(auto pWindow: {std::make_pair(101, 1), std::make_pair(200, 3), std::make_pair(101, 37), std::make_pair(50, 50), std::make_pair(20, 80)}) {
+        std::vector<std::pair<double, double> > vpProfile;
+        der_snr_profile(vWave.data(), vFlux.data(), vFlux.size(), pWindow.first, pWindow.second, vpProfile);
+        BOOST_CHECK(vpProfile.size()==(vKept_flux.size()-pWindow.first)/pWindow.second+1);
+
+        for(size_t i=0; i<vpProfile.size(); i++) {
+            size_t stBegin=i*pWindow.second;
+            std::vector<double> vWindow(vKept_flux.begin()+stBegin, vKept_flux.begin()+stBegin+pWindow.first);
+            BOOST_CHECK_CLOSE(vpProfile[i].first, vKept_wave[stBegin+pWindow.first/2], EPS);
+            BOOST_CHECK_CLOSE(vpProfile[i].second, sorted_der_snr(vWindow), EPS);
+        }
+    }
+
+    // a spectrum shorter than the window is a single window
+    std::vector<std::pair<double, double> > vpProfile;
+    der_snr_profile(vWave.data(), vFlux.data(), 30, 1000, 10, vpProfile);
+    BOOST_REQUIRE(vpProfile.size()==1);
+    BOOST_CHECK_CLOSE(vpProfile[0].second, sorted_der_snr(std::vector<double>(vFlux.begin(), vFlux.begin()+30)), EPS);
+}
+
+BOOST_AUTO_TEST_CASE(Snr_regions) {
+    std::mt19937 mtGen(5);
+    std::normal_distribution<double> ndFlux(1, 0.1);
+
+    std::vector<double> vWave(NPOINT), vFlux(NPOINT);
+    for(size_t i=0; i<vFlux.size(); i++) {
+        vWave[i]=4000+0.1*i;
+        vFlux[i]=ndFlux(mtGen);
+    }
+
+    // bounds included, a range outside the spectrum
+    std::vector<std::pair<double, double> > vpRegion={{4010, 4020}, {4050.05, 4080}, {3000, 3100}};
+    std::vector<double> vSnr;
+    der_snr_regions(vWave.data(), vFlux.data(), vFlux.size(), vpRegion, vSnr);
+    BOOST_REQUIRE(vSnr.size()==vpRegion.size());
+    BOOST_CHECK_CLOSE(vSnr[0], sorted_der_snr(std::vector<double>(vFlux.begin()+100, vFlux.begin()+201)), EPS);
+    BOOST_CHECK_CLOSE(vSnr[1], sorted_der_snr(std::vector<double>(vFlux.begin()+501, vFlux.begin()+801)), EPS);
+    BOOST_CHECK(vSnr[2]==-1);
+
+    // wavelengths in descending order
+    std::reverse(vWave.begin(), vWave.end());
+    std::reverse(vFlux.begin(), vFlux.end());
+    std::vector<double> vSnr_rev;
+    der_snr_regions(vWave.data(), vFlux.data(), vFlux.size(), vpRegion, vSnr_rev);
+    BOOST_REQUIRE(vSnr_rev.size()==vpRegion.size());
+    for(size_t i=0; i<vSnr.size(); i++)
+        BOOST_CHECK_CLOSE(vSnr_rev[i], vSnr[i], 1e-2);
+}
+
+BOOST_AUTO_TEST_CASE(Snr_sketch) {
+    std::mt19937 mtGen(13);
+    std::lognormal_distribution<double> lndValue(0, 2);
+
+    // any quantile within alpha, whatever the spread of the values
+    _sketch skValue(0.01);
+    std::vector<double> vValue(10*NPOINT);
+    for(auto &dV: vValue) {
+        dV=lndValue(mtGen);
+        skValue.add(dV);
+    }
+    std::sort(vValue.begin(), vValue.end());
+    for(double dQ: {0., 0.1, 0.5, 0.9, 0.99, 1.})
+        BOOST_CHECK_CLOSE(skValue.quantile(dQ), vValue[static_cast<size_t>(dQ*(vValue.size()-1))], 1.0001);
+    BOOST_CHECK_CLOSE(skValue.median(), sorted_median(vValue), 1.0001);
+    BOOST_CHECK(skValue.get_bins()<SKETCH_BINS);
+}
+
+BOOST_AUTO_TEST_CASE(Snr_sketch_der_snr) {
+    std::mt19937 mtGen(17);
+    std::normal_distribution<double> ndFlux(1, 0.05);
+
+    std::vector<double> vFlux(20*NPOINT+3);
+    for(auto &dF: vFlux) dF=ndFlux(mtGen);
+    vFlux[7]=-1;
+
+    const double dRef=sorted_der_snr(vFlux);
+    _snr_sketch<double> ssWhole;
+    ssWhole.add(vFlux.data(), vFlux.size());
+    BOOST_CHECK(std::abs(ssWhole.get_snr()/dRef-1)<=ssWhole.get_error());
+
+    // chunks of any size, some shorter than the residuals, merged in order
+    for(size_t stChunk: {1, 3, 4, 5, 1000}) {
+        _snr_sketch<double> ssMerged;
+        for(size_t i=0; i<vFlux.size(); i+=stChunk) {
+            _snr_sketch<double> ssChunk;
+            ssChunk.add(vFlux.data()+i, std::min(stChunk, vFlux.size()-i));
+            BOOST_REQUIRE(ssMerged.merge(ssChunk));
+        }
+        BOOST_CHECK(ssMerged.count()==ssWhole.count());
+        BOOST_CHECK_CLOSE(ssMerged.get_snr(), ssWhole.get_snr(), EPS);
+    }
+
+    BOOST_CHECK(_snr_sketch<double>().get_snr()==-1);
+}
+
+BOOST_AUTO_TEST_CASE(Snr_nan) {
+    std::mt19937 mtGen(19);
+    std::normal_distribution<double> ndFlux(1, 0.1);
+
+    // a row of NaN is dropped like a negative flux
+    std::vector<double> vWave(NPOINT), vFlux(NPOINT), vKept_wave, vKept_flux;
+    for(size_t i=0; i<vFlux.size(); i++) {
+        vWave[i]=4000+0.1*i;
+        vFlux[i]=i%53==0 ? std::nan("") : ndFlux(mtGen);
+        if (!std::isnan(vFlux[i])) {
+            vKept_wave.push_back(vWave[i]);
+            vKept_flux.push_back(vFlux[i]);
+        }
+    }
+
+    BOOST_CHECK_CLOSE(der_snr(vFlux.data(), vFlux.size()), sorted_der_snr(vKept_flux), EPS);
+
+    // the sliding medians and the selected windows
+    for(auto pWindow: {std::make_pair(101, 1), std::make_pair(50, 50)}) {
+        std::vector<std::pair<double, double> > vpProfile, vpKept;
+        der_snr_profile(vWave.data(), vFlux.data(), vFlux.size(), pWindow.first, pWindow.second, vpProfile);
+        der_snr_profile(vKept_wave.data(), vKept_flux.data(), vKept_flux.size(), pWindow.first, pWindow.second, vpKept);
+        BOOST_REQUIRE(vpProfile.size()==vpKept.size());
+        for(size_t i=0; i<vpProfile.size(); i++) {
+            BOOST_CHECK(vpProfile[i].first==vpKept[i].first);
+            BOOST_CHECK_CLOSE(vpProfile[i].second, vpKept[i].second, EPS);
+        }
+    }
+
+    std::vector<double> vSnr, vSnr_kept;
+    der_snr_regions(vWave.data(), vFlux.data(), vFlux.size(), {{4000, 4020}, {4030, 4090}}, vSnr);
+    der_snr_regions(vKept_wave.data(), vKept_flux.data(), vKept_flux.size(), {{4000, 4020}, {4030, 4090}}, vSnr_kept);
+    BOOST_REQUIRE(vSnr.size()==2 && vSnr_kept.size()==2);
+    for(size_t i=0; i<vSnr.size(); i++)
+        BOOST_CHECK_CLOSE(vSnr[i], vSnr_kept[i], EPS);
+
+    _snr_sketch<double> ssFlux, ssKept;
+    ssFlux.add(vFlux.data(), vFlux.size());
+    ssKept.add(vKept_flux.data(), vKept_flux.size());
+    BOOST_CHECK(ssFlux.get_snr()==ssKept.get_snr());
+}
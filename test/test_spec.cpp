@@ -0,0 +1,93 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+
+#include "spec.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define NPOINT 1000
+// ----------------------------------
+
+std::vector<std::vector<float> > gen_spectrum() {
+    std::mt19937 mtGen(23);
+    std::normal_distribution<float> ndFlux(1, 0.1);
+
+    std::vector<std::vector<float> > vvData(NPOINT);
+    for(size_t i=0; i<vvData.size(); i++)
+        vvData[i]={4000+0.5f*i, i%31==0 ? -1 : ndFlux(mtGen)};
+    return vvData;
+}
+
+BOOST_AUTO_TEST_CASE(Spec_split_chain) {
+    std::vector<std::unique_ptr<_stage> > vpStage;
+
+    BOOST_CHECK(split_chain({"trim", "-l", "4700", "-u", "4800", ":", "threshold", "-t", "0", ":", "der_snr"}, vpStage));
+    BOOST_REQUIRE(vpStage.size()==3);
+    BOOST_CHECK(vpStage[0]->get_name()=="trim");
+    BOOST_CHECK(vpStage[1]->get_name()=="threshold");
+    BOOST_CHECK(vpStage[2]->get_name()=="der_snr");
+    BOOST_CHECK(vpStage[0]->is_writer() && !vpStage[2]->is_writer());
+
+    // empty commands are ignored
+    BOOST_CHECK(split_chain({":", "threshold", "-t", "0", ":", ":"}, vpStage));
+    BOOST_CHECK(vpStage.size()==1);
+    BOOST_CHECK(split_chain({}, vpStage));
+    BOOST_CHECK(vpStage.empty());
+
+    BOOST_CHECK(!split_chain({"trim", "-l", "1", "-u", "2", ":", "smooth"}, vpStage));
+    BOOST_CHECK(!_stage::is_command("smooth"));
+}
+
+BOOST_AUTO_TEST_CASE(Spec_options) {
+    std::vector<std::unique_ptr<_stage> > vpStage;
+
+    // a required option missing, an option of another command
+    BOOST_CHECK_THROW(split_chain({"trim", "-l", "4700"}, vpStage), boost::program_options::error);
+    BOOST_CHECK_THROW(split_chain({"threshold", "-l", "0"}, vpStage), boost::program_options::error);
+
+    // shift needs exactly one of --wavelength and --velocity
+    BOOST_CHECK(split_chain({"shift", "-w", "1.5"}, vpStage));
+    BOOST_CHECK(split_chain({"shift", "-v", "12.3"}, vpStage));
+    BOOST_CHECK_THROW(split_chain({"shift", "-w", "1.5", "-v", "12.3"}, vpStage), boost::program_options::error);
+    BOOST_CHECK_THROW(split_chain({"shift"}, vpStage), boost::program_options::error);
+
+    BOOST_CHECK(split_chain({"der_snr", "-o", "snr.tsv", "--format", "tsv", "--sort", "snr"}, vpStage));
+    const _stage_der_snr *pSnr=dynamic_cast<const _stage_der_snr*>(vpStage[0].get());
+    BOOST_REQUIRE(pSnr);
+    BOOST_CHECK(pSnr->get_output()=="snr.tsv");
+    BOOST_CHECK(pSnr->get_format()==_collector::eFormat::TSV);
+    BOOST_CHECK(pSnr->get_order()==_collector::eOrder::SNR);
+    // the files are found in no particular order: the table is sorted by path by default
+    BOOST_CHECK(split_chain({"der_snr"}, vpStage));
+    BOOST_CHECK(dynamic_cast<const _stage_der_snr*>(vpStage[0].get())->get_order()==_collector::eOrder::PATH);
+    BOOST_CHECK_THROW(split_chain({"der_snr", "--format", "xml"}, vpStage), boost::program_options::error);
+    BOOST_CHECK_THROW(split_chain({"der_snr", "--sort", "size"}, vpStage), boost::program_options::error);
+}
+
+BOOST_AUTO_TEST_CASE(Spec_chain_tools) {
+    std::vector<std::unique_ptr<_stage> > vpStage;
+    BOOST_REQUIRE(split_chain({"trim", "-l", "4100", "-u", "4300", ":", "threshold", "-t", "0.95", ":",
+                               "shift", "-v", "12.3", ":", "der_snr"}, vpStage));
+
+    _csv<float> csvChain(gen_spectrum());
+    std::string sResult;
+    for(auto &pStage: vpStage)
+        BOOST_REQUIRE(pStage->apply(csvChain, sResult));
+
+    // the operations of trim, threshold, shift and der_snr, one after the other
+    _csv<float> csvTools(gen_spectrum());
+    BOOST_REQUIRE(csvTools.apply_range_threshold(4100, 4300, 0));
+    BOOST_REQUIRE(csvTools.apply_min_threshold(0.95, 1));
+    BOOST_REQUIRE(csvTools.transform_lin(1/(1+12.3/CLIGHT), 0, 0));
+
+    BOOST_CHECK(csvChain.get_data()==csvTools.get_data());
+    BOOST_CHECK(csvChain.get_data_size_i()<NPOINT);
+    BOOST_CHECK(sResult=="\t"+std::to_string(der_snr(csvTools.get_column(1))));
+}
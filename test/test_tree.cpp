@@ -0,0 +1,103 @@
+#define BOOST_TEST_MODULE Tests
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "tree.h"
+
+#include <boost/test/unit_test.hpp>
+
+// ----------------------------------
+// Test parameters
+#define TREE_IN "test_tree_in"
+#define TREE_OUT "test_tree_out"
+#define NDIR 20
+// ----------------------------------
+
+BOOST_AUTO_TEST_CASE(Tree_match) {
+    BOOST_CHECK(_tree::match("*.dat", "a.dat"));
+    BOOST_CHECK(!_tree::match("*.dat", "a.dat.gz"));
+    BOOST_CHECK(_tree::match("*", ""));
+    BOOST_CHECK(_tree::match("a?c", "abc"));
+    BOOST_CHECK(!_tree::match("a?c", "ac"));
+    BOOST_CHECK(_tree::match("*b*b*", "abcbd"));
+    BOOST_CHECK(_tree::match("HD[0-9]*.fits", "HD123.fits"));
+    BOOST_CHECK(!_tree::match("HD[!0-9]*", "HD1"));
+    BOOST_CHECK(_tree::match("sub/*/x", "sub/a/b/x"));
+    BOOST_CHECK(_tree::match("a[", "a["));
+}
+
+BOOST_AUTO_TEST_CASE(Tree_spectrum) {
+    BOOST_CHECK(_tree::is_spectrum("data/a.dat"));
+    BOOST_CHECK(_tree::is_spectrum("data/a.b.fits"));
+    BOOST_CHECK(!_tree::is_spectrum("data/a"));
+    BOOST_CHECK(!_tree::is_spectrum("data/a.tar.gz"));
+    BOOST_CHECK(!_tree::is_spectrum("data/notes.txt"));
+    BOOST_CHECK(!_tree::is_spectrum("data/a.zip"));
+}
+
+BOOST_AUTO_TEST_CASE(Tree_walk) {
+    fs::remove_all(TREE_IN);
+    fs::remove_all(TREE_OUT);
+
+    std::set<std::string> ssExpected;
+    for(int i=0; i<NDIR; i++) {
+        fs::path pDir=fs::path(TREE_IN)/("d"+std::to_string(i))/"sub";
+        fs::create_directories(pDir);
+        std::ofstream(pDir/"a.dat") << "1 2\n";
+        std::ofstream(pDir/"b.obs") << "1 2\n";
+        std::ofstream(pDir/"note.txt") << "note\n";
+        ssExpected.insert((pDir/"a.dat").string());
+    }
+    fs::create_directories(fs::path(TREE_IN)/"skip");
+    std::ofstream(fs::path(TREE_IN)/"skip"/"c.dat") << "1 2\n";
+
+    for(int iThreads: {1, 4}) {
+        fs::remove_all(TREE_OUT);
+
+        _tree tree(TREE_IN, TREE_OUT);
+        tree.set_threads(iThreads);
+        tree.set_include({"*.dat", "*.txt"});
+        tree.set_exclude({"skip"});
+
+        std::set<std::string> ssFound;
+        BOOST_CHECK(tree.walk([&](const std::string &sIn, const std::string &sOut) {
+            ssFound.insert(sIn);
+            BOOST_CHECK(sOut.compare(0, std::string(TREE_OUT).size(), TREE_OUT)==0);
+        }));
+
+        BOOST_CHECK(ssFound==ssExpected);
+        BOOST_CHECK(tree.get_linked()==NDIR);
+        BOOST_CHECK(fs::exists(fs::path(TREE_OUT)/"d0"/"sub"/"note.txt"));
+        BOOST_CHECK(!fs::exists(fs::path(TREE_OUT)/"skip"));
+    }
+
+    // discovery only
+    _tree tree(TREE_IN);
+    size_t stFound=0;
+    BOOST_CHECK(tree.walk([&](const std::string&, const std::string &sOut) {
+        BOOST_CHECK(sOut.empty());
+        stFound++;
+    }));
+    BOOST_CHECK(stFound==2*NDIR+1);
+
+    fs::remove_all(TREE_IN);
+    fs::remove_all(TREE_OUT);
+}
+
+BOOST_AUTO_TEST_CASE(Tree_relink) {
+    // the output of a previous run is replaced
+    fs::remove_all(TREE_IN);
+    fs::create_directories(TREE_IN);
+    std::ofstream(fs::path(TREE_IN)/"a.fits") << "new\n";
+    std::ofstream(fs::path(TREE_IN)/"b.fits") << "old\n";
+    BOOST_CHECK(_tree::relink(fs::path(TREE_IN)/"a.fits", fs::path(TREE_IN)/"b.fits"));
+    std::string sLine;
+    std::getline(std::ifstream(fs::path(TREE_IN)/"b.fits"), sLine);
+    BOOST_CHECK(sLine=="new");
+    BOOST_CHECK(!_tree::relink(fs::path(TREE_IN)/"none.fits", fs::path(TREE_IN)/"c.fits"));
+    fs::remove_all(TREE_IN);
+}